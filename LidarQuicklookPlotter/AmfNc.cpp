@@ -5,6 +5,7 @@
 #include<filesystem>
 #include<cmath>
 #include<locale>
+#include<netcdf.h>
 
 
 
@@ -201,6 +202,108 @@ void makeContinuous(sci::GridData<degreeF, 1> &angles)
 	}
 }
 
+//Finds the latest version of a file by opening every file in the directory that starts with
+//baseFilename and reading its product_version. The versions are zero if there are none.
+void OutputAmfNcFile::findLatestVersion(const sci::string &directory, const sci::string &baseFilename, size_t &majorVersion, size_t &minorVersion, sci::string &history)
+{
+	majorVersion = 0;
+	minorVersion = 0;
+	history = sU("");
+	std::vector<sci::string> existingFiles = sci::getAllFiles(directory, false, true);
+	for (size_t i = 0; i < existingFiles.size(); ++i)
+	{
+		if (existingFiles[i].substr(0, baseFilename.length()) == baseFilename)
+		{
+			try
+			{
+				sci::InputNcFile previous(existingFiles[i]);
+				sci::string thisExistingHistory = previous.getGlobalAttribute<sci::string>(sU("history"));
+				sci::string previousVersionString = previous.getGlobalAttribute<sci::string>(sU("product_version"));
+				sci::assertThrow(previousVersionString.length() > 1 && previousVersionString[0] == 'v', sci::err(sci::SERR_USER, 0, sU("Previous version of the file has an ill formatted product version.")));
+
+				int thisPrevMajorVersion;
+				int thisPrevMinorVersion;
+				//remove the v from the beginning of the version string
+				previousVersionString = previousVersionString.substr(1);
+				//replace the . with a space
+				if (previousVersionString.find_first_of(sU('.')) != sci::string::npos)
+				{
+					previousVersionString[previousVersionString.find_first_of(sU('.'))] = sU(' ');
+
+					//replace the b in beta (if it is there) with a space
+					if (previousVersionString.find_first_of(sU('b')) != sci::string::npos)
+					{
+						previousVersionString[previousVersionString.find_first_of(sU('b'))] = sU(' ');
+					}
+				}
+				else
+					previousVersionString = previousVersionString + sU(" 0"); //if the minor version isn't there, then add it
+
+				//put the string into a stream and read out the major and minor versions
+				sci::istringstream versionStream(previousVersionString);
+				versionStream >> thisPrevMajorVersion;
+				versionStream >> thisPrevMinorVersion;
+
+				if (thisPrevMajorVersion > majorVersion || (thisPrevMajorVersion == majorVersion && thisPrevMinorVersion > minorVersion))
+				{
+					majorVersion = thisPrevMajorVersion;
+					minorVersion = thisPrevMinorVersion;
+					history = thisExistingHistory;
+				}
+			}
+			catch (...)
+			{
+				//we end up here if the file is not a valid netcdf or some other read problem
+				//This isn't an issue, just move on to the next file.
+			}
+		}
+	}
+}
+
+template<class T>
+void putTimeSliceWith(int (*put)(int, int, const size_t*, const size_t*, const T*), int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const T* values)
+{
+	size_t start[3]{ timeIndex, 0, 0 };
+	size_t count[3]{ 1, shape[0], shape[1] };
+	int status = put(fileId, variableId, start, count, values);
+	sci::assertThrow(status == NC_NOERR, sci::err(sci::SERR_USER, 0, sU("Failed to write part of a netCDF variable: ") + sci::fromUtf8(nc_strerror(status))));
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const double* values)
+{
+	putTimeSliceWith(nc_put_vara_double, fileId, variableId, timeIndex, shape, values);
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const float* values)
+{
+	putTimeSliceWith(nc_put_vara_float, fileId, variableId, timeIndex, shape, values);
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const uint8_t* values)
+{
+	putTimeSliceWith(nc_put_vara_uchar, fileId, variableId, timeIndex, shape, values);
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int8_t* values)
+{
+	putTimeSliceWith(nc_put_vara_schar, fileId, variableId, timeIndex, shape, (const signed char*)values);
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int16_t* values)
+{
+	putTimeSliceWith(nc_put_vara_short, fileId, variableId, timeIndex, shape, values);
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int32_t* values)
+{
+	putTimeSliceWith(nc_put_vara_int, fileId, variableId, timeIndex, shape, values);
+}
+
+void OutputAmfNcFile::putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int64_t* values)
+{
+	putTimeSliceWith(nc_put_vara_longlong, fileId, variableId, timeIndex, shape, (const long long*)values);
+}
+
 void OutputAmfNcFile::writeTimeAndLocationData(const Platform &platform)
 {
 	sci::GridData<double, 1> secondsAfterEpoch(std::array<size_t, 1>{ m_times.size() });
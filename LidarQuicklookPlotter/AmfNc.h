@@ -8,9 +8,14 @@
 #include<svector/svector.h>
 #include<locale>
 #include<map>
+#include<cmath>
+#include<algorithm>
 #include<svector/array.h>
 #include<ranges>
 #include"CellMethods.h"
+#include"NcVersionManifest.h"
+#include<memory>
+#include<type_traits>
 #include<svector/ArrayManipulation.h>
 #include<svector/Statistics.h>
 
@@ -24,7 +29,7 @@ class CampbellCeilometerProfile;
 template<class DEST_PHYSICAL>
 constexpr inline auto PhysicalToValueTransform(DEST_PHYSICAL source)
 {
-	return source.value<typename DEST_PHYSICAL::unit>();
+	return source.template value<typename DEST_PHYSICAL::unit>();
 }
 
 
@@ -55,6 +60,21 @@ struct ProcessingOptions
 	bool generateNetCdf;
 	bool closeOnCompletion;
 	second waitTime;
+	bool memoryMappedHplParsing = false; //parse hpl lidar files from a memory map using std::from_chars rather than via a stream
+	size_t fileReadingThreads = 1; //maximum number of input files to parse concurrently, 1 reads them one at a time
+	sci::string hplCacheDirectory; //directory for binary copies of parsed hpl files, empty to disable the cache
+	size_t hplCacheMaxMegabytes = 2048; //the least recently used hpl cache files are deleted beyond this size
+	size_t sharedHplCacheMegabytes = 0; //memory for parsed hpl files shared between lidar processors, 0 to disable
+	size_t maxConcurrentTasks = 1; //maximum number of processors or output days to process at the same time
+	bool watchInputDirectory = false; //use inotify to track new files rather than rescanning the input directory (Linux only)
+	double watchRescanMinutes = 60.0; //with watchInputDirectory, still rescan the whole input directory this often in case events were missed, 0 to never
+	double lidarSnrFlagThreshold1 = 1.0; //lidar gates with a signal to noise ratio below this are flagged as SNR less than 1
+	double lidarSnrFlagThreshold2 = 2.0; //lidar gates with a signal to noise ratio below this are flagged as SNR less than 2
+	double lidarSnrFlagThreshold3 = 3.0; //lidar gates with a signal to noise ratio below this are flagged as SNR less than 3
+	double lidarDopplerFlagLimit = 19.0; //lidar doppler velocities with a magnitude above this (m s-1) are flagged as out of range
+	bool appendToLatestDay = false; //keep the latest day's data in memory so new files for that day can be read on their own
+	bool useNcVersionManifest = false; //find the previous version of each netCDF from a manifest in the output directory rather than opening every version
+	bool verifyNcVersionManifest = false; //scan the previous versions anyway and correct the manifest from them
 };
 
 struct ProcessingSoftwareInfo
@@ -212,6 +232,28 @@ public:
 
 		::correctDirection(instrumentRelativeElevation, instrumentRelativeAzimuth, sinInstrumentElevation, sinInstrumentAzimuth, sinInstrumentRoll, cosInstrumentElevation, cosInstrumentAzimuth, cosInstrumentRoll, correctedElevation, correctedAzimuth);
 	}
+	//Corrects many directions at once, e.g. one per profile of a lidar file. The attitudes for every
+	//averaging window are found with one virtual call, which is where the time goes. Each direction is
+	//then corrected by the same function as the single direction version, so the results are exactly
+	//the same. This matters near vertical, where asin turns a last bit difference in a float into
+	//about 0.02 degrees. PlatformCorrectionComparison checks the two versions match.
+	void correctDirection(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, const sci::GridData<degreeF, 1> &instrumentRelativeAzimuths, const sci::GridData<degreeF, 1> &instrumentRelativeElevations, sci::GridData<degreeF, 1> &correctedAzimuths, sci::GridData<degreeF, 1> &correctedElevations) const
+	{
+		sci::assertThrow(endTimes.size() == startTimes.size() && instrumentRelativeAzimuths.size() == startTimes.size() && instrumentRelativeElevations.size() == startTimes.size(), sci::err(sci::SERR_USER, 0, sU("Passed arrays of different sizes to Platform::correctDirection.")));
+		sci::GridData<unitlessF, 1> sinInstrumentElevations;
+		sci::GridData<unitlessF, 1> sinInstrumentAzimuths;
+		sci::GridData<unitlessF, 1> sinInstrumentRolls;
+		sci::GridData<unitlessF, 1> cosInstrumentElevations;
+		sci::GridData<unitlessF, 1> cosInstrumentAzimuths;
+		sci::GridData<unitlessF, 1> cosInstrumentRolls;
+		getInstrumentTrigAttitudesForDirectionCorrection(startTimes, endTimes, sinInstrumentElevations, sinInstrumentAzimuths, sinInstrumentRolls, cosInstrumentElevations, cosInstrumentAzimuths, cosInstrumentRolls);
+
+		const size_t n = startTimes.size();
+		correctedAzimuths.resize(n);
+		correctedElevations.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			::correctDirection(instrumentRelativeElevations[i], instrumentRelativeAzimuths[i], sinInstrumentElevations[i], sinInstrumentAzimuths[i], sinInstrumentRolls[i], cosInstrumentElevations[i], cosInstrumentAzimuths[i], cosInstrumentRolls[i], correctedElevations[i], correctedAzimuths[i]);
+	}
 	template<class T>
 	void correctVector(sci::UtcTime startTime, sci::UtcTime endTime, T measuredX, T measuredY, T measuredZ, T &correctedX, T &correctedY, T &correctedZ) const
 	{
@@ -241,6 +283,28 @@ public:
 	}
 	virtual void getInstrumentVelocity(sci::UtcTime startTime, sci::UtcTime endTime, metrePerSecondF &eastwardVelocity, metrePerSecondF &northwardVelocity, metrePerSecondF &upwardVelocity) const = 0;
 	virtual void getInstrumentTrigAttitudesForDirectionCorrection(sci::UtcTime startTime, sci::UtcTime endTime, unitlessF &sinInstrumentElevation, unitlessF &sinInstrumentAzimuth, unitlessF &sinInstrumentRoll, unitlessF &cosInstrumentElevation, unitlessF &cosInstrumentAzimuth, unitlessF &cosInstrumentRoll) const = 0;
+	//Versions of the above for many averaging windows at once. These just call the single window
+	//versions, platforms that can share work between windows should override them. Overrides must
+	//give exactly the same results as the single window versions.
+	virtual void getInstrumentVelocity(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<metrePerSecondF, 1> &eastwardVelocities, sci::GridData<metrePerSecondF, 1> &northwardVelocities, sci::GridData<metrePerSecondF, 1> &upwardVelocities) const
+	{
+		eastwardVelocities.resize(startTimes.size());
+		northwardVelocities.resize(startTimes.size());
+		upwardVelocities.resize(startTimes.size());
+		for (size_t i = 0; i < startTimes.size(); ++i)
+			getInstrumentVelocity(startTimes[i], endTimes[i], eastwardVelocities[i], northwardVelocities[i], upwardVelocities[i]);
+	}
+	virtual void getInstrumentTrigAttitudesForDirectionCorrection(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<unitlessF, 1> &sinInstrumentElevations, sci::GridData<unitlessF, 1> &sinInstrumentAzimuths, sci::GridData<unitlessF, 1> &sinInstrumentRolls, sci::GridData<unitlessF, 1> &cosInstrumentElevations, sci::GridData<unitlessF, 1> &cosInstrumentAzimuths, sci::GridData<unitlessF, 1> &cosInstrumentRolls) const
+	{
+		sinInstrumentElevations.resize(startTimes.size());
+		sinInstrumentAzimuths.resize(startTimes.size());
+		sinInstrumentRolls.resize(startTimes.size());
+		cosInstrumentElevations.resize(startTimes.size());
+		cosInstrumentAzimuths.resize(startTimes.size());
+		cosInstrumentRolls.resize(startTimes.size());
+		for (size_t i = 0; i < startTimes.size(); ++i)
+			getInstrumentTrigAttitudesForDirectionCorrection(startTimes[i], endTimes[i], sinInstrumentElevations[i], sinInstrumentAzimuths[i], sinInstrumentRolls[i], cosInstrumentElevations[i], cosInstrumentAzimuths[i], cosInstrumentRolls[i]);
+	}
 	virtual void getLocation(sci::UtcTime startTime, sci::UtcTime endTime, degreeF &latitude, degreeF &longitude, metreF &altitude) const = 0;
 	virtual void getInstrumentVelocity(sci::UtcTime startTime, sci::UtcTime endTime, metrePerSecondF &speed, degreeF &course) const
 	{
@@ -296,6 +360,12 @@ public:
 		northwardVelocity = metrePerSecondF(0.0);
 		upwardVelocity = metrePerSecondF(0.0);
 	}
+	virtual void getInstrumentVelocity(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<metrePerSecondF, 1> &eastwardVelocities, sci::GridData<metrePerSecondF, 1> &northwardVelocities, sci::GridData<metrePerSecondF, 1> &upwardVelocities) const override
+	{
+		eastwardVelocities = sci::GridData<metrePerSecondF, 1>(startTimes.size(), metrePerSecondF(0.0));
+		northwardVelocities = sci::GridData<metrePerSecondF, 1>(startTimes.size(), metrePerSecondF(0.0));
+		upwardVelocities = sci::GridData<metrePerSecondF, 1>(startTimes.size(), metrePerSecondF(0.0));
+	}
 	virtual void getInstrumentTrigAttitudesForDirectionCorrection(sci::UtcTime startTime, sci::UtcTime endTime, unitlessF &sinInstrumentElevation, unitlessF &sinInstrumentAzimuth, unitlessF &sinInstrumentRoll, unitlessF &cosInstrumentElevation, unitlessF &cosInstrumentAzimuth, unitlessF &cosInstrumentRoll) const override
 	{
 		sinInstrumentElevation = m_sinInstrumentElevation;
@@ -305,6 +375,15 @@ public:
 		cosInstrumentAzimuth = m_cosInstrumentAzimuth;
 		cosInstrumentRoll = m_cosInstrumentRoll;
 	}
+	virtual void getInstrumentTrigAttitudesForDirectionCorrection(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<unitlessF, 1> &sinInstrumentElevations, sci::GridData<unitlessF, 1> &sinInstrumentAzimuths, sci::GridData<unitlessF, 1> &sinInstrumentRolls, sci::GridData<unitlessF, 1> &cosInstrumentElevations, sci::GridData<unitlessF, 1> &cosInstrumentAzimuths, sci::GridData<unitlessF, 1> &cosInstrumentRolls) const override
+	{
+		sinInstrumentElevations = sci::GridData<unitlessF, 1>(startTimes.size(), m_sinInstrumentElevation);
+		sinInstrumentAzimuths = sci::GridData<unitlessF, 1>(startTimes.size(), m_sinInstrumentAzimuth);
+		sinInstrumentRolls = sci::GridData<unitlessF, 1>(startTimes.size(), m_sinInstrumentRoll);
+		cosInstrumentElevations = sci::GridData<unitlessF, 1>(startTimes.size(), m_cosInstrumentElevation);
+		cosInstrumentAzimuths = sci::GridData<unitlessF, 1>(startTimes.size(), m_cosInstrumentAzimuth);
+		cosInstrumentRolls = sci::GridData<unitlessF, 1>(startTimes.size(), m_cosInstrumentRoll);
+	}
 	virtual void getLocation(sci::UtcTime startTime, sci::UtcTime endTime, degreeF &latitude, degreeF &longitude, metreF &altitude) const override
 	{
 		latitude = m_latitude;
@@ -422,15 +501,201 @@ inline degreeF rangeLimitAngle(degreeF angle)
 	return angle - jumpAmount;
 }
 
+//Precomputed running integrals, NaN counts and minimums/maximums for a series of values at a
+//series of times, so the mean, minimum and maximum over any time window can be found without
+//copying and integrating every sample in the window. The running integrals are stored at the
+//start of each block of samples, so a lookup needs at most one block of samples at each end
+//of the window, and the minimums and maximums of whole blocks come from a tree. Values are
+//treated as varying linearly between samples, as in sci::integrate. Nothing is modified by a
+//lookup, so it is safe to use from several threads.
+//The standard deviation is not taken from running integrals of the squares. Over weeks of
+//unwrapped headings these become so large that their rounding errors swamp the variance of a
+//short window, so squaredDeviationIntegral works from the window's own samples instead.
+template<class T>
+class TimeSeriesIndex
+{
+public:
+	typedef typename T::unit unit;
+	TimeSeriesIndex()
+		:m_nBlocks(0)
+	{
+	}
+	void build(const sci::GridData<sci::UtcTime, 1> &times, const sci::GridData<T, 1> &values)
+	{
+		m_blockIntegrals.clear();
+		m_blockNanCounts.clear();
+		m_minTree.clear();
+		m_maxTree.clear();
+		m_nBlocks = 0;
+		if (values.size() != times.size() || times.size() < 2)
+			return;
+
+		m_nBlocks = (values.size() + blockSize - 1) / blockSize;
+		m_blockIntegrals.resize(m_nBlocks);
+		m_blockNanCounts.resize(m_nBlocks + 1);
+		double integral = 0.0;
+		size_t nanCount = 0;
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			if (i % blockSize == 0)
+			{
+				m_blockIntegrals[i / blockSize] = integral;
+				m_blockNanCounts[i / blockSize] = nanCount;
+			}
+			if (isNan(values[i]))
+				++nanCount;
+			if (i + 1 < values.size())
+				integral += segmentIntegral(times, values, i);
+		}
+		m_blockNanCounts[m_nBlocks] = nanCount;
+
+		//the leaves of the trees are the blocks, each parent holds the min/max of its children
+		m_minTree.assign(2 * m_nBlocks, values[0]);
+		m_maxTree.assign(2 * m_nBlocks, values[0]);
+		for (size_t i = 0; i < m_nBlocks; ++i)
+		{
+			size_t begin = i * blockSize;
+			m_minTree[m_nBlocks + i] = values[begin];
+			m_maxTree[m_nBlocks + i] = values[begin];
+			scanMinMax(values, begin, std::min(begin + blockSize, values.size()), m_minTree[m_nBlocks + i], m_maxTree[m_nBlocks + i]);
+		}
+		for (size_t i = m_nBlocks - 1; i > 0; --i)
+		{
+			m_minTree[i] = std::min(m_minTree[2 * i], m_minTree[2 * i + 1]);
+			m_maxTree[i] = std::max(m_maxTree[2 * i], m_maxTree[2 * i + 1]);
+		}
+	}
+	bool isBuilt() const { return m_nBlocks > 0; }
+	//the integral, in seconds times unit, of the values from the first time to time, where
+	//lowerIndex is the sample at or before time and is less than the last sample
+	double integral(const sci::GridData<sci::UtcTime, 1> &times, const sci::GridData<T, 1> &values, size_t lowerIndex, const sci::UtcTime &time) const
+	{
+		size_t block = lowerIndex / blockSize;
+		double result = m_blockIntegrals[block];
+		for (size_t i = block * blockSize; i < lowerIndex; ++i)
+			result += segmentIntegral(times, values, i);
+		return result + partialSegmentIntegral(times, lowerIndex, time, nodeValue(values, lowerIndex), nodeValue(values, lowerIndex + 1));
+	}
+	//The integral, in seconds times unit squared, of the squared deviations of the values from
+	//mean between startTime and endTime. The squared deviations are integrated trapezoidally
+	//between the samples, as sci::integrate does. This goes through every sample in the window.
+	static double squaredDeviationIntegral(const sci::GridData<sci::UtcTime, 1> &times, const sci::GridData<T, 1> &values, size_t startLowerIndex, const sci::UtcTime &startTime, size_t endLowerIndex, const sci::UtcTime &endTime, double mean)
+	{
+		auto squaredDeviation = [&](size_t index)
+		{
+			double deviation = nodeValue(values, index) - mean;
+			return deviation * deviation;
+		};
+		double result = 0.0;
+		for (size_t i = startLowerIndex; i < endLowerIndex; ++i)
+			result += secondsBetween(times[i], times[i + 1]) * (squaredDeviation(i) + squaredDeviation(i + 1)) / 2.0;
+		result += partialSegmentIntegral(times, endLowerIndex, endTime, squaredDeviation(endLowerIndex), squaredDeviation(endLowerIndex + 1));
+		result -= partialSegmentIntegral(times, startLowerIndex, startTime, squaredDeviation(startLowerIndex), squaredDeviation(startLowerIndex + 1));
+		return result;
+	}
+	//true if any of the samples firstIndex to lastIndex inclusive are NaN
+	bool hasNan(const sci::GridData<T, 1> &values, size_t firstIndex, size_t lastIndex) const
+	{
+		return nanCountBefore(values, lastIndex + 1) > nanCountBefore(values, firstIndex);
+	}
+	//the minimum and maximum of samples firstIndex to lastIndex inclusive, which must not include any NaNs
+	void findMinMax(const sci::GridData<T, 1> &values, size_t firstIndex, size_t lastIndex, T &min, T &max) const
+	{
+		min = values[firstIndex];
+		max = values[firstIndex];
+		size_t firstBlock = firstIndex / blockSize;
+		size_t lastBlock = lastIndex / blockSize;
+		if (firstBlock == lastBlock)
+		{
+			scanMinMax(values, firstIndex, lastIndex + 1, min, max);
+			return;
+		}
+		scanMinMax(values, firstIndex, (firstBlock + 1) * blockSize, min, max);
+		scanMinMax(values, lastBlock * blockSize, lastIndex + 1, min, max);
+		size_t left = firstBlock + 1 + m_nBlocks;
+		size_t right = lastBlock + m_nBlocks;
+		while (left < right)
+		{
+			if (left & 1)
+			{
+				min = std::min(min, m_minTree[left]);
+				max = std::max(max, m_maxTree[left]);
+				++left;
+			}
+			if (right & 1)
+			{
+				--right;
+				min = std::min(min, m_minTree[right]);
+				max = std::max(max, m_maxTree[right]);
+			}
+			left /= 2;
+			right /= 2;
+		}
+	}
+	static double secondsBetween(const sci::UtcTime &earlier, const sci::UtcTime &later)
+	{
+		return second(later - earlier).value<second>();
+	}
+private:
+	static constexpr size_t blockSize = 64;
+	static bool isNan(const T &value)
+	{
+		return std::isnan(value.template value<unit>());
+	}
+	//NaNs count as zero here, we check for them separately
+	static double nodeValue(const sci::GridData<T, 1> &values, size_t index)
+	{
+		double value = values[index].template value<unit>();
+		if (std::isnan(value))
+			return 0.0;
+		return value;
+	}
+	static double segmentIntegral(const sci::GridData<sci::UtcTime, 1> &times, const sci::GridData<T, 1> &values, size_t index)
+	{
+		return secondsBetween(times[index], times[index + 1]) * (nodeValue(values, index) + nodeValue(values, index + 1)) / 2.0;
+	}
+	//the integral from times[lowerIndex] to time of a quantity varying linearly from lowerValue
+	//at times[lowerIndex] to upperValue at times[lowerIndex + 1]
+	static double partialSegmentIntegral(const sci::GridData<sci::UtcTime, 1> &times, size_t lowerIndex, const sci::UtcTime &time, double lowerValue, double upperValue)
+	{
+		double interval = secondsBetween(times[lowerIndex], time);
+		if (interval <= 0.0)
+			return 0.0;
+		double valueAtTime = lowerValue + (upperValue - lowerValue) * interval / secondsBetween(times[lowerIndex], times[lowerIndex + 1]);
+		return interval * (lowerValue + valueAtTime) / 2.0;
+	}
+	size_t nanCountBefore(const sci::GridData<T, 1> &values, size_t index) const
+	{
+		size_t block = index / blockSize;
+		if (block == m_nBlocks)
+			return m_blockNanCounts[m_nBlocks];
+		size_t result = m_blockNanCounts[block];
+		for (size_t i = block * blockSize; i < index; ++i)
+			if (isNan(values[i]))
+				++result;
+		return result;
+	}
+	static void scanMinMax(const sci::GridData<T, 1> &values, size_t begin, size_t end, T &min, T &max)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			min = std::min(min, values[i]);
+			max = std::max(max, values[i]);
+		}
+	}
+	size_t m_nBlocks;
+	std::vector<double> m_blockIntegrals;
+	std::vector<size_t> m_blockNanCounts;
+	std::vector<T> m_minTree;
+	std::vector<T> m_maxTree;
+};
+
 class ShipPlatform : public Platform
 {
 public:
 	ShipPlatform(sci::string name, metreF altitude, const sci::GridData<sci::UtcTime, 1> &times, const sci::GridData<degreeF, 1> &latitudes, const sci::GridData<degreeF, 1> &longitudes, const sci::GridData<sci::string, 1> &locationKeywords, const sci::GridData<degreeF, 1> &instrumentElevationsShipRelative, const sci::GridData<degreeF, 1> &instrumentAzimuthsShipRelative, const sci::GridData<degreeF, 1> &instrumentRollsShipRelative, const sci::GridData<degreeF, 1> &shipCourses, const sci::GridData<metrePerSecondF, 1> &shipSpeeds, const sci::GridData<degreeF, 1> &shipElevations, const sci::GridData<degreeF, 1> &shipAzimuths, const sci::GridData<degreeF, 1> &shipRolls, sci::string hatproRetrieval)
 		:Platform(name, PlatformType::moving, DeploymentMode::sea, locationKeywords, hatproRetrieval)
 	{
-		m_previousLowerIndexEndTime = 0;
-		m_previousLowerIndexStartTime = 0;
-
 		m_times = times;
 		m_altitude = altitude;
 		m_latitudes = latitudes;
@@ -527,13 +792,12 @@ public:
 		//set up a series of instrument azimuths that do not jump at the 0/360 point
 		m_instrumentAzimuthsAbsoluteNoJumps = shipAzimuths;
 		makeContinuous(m_instrumentAzimuthsAbsoluteNoJumps);
+
+		buildIndices();
 	}
 	ShipPlatform(sci::string name, metreF altitude, const sci::GridData<sci::UtcTime, 1> &times, const sci::GridData<degreeF, 1> &latitudes, const sci::GridData<degreeF, 1> &longitudes, const sci::GridData<sci::string, 1> &locationKeywords, degreeF instrumentElevationShipRelative, degreeF instrumentAzimuthShipRelative, degreeF instrumentRollShipRelative, const sci::GridData<degreeF, 1> &shipCourses, const sci::GridData<metrePerSecondF, 1> &shipSpeeds, const sci::GridData<degreeF, 1> &shipElevations, const sci::GridData<degreeF, 1> &shipAzimuths, const sci::GridData<degreeF, 1> &shipRolls, sci::string hatproRetrieval)
 		:Platform(name, PlatformType::moving, DeploymentMode::sea, locationKeywords, hatproRetrieval)
 	{
-		m_previousLowerIndexEndTime = 0;
-		m_previousLowerIndexStartTime = 0;
-
 		m_times = times;
 		m_altitude = altitude;
 		m_latitudes = latitudes;
@@ -643,19 +907,42 @@ public:
 		//set up a series of instrument azimuths that do not jump at the 0/360 point
 		m_instrumentAzimuthsAbsoluteNoJumps = shipAzimuths;
 		makeContinuous(m_instrumentAzimuthsAbsoluteNoJumps);
+
+		buildIndices();
 	}
 	virtual void getLocation(sci::UtcTime startTime, sci::UtcTime endTime, degreeF &latitude, degreeF &longitude, metreF &altitude) const
 	{
-		latitude = findMean(startTime, endTime, m_latitudes);
-		longitude = findMean(startTime, endTime, m_longitudesNoJumps);
+		latitude = findMean(startTime, endTime, m_latitudes, m_latitudesIndex);
+		longitude = findMean(startTime, endTime, m_longitudesNoJumps, m_longitudesNoJumpsIndex);
 		longitude = rangeLimitAngle(longitude);
 		altitude = m_altitude;
 	}
 	virtual void getInstrumentVelocity(sci::UtcTime startTime, sci::UtcTime endTime, metrePerSecondF &eastwardVelocity, metrePerSecondF &northwardVelocity, metrePerSecondF &upwardVelocity) const override
 	{
 		upwardVelocity = metrePerSecondF(0.0);
-		eastwardVelocity = findMean(startTime, endTime, m_u);
-		northwardVelocity = findMean(startTime, endTime, m_v);
+		eastwardVelocity = findMean(startTime, endTime, m_u, m_uIndex);
+		northwardVelocity = findMean(startTime, endTime, m_v, m_vIndex);
+	}
+	//the window's position in the time series is found once and shared by u and v
+	virtual void getInstrumentVelocity(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<metrePerSecondF, 1> &eastwardVelocities, sci::GridData<metrePerSecondF, 1> &northwardVelocities, sci::GridData<metrePerSecondF, 1> &upwardVelocities) const override
+	{
+		const size_t n = startTimes.size();
+		eastwardVelocities.resize(n);
+		northwardVelocities.resize(n);
+		upwardVelocities = sci::GridData<metrePerSecondF, 1>(n, metrePerSecondF(0.0));
+		for (size_t i = 0; i < n; ++i)
+		{
+			size_t startLowerIndex;
+			size_t endLowerIndex;
+			if (!findLowerIndices(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex))
+			{
+				eastwardVelocities[i] = std::numeric_limits<metrePerSecondF>::quiet_NaN();
+				northwardVelocities[i] = std::numeric_limits<metrePerSecondF>::quiet_NaN();
+				continue;
+			}
+			eastwardVelocities[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_u, m_uIndex);
+			northwardVelocities[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_v, m_vIndex);
+		}
 	}
 	/*virtual void getMotion(sci::UtcTime startTime, sci::UtcTime endTime, metrePerSecond &speed, degree &course, degree & azimuth) const override
 	{
@@ -674,9 +961,9 @@ public:
 	}*/
 	virtual void getInstrumentAttitudes(sci::UtcTime startTime, sci::UtcTime endTime, AttitudeAverage &elevation, AttitudeAverage &azimuth, AttitudeAverage &roll) const override
 	{
-		findStatistics(startTime, endTime, m_instrumentElevationsAbsolute, elevation.m_mean, elevation.m_stdev, elevation.m_min, elevation.m_max, elevation.m_rate);
-		findStatistics(startTime, endTime, m_instrumentAzimuthsAbsoluteNoJumps, azimuth.m_mean, azimuth.m_stdev, azimuth.m_min, azimuth.m_max, azimuth.m_rate);
-		findStatistics(startTime, endTime, m_instrumentRollsAbsolute, roll.m_mean, roll.m_stdev, roll.m_min, roll.m_max, roll.m_rate);
+		findStatistics(startTime, endTime, m_instrumentElevationsAbsolute, m_instrumentElevationsAbsoluteIndex, elevation.m_mean, elevation.m_stdev, elevation.m_min, elevation.m_max, elevation.m_rate);
+		findStatistics(startTime, endTime, m_instrumentAzimuthsAbsoluteNoJumps, m_instrumentAzimuthsAbsoluteNoJumpsIndex, azimuth.m_mean, azimuth.m_stdev, azimuth.m_min, azimuth.m_max, azimuth.m_rate);
+		findStatistics(startTime, endTime, m_instrumentRollsAbsolute, m_instrumentRollsAbsoluteIndex, roll.m_mean, roll.m_stdev, roll.m_min, roll.m_max, roll.m_rate);
 		degreeF azimuthOffset = rangeLimitAngle(azimuth.m_mean) - azimuth.m_mean;
 		azimuth.m_mean += azimuthOffset;
 		azimuth.m_max += azimuthOffset;
@@ -684,9 +971,9 @@ public:
 	}
 	virtual void getPlatformAttitudes(sci::UtcTime startTime, sci::UtcTime endTime, AttitudeAverage &elevation, AttitudeAverage &azimuth, AttitudeAverage &roll) const override
 	{
-		findStatistics(startTime, endTime, m_shipElevations, elevation.m_mean, elevation.m_stdev, elevation.m_min, elevation.m_max, elevation.m_rate);
-		findStatistics(startTime, endTime, m_shipAzimuthsNoJumps, azimuth.m_mean, azimuth.m_stdev, azimuth.m_min, azimuth.m_max, azimuth.m_rate);
-		findStatistics(startTime, endTime, m_shipRolls, roll.m_mean, roll.m_stdev, roll.m_min, roll.m_max, roll.m_rate);
+		findStatistics(startTime, endTime, m_shipElevations, m_shipElevationsIndex, elevation.m_mean, elevation.m_stdev, elevation.m_min, elevation.m_max, elevation.m_rate);
+		findStatistics(startTime, endTime, m_shipAzimuthsNoJumps, m_shipAzimuthsNoJumpsIndex, azimuth.m_mean, azimuth.m_stdev, azimuth.m_min, azimuth.m_max, azimuth.m_rate);
+		findStatistics(startTime, endTime, m_shipRolls, m_shipRollsIndex, roll.m_mean, roll.m_stdev, roll.m_min, roll.m_max, roll.m_rate);
 		degreeF azimuthOffset = rangeLimitAngle(azimuth.m_mean) - azimuth.m_mean;
 		azimuth.m_mean += azimuthOffset;
 		azimuth.m_max += azimuthOffset;
@@ -694,12 +981,44 @@ public:
 	}
 	virtual void getInstrumentTrigAttitudesForDirectionCorrection(sci::UtcTime startTime, sci::UtcTime endTime, unitlessF &sinInstrumentElevation, unitlessF &sinInstrumentAzimuth, unitlessF &sinInstrumentRoll, unitlessF &cosInstrumentElevation, unitlessF &cosInstrumentAzimuth, unitlessF &cosInstrumentRoll) const override
 	{
-		sinInstrumentElevation = findMean(startTime, endTime, m_sinInstrumentElevationsAbsolute);
-		sinInstrumentAzimuth = findMean(startTime, endTime, m_sinInstrumentAzimuthsAbsolute);
-		sinInstrumentRoll = findMean(startTime, endTime, m_sinInstrumentRollsAbsolute);
-		cosInstrumentElevation = findMean(startTime, endTime, m_cosInstrumentElevationsAbsolute);
-		cosInstrumentAzimuth = findMean(startTime, endTime, m_cosInstrumentAzimuthsAbsolute);
-		cosInstrumentRoll = findMean(startTime, endTime, m_cosInstrumentRollsAbsolute);
+		sinInstrumentElevation = findMean(startTime, endTime, m_sinInstrumentElevationsAbsolute, m_sinInstrumentElevationsAbsoluteIndex);
+		sinInstrumentAzimuth = findMean(startTime, endTime, m_sinInstrumentAzimuthsAbsolute, m_sinInstrumentAzimuthsAbsoluteIndex);
+		sinInstrumentRoll = findMean(startTime, endTime, m_sinInstrumentRollsAbsolute, m_sinInstrumentRollsAbsoluteIndex);
+		cosInstrumentElevation = findMean(startTime, endTime, m_cosInstrumentElevationsAbsolute, m_cosInstrumentElevationsAbsoluteIndex);
+		cosInstrumentAzimuth = findMean(startTime, endTime, m_cosInstrumentAzimuthsAbsolute, m_cosInstrumentAzimuthsAbsoluteIndex);
+		cosInstrumentRoll = findMean(startTime, endTime, m_cosInstrumentRollsAbsolute, m_cosInstrumentRollsAbsoluteIndex);
+	}
+	//the window's position in the time series is found once and shared by all six tables
+	virtual void getInstrumentTrigAttitudesForDirectionCorrection(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<unitlessF, 1> &sinInstrumentElevations, sci::GridData<unitlessF, 1> &sinInstrumentAzimuths, sci::GridData<unitlessF, 1> &sinInstrumentRolls, sci::GridData<unitlessF, 1> &cosInstrumentElevations, sci::GridData<unitlessF, 1> &cosInstrumentAzimuths, sci::GridData<unitlessF, 1> &cosInstrumentRolls) const override
+	{
+		const size_t n = startTimes.size();
+		sinInstrumentElevations.resize(n);
+		sinInstrumentAzimuths.resize(n);
+		sinInstrumentRolls.resize(n);
+		cosInstrumentElevations.resize(n);
+		cosInstrumentAzimuths.resize(n);
+		cosInstrumentRolls.resize(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			size_t startLowerIndex;
+			size_t endLowerIndex;
+			if (!findLowerIndices(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex))
+			{
+				sinInstrumentElevations[i] = std::numeric_limits<unitlessF>::quiet_NaN();
+				sinInstrumentAzimuths[i] = std::numeric_limits<unitlessF>::quiet_NaN();
+				sinInstrumentRolls[i] = std::numeric_limits<unitlessF>::quiet_NaN();
+				cosInstrumentElevations[i] = std::numeric_limits<unitlessF>::quiet_NaN();
+				cosInstrumentAzimuths[i] = std::numeric_limits<unitlessF>::quiet_NaN();
+				cosInstrumentRolls[i] = std::numeric_limits<unitlessF>::quiet_NaN();
+				continue;
+			}
+			sinInstrumentElevations[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_sinInstrumentElevationsAbsolute, m_sinInstrumentElevationsAbsoluteIndex);
+			sinInstrumentAzimuths[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_sinInstrumentAzimuthsAbsolute, m_sinInstrumentAzimuthsAbsoluteIndex);
+			sinInstrumentRolls[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_sinInstrumentRollsAbsolute, m_sinInstrumentRollsAbsoluteIndex);
+			cosInstrumentElevations[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_cosInstrumentElevationsAbsolute, m_cosInstrumentElevationsAbsoluteIndex);
+			cosInstrumentAzimuths[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_cosInstrumentAzimuthsAbsolute, m_cosInstrumentAzimuthsAbsoluteIndex);
+			cosInstrumentRolls[i] = findMean(startTimes[i], endTimes[i], startLowerIndex, endLowerIndex, m_cosInstrumentRollsAbsolute, m_cosInstrumentRollsAbsoluteIndex);
+		}
 	}
 	virtual bool getFixedAltitude() const override
 	{
@@ -740,83 +1059,125 @@ private:
 	sci::GridData<unitlessF, 1> m_cosInstrumentAzimuthsAbsolute;
 	sci::GridData<unitlessF, 1> m_cosInstrumentRollsAbsolute;
 
-	mutable size_t m_previousLowerIndexStartTime;
-	mutable size_t m_previousLowerIndexEndTime;
+	TimeSeriesIndex<degreeF> m_latitudesIndex;
+	TimeSeriesIndex<degreeF> m_longitudesNoJumpsIndex;
+	TimeSeriesIndex<metrePerSecondF> m_uIndex;
+	TimeSeriesIndex<metrePerSecondF> m_vIndex;
+	TimeSeriesIndex<degreeF> m_instrumentElevationsAbsoluteIndex;
+	TimeSeriesIndex<degreeF> m_instrumentAzimuthsAbsoluteNoJumpsIndex;
+	TimeSeriesIndex<degreeF> m_instrumentRollsAbsoluteIndex;
+	TimeSeriesIndex<degreeF> m_shipElevationsIndex;
+	TimeSeriesIndex<degreeF> m_shipAzimuthsNoJumpsIndex;
+	TimeSeriesIndex<degreeF> m_shipRollsIndex;
+	TimeSeriesIndex<unitlessF> m_sinInstrumentElevationsAbsoluteIndex;
+	TimeSeriesIndex<unitlessF> m_sinInstrumentAzimuthsAbsoluteIndex;
+	TimeSeriesIndex<unitlessF> m_sinInstrumentRollsAbsoluteIndex;
+	TimeSeriesIndex<unitlessF> m_cosInstrumentElevationsAbsoluteIndex;
+	TimeSeriesIndex<unitlessF> m_cosInstrumentAzimuthsAbsoluteIndex;
+	TimeSeriesIndex<unitlessF> m_cosInstrumentRollsAbsoluteIndex;
+
+	void buildIndices()
+	{
+		m_latitudesIndex.build(m_times, m_latitudes);
+		m_longitudesNoJumpsIndex.build(m_times, m_longitudesNoJumps);
+		m_uIndex.build(m_times, m_u);
+		m_vIndex.build(m_times, m_v);
+		m_instrumentElevationsAbsoluteIndex.build(m_times, m_instrumentElevationsAbsolute);
+		m_instrumentAzimuthsAbsoluteNoJumpsIndex.build(m_times, m_instrumentAzimuthsAbsoluteNoJumps);
+		m_instrumentRollsAbsoluteIndex.build(m_times, m_instrumentRollsAbsolute);
+		m_shipElevationsIndex.build(m_times, m_shipElevations);
+		m_shipAzimuthsNoJumpsIndex.build(m_times, m_shipAzimuthsNoJumps);
+		m_shipRollsIndex.build(m_times, m_shipRolls);
+		m_sinInstrumentElevationsAbsoluteIndex.build(m_times, m_sinInstrumentElevationsAbsolute);
+		m_sinInstrumentAzimuthsAbsoluteIndex.build(m_times, m_sinInstrumentAzimuthsAbsolute);
+		m_sinInstrumentRollsAbsoluteIndex.build(m_times, m_sinInstrumentRollsAbsolute);
+		m_cosInstrumentElevationsAbsoluteIndex.build(m_times, m_cosInstrumentElevationsAbsolute);
+		m_cosInstrumentAzimuthsAbsoluteIndex.build(m_times, m_cosInstrumentAzimuthsAbsolute);
+		m_cosInstrumentRollsAbsoluteIndex.build(m_times, m_cosInstrumentRollsAbsolute);
+	}
 
 	template<class T>
-	T findMean(const sci::UtcTime &startTime, const sci::UtcTime &endTime, const sci::GridData<T, 1> &property) const
+	T interpolate(const sci::UtcTime &time, size_t lowerIndex, const sci::GridData<T, 1> &property) const
+	{
+		return T(sci::linearinterpolate(time, m_times[lowerIndex], m_times[lowerIndex + 1], property[lowerIndex], property[lowerIndex + 1]));
+	}
+	template<class T>
+	T findMean(const sci::UtcTime &startTime, const sci::UtcTime &endTime, const sci::GridData<T, 1> &property, const TimeSeriesIndex<T> &index) const
+	{
+		if (!index.isBuilt() || startTime < m_times[0] || endTime > m_times.back())
+			return std::numeric_limits<T>::quiet_NaN();
+		return findMean(startTime, endTime, findLowerIndex(startTime), findLowerIndex(endTime), property, index);
+	}
+	//As above, but with the lower indices of the start and end times already found by findLowerIndices
+	template<class T>
+	T findMean(const sci::UtcTime &startTime, const sci::UtcTime &endTime, size_t startLowerIndex, size_t endLowerIndex, const sci::GridData<T, 1> &property, const TimeSeriesIndex<T> &index) const
 	{
-		if (startTime < m_times[0] || endTime > m_times.back())
+		if (!index.isBuilt())
 			return std::numeric_limits<T>::quiet_NaN();
 		if (startTime == endTime)
-		{
-			size_t lowerIndex = std::min(findLowerIndex(startTime, true), m_times.size() - 1);
-			return T(sci::linearinterpolate(startTime, m_times[lowerIndex], m_times[lowerIndex + 1], property[lowerIndex], property[lowerIndex + 1]));
-		}
-		size_t startLowerIndex = std::min(findLowerIndex(startTime, true), m_times.size() - 1);
-		size_t endLowerIndex = findLowerIndex(endTime, false);
-		size_t endUpperIndex = std::min(endLowerIndex + 1, m_times.size() - 1);
-		std::vector<sci::UtcTime> subTimes(m_times.begin() + startLowerIndex, m_times.begin() + endUpperIndex + 1);
-		std::vector<T> subProperty(property.begin() + startLowerIndex, property.begin() + endUpperIndex + 1);
-		return T(sci::integrate(subTimes, subProperty, startTime, endTime) / (endTime - startTime));
+			return interpolate(startTime, startLowerIndex, property);
+		if (index.hasNan(property, startLowerIndex, endLowerIndex + 1))
+			return std::numeric_limits<T>::quiet_NaN();
+		double integral = index.integral(m_times, property, endLowerIndex, endTime) - index.integral(m_times, property, startLowerIndex, startTime);
+		return T(typename T::valueType(integral / TimeSeriesIndex<T>::secondsBetween(startTime, endTime)));
 	}
 	template<class T>
-	void findStatistics(const sci::UtcTime &startTime, const sci::UtcTime &endTime, const sci::GridData<T, 1> &property, T &mean, T &stdev, T &min, T &max, decltype(T(1) / sci::Physical<sci::Second<>, typename T::valueType>(1)) &rate) const
+	void findStatistics(const sci::UtcTime &startTime, const sci::UtcTime &endTime, const sci::GridData<T, 1> &property, const TimeSeriesIndex<T> &index, T &mean, T &stdev, T &min, T &max, decltype(T(1) / sci::Physical<sci::Second<>, typename T::valueType>(1)) &rate) const
 	{
 		typedef std::remove_reference<decltype(rate)>::type rateType;
-		if (startTime < m_times[0] || endTime > m_times.back())
+		if (!index.isBuilt() || startTime < m_times[0] || endTime > m_times.back())
 		{
 			mean = std::numeric_limits<T>::quiet_NaN();
 			min = std::numeric_limits<T>::quiet_NaN();
 			max = std::numeric_limits<T>::quiet_NaN();
 			stdev = std::numeric_limits<T>::quiet_NaN();
+			rate = std::numeric_limits<rateType>::quiet_NaN();
 			return;
 		}
+		size_t startLowerIndex = findLowerIndex(startTime);
 		if (startTime == endTime)
 		{
-			size_t lowerIndex = std::min(findLowerIndex(startTime, true), m_times.size() - 1);
-			mean = T(sci::linearinterpolate(startTime, m_times[lowerIndex], m_times[lowerIndex + 1], property[lowerIndex], property[lowerIndex + 1]));
+			mean = interpolate(startTime, startLowerIndex, property);
 			min = mean;
 			max = mean;
 			stdev = T(0);
-			rate = std::numeric_limits<std::remove_reference_t<decltype(rate)>>::quiet_NaN();
+			rate = std::numeric_limits<rateType>::quiet_NaN();
+			return;
 		}
-		size_t startLowerIndex = std::min(findLowerIndex(startTime, true), m_times.size() - 1);
-		size_t endLowerIndex = findLowerIndex(endTime, false);
-		size_t endUpperIndex = std::min(endLowerIndex + 1, m_times.size() - 1);
-		sci::GridData<sci::UtcTime, 1> subTimes(m_times.begin() + startLowerIndex, m_times.begin() + endUpperIndex + 1);
-		sci::GridData<degreeF, 1> subProperty(property.begin() + startLowerIndex, property.begin() + endUpperIndex + 1);
-		mean = T(sci::integrate(subTimes, subProperty, startTime, endTime) / (endTime - startTime));
-		min = sci::min(subProperty);
-		max = sci::max(subProperty);
-		size_t lowerIndexStart = std::min(findLowerIndex(startTime, true), m_times.size() - 1);
-		size_t lowerIndexEnd = std::min(findLowerIndex(endTime, false), m_times.size() - 1);
-		rate = rateType((sci::linearinterpolate(endTime, m_times[lowerIndexEnd], m_times[lowerIndexEnd + 1], property[lowerIndexEnd], property[lowerIndexEnd + 1]) - sci::linearinterpolate(startTime, m_times[lowerIndexStart], m_times[lowerIndexStart + 1], property[lowerIndexStart], property[lowerIndexStart + 1])) / (endTime - startTime));
-		sci::GridData<decltype(subProperty[0] * subProperty[0]), 1>subPropertySquared(subProperty.size());
-		for (size_t i = 0; i < subProperty.size(); ++i)
-			subPropertySquared[i] = sci::pow<2>(subProperty[i] - mean);
-		auto variance = sci::integrate(subTimes, subPropertySquared, startTime, endTime) / (endTime - startTime);
-		stdev = T(sci::TypeTraits<decltype(variance)>::sqrt(variance));
-	}
-	size_t findLowerIndex(sci::UtcTime time, bool startTime) const
-	{
-		size_t &previousLowerIndex = startTime ? m_previousLowerIndexStartTime : m_previousLowerIndexEndTime;
-
-		if (time > m_times.back() || time < m_times[0])
-			return -1;
-		size_t result = std::max(size_t(1), previousLowerIndex); // we use this to keep track of the last place we found - usually we are iterating forward in time so it is a useful optimisation
-		if (m_times[result] > time)
-			result = 1;
-		for (; result < m_times.size(); ++result)
+		size_t endLowerIndex = findLowerIndex(endTime);
+		rate = rateType((interpolate(endTime, endLowerIndex, property) - interpolate(startTime, startLowerIndex, property)) / (endTime - startTime));
+		if (index.hasNan(property, startLowerIndex, endLowerIndex + 1))
 		{
-			if (m_times[result] >= time)
-			{
-				--result;
-				break;
-			}
+			mean = std::numeric_limits<T>::quiet_NaN();
+			min = std::numeric_limits<T>::quiet_NaN();
+			max = std::numeric_limits<T>::quiet_NaN();
+			stdev = std::numeric_limits<T>::quiet_NaN();
+			return;
 		}
-		previousLowerIndex = result;
-		return result;
+		//the min and max are of the samples either side of the window, as they always have been
+		index.findMinMax(property, startLowerIndex, endLowerIndex + 1, min, max);
+		double duration = TimeSeriesIndex<T>::secondsBetween(startTime, endTime);
+		double meanValue = (index.integral(m_times, property, endLowerIndex, endTime) - index.integral(m_times, property, startLowerIndex, startTime)) / duration;
+		double variance = TimeSeriesIndex<T>::squaredDeviationIntegral(m_times, property, startLowerIndex, startTime, endLowerIndex, endTime, meanValue) / duration;
+		mean = T(typename T::valueType(meanValue));
+		stdev = T(typename T::valueType(std::sqrt(variance)));
+	}
+	//The index of the last sample before time, or 0 if time is the first sample. time must be
+	//within the range of the samples.
+	size_t findLowerIndex(const sci::UtcTime &time) const
+	{
+		size_t upperIndex = std::lower_bound(m_times.begin(), m_times.end(), time) - m_times.begin();
+		return upperIndex == 0 ? 0 : std::min(upperIndex - 1, m_times.size() - 2);
+	}
+	//Finds the lower indices of both ends of an averaging window, returning false if the window
+	//is not within the range of the samples
+	bool findLowerIndices(const sci::UtcTime &startTime, const sci::UtcTime &endTime, size_t &startLowerIndex, size_t &endLowerIndex) const
+	{
+		if (m_times.size() < 2 || startTime < m_times[0] || endTime > m_times.back())
+			return false;
+		startLowerIndex = findLowerIndex(startTime);
+		endLowerIndex = startTime == endTime ? startLowerIndex : findLowerIndex(endTime);
+		return true;
 	}
 };
 
@@ -842,6 +1203,15 @@ public:
 		cosInstrumentAzimuth = m_cosInstrumentAzimuth;
 		cosInstrumentRoll = m_cosInstrumentRoll;
 	}
+	virtual void getInstrumentTrigAttitudesForDirectionCorrection(const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, sci::GridData<unitlessF, 1> &sinInstrumentElevations, sci::GridData<unitlessF, 1> &sinInstrumentAzimuths, sci::GridData<unitlessF, 1> &sinInstrumentRolls, sci::GridData<unitlessF, 1> &cosInstrumentElevations, sci::GridData<unitlessF, 1> &cosInstrumentAzimuths, sci::GridData<unitlessF, 1> &cosInstrumentRolls) const override
+	{
+		sinInstrumentElevations = sci::GridData<unitlessF, 1>(startTimes.size(), m_sinInstrumentElevation);
+		sinInstrumentAzimuths = sci::GridData<unitlessF, 1>(startTimes.size(), m_sinInstrumentAzimuth);
+		sinInstrumentRolls = sci::GridData<unitlessF, 1>(startTimes.size(), m_sinInstrumentRoll);
+		cosInstrumentElevations = sci::GridData<unitlessF, 1>(startTimes.size(), m_cosInstrumentElevation);
+		cosInstrumentAzimuths = sci::GridData<unitlessF, 1>(startTimes.size(), m_cosInstrumentAzimuth);
+		cosInstrumentRolls = sci::GridData<unitlessF, 1>(startTimes.size(), m_cosInstrumentRoll);
+	}
 	virtual bool getFixedAltitude() const override
 	{
 		return true;
@@ -878,12 +1248,12 @@ sci::string getBoundsString(const LAT_GRID& latitudes, const LON_GRID& longitude
 	sci::stringstream result;
 	if (latitudes.size() == 1)
 	{
-		result << latitudes[0].value<degreeF>() << sU("N ") << longitudes[0].value<degreeF>() << sU("E");
+		result << latitudes[0].template value<degreeF>() << sU("N ") << longitudes[0].template value<degreeF>() << sU("E");
 	}
 	else
 	{
-		result << sci::min(latitudes).value<degreeF>() << "N " << sci::min(longitudes).value<degreeF>() << "E, "
-			<< sci::max(latitudes).value<degreeF>() << "N " << sci::max(longitudes).value<degreeF>() << "E";
+		result << sci::min(latitudes).template value<degreeF>() << "N " << sci::min(longitudes).template value<degreeF>() << "E, "
+			<< sci::max(latitudes).template value<degreeF>() << "N " << sci::max(longitudes).template value<degreeF>() << "E";
 	}
 
 	return result.str();
@@ -968,9 +1338,24 @@ public:
 	template<class T, class U>
 	void write(const T &variable, const U &data)
 	{
-		auto ncOutputView = sci::make_gridtransform_view(data, [](const U::value_type& val) { return T::transformForOutput(val); });
+		auto ncOutputView = sci::make_gridtransform_view(data, [](const typename U::value_type& val) { return T::transformForOutput(val); });
 		sci::OutputNcFile::write(variable, ncOutputView);
 	}
+	//Writes the data for one time of a (time, x, y) variable, so a large variable can be written
+	//a time at a time rather than held in memory all at once. The file must already have left
+	//define mode, which happens when the first whole variable is written, e.g. by
+	//writeTimeAndLocationData.
+	template<class T, class U>
+	void writeTimeSlice(const T& variable, size_t timeIndex, const sci::GridData<U, 2>& data)
+	{
+		typedef std::remove_cvref_t<decltype(T::transformForOutput(std::declval<U>()))> OutputType;
+		std::array<size_t, 2> shape = data.shape();
+		std::vector<OutputType> values(shape[0] * shape[1]);
+		for (size_t i = 0; i < shape[0]; ++i)
+			for (size_t j = 0; j < shape[1]; ++j)
+				values[i * shape[1] + j] = T::transformForOutput(data[i][j]);
+		putTimeSlice(getId(), variable.getId(), timeIndex, shape, values.data());
+	}
 	//template<size_t NDIMS>
 	//void writeDbData(const AmfNcDbVariableFromLogarithmicData<unitlessF>& variable, const sci::GridData<unitlessF, NDIMS>& data);
 	template<class T, sci::IsGrid U>
@@ -998,7 +1383,7 @@ public:
 			//create a new view of the data, but with the new strides
 			auto reshapedView(data | sci::views::grid<U::ndims - 1>(sci::GridPremultipliedStridesReference< U::ndims - 1>(&strides[0])));
 			//make a view applying any needed transform
-			auto ncOutputView = sci::make_gridtransform_view(reshapedView, [](const U::value_type& val) { return T::transformForOutput(val); });
+			auto ncOutputView = sci::make_gridtransform_view(reshapedView, [](const typename U::value_type& val) { return T::transformForOutput(val); });
 			//write out the data
 			sci::OutputNcFile::write(variable, ncOutputView);
 		}
@@ -1006,7 +1391,7 @@ public:
 		{
 			auto reshapedView(data | sci::views::grid<U::ndims - 1>(sci::GridPremultipliedStridesReference< U::ndims - 1>()));
 			//make a view applying any needed transform
-			auto ncOutputView = sci::make_gridtransform_view(reshapedView, [](const U::value_type& val) { return T::transformForOutput(val); });
+			auto ncOutputView = sci::make_gridtransform_view(reshapedView, [](const typename U::value_type& val) { return T::transformForOutput(val); });
 			//write out the data
 			sci::OutputNcFile::write(variable, ncOutputView);
 		}
@@ -1047,20 +1432,19 @@ private:
 			sci::string comment,
 			const std::vector< sci::NcAttribute*>& globalAttributes,
 			bool incrementMajorVersion);
+	static void findLatestVersion(const sci::string &directory, const sci::string &baseFilename, size_t &majorVersion, size_t &minorVersion, sci::string &history);
+	//netCDF has a separate put function for each type
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const double* values);
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const float* values);
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const uint8_t* values);
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int8_t* values);
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int16_t* values);
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int32_t* values);
+	static void putTimeSlice(int fileId, int variableId, size_t timeIndex, const std::array<size_t, 2>& shape, const int64_t* values);
 	template<class T>
 	struct Fill
 	{
 	};
-	template<>
-	struct Fill<double>
-	{
-		static const double value;
-	};
-	template<>
-	struct Fill<float>
-	{
-		static const float value;
-	};
 	template<class T>
 	struct Fill<sci::Physical<T, double>>
 	{
@@ -1071,40 +1455,10 @@ private:
 	{
 		static const sci::Physical<T, float> value;
 	};
-	template<>
-	struct Fill<uint8_t>
-	{
-		static const uint8_t value;
-	};
-	template<>
-	struct Fill<int16_t>
-	{
-		static const int16_t value;
-	};
-	template<>
-	struct Fill<int32_t>
-	{
-		static const int32_t value;
-	};
-	template<>
-	struct Fill<int64_t>
-	{
-		static const int64_t value;
-	};
 	template<class T>
 	struct TypeName
 	{
 
-	};
-	template<>
-	struct TypeName<double>
-	{
-		static const sci::string name;
-	};
-	template<>
-	struct TypeName<float>
-	{
-		static const sci::string name;
 	};
 	template<class T>
 	struct TypeName<sci::Physical<T, double>>
@@ -1116,31 +1470,6 @@ private:
 	{
 		static const sci::string name;
 	};
-	template<>
-	struct TypeName<int8_t>
-	{
-		static const sci::string name;
-	};
-	template<>
-	struct TypeName<uint8_t>
-	{
-		static const sci::string name;
-	};
-	template<>
-	struct TypeName<int16_t>
-	{
-		static const sci::string name;
-	};
-	template<>
-	struct TypeName<int32_t>
-	{
-		static const sci::string name;
-	};
-	template<>
-	struct TypeName<int64_t>
-	{
-		static const sci::string name;
-	};
 
 	sci::string m_filename;
 
@@ -1206,6 +1535,73 @@ private:
 	sci::GridData<degreeF, 1> m_headings;
 };
 
+//full specialisations of the member templates have to be at namespace scope, gcc rejects them in the class
+template<>
+struct OutputAmfNcFile::Fill<double>
+{
+	static const double value;
+};
+template<>
+struct OutputAmfNcFile::Fill<float>
+{
+	static const float value;
+};
+template<>
+struct OutputAmfNcFile::Fill<uint8_t>
+{
+	static const uint8_t value;
+};
+template<>
+struct OutputAmfNcFile::Fill<int16_t>
+{
+	static const int16_t value;
+};
+template<>
+struct OutputAmfNcFile::Fill<int32_t>
+{
+	static const int32_t value;
+};
+template<>
+struct OutputAmfNcFile::Fill<int64_t>
+{
+	static const int64_t value;
+};
+template<>
+struct OutputAmfNcFile::TypeName<double>
+{
+	static const sci::string name;
+};
+template<>
+struct OutputAmfNcFile::TypeName<float>
+{
+	static const sci::string name;
+};
+template<>
+struct OutputAmfNcFile::TypeName<int8_t>
+{
+	static const sci::string name;
+};
+template<>
+struct OutputAmfNcFile::TypeName<uint8_t>
+{
+	static const sci::string name;
+};
+template<>
+struct OutputAmfNcFile::TypeName<int16_t>
+{
+	static const sci::string name;
+};
+template<>
+struct OutputAmfNcFile::TypeName<int32_t>
+{
+	static const sci::string name;
+};
+template<>
+struct OutputAmfNcFile::TypeName<int64_t>
+{
+	static const sci::string name;
+};
+
 template<class T>
 const sci::Physical<T, double> OutputAmfNcFile::Fill<sci::Physical<T, double>>::value = sci::Physical<T, double>(-1e20);
 template<class T>
@@ -1320,7 +1716,7 @@ public:
 	{
 		if (data.size() > 0)
 		{
-			static_assert(std::is_same_v<FLAGSGRID::value_type, uint8_t>, "flags must be of uint8_t type.");
+			static_assert(std::is_same_v<typename FLAGSGRID::value_type, uint8_t>, "flags must be of uint8_t type.");
 			T validMin;
 			T validMax;
 			getMinMax(data, flags, validMin, validMax);
@@ -1337,7 +1733,7 @@ public:
 	{
 		if (data.size() > 0)
 		{
-			static_assert(std::is_same_v<FLAGSGRID::value_type, uint8_t>, "flags must be of uint8_t type.");
+			static_assert(std::is_same_v<typename FLAGSGRID::value_type, uint8_t>, "flags must be of uint8_t type.");
 			T validMin;
 			T validMax;
 			getMinMax(data, flags, validMin, validMax);
@@ -1498,7 +1894,7 @@ public:
 	template<class U>
 	static VALUE_TYPE transformForOutput(const U& val)
 	{
-		return val == val ? val.value<UNIT>() : OutputAmfNcFile::getFillValue<VALUE_TYPE>();
+		return val == val ? val.template value<UNIT>() : OutputAmfNcFile::getFillValue<VALUE_TYPE>();
 	}
 
 private:
@@ -1550,8 +1946,8 @@ private:
 	}
 	void setMinMax(const sci::OutputNcFile& ncFile, sci::Physical<UNIT, VALUE_TYPE> validMin, sci::Physical<UNIT, VALUE_TYPE> validMax)
 	{
-		sci::NcAttribute validMinAttribute(sU("valid_min"), validMin.value<UNIT>());
-		sci::NcAttribute validMaxAttribute(sU("valid_max"), validMax.value<UNIT>());
+		sci::NcAttribute validMinAttribute(sU("valid_min"), validMin.template value<UNIT>());
+		sci::NcAttribute validMaxAttribute(sU("valid_max"), validMax.template value<UNIT>());
 		sci::NcVariable<VALUE_TYPE>::addAttribute(validMinAttribute, ncFile);
 		sci::NcVariable<VALUE_TYPE>::addAttribute(validMaxAttribute, ncFile);
 	}
@@ -1601,7 +1997,7 @@ public:
 	template<class U>
 	static valueType transformForOutput(const U& val)
 	{
-		return val == val ? Decibel<REFERENCE_UNIT>::linearToDecibel(val).value<unitlessF>() : OutputAmfNcFile::getFillValue<valueType>();
+		return val == val ? Decibel<REFERENCE_UNIT>::linearToDecibel(val).template value<unitlessF>() : OutputAmfNcFile::getFillValue<valueType>();
 	}
 };
 
@@ -1679,7 +2075,7 @@ private:
 		sci::NcAttribute validMinAttribute(sU("valid_min"), Decibel<REFERENCE_UNIT>::linearToDecibel(validMinLinear));
 		sci::NcAttribute validMaxAttribute(sU("valid_max"), Decibel<REFERENCE_UNIT>::linearToDecibel(validMaxLinear));
 		//sci::NcAttribute typeAttribute(sU("type"), OutputAmfNcFile::getTypeName<Decibel<REFERENCE_UNIT>::valueType>());
-		sci::NcAttribute fillValueAttribute(sU("_FillValue"), OutputAmfNcFile::getFillValue< Decibel<REFERENCE_UNIT>::valueType>());
+		sci::NcAttribute fillValueAttribute(sU("_FillValue"), OutputAmfNcFile::getFillValue<typename Decibel<REFERENCE_UNIT>::valueType>());
 		sci::NcAttribute coordinatesAttribute(sU("coordinates"), getCoordinatesAttributeText(coordinates));
 		sci::NcAttribute cellMethodsAttribute(sU("cell_methods"), getCellMethodsAttributeText(cellMethods));
 		sci::NcAttribute commentAttribute(sU("comment"), comment);
@@ -1713,7 +2109,7 @@ private:
 		sci::NcAttribute validMinAttribute(sU("valid_min"), validMinLogarithmic.value<unitlessF>());
 		sci::NcAttribute validMaxAttribute(sU("valid_max"), validMaxLogarithmic.value<unitlessF>());
 		//sci::NcAttribute typeAttribute(sU("type"), OutputAmfNcFile::getTypeName<Decibel<REFERENCE_UNIT>::valueType>());
-		sci::NcAttribute fillValueAttribute(sU("_FillValue"), OutputAmfNcFile::getFillValue< Decibel<REFERENCE_UNIT>::valueType>());
+		sci::NcAttribute fillValueAttribute(sU("_FillValue"), OutputAmfNcFile::getFillValue<typename Decibel<REFERENCE_UNIT>::valueType>());
 		sci::NcAttribute coordinatesAttribute(sU("coordinates"), getCoordinatesAttributeText(coordinates));
 		sci::NcAttribute cellMethodsAttribute(sU("cell_methods"), getCellMethodsAttributeText(cellMethods));
 		sci::NcAttribute commentAttribute(sU("comment"), comment);
@@ -1759,9 +2155,9 @@ public:
 	{
 	}
 	template <class DATA_TYPE>
-	static DATA_TYPE::valueType transformForOutput(const DATA_TYPE& val)
+	static typename DATA_TYPE::valueType transformForOutput(const DATA_TYPE& val)
 	{
-		return val == val ? Decibel<REFERENCE_UNIT>::linearToDecibel(val).value<sci::Unitless>() : OutputAmfNcFile::getFillValue<DATA_TYPE::valueType>();
+		return val == val ? Decibel<REFERENCE_UNIT>::linearToDecibel(val).template value<sci::Unitless>() : OutputAmfNcFile::getFillValue<typename DATA_TYPE::valueType>();
 	}
 };
 
@@ -2108,59 +2504,24 @@ void OutputAmfNcFile::initialise(AmfVersion amfVersion,
 	sci::assertThrow(!usedReplacement, sci::err(sci::SERR_USER, 0, message.str()));
 #endif
 
-	//Check if there is an existing file and get its history
+	//Check if there is an existing file and get its history. The manifest saves opening every
+	//previous version, but in verify mode we always scan and the manifest is corrected from that.
 	sci::string existingHistory;
 	size_t prevMajorVersion = 0;
 	size_t prevMinorVersion = 0;
-	std::vector<sci::string> existingFiles = sci::getAllFiles(directory, false, true);
-	for (size_t i = 0; i < existingFiles.size(); ++i)
+	sci::string baseFilenameNoDirectory = baseFilename.substr(baseFilename.find_last_of(sU("\\/")) == sci::string::npos ? 0 : baseFilename.find_last_of(sU("\\/")) + 1);
+	std::unique_ptr<NcVersionManifest> versionManifest;
+	NcVersionRecord previousVersion;
+	if (dataInfo.processingOptions.useNcVersionManifest)
+		versionManifest.reset(new NcVersionManifest(directory));
+	if (versionManifest && !dataInfo.processingOptions.verifyNcVersionManifest && versionManifest->find(baseFilenameNoDirectory, previousVersion))
 	{
-		if (existingFiles[i].substr(0, baseFilename.length()) == baseFilename)
-		{
-			try
-			{
-				sci::InputNcFile previous(existingFiles[i]);
-				sci::string thisExistingHistory = previous.getGlobalAttribute<sci::string>(sU("history"));
-				sci::string previousVersionString = previous.getGlobalAttribute<sci::string>(sU("product_version"));
-				sci::assertThrow(previousVersionString.length() > 1 && previousVersionString[0] == 'v', sci::err(sci::SERR_USER, 0, sU("Previous version of the file has an ill formatted product version.")));
-
-				int thisPrevMajorVersion;
-				int thisPrevMinorVersion;
-				//remove the v from the beginning of the version string
-				previousVersionString = previousVersionString.substr(1);
-				//replace the . with a space
-				if (previousVersionString.find_first_of(sU('.')) != sci::string::npos)
-				{
-					previousVersionString[previousVersionString.find_first_of(sU('.'))] = sU(' ');
-
-					//replace the b in beta (if it is there) with a space
-					if (previousVersionString.find_first_of(sU('b')) != sci::string::npos)
-					{
-						previousVersionString[previousVersionString.find_first_of(sU('b'))] = sU(' ');
-					}
-				}
-				else
-					previousVersionString = previousVersionString + sU(" 0"); //if the minor version isn't there, then add it
-
-				//put the string into a stream and read out the major and minor versions
-				sci::istringstream versionStream(previousVersionString);
-				versionStream >> thisPrevMajorVersion;
-				versionStream >> thisPrevMinorVersion;
-
-				if (thisPrevMajorVersion > prevMajorVersion || (thisPrevMajorVersion == prevMajorVersion && thisPrevMinorVersion > prevMinorVersion))
-				{
-					prevMajorVersion = thisPrevMajorVersion;
-					prevMinorVersion = thisPrevMinorVersion;
-					existingHistory = thisExistingHistory;
-				}
-			}
-			catch (...)
-			{
-				//we end up here if the file is not a valid netcdf or some other read problem
-				//This isn't an issue, just move on to the next file.
-			}
-		}
+		prevMajorVersion = previousVersion.majorVersion;
+		prevMinorVersion = previousVersion.minorVersion;
+		existingHistory = previousVersion.history;
 	}
+	else
+		findLatestVersion(directory, baseFilename, prevMajorVersion, prevMinorVersion, existingHistory);
 
 	size_t majorVersion;
 	size_t minorVersion;
@@ -2282,6 +2643,15 @@ void OutputAmfNcFile::initialise(AmfVersion amfVersion,
 	write(sci::NcAttribute(sU("history"), history.str()));
 	write(sci::NcAttribute(sU("product_version"), versionString.str()));
 	write(sci::NcAttribute(sU("last_revised_date"), getFormattedDateTime(now, sU("-"), sU(":"), sU("T"))));
+	if (versionManifest)
+	{
+		NcVersionRecord newVersion;
+		newVersion.majorVersion = majorVersion;
+		newVersion.minorVersion = minorVersion;
+		newVersion.filename = m_filename.substr(m_filename.find_last_of(sU("\\/")) == sci::string::npos ? 0 : m_filename.find_last_of(sU("\\/")) + 1);
+		newVersion.history = history.str();
+		versionManifest->update(baseFilenameNoDirectory, newVersion);
+	}
 
 	//Now add the time dimension
 	write(m_timeDimension);
@@ -0,0 +1,59 @@
+#pragma once
+#include<bit>
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<type_traits>
+
+//Helpers for reading little endian binary data directly out of a byte buffer, such as a
+//MemoryMappedFile. Values are copied out with memcpy, so they need not be aligned, and are
+//byte swapped on big endian machines, so files written by Windows instrument PCs read the
+//same on any platform. Like CharBufferParsing.h the position is taken by reference and
+//advanced past whatever was read. There is no check against the end of the buffer, so
+//check a whole block is present with bufferHasBytes or bufferHasRecords first.
+
+inline bool bufferHasBytes(const char *position, const char *end, uint64_t nBytes)
+{
+	return uint64_t(end - position) >= nBytes;
+}
+
+//divides rather than multiplies so a corrupt record count can't overflow
+inline bool bufferHasRecords(const char *position, const char *end, uint64_t nRecords, uint64_t recordSize)
+{
+	return recordSize == 0 || uint64_t(end - position) / recordSize >= nRecords;
+}
+
+template<class T>
+T readLittleEndian(const char *&position)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "readLittleEndian can only be used with trivially copyable types.");
+	T result;
+	if constexpr (std::endian::native == std::endian::little || sizeof(T) == 1)
+		std::memcpy(&result, position, sizeof(T));
+	else
+	{
+		char bytes[sizeof(T)];
+		for (size_t i = 0; i < sizeof(T); ++i)
+			bytes[i] = position[sizeof(T) - 1 - i];
+		std::memcpy(&result, bytes, sizeof(T));
+	}
+	position += sizeof(T);
+	return result;
+}
+
+//reads n consecutive values, on little endian machines this is a single copy
+template<class T>
+void readLittleEndian(const char *&position, T *destination, size_t n)
+{
+	if constexpr (std::endian::native == std::endian::little || sizeof(T) == 1)
+	{
+		if (n > 0)
+			std::memcpy(destination, position, n * sizeof(T));
+		position += n * sizeof(T);
+	}
+	else
+	{
+		for (size_t i = 0; i < n; ++i)
+			destination[i] = readLittleEndian<T>(position);
+	}
+}
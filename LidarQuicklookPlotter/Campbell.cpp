@@ -8,34 +8,18 @@
 #include<string>
 #include<sstream>
 #include<cmath>
+#include<cstring>
 #include<svector/serr.h>
+#include"CampbellParsing.h"
 
 
-// ----------------------------------------------------
-// Calculate CRC16 checksum
-// buf is a pointer to the input string
-// len is the length of the input string
-// copied directly from the cs135 manual, but with types
-// changed to fixed size types and the function name and
-// result variable name changed
-// ----------------------------------------------------
-uint16_t generateChecksum(char *buffer, size_t length)
+//copies the next length bytes of a buffer and moves position past them, throwing if the
+//buffer ends first
+void readCampbellBytes(const char *&position, const char *end, char *destination, size_t length)
 {
-	uint16_t checksum;
-	uint16_t m;
-	int32_t i, j;
-	checksum = 0xFFFF;
-	for (i = 0; i < length; ++i)
-	{
-		checksum ^= buffer[i] << 8;
-		for (j = 0; j < 8; ++j) {
-			m = (checksum & 0x8000) ? 0x1021 : 0;
-			checksum <<= 1;
-			checksum ^= m;
-		}
-	}
-	checksum ^= 0xFFFF;
-	return checksum;
+	sci::assertThrow(size_t(end - position) >= length, sci::err(sci::SERR_USER, 0, sU("Reached the end of the data part way through a Campbell message.")));
+	std::memcpy(destination, position, length);
+	position += length;
 }
 
 #pragma warning(push)
@@ -47,10 +31,10 @@ CampbellHeader::CampbellHeader(char startOfHeaderCharacter, char startOfTextChar
 }
 #pragma warning(pop)
 
-void CampbellHeader::readHeader(std::istream &stream)
+void CampbellHeader::readHeader(const char *&position, const char *end)
 {
 	char commonHeader[8];
-	stream.read(commonHeader, 7);
+	readCampbellBytes(position, end, commonHeader, 7);
 	m_bytes = std::vector<char>(commonHeader, commonHeader + 7);
 
 	//check the start header character
@@ -83,7 +67,7 @@ void CampbellHeader::readHeader(std::istream &stream)
 	if (m_messageType == campbellMessageType::cs)
 	{
 		char messageNumberText[4];
-		stream.read(messageNumberText, 3);
+		readCampbellBytes(position, end, messageNumberText, 3);
 		m_bytes.insert(m_bytes.end(), messageNumberText, messageNumberText + 3);
 		messageNumberText[3] = '\0';
 		if (messageNumberText[0] < '0' || messageNumberText[0] > '9'
@@ -103,7 +87,7 @@ void CampbellHeader::readHeader(std::istream &stream)
 	{
 
 		char messageNumberText[3];
-		stream.read(messageNumberText, 2);
+		readCampbellBytes(position, end, messageNumberText, 2);
 		m_bytes.insert(m_bytes.end(), messageNumberText, messageNumberText + 2);
 		messageNumberText[2] = '\0';
 		if (messageNumberText[0] == '1')
@@ -162,7 +146,7 @@ void CampbellHeader::readHeader(std::istream &stream)
 	else if (m_messageType == campbellMessageType::ct)
 	{
 		char shouldBeZero;
-		stream.read(&shouldBeZero, 1);
+		readCampbellBytes(position, end, &shouldBeZero, 1);
 		m_bytes.insert(m_bytes.end(), shouldBeZero);
 		char shouldBeOne = m_os[2];
 		m_os = m_os.substr(0, 2);
@@ -178,7 +162,7 @@ void CampbellHeader::readHeader(std::istream &stream)
 
 	//Check we end with the text start character and crlf
 	char headerEnd[3];
-	stream.read(headerEnd, 3);
+	readCampbellBytes(position, end, headerEnd, 3);
 	m_bytes.insert(m_bytes.end(), headerEnd, headerEnd + 3);
 	if (headerEnd[0] != m_startOfTextCharacter)
 	{
@@ -200,27 +184,6 @@ void DefaultMessage::readMessage(std::istream &stream)
 
 }
 
-int hexCharToNumber(char hexChar)
-{
-	if (hexChar > char(47) && hexChar < char(58))
-		return int(hexChar) - int(48);
-	else if (hexChar > char(96) && hexChar < char(103))
-		return int(hexChar) - int(87);
-	
-	throw(sci::err(sci::SERR_USER, 0, sU("Recieved a non hex number to parse.")));
-}
-
-int hexTextToNumber(char* textHex)
-{
-	int result = (((hexCharToNumber(textHex[0]) * 16 + hexCharToNumber(textHex[1])) * 16 + hexCharToNumber(textHex[2])) * 16 + hexCharToNumber(textHex[3])) * 16 + hexCharToNumber(textHex[4]);
-	//two's compliment format means the first bit is actually negative - correct for the
-	//fact that we have aded it on.
-	if (result > (8 * 16 * 16 * 16 * 16))
-		result -= 2 * 8 * 16 * 16 * 16 * 16;
-
-	return result;
-}
-
 #pragma warning(push)
 #pragma warning (disable : 26495)
 CampbellMessage2::CampbellMessage2(char endOfTextCharacter)
@@ -265,20 +228,27 @@ ceilometerMessageStatus parseMessageStatus(char text)
 	throw(sci::err(sci::SERR_USER, 0, sU("Received an invalid character when determining the ceilometer message status.")));
 }
 
-void CampbellMessage2::read(std::istream &istream, const CampbellHeader &header)
+void CampbellMessage2::read(const char *&position, const char *end, const CampbellHeader &header)
 {
 
-	//first read in the whole stream and tag it onto the header. We will use this
-	//for checksum calculation
-	std::vector<char> buffer = header.getBytes();
-	size_t messageStartByte = buffer.size();
-	buffer.resize(buffer.size() + 10335);
-	istream.read(&buffer[messageStartByte], 10335);
-
-	//create a binary stream from the data that we will use to parse each of the values;
-	std::istringstream bufferStream(std::string(&buffer[messageStartByte], buffer.size() - messageStartByte));
+	//The message is parsed where it is. Only if the data ends early is it copied, so it
+	//can be padded with zeros, which are not valid hex and will be rejected below
+	const size_t messageLength = 10335;
+	const char *message = position;
+	std::vector<char> paddedMessage;
+	if (size_t(end - position) < messageLength)
+	{
+		paddedMessage.assign(position, end);
+		paddedMessage.resize(messageLength, '\0');
+		message = &paddedMessage[0];
+		position = end;
+	}
+	else
+		position += messageLength;
 
-	//parse all the variables from the bufferStream
+	//parse all the variables directly from the message
+	const char *bufferPosition = message;
+	const char *bufferEnd = message + messageLength;
 
 	char crlf[2];
 	char space;
@@ -291,21 +261,21 @@ void CampbellMessage2::read(std::istream &istream, const CampbellHeader &header)
 	char height3[6];
 	char height4[6];
 	char flags[12];
-	bufferStream.read(&messageStatus, 1);
-	bufferStream.read(&alarmStatus, 1);
-	bufferStream.read(&space, 1);
-	bufferStream.read(transmission, 3);
-	bufferStream.read(&space, 1);
-	bufferStream.read(height1, 5);
-	bufferStream.read(&space, 1);
-	bufferStream.read(height2, 5);
-	bufferStream.read(&space, 1);
-	bufferStream.read(height3, 5);
-	bufferStream.read(&space, 1);
-	bufferStream.read(height4, 5);
-	bufferStream.read(&space, 1);
-	bufferStream.read(flags, 12);
-	bufferStream.read(crlf, 2);
+	readCampbellBytes(bufferPosition, bufferEnd, &messageStatus, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, &alarmStatus, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, transmission, 3);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, height1, 5);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, height2, 5);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, height3, 5);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, height4, 5);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, flags, 12);
+	readCampbellBytes(bufferPosition, bufferEnd, crlf, 2);
 
 	height1[5] = '\0';
 	height2[5] = '\0';
@@ -348,36 +318,36 @@ void CampbellMessage2::read(std::istream &istream, const CampbellHeader &header)
 	char pulseQuantity[5];
 	char sampleRate[3];
 	char sum[4];
-	bufferStream.read(scale, 5);
+	readCampbellBytes(bufferPosition, bufferEnd, scale, 5);
 	scale[5] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(res, 2);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, res, 2);
 	res[2] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(n, 4);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, n, 4);
 	n[4] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(energy, 3);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, energy, 3);
 	energy[3] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(laserTemperature, 3);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, laserTemperature, 3);
 	laserTemperature[3] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(tiltAngle, 2);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, tiltAngle, 2);
 	tiltAngle[2] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(background, 4);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, background, 4);
 	background[4] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(pulseQuantity, 4);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, pulseQuantity, 4);
 	pulseQuantity[4] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(sampleRate, 2);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, sampleRate, 2);
 	sampleRate[2] = '\0';
-	bufferStream.read(&space, 1);
-	bufferStream.read(sum, 3);
+	readCampbellBytes(bufferPosition, bufferEnd, &space, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, sum, 3);
 	sum[3] = '\0';
-	bufferStream.read(crlf, 2);
+	readCampbellBytes(bufferPosition, bufferEnd, crlf, 2);
 
 	m_scale = percentF((percentF::valueType)std::atof(scale));
 	m_resolution = metreF((metreF::valueType)std::atof(res));
@@ -394,27 +364,26 @@ void CampbellMessage2::read(std::istream &istream, const CampbellHeader &header)
 
 
 
-	std::vector<char> data(10240);
-	bufferStream.read(&data[0], 10240);
-	bufferStream.read(crlf, 2);
+	const char *data = bufferPosition;
+	bufferPosition += 10240;
+	readCampbellBytes(bufferPosition, bufferEnd, crlf, 2);
 
 	char endOfTextCharacter;
 	char checksum[4];
-	bufferStream.read(&endOfTextCharacter, 1);
-	bufferStream.read(checksum, 4);
+	readCampbellBytes(bufferPosition, bufferEnd, &endOfTextCharacter, 1);
+	readCampbellBytes(bufferPosition, bufferEnd, checksum, 4);
 
 	m_data.resize(2046); //last two points are always zero so ignore them and use 2046 rather than 2048
-	char* currentPoint = &data[0];
+	int32_t values[2046];
+	hexTextToNumbers(data, m_data.size(), values);
 	for (size_t i = 0; i < m_data.size(); ++i)
-	{
-		m_data[i] = perSteradianPerKilometreF((perSteradianPerKilometreF::valueType)hexTextToNumber(currentPoint))*m_scale / unitlessF((unitlessF::valueType)100000.0);
-		currentPoint += 5;
-	}
+		m_data[i] = perSteradianPerKilometreF((perSteradianPerKilometreF::valueType)values[i])*m_scale / unitlessF((unitlessF::valueType)100000.0);
 
 	//we calculate the checksum based on all caharacters after the start of header
 	//character, up to and including the end of text character. So we exclude the
-	//1st character and the last 4 from the buffer.
-	unsigned int calculatedChecksum = generateChecksum(&buffer[1], buffer.size() - 5);
+	//1st character of the header and the last 4 of the message.
+	const std::vector<char> &headerBytes = header.getBytes();
+	unsigned int calculatedChecksum = updateChecksum(updateChecksum(0xFFFF, &headerBytes[1], headerBytes.size() - 1), message, messageLength - 4) ^ 0xFFFF;
 	//now convert the read checksum into a number for easy comparison. We can use the
 	//same function as used for converting the profile data, but this accepts 5
 	//characters, so prepend a 0. Note we don't need to stress about 2s compliment 
@@ -36,7 +36,7 @@ class CampbellHeader
 {
 public:
 	CampbellHeader(char startOfHeaderCharacter = '\01', char startOfTextCharacter = '\02');
-	void readHeader(std::istream &stream);
+	void readHeader(const char *&position, const char *end);
 	char getStartOfHeaderCharacter() const { return m_startOfHeaderCharacter; }
 	char getStartOfTextCharacter() const { return m_startOfTextCharacter; }
 	campbellMessageType getMessageType() const { sci::assertThrow(m_initialised, sci::err(sci::SERR_USER, 0, sU("Attempted to get the message type for an uninitialised CampbellHeader object."))); return m_messageType; }
@@ -70,7 +70,8 @@ class CampbellMessage2
 {
 public:
 	CampbellMessage2(char endOfTextCharacter = '\3');
-	void read(std::istream &stream, const CampbellHeader &header);
+	//reads the message following the header and moves position past it
+	void read(const char *&position, const char *end, const CampbellHeader &header);
 	const std::vector<perSteradianPerKilometreF> &getData() const { return m_data; }
 	std::vector<metreF> getHeights() const { return std::vector<metreF>{m_height1, m_height2, m_height3, m_height4, }; }
 	metreF getHeight1() const { return m_height1; }
@@ -0,0 +1,81 @@
+#include"CampbellParsing.h"
+#include<array>
+#include<svector/serr.h>
+
+//The CRC16 (CCITT polynomial 0x1021) of each possible byte value, so the checksum can be
+//updated a byte at a time rather than a bit at a time. Each entry is what the bit by bit
+//loop in the cs135 manual does to the top byte of the checksum.
+constexpr std::array<uint16_t, 256> generateChecksumTable()
+{
+	std::array<uint16_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint16_t crc = uint16_t(i << 8);
+		for (int j = 0; j < 8; ++j)
+			crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+		table[i] = crc;
+	}
+	return table;
+}
+constexpr std::array<uint16_t, 256> g_checksumTable = generateChecksumTable();
+
+// ----------------------------------------------------
+// Add length bytes to a running CRC16 checksum
+// As described in the cs135 manual, the checksum starts
+// at 0xFFFF and the final result is xored with 0xFFFF.
+// Updating in parts lets us checksum the header and
+// message without copying them into one buffer.
+// ----------------------------------------------------
+uint16_t updateChecksum(uint16_t checksum, const char *buffer, size_t length)
+{
+	const unsigned char *bytes = (const unsigned char*)buffer;
+	for (size_t i = 0; i < length; ++i)
+		checksum = uint16_t(checksum << 8) ^ g_checksumTable[(checksum >> 8) ^ bytes[i]];
+	return checksum;
+}
+
+//The value of each character as a hex digit, or 0x10 for characters that aren't lower case
+//hex digits, which is the only case the ceilometer uses
+constexpr std::array<uint8_t, 256> generateHexDigitTable()
+{
+	std::array<uint8_t, 256> table{};
+	for (size_t i = 0; i < 256; ++i)
+		table[i] = 0x10;
+	for (uint8_t i = 0; i < 10; ++i)
+		table['0' + i] = i;
+	for (uint8_t i = 0; i < 6; ++i)
+		table['a' + i] = 10 + i;
+	return table;
+}
+constexpr std::array<uint8_t, 256> g_hexDigitTable = generateHexDigitTable();
+
+//Decodes nValues consecutive 5 digit two's complement hex numbers. The digits are looked up
+//rather than tested, and invalid characters are collected in one flag and checked at the
+//end, so there are no branches in the loop.
+void hexTextToNumbers(const char *textHex, size_t nValues, int32_t *values)
+{
+	const unsigned char *digits = (const unsigned char*)textHex;
+	uint8_t invalid = 0;
+	for (size_t i = 0; i < nValues; ++i)
+	{
+		uint8_t digit0 = g_hexDigitTable[digits[0]];
+		uint8_t digit1 = g_hexDigitTable[digits[1]];
+		uint8_t digit2 = g_hexDigitTable[digits[2]];
+		uint8_t digit3 = g_hexDigitTable[digits[3]];
+		uint8_t digit4 = g_hexDigitTable[digits[4]];
+		invalid |= digit0 | digit1 | digit2 | digit3 | digit4;
+		int32_t result = (int32_t(digit0) << 16) | (int32_t(digit1) << 12) | (int32_t(digit2) << 8) | (int32_t(digit3) << 4) | int32_t(digit4);
+		//two's compliment format means the first bit is actually negative - correct for the
+		//fact that we have aded it on.
+		values[i] = result - int32_t(result > 0x80000) * 0x100000;
+		digits += 5;
+	}
+	sci::assertThrow((invalid & 0x10) == 0, sci::err(sci::SERR_USER, 0, sU("Recieved a non hex number to parse.")));
+}
+
+int hexTextToNumber(const char* textHex)
+{
+	int32_t result;
+	hexTextToNumbers(textHex, 1, &result);
+	return result;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+
+//Adds length bytes to a running CRC16 (CCITT polynomial 0x1021) checksum, as used by Campbell
+//ceilometers. Start with 0xFFFF and xor the final result with 0xFFFF.
+uint16_t updateChecksum(uint16_t checksum, const char *buffer, size_t length);
+//Decodes nValues consecutive 5 digit lower case two's complement hex numbers. Throws if any
+//character is not a hex digit.
+void hexTextToNumbers(const char *textHex, size_t nValues, int32_t *values);
+int hexTextToNumber(const char *textHex);
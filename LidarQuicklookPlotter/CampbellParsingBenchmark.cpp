@@ -0,0 +1,222 @@
+//Compares the table based Campbell checksum and hex decoding in CampbellParsing.cpp with the
+//bit by bit checksum from the cs135 manual and the digit by digit decoder they replaced. Both
+//are run on the same synthetic messages, the outputs are checked to be identical and the times
+//are reported. Returns non zero if any output differs.
+//Usage: CampbellParsingBenchmark [nMessages]
+#include"CampbellParsing.h"
+#include<svector/serr.h>
+#include<iostream>
+#include<vector>
+#include<string>
+#include<random>
+#include<chrono>
+#include<cstdlib>
+
+// ----------------------------------------------------
+// Calculate CRC16 checksum
+// buf is a pointer to the input string
+// len is the length of the input string
+// copied directly from the cs135 manual, but with types
+// changed to fixed size types and the function name and
+// result variable name changed
+// ----------------------------------------------------
+uint16_t referenceChecksum(const char *buffer, size_t length)
+{
+	uint16_t checksum;
+	uint16_t m;
+	size_t i;
+	int32_t j;
+	checksum = 0xFFFF;
+	for (i = 0; i < length; ++i)
+	{
+		checksum ^= buffer[i] << 8;
+		for (j = 0; j < 8; ++j) {
+			m = (checksum & 0x8000) ? 0x1021 : 0;
+			checksum <<= 1;
+			checksum ^= m;
+		}
+	}
+	checksum ^= 0xFFFF;
+	return checksum;
+}
+
+int referenceHexCharToNumber(char hexChar)
+{
+	if (hexChar > char(47) && hexChar < char(58))
+		return int(hexChar) - int(48);
+	else if (hexChar > char(96) && hexChar < char(103))
+		return int(hexChar) - int(87);
+
+	throw(sci::err(sci::SERR_USER, 0, sU("Recieved a non hex number to parse.")));
+}
+
+int referenceHexTextToNumber(const char *textHex)
+{
+	int result = (((referenceHexCharToNumber(textHex[0]) * 16 + referenceHexCharToNumber(textHex[1])) * 16 + referenceHexCharToNumber(textHex[2])) * 16 + referenceHexCharToNumber(textHex[3])) * 16 + referenceHexCharToNumber(textHex[4]);
+	//two's compliment format means the first bit is actually negative - correct for the
+	//fact that we have aded it on.
+	if (result > (8 * 16 * 16 * 16 * 16))
+		result -= 2 * 8 * 16 * 16 * 16 * 16;
+
+	return result;
+}
+
+//A cs message has 2048 backscatter values of 5 hex digits, plus a few hundred other characters
+const size_t nValuesPerMessage = 2048;
+const size_t nOtherCharactersPerMessage = 300;
+
+//The text of a backscatter profile with random values, always including the values at the
+//ends of the range and the 0x80000 edge case
+std::string makeProfileText(std::mt19937 &generator)
+{
+	std::uniform_int_distribution<uint32_t> distribution(0, 0xFFFFF);
+	std::string text;
+	text.reserve(nValuesPerMessage * 5);
+	const char *hexDigits = "0123456789abcdef";
+	for (size_t i = 0; i < nValuesPerMessage; ++i)
+	{
+		uint32_t value = distribution(generator);
+		if (i == 0)
+			value = 0x00000;
+		else if (i == 1)
+			value = 0x7FFFF;
+		else if (i == 2)
+			value = 0x80000;
+		else if (i == 3)
+			value = 0x80001;
+		else if (i == 4)
+			value = 0xFFFFF;
+		for (int j = 4; j >= 0; --j)
+			text.push_back(hexDigits[(value >> (j * 4)) & 0xF]);
+	}
+	return text;
+}
+
+//A whole message including all byte values, as the checksum covers the control characters
+//and a corrupted file can contain anything
+std::string makeMessage(std::mt19937 &generator)
+{
+	std::uniform_int_distribution<int> distribution(0, 255);
+	std::string message;
+	for (size_t i = 0; i < nOtherCharactersPerMessage; ++i)
+		message.push_back(char(distribution(generator)));
+	message += makeProfileText(generator);
+	return message;
+}
+
+template<class FUNCTION>
+double timeSeconds(FUNCTION function)
+{
+	auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nMessages = 2000;
+	if (argc > 1)
+		nMessages = std::strtoul(argv[1], nullptr, 10);
+	if (nMessages == 0)
+	{
+		std::cout << "Usage: CampbellParsingBenchmark [nMessages]\n";
+		return 1;
+	}
+
+	std::mt19937 generator(20201017);
+	std::vector<std::string> messages(nMessages);
+	for (auto &message : messages)
+		message = makeMessage(generator);
+
+	bool passed = true;
+
+	//checksums - the new one is also checked when it is updated in two parts, as
+	//CampbellMessage2 does for the header and message
+	std::vector<uint16_t> referenceChecksums(nMessages);
+	std::vector<uint16_t> tableChecksums(nMessages);
+	double referenceChecksumTime = timeSeconds([&]()
+		{
+			for (size_t i = 0; i < nMessages; ++i)
+				referenceChecksums[i] = referenceChecksum(messages[i].data(), messages[i].size());
+		});
+	double tableChecksumTime = timeSeconds([&]()
+		{
+			for (size_t i = 0; i < nMessages; ++i)
+				tableChecksums[i] = updateChecksum(0xFFFF, messages[i].data(), messages[i].size()) ^ 0xFFFF;
+		});
+	for (size_t i = 0; i < nMessages; ++i)
+	{
+		size_t split = i % messages[i].size();
+		uint16_t splitChecksum = updateChecksum(updateChecksum(0xFFFF, messages[i].data(), split), messages[i].data() + split, messages[i].size() - split) ^ 0xFFFF;
+		if (tableChecksums[i] != referenceChecksums[i] || splitChecksum != referenceChecksums[i])
+		{
+			std::cout << "Checksum mismatch for message " << i << ": reference " << referenceChecksums[i] << ", table " << tableChecksums[i] << ", split " << splitChecksum << "\n";
+			passed = false;
+			break;
+		}
+	}
+
+	//hex decoding of the backscatter profiles
+	std::vector<int32_t> referenceValues(nMessages * nValuesPerMessage);
+	std::vector<int32_t> tableValues(nMessages * nValuesPerMessage);
+	double referenceHexTime = timeSeconds([&]()
+		{
+			for (size_t i = 0; i < nMessages; ++i)
+			{
+				const char *profile = messages[i].data() + nOtherCharactersPerMessage;
+				for (size_t j = 0; j < nValuesPerMessage; ++j)
+					referenceValues[i * nValuesPerMessage + j] = referenceHexTextToNumber(profile + j * 5);
+			}
+		});
+	double tableHexTime = timeSeconds([&]()
+		{
+			for (size_t i = 0; i < nMessages; ++i)
+				hexTextToNumbers(messages[i].data() + nOtherCharactersPerMessage, nValuesPerMessage, &tableValues[i * nValuesPerMessage]);
+		});
+	for (size_t i = 0; i < referenceValues.size(); ++i)
+	{
+		if (tableValues[i] != referenceValues[i])
+		{
+			std::cout << "Hex decoding mismatch for value " << i << ": reference " << referenceValues[i] << ", table " << tableValues[i] << "\n";
+			passed = false;
+			break;
+		}
+	}
+
+	//both decoders must reject characters that aren't lower case hex digits
+	for (const char *invalid : { "0000g", "ABCDE", "12 45", "-1234" })
+	{
+		bool referenceThrew = false;
+		bool tableThrew = false;
+		try
+		{
+			referenceHexTextToNumber(invalid);
+		}
+		catch (sci::err)
+		{
+			referenceThrew = true;
+		}
+		try
+		{
+			hexTextToNumber(invalid);
+		}
+		catch (sci::err)
+		{
+			tableThrew = true;
+		}
+		if (!referenceThrew || !tableThrew)
+		{
+			std::cout << "Invalid hex text \"" << invalid << "\" was not rejected by both decoders\n";
+			passed = false;
+		}
+	}
+
+	double checksumMegabytes = double(nMessages * messages[0].size()) / 1e6;
+	std::cout << nMessages << " messages of " << messages[0].size() << " bytes\n";
+	std::cout << "Checksum:    bit by bit " << checksumMegabytes / referenceChecksumTime << " MB/s, table " << checksumMegabytes / tableChecksumTime << " MB/s, "
+		<< referenceChecksumTime / tableChecksumTime << " times faster\n";
+	std::cout << "Hex decoding: per digit " << double(referenceValues.size()) / referenceHexTime / 1e6 << " million values/s, table " << double(tableValues.size()) / tableHexTime / 1e6 << " million values/s, "
+		<< referenceHexTime / tableHexTime << " times faster\n";
+	std::cout << (passed ? "The outputs are identical\n" : "FAILED: the outputs differ\n");
+	return passed ? 0 : 1;
+}
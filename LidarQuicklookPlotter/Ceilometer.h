@@ -119,6 +119,7 @@ public:
 	virtual bool hasData() const override { return m_hasData; }
 	std::vector<std::vector<sci::string>> groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles) const override;
 	virtual bool fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime) const override;
+	virtual bool getFileTimePeriod(const sci::string &fileName, sci::UtcTime &fileStart, sci::UtcTime &fileEnd) const override;
 	sci::string getName() const override
 	{
 		return sU("Ceilometer Processor");
@@ -0,0 +1,54 @@
+#pragma once
+#include<charconv>
+#include<string_view>
+#include<system_error>
+
+//Helpers for parsing text directly out of a character buffer, such as a MemoryMappedFile.
+//Numbers are converted with std::from_chars, which unlike stream extraction does not
+//consult the locale or allocate, so it is much faster for large text data files.
+//All functions take the current position by reference and advance it past whatever
+//they consumed.
+
+inline bool isBufferWhitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline void skipBufferWhitespace(const char *&position, const char *end)
+{
+	while (position != end && isBufferWhitespace(*position))
+		++position;
+}
+
+//Skips leading whitespace then parses a number in the same way as stream extraction
+//would. Returns false if no number could be parsed, in which case position is left at
+//the first non whitespace character.
+template<class T>
+bool parseBufferNumber(const char *&position, const char *end, T &value)
+{
+	skipBufferWhitespace(position, end);
+	const char *start = position;
+	//stream extraction accepts a leading +, from_chars does not
+	if (start != end && *start == '+')
+		++start;
+	std::from_chars_result result = std::from_chars(start, end, value);
+	if (result.ec != std::errc())
+		return false;
+	position = result.ptr;
+	return true;
+}
+
+//Returns the next line without its line ending and moves position to the start of the
+//following line. Both \n and \r\n line endings are accepted.
+inline std::string_view getBufferLine(const char *&position, const char *end)
+{
+	const char *lineStart = position;
+	while (position != end && *position != '\n')
+		++position;
+	const char *lineEnd = position;
+	if (position != end)
+		++position;
+	if (lineEnd != lineStart && *(lineEnd - 1) == '\r')
+		--lineEnd;
+	return std::string_view(lineStart, lineEnd - lineStart);
+}
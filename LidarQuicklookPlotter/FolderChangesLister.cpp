@@ -3,6 +3,13 @@
 #include<algorithm>
 #include"InstrumentProcessor.h"
 #include<map>
+#include"SnapshotDatabase.h"
+
+void FolderChangesLister::setSnapshotFile(const sci::string &snapshotFile)
+{
+	m_snapshotFile = snapshotFile;
+	m_snapshotDatabase = SnapshotDatabase::get(snapshotFile);
+}
 
 std::vector<sci::string> FolderChangesLister::getChanges(const InstrumentProcessor& processor, sci::UtcTime startTime, sci::UtcTime endTime) const
 {
@@ -10,30 +17,44 @@ std::vector<sci::string> FolderChangesLister::getChanges(const InstrumentProcess
 }
 
 std::vector<std::vector<sci::string>> FolderChangesLister::getChangesSeparatedByOutput(const InstrumentProcessor& processor, sci::UtcTime startTime, sci::UtcTime endTime) const
+{
+	std::vector<sci::string> changes;
+	return getChangesSeparatedByOutput(processor, startTime, endTime, changes);
+}
+
+std::vector<std::vector<sci::string>> FolderChangesLister::getChangesSeparatedByOutput(const InstrumentProcessor& processor, sci::UtcTime startTime, sci::UtcTime endTime, std::vector<sci::string> &changedFiles) const
 {
 	std::vector<std::pair<sci::string, sci::UtcTime>> folderContents = listFolderContents(processor, startTime, endTime);
-	std::vector<sci::string> changes = getChanges(folderContents, processor, startTime, endTime);
+	changedFiles = getChanges(folderContents, processor, startTime, endTime);
 	std::vector<sci::string> folderContentsNoTime(folderContents.size());
 	for (size_t i = 0; i < folderContentsNoTime.size(); ++i)
 		folderContentsNoTime[i] = folderContents[i].first;
 
-	return processor.groupInputFilesbyOutputFiles(changes, folderContentsNoTime);
+	return processor.groupInputFilesbyOutputFiles(changedFiles, folderContentsNoTime);
 }
 
 void FolderChangesLister::updateSnapshotFile(const sci::string& changedFile, sci::UtcTime checkedTime) const
 {
-	std::fstream fout;
-	fout.open(sci::nativeUnicode(getSnapshotFile()), std::ios::app);
-	fout << sci::toUtf8(changedFile) << ":" << checkedTime.getIso8601String(0, false, false, true) << "\n";
-	fout.close();
+	updateSnapshotFile(std::vector<sci::string>{ changedFile }, checkedTime);
+}
+
+//records all the files as one batch, so either they all get recorded or none do
+void FolderChangesLister::updateSnapshotFile(const std::vector<sci::string>& changedFiles, sci::UtcTime checkedTime) const
+{
+	std::vector<std::pair<sci::string, sci::UtcTime>> entries(changedFiles.size());
+	for (size_t i = 0; i < changedFiles.size(); ++i)
+		entries[i] = { changedFiles[i], checkedTime };
+	m_snapshotDatabase->update(entries);
 }
 
 void FolderChangesLister::clearSnapshotFile()
 {
+	//clear the old text snapshot too, otherwise it would get imported again
 	std::fstream fin;
 	fin.open(sci::nativeUnicode(m_snapshotFile), std::ios::out);
 	sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not clear the snapshot file ") + m_snapshotFile + sU(".")));
 	fin.close();
+	m_snapshotDatabase->clear();
 }
 
 
@@ -64,64 +85,20 @@ std::vector<std::pair<sci::string, sci::UtcTime>> FolderChangesLister::listFolde
 
 std::vector<sci::string> FolderChangesLister::getChanges(const std::vector<std::pair<sci::string, sci::UtcTime>>& folderContents, const InstrumentProcessor& processor, sci::UtcTime startTime, sci::UtcTime endTime) const
 {
-	std::map<sci::string, sci::UtcTime> lastProcessedTimeMap;
-
-	//read in the previously known about files and the last time they were processed
-	//we put them in a map to make searching fast and easy
-	std::fstream fin;
-	fin.open(sci::nativeUnicode(getSnapshotFile()), std::ios::in);
-	if (fin.is_open())
-	{
-		std::string line; //utf8
-		std::getline(fin, line);
-		size_t lineNumber = 1; //for debugging purposes, it will be optimised out in release builds
-		while (!fin.eof() && !fin.bad() && !fin.fail())
-		{
-			if (line.length() > 19)
-			{
-				//split the line into a filename and a date/time
-				sci::string filename = sci::fromUtf8(line.substr(0, line.length() - 20));
-				std::string timeString = line.substr(line.length() - 19);
-				//replace the date/time separators with spaces
-				for (size_t i = 0; i < timeString.length(); ++i)
-					if (timeString[i] == '-' || timeString[i] == ':' || timeString[i] == 'T')
-						timeString[i] = ' ';
-				//read in time from the time string
-				int hour;
-				int minute;
-				int second;
-				int year;
-				int month;
-				int dayOfMonth;
-				std::istringstream strm(timeString);
-				strm >> year >> month >> dayOfMonth >> hour >> minute >> second;
-				sci::UtcTime time(year, month, dayOfMonth, hour, minute, second);
-
-				//record the filename and time
-				lastProcessedTimeMap[filename] = time;
-
-				//get the next line
-				//line.clear(); //clear the line in case getline fails, then we have a zero length line and exit the loop
-				std::getline(fin, line);
-				++lineNumber;
-			}
-			else
-			{
-				std::getline(fin, line);
-			}
-		}
-		fin.close();
-	}
+	//the database holds the last time each previously known about file was processed. Pick up
+	//anything another process has recorded since we last looked.
+	m_snapshotDatabase->refresh();
+	const SnapshotDatabase &database = *m_snapshotDatabase;
 
-	//check the map to see if the files found exist in the map and if they do, if their
+	//check the database to see if the files found exist in it and if they do, if their
 	//processed date is before their modified date. 
 	std::vector<sci::string> changedFiles;
 	for (size_t i = 0; i < folderContents.size(); ++i)
 	{
-		auto processed = lastProcessedTimeMap.find(folderContents[i].first);
-		if (processed == lastProcessedTimeMap.end())
+		sci::UtcTime processedTime;
+		if (!database.find(folderContents[i].first, processedTime))
 			changedFiles.push_back(folderContents[i].first);
-		else if (processed->second < folderContents[i].second)
+		else if (processedTime < folderContents[i].second)
 			changedFiles.push_back(folderContents[i].first);
 	}
 
@@ -1,11 +1,13 @@
 #pragma once
 #include<string>
 #include<vector>
+#include<memory>
 #include<wx/dir.h>
 #include<svector/sstring.h>
 #include<svector/time.h>
 
 class InstrumentProcessor;
+class SnapshotDatabase;
 
 class FolderChangesLister
 {
@@ -16,19 +18,23 @@ public:
 		setSnapshotFile(snapshotFile);
 	}
 	void setDirectory(const sci::string &directory) { m_directory = directory; }
-	void setSnapshotFile(const sci::string &snapshotFile) { m_snapshotFile = snapshotFile; }
+	void setSnapshotFile(const sci::string &snapshotFile);
 	const sci::string &getDirectory() const { return m_directory; }
 	const sci::string &getSnapshotFile() const { return m_snapshotFile; }
 	std::vector<sci::string> getChanges(const InstrumentProcessor& processor, sci::UtcTime startTime, sci::UtcTime endTime) const;
 	virtual std::vector<std::vector<sci::string>> getChangesSeparatedByOutput(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime) const;
-	virtual void updateSnapshotFile(const sci::string &changedFile, sci::UtcTime checkedTime) const;
+	//as above, but also gives the files that actually changed, rather than all the files for the changed outputs
+	std::vector<std::vector<sci::string>> getChangesSeparatedByOutput(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime, std::vector<sci::string> &changedFiles) const;
+	void updateSnapshotFile(const sci::string &changedFile, sci::UtcTime checkedTime) const;
+	virtual void updateSnapshotFile(const std::vector<sci::string> &changedFiles, sci::UtcTime checkedTime) const;
 	virtual void clearSnapshotFile();
-	std::vector<std::pair<sci::string, sci::UtcTime>> listFolderContents(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime) const;
+	virtual std::vector<std::pair<sci::string, sci::UtcTime>> listFolderContents(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime) const;
 	virtual ~FolderChangesLister() {}
 private:
 	virtual std::vector<sci::string> getChanges(const std::vector<std::pair<sci::string, sci::UtcTime>>& folderContents, const InstrumentProcessor& processor, sci::UtcTime startTime, sci::UtcTime endTime) const;
 	sci::string m_directory;
 	sci::string m_snapshotFile;
+	std::shared_ptr<SnapshotDatabase> m_snapshotDatabase;
 };
 
 //This class lists folder changes simply assuming that if a file existed during the last snapshot
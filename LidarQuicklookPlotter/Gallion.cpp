@@ -1,8 +1,170 @@
 #include"Gallion.h"
 #include"ProgressReporter.h"
-#include<svector/sminimiser2.h>
 #include"AmfNc.h"
 #include"Lidar.h"
+#include<array>
+#include<cmath>
+#include<memory>
+
+//Closed form linear least squares fit of u, v and w to the radial velocities of a VAD scan, i.e.
+//solving equation (3) of the paper referenced in GalionAdvancedProcessor::readData. The
+//pseudo-inverse (A^T A)^-1 A^T only depends on the scan geometry, so it is calculated once per
+//scan and reused for every gate. Gates with some rays missing get their own pseudo-inverse from
+//the rays that are present.
+class VadSolver
+{
+public:
+	template<class PROFILES>
+	VadSolver(const PROFILES &profiles)
+	{
+		m_azimuths.resize(profiles.size());
+		m_elevations.resize(profiles.size());
+		m_a.resize(profiles.size());
+		for (size_t i = 0; i < profiles.size(); ++i)
+		{
+			degreeF azimuth = profiles[i].azimuth;
+			degreeF elevation = profiles[i].elevation;
+			m_azimuths[i] = azimuth;
+			m_elevations[i] = elevation;
+			m_a[i][0] = (sci::sin(azimuth) * sci::sin(degreeF(90) - elevation)).value<unitlessF::unit>();
+			m_a[i][1] = (sci::cos(azimuth) * sci::sin(degreeF(90) - elevation)).value<unitlessF::unit>();
+			m_a[i][2] = sci::cos(degreeF(90) - elevation).value<unitlessF::unit>();
+		}
+		m_solvable = pseudoInverse(std::vector<bool>(m_a.size(), true), m_pseudoInverse);
+	}
+	//true if the profiles point in the same directions as those this solver was created for, so
+	//the solver can be reused
+	template<class PROFILES>
+	bool hasGeometry(const PROFILES &profiles) const
+	{
+		if (profiles.size() != m_azimuths.size())
+			return false;
+		for (size_t i = 0; i < profiles.size(); ++i)
+			if (!(profiles[i].azimuth == m_azimuths[i] && profiles[i].elevation == m_elevations[i]))
+				return false;
+		return true;
+	}
+	//Fits every gate of the scan. The residual is the root mean square difference between the
+	//measured and fitted radial velocities and rSquared is the fraction of the variance in the
+	//radial velocities explained by the fit.
+	template<class PROFILES>
+	void solve(const PROFILES &profiles, std::vector<metrePerSecondF> &u, std::vector<metrePerSecondF> &v, std::vector<metrePerSecondF> &w,
+		std::vector<metrePerSecondF> &residuals, std::vector<unitlessF> &rSquareds) const
+	{
+		size_t nGates = profiles[0].velocity.size();
+		u.assign(nGates, std::numeric_limits<metrePerSecondF>::quiet_NaN());
+		v.assign(nGates, std::numeric_limits<metrePerSecondF>::quiet_NaN());
+		w.assign(nGates, std::numeric_limits<metrePerSecondF>::quiet_NaN());
+		residuals.assign(nGates, std::numeric_limits<metrePerSecondF>::quiet_NaN());
+		rSquareds.assign(nGates, std::numeric_limits<unitlessF>::quiet_NaN());
+
+		std::vector<double> radialVelocities(m_a.size());
+		std::vector<bool> use(m_a.size());
+		std::vector<std::array<double, 3>> gatePseudoInverse;
+		for (size_t i = 0; i < nGates; ++i)
+		{
+			size_t nUsed = 0;
+			for (size_t j = 0; j < m_a.size(); ++j)
+			{
+				radialVelocities[j] = profiles[j].velocity.size() > i ? profiles[j].velocity[i].value<metrePerSecondF::unit>() : std::numeric_limits<double>::quiet_NaN();
+				use[j] = !std::isnan(radialVelocities[j]);
+				if (use[j])
+					++nUsed;
+			}
+			const std::vector<std::array<double, 3>> *rayWeights = &m_pseudoInverse;
+			if (nUsed < m_a.size())
+			{
+				if (!pseudoInverse(use, gatePseudoInverse))
+					continue;
+				rayWeights = &gatePseudoInverse;
+			}
+			else if (!m_solvable)
+				continue;
+
+			double uvw[3]{ 0.0, 0.0, 0.0 };
+			double meanRadialVelocity = 0.0;
+			for (size_t j = 0; j < m_a.size(); ++j)
+			{
+				if (!use[j])
+					continue;
+				for (size_t k = 0; k < 3; ++k)
+					uvw[k] += (*rayWeights)[j][k] * radialVelocities[j];
+				meanRadialVelocity += radialVelocities[j];
+			}
+			meanRadialVelocity /= double(nUsed);
+
+			double residualSumOfSquares = 0.0;
+			double totalSumOfSquares = 0.0;
+			for (size_t j = 0; j < m_a.size(); ++j)
+			{
+				if (!use[j])
+					continue;
+				double residual = radialVelocities[j] - (m_a[j][0] * uvw[0] + m_a[j][1] * uvw[1] + m_a[j][2] * uvw[2]);
+				residualSumOfSquares += residual * residual;
+				totalSumOfSquares += (radialVelocities[j] - meanRadialVelocity) * (radialVelocities[j] - meanRadialVelocity);
+			}
+
+			u[i] = metrePerSecondF(metrePerSecondF::valueType(uvw[0]));
+			v[i] = metrePerSecondF(metrePerSecondF::valueType(uvw[1]));
+			w[i] = metrePerSecondF(metrePerSecondF::valueType(uvw[2]));
+			residuals[i] = metrePerSecondF(metrePerSecondF::valueType(std::sqrt(residualSumOfSquares / double(nUsed))));
+			if (totalSumOfSquares > 0.0)
+				rSquareds[i] = unitlessF(unitlessF::valueType(1.0 - residualSumOfSquares / totalSumOfSquares));
+		}
+	}
+private:
+	//Calculates (A^T A)^-1 A^T using just the rays flagged in use, stored transposed so row j
+	//holds the contribution of ray j. Returns false if the rays don't constrain all of u, v and w.
+	bool pseudoInverse(const std::vector<bool> &use, std::vector<std::array<double, 3>> &result) const
+	{
+		//the normal matrix A^T A
+		double n[3][3]{ {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0} };
+		size_t nUsed = 0;
+		for (size_t i = 0; i < m_a.size(); ++i)
+		{
+			if (!use[i])
+				continue;
+			++nUsed;
+			for (size_t j = 0; j < 3; ++j)
+				for (size_t k = 0; k < 3; ++k)
+					n[j][k] += m_a[i][j] * m_a[i][k];
+		}
+		if (nUsed < 3)
+			return false;
+
+		//invert it via the adjugate, it is symmetric so the adjugate is too
+		double inverse[3][3];
+		inverse[0][0] = n[1][1] * n[2][2] - n[1][2] * n[2][1];
+		inverse[0][1] = n[0][2] * n[2][1] - n[0][1] * n[2][2];
+		inverse[0][2] = n[0][1] * n[1][2] - n[0][2] * n[1][1];
+		inverse[1][1] = n[0][0] * n[2][2] - n[0][2] * n[2][0];
+		inverse[1][2] = n[0][2] * n[1][0] - n[0][0] * n[1][2];
+		inverse[2][2] = n[0][0] * n[1][1] - n[0][1] * n[1][0];
+		inverse[1][0] = inverse[0][1];
+		inverse[2][0] = inverse[0][2];
+		inverse[2][1] = inverse[1][2];
+		double determinant = n[0][0] * inverse[0][0] + n[0][1] * inverse[1][0] + n[0][2] * inverse[2][0];
+		//the elements of A are at most 1, so compare with the scale of A^T A to spot a singular matrix
+		double scale = n[0][0] + n[1][1] + n[2][2];
+		if (!(std::abs(determinant) > 1e-9 * scale * scale * scale))
+			return false;
+		for (size_t j = 0; j < 3; ++j)
+			for (size_t k = 0; k < 3; ++k)
+				inverse[j][k] /= determinant;
+
+		result.assign(m_a.size(), std::array<double, 3>{ 0.0, 0.0, 0.0 });
+		for (size_t i = 0; i < m_a.size(); ++i)
+			if (use[i])
+				for (size_t j = 0; j < 3; ++j)
+					result[i][j] = inverse[j][0] * m_a[i][0] + inverse[j][1] * m_a[i][1] + inverse[j][2] * m_a[i][2];
+		return true;
+	}
+	std::vector<degreeF> m_azimuths;
+	std::vector<degreeF> m_elevations;
+	std::vector<std::array<double, 3>> m_a; //the A matrix from equation 3, one row per ray
+	std::vector<std::array<double, 3>> m_pseudoInverse; //for when all rays are present
+	bool m_solvable;
+};
 
 void readData(const std::vector<sci::string>& inputFilenames, const Platform& platform, ProgressReporter& progressReporter)
 {
@@ -262,6 +424,8 @@ void GalionAdvancedProcessor::readData(const std::vector<sci::string>& inputFile
 		m_windU.resize(nVad);
 		m_windV.resize(nVad);
 		m_windW.resize(nVad);
+		m_windResiduals.resize(nVad);
+		m_windRSquareds.resize(nVad);
 		m_windStartTimes.resize(nVad);
 		m_windEndTimes.resize(nVad);
 		m_windHeightInterval.resize(nVad);
@@ -273,70 +437,21 @@ void GalionAdvancedProcessor::readData(const std::vector<sci::string>& inputFile
 			if (isVad[i])
 			{
 				sci::GridData<Profile, 2 >& scans = m_profiles[i];
+				//the scans of a pattern usually point in exactly the same directions, so we only
+				//need a new solver when that changes
+				std::unique_ptr<VadSolver> solver;
 				for (size_t j = 0; j < scans.shape()[0]; ++j)
 				{
 					auto profiles = scans[j]; // should be a 1d view into the scans grid
 					++windProfileIndex;
-					m_windU[windProfileIndex].resize(profiles[0].velocity.size());
-					m_windV[windProfileIndex].resize(profiles[0].velocity.size());
-					m_windW[windProfileIndex].resize(profiles[0].velocity.size());
 					m_windStartTimes[windProfileIndex] = profiles[0].time;
 					m_windEndTimes[windProfileIndex] = profiles[profiles.size()-1].time;
 					m_windHeightInterval[windProfileIndex] = m_rangeInterval *sci::sin( profiles[0].elevation);
 
-					//The A matrix from equation 3. Row is the first index, column is the second
-					sci::GridData<unitlessF, 2> A({ profiles.size(), 3 });
-					for (size_t k = 0; k < A.shape()[0]; ++k)
-					{
-						degreeF azimuth = profiles[k].azimuth;
-						degreeF elevation = profiles[k].elevation;
-						A[k][0] = sci::sin(azimuth) * sci::sin(degreeF(90) - elevation);
-						A[k][1] = sci::cos(azimuth) * sci::sin(degreeF(90) - elevation);
-						A[k][2] = sci::cos(degreeF(90) - elevation);
-					}
-
-					//lamda function to stop the minimisation routine as needed - note that it just never
-					//stops as we instead limit the iterations
-					auto stopper = [&](const sci::GridData<metrePerSecondF, 1>&, metreSquaredPerSecondSquaredF residual)
-					{
-						return residual == metreSquaredPerSecondSquaredF(0);
-					};
-
-					//test
-					sci::GridData<metrePerSecondF, 1> testVelocities(3);
-					testVelocities[0] = metrePerSecondF(10);
-					testVelocities[1] = metrePerSecondF(10);
-					testVelocities[2] = metrePerSecondF(1);
-					sci::GridData<metrePerSecondF, 1> uvw(3, metrePerSecondF(0)); //initial guess, all zeros
-					sci::GridData<metrePerSecondF, 1> uvwScale(3);
-					uvwScale[0] = metrePerSecondF(1);
-					uvwScale[1] = metrePerSecondF(1);
-					uvwScale[2] = metrePerSecondF(0.1);
-					sci::GridData<metrePerSecondF, 1> dopplerVelocities(profiles.size(), metrePerSecondF(0));
-					for (size_t l = 0; l < A.shape()[0]; ++l)
-						for (size_t k = 0; k < A.shape()[1]; ++k)
-							dopplerVelocities[l] += A[l][k] * testVelocities[k];
-					sci::minimisePowell(A, dopplerVelocities, stopper, uvw, uvwScale, 9, 9);
-
-
-
-					for (size_t l = 0; l < profiles[0].velocity.size(); ++l)
-					{
-						sci::GridData<metrePerSecondF, 1> dopplerVelocities(profiles.size());
-						for (size_t k = 0; k < profiles.size(); ++k)
-							dopplerVelocities[k] = profiles[k].velocity[l];
-						sci::GridData<metrePerSecondF, 1> uvw(3, metrePerSecondF(0)); //initial guess, all zeros
-						sci::GridData<metrePerSecondF, 1> uvwScale(3);
-						uvwScale[0] = metrePerSecondF(10);
-						uvwScale[1] = metrePerSecondF(10);
-						uvwScale[2] = metrePerSecondF(1);
-
-
-						sci::minimisePowell(A, dopplerVelocities, stopper, uvw, uvwScale, 9, 9);
-						m_windU[windProfileIndex][l] = uvw[0];
-						m_windV[windProfileIndex][l] = uvw[1];
-						m_windW[windProfileIndex][l] = uvw[2];
-					}
+					if (!solver || !solver->hasGeometry(profiles))
+						solver.reset(new VadSolver(profiles));
+					solver->solve(profiles, m_windU[windProfileIndex], m_windV[windProfileIndex], m_windW[windProfileIndex],
+						m_windResiduals[windProfileIndex], m_windRSquareds[windProfileIndex]);
 
 				}
 			}
@@ -568,6 +683,8 @@ void GalionAdvancedProcessor::writeWindProfilesToNc(const sci::string& directory
 		sci::GridData<metrePerSecondF, 2> windSpeeds({ m_windStartTimes.size(), m_windU[0].size() }, std::numeric_limits<metrePerSecondF>::quiet_NaN());
 		sci::GridData<degreeF, 2> windDirections({ m_windStartTimes.size(), m_windU[0].size() }, std::numeric_limits<degreeF>::quiet_NaN());
 		sci::GridData<uint8_t, 2> windFlags({ m_windStartTimes.size(), m_windU[0].size() }, lidarMissingDataFlag);
+		sci::GridData<metrePerSecondF, 2> fitResiduals({ m_windStartTimes.size(), m_windU[0].size() }, std::numeric_limits<metrePerSecondF>::quiet_NaN());
+		sci::GridData<unitlessF, 2> fitRSquareds({ m_windStartTimes.size(), m_windU[0].size() }, std::numeric_limits<unitlessF>::quiet_NaN());
 
 		//copy data from profiles to the grid
 		sci::assertThrow(platform.getFixed(), sci::err(sci::SERR_USER, 0, sU("Cannot yet deal with wind profiles on moving platforms")));
@@ -587,6 +704,8 @@ void GalionAdvancedProcessor::writeWindProfilesToNc(const sci::string& directory
 				altitudes[i][j] = m_windHeightInterval[i] * unitlessF(j - 0.5)+altitude;
 				windSpeeds[i][j] = sci::sqrt(m_windU[i][j] * m_windU[i][j] + m_windV[i][j] * m_windV[i][j]);
 				windDirections[i][j] = -sci::atan2(m_windV[i][j], m_windU[i][j]) + degreeF(180) + azimuth.m_mean;
+				fitResiduals[i][j] = m_windResiduals[i][j];
+				fitRSquareds[i][j] = m_windRSquareds[i][j];
 			}
 		}
 		//ensure we are on 0-360 range, not -180-180 range for wind directions
@@ -605,6 +724,8 @@ void GalionAdvancedProcessor::writeWindProfilesToNc(const sci::string& directory
 		AmfNcAltitudeVariable altitudeVariable(file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, altitudes, FeatureType::timeSeriesProfile);
 		AmfNcVariable<metrePerSecondF> windSpeedVariable(sU("wind_speed"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, sU("Mean Wind Speed"), sU("wind_speed"), windSpeeds, true, coordinates, cellMethods, windFlags);
 		AmfNcVariable<degreeF> windDirectionVariable(sU("wind_from_direction"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, sU("Wind From Direction"), sU("wind_from_direction"), windDirections, true, coordinates, cellMethods, windFlags);
+		AmfNcVariable<metrePerSecondF> fitResidualVariable(sU("radial_velocity_fit_residual"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, sU("Root Mean Square Difference Between Measured and Fitted Radial Velocities"), sU(""), fitResiduals, true, coordinates, cellMethods, windFlags);
+		AmfNcVariable<unitlessF> fitRSquaredVariable(sU("radial_velocity_fit_r_squared"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, sU("Fraction of Radial Velocity Variance Explained by the Wind Fit"), sU(""), fitRSquareds, true, coordinates, cellMethods, windFlags);
 		//AmfNcFlagVariable windFlagVariable(sU("qc_flag"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension });
 
 		file.writeTimeAndLocationData(platform);
@@ -612,6 +733,8 @@ void GalionAdvancedProcessor::writeWindProfilesToNc(const sci::string& directory
 		file.write(altitudeVariable, altitudes);
 		file.write(windSpeedVariable, windSpeeds);
 		file.write(windDirectionVariable, windDirections);
+		file.write(fitResidualVariable, fitResiduals);
+		file.write(fitRSquaredVariable, fitRSquareds);
 		//file.write(windFlagVariable, windFlags);
 	}
 }
@@ -711,13 +834,13 @@ void GalionAdvancedProcessor::writeScanToNc(const sci::string& directory, size_t
 		{
 			for (size_t k = 0; k < shape[2]; ++k)
 			{
-				if (snrsPlusOne[i][j][k] < unitlessF(2))
+				if (snrsPlusOne[i][j][k] < unitlessF(float(processingOptions.lidarSnrFlagThreshold1 + 1.0)))
 					dopplerVelocityFlags[i][j][k] = lidarSnrBelow1Flag;
-				else if (snrsPlusOne[i][j][k] < unitlessF(3))
+				else if (snrsPlusOne[i][j][k] < unitlessF(float(processingOptions.lidarSnrFlagThreshold2 + 1.0)))
 					dopplerVelocityFlags[i][j][k] = lidarSnrBelow2Flag;
-				else if (snrsPlusOne[i][j][k] < unitlessF(4))
+				else if (snrsPlusOne[i][j][k] < unitlessF(float(processingOptions.lidarSnrFlagThreshold3 + 1.0)))
 					dopplerVelocityFlags[i][j][k] = lidarSnrBelow3Flag;
-				else if (sci::abs<metrePerSecondF>(instrumentRelativeDopplerVelocities[i][j][k]) > metrePerSecondF(19))
+				else if (sci::abs<metrePerSecondF>(instrumentRelativeDopplerVelocities[i][j][k]) > metrePerSecondF(float(processingOptions.lidarDopplerFlagLimit)))
 					dopplerVelocityFlags[i][j][k] = lidarDopplerOutOfRangeFlag;
 				else
 					dopplerVelocityFlags[i][j][k] = lidarGoodDataFlag;
@@ -860,7 +983,7 @@ void GalionAdvancedProcessor::writeScanToNc(const sci::string& directory, size_t
 	//AmfNcVariable<metrePerSecondF, decltype(motionCorrectedDopplerVelocities), true> dopplerVariableEarthFrame(sU("radial_velocity_of_scatterers_away_from_instrument_earth_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Radial Velocity of Scatterers Away From Instrument Earth Frame"), sU(""), motionCorrectedDopplerVelocities, true, coordinates, cellMethodsData);
 	//AmfNcVariable<perSteradianPerMetreF> backscatterVariable(sU("attenuated_aerosol_backscatter_coefficient"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & rangeIndexDimension, & angleIndexDimension }, sU("Attenuated Aerosol Backscatter Coefficient"), sU(""), backscatters, true, coordinates, cellMethodsData, backscatterFlags);
 	AmfNcVariable<unitlessF> snrsPlusOneVariable(sU("signal_to_noise_ratio_plus_1"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & rangeIndexDimension, & angleIndexDimension }, sU("Signal to Noise Ratio: SNR+1"), sU(""), snrsPlusOne, true, coordinates, cellMethodsData, sci::GridData<uint8_t, 0>(1));
-	AmfNcFlagVariable dopplerFlagVariable(sU("qc_flag_radial_velocity_of_scatterers_away_from_instrument"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & rangeIndexDimension, & angleIndexDimension });
+	AmfNcFlagVariable dopplerFlagVariable(sU("qc_flag_radial_velocity_of_scatterers_away_from_instrument"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & rangeIndexDimension, & angleIndexDimension });
 	//AmfNcFlagVariable backscatterFlagVariable(sU("qc_flag_backscatter"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & rangeIndexDimension, & angleIndexDimension });
 
 	file.writeTimeAndLocationData(platform);
@@ -208,6 +208,8 @@ private:
 	std::vector<std::vector<metrePerSecondF>> m_windU;
 	std::vector<std::vector<metrePerSecondF>> m_windV;
 	std::vector<std::vector<metrePerSecondF>> m_windW;
+	std::vector<std::vector<metrePerSecondF>> m_windResiduals; //rms difference between the measured and fitted radial velocities
+	std::vector<std::vector<unitlessF>> m_windRSquareds; //fraction of the radial velocity variance explained by the fit
 	sci::GridData<sci::UtcTime, 1> m_windStartTimes;
 	sci::GridData<sci::UtcTime, 1> m_windEndTimes;
 	std::vector<metreF>m_windHeightInterval;
@@ -0,0 +1,440 @@
+#include"HplFileCache.h"
+#include<svector/serr.h>
+#include<fstream>
+#include<mutex>
+#include<thread>
+#include<algorithm>
+#include<sstream>
+#include<iomanip>
+#include<cstdint>
+
+//Increase this whenever the layout of the cache files changes so that old cache files are ignored
+const uint32_t g_hplCacheVersion = 1;
+const char g_hplCacheMagic[8] = { 'H', 'P', 'L', 'C', 'A', 'C', 'H', 'E' };
+
+//only one thread may trim the cache directory at once
+std::mutex g_hplCacheTrimMutex;
+
+template<class T>
+void writeBinary(std::ostream &stream, const T &value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "writeBinary can only be used with trivially copyable types.");
+	stream.write((const char*)&value, sizeof(T));
+}
+
+template<class T>
+void readBinary(std::istream &stream, T &value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "readBinary can only be used with trivially copyable types.");
+	stream.read((char*)&value, sizeof(T));
+}
+
+void writeBinary(std::ostream &stream, const sci::string &value)
+{
+	writeBinary(stream, uint64_t(value.length()));
+	stream.write((const char*)value.data(), value.length() * sizeof(sci::string::value_type));
+}
+
+void readBinary(std::istream &stream, sci::string &value)
+{
+	uint64_t length = 0;
+	readBinary(stream, length);
+	//a corrupt file could give a silly length, don't try to allocate it
+	if (!stream || length > 32768)
+	{
+		stream.setstate(std::ios::failbit);
+		return;
+	}
+	value.resize(length);
+	stream.read((char*)value.data(), length * sizeof(sci::string::value_type));
+}
+
+//the size and modification time are what tell us whether the hpl file has changed since it was cached
+bool getFileStamp(const sci::string &filename, uint64_t &size, int64_t &modificationTime)
+{
+	std::error_code error;
+	std::filesystem::path path(sci::nativeUnicode(filename));
+	size = std::filesystem::file_size(path, error);
+	if (error)
+		return false;
+	modificationTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+	return !error;
+}
+
+HplFileCache::HplFileCache(const sci::string &directory, size_t maxBytes)
+	:m_directory(sci::nativeUnicode(directory)), m_maxBytes(maxBytes)
+{
+}
+
+std::filesystem::path HplFileCache::getCachePath(const sci::string &hplFilename) const
+{
+	//name the cache file from a hash of the full path of the hpl file. The full path is also
+	//stored in the cache file, so a hash collision just gives a cache miss.
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << uint64_t(std::hash<sci::string>()(hplFilename)) << ".hplcache";
+	return m_directory / name.str();
+}
+
+bool HplFileCache::load(const sci::string &hplFilename, HplHeader &header, std::vector<HplProfile> &profiles) const
+{
+	try
+	{
+		uint64_t size;
+		int64_t modificationTime;
+		if (!getFileStamp(hplFilename, size, modificationTime))
+			return false;
+
+		std::filesystem::path cachePath = getCachePath(hplFilename);
+		std::ifstream stream(cachePath, std::ios::in | std::ios::binary);
+		if (!stream.is_open())
+			return false;
+
+		char magic[8];
+		uint32_t version = 0;
+		uint64_t cachedSize = 0;
+		int64_t cachedModificationTime = 0;
+		sci::string cachedFilename;
+		stream.read(magic, 8);
+		readBinary(stream, version);
+		readBinary(stream, cachedSize);
+		readBinary(stream, cachedModificationTime);
+		readBinary(stream, cachedFilename);
+		if (!stream || !std::equal(magic, magic + 8, g_hplCacheMagic) || version != g_hplCacheVersion
+			|| cachedSize != size || cachedModificationTime != modificationTime || cachedFilename != hplFilename)
+			return false;
+
+		readHeader(stream, header);
+		uint64_t nProfiles = 0;
+		readBinary(stream, nProfiles);
+		//every profile takes up far more than one byte of the hpl file, so this catches corrupt counts
+		if (!stream || nProfiles > size)
+			return false;
+		profiles.resize(nProfiles);
+		std::vector<float> buffer;
+		std::vector<uint32_t> gateBuffer;
+		for (size_t i = 0; i < profiles.size(); ++i)
+		{
+			readProfile(stream, profiles[i], buffer, gateBuffer);
+			if (!stream)
+			{
+				profiles.clear();
+				return false;
+			}
+		}
+		stream.close();
+
+		//touch the cache file so that trimming removes the least recently used files first
+		std::error_code error;
+		std::filesystem::last_write_time(cachePath, std::filesystem::file_time_type::clock::now(), error);
+		return true;
+	}
+	catch (...)
+	{
+		profiles.clear();
+		return false;
+	}
+}
+
+void HplFileCache::store(const sci::string &hplFilename, const HplHeader &header, const std::vector<HplProfile> &profiles) const
+{
+	try
+	{
+		uint64_t size;
+		int64_t modificationTime;
+		if (!getFileStamp(hplFilename, size, modificationTime))
+			return;
+
+		std::error_code error;
+		std::filesystem::create_directories(m_directory, error);
+		if (error)
+			return;
+
+		//write to a temporary file and then rename it, so a half written file can never be loaded
+		std::filesystem::path cachePath = getCachePath(hplFilename);
+		std::ostringstream temporaryExtension;
+		temporaryExtension << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+		std::filesystem::path temporaryPath = cachePath;
+		temporaryPath += temporaryExtension.str();
+		{
+			std::ofstream stream(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!stream.is_open())
+				return;
+			stream.write(g_hplCacheMagic, 8);
+			writeBinary(stream, g_hplCacheVersion);
+			writeBinary(stream, size);
+			writeBinary(stream, modificationTime);
+			writeBinary(stream, hplFilename);
+			writeHeader(stream, header);
+			writeBinary(stream, uint64_t(profiles.size()));
+			std::vector<float> buffer;
+			std::vector<uint32_t> gateBuffer;
+			for (size_t i = 0; i < profiles.size(); ++i)
+				writeProfile(stream, profiles[i], buffer, gateBuffer);
+			stream.close();
+			if (!stream)
+			{
+				std::filesystem::remove(temporaryPath, error);
+				return;
+			}
+		}
+		std::filesystem::rename(temporaryPath, cachePath, error);
+		if (error)
+		{
+			std::filesystem::remove(temporaryPath, error);
+			return;
+		}
+	}
+	catch (...)
+	{
+		return;
+	}
+	trim();
+}
+
+void HplFileCache::trim() const
+{
+	std::lock_guard<std::mutex> lock(g_hplCacheTrimMutex);
+	try
+	{
+		struct CacheFile
+		{
+			std::filesystem::path path;
+			std::filesystem::file_time_type lastUsed;
+			uintmax_t size;
+		};
+		std::vector<CacheFile> cacheFiles;
+		uintmax_t totalSize = 0;
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(m_directory))
+		{
+			if (!entry.is_regular_file() || entry.path().extension() != ".hplcache")
+				continue;
+			cacheFiles.push_back({ entry.path(), entry.last_write_time(), entry.file_size() });
+			totalSize += cacheFiles.back().size;
+		}
+		if (totalSize <= m_maxBytes)
+			return;
+
+		std::sort(cacheFiles.begin(), cacheFiles.end(), [](const CacheFile &a, const CacheFile &b) { return a.lastUsed < b.lastUsed; });
+		for (size_t i = 0; i < cacheFiles.size() && totalSize > m_maxBytes; ++i)
+		{
+			std::error_code error;
+			if (std::filesystem::remove(cacheFiles[i].path, error))
+				totalSize -= cacheFiles[i].size;
+		}
+	}
+	catch (...)
+	{
+	}
+}
+
+void HplFileCache::writeHeader(std::ostream &stream, const HplHeader &header)
+{
+	writeBinary(stream, header.filename);
+	writeBinary(stream, uint32_t(header.systemId));
+	writeBinary(stream, uint64_t(header.nGates));
+	writeBinary(stream, header.rangeGateLength.value<metreF>());
+	writeBinary(stream, uint64_t(header.pointsPerGate));
+	writeBinary(stream, uint64_t(header.pulsesPerRay));
+	writeBinary(stream, uint64_t(header.nRays));
+	writeBinary(stream, int32_t(header.scanType));
+	writeBinary(stream, header.focusRange.value<metreF>());
+	writeBinary(stream, double(second(header.startTime - sci::UtcTime(1970, 1, 1, 0, 0, 0)).value<second>()));
+	writeBinary(stream, header.dopplerResolution.value<metrePerSecondF>());
+	writeBinary(stream, uint8_t(header.oldType ? 1 : 0));
+}
+
+void HplFileCache::readHeader(std::istream &stream, HplHeader &header)
+{
+	uint32_t systemId = 0;
+	uint64_t nGates = 0;
+	metreF::valueType rangeGateLength = 0;
+	uint64_t pointsPerGate = 0;
+	uint64_t pulsesPerRay = 0;
+	uint64_t nRays = 0;
+	int32_t scanType = 0;
+	metreF::valueType focusRange = 0;
+	double startTime = 0;
+	metrePerSecondF::valueType dopplerResolution = 0;
+	uint8_t oldType = 0;
+
+	readBinary(stream, header.filename);
+	readBinary(stream, systemId);
+	readBinary(stream, nGates);
+	readBinary(stream, rangeGateLength);
+	readBinary(stream, pointsPerGate);
+	readBinary(stream, pulsesPerRay);
+	readBinary(stream, nRays);
+	readBinary(stream, scanType);
+	readBinary(stream, focusRange);
+	readBinary(stream, startTime);
+	readBinary(stream, dopplerResolution);
+	readBinary(stream, oldType);
+
+	header.systemId = systemId;
+	header.nGates = size_t(nGates);
+	header.rangeGateLength = metreF(rangeGateLength);
+	header.pointsPerGate = size_t(pointsPerGate);
+	header.pulsesPerRay = size_t(pulsesPerRay);
+	header.nRays = size_t(nRays);
+	header.scanType = ScanType(scanType);
+	header.focusRange = metreF(focusRange);
+	header.startTime = sci::UtcTime(1970, 1, 1, 0, 0, 0) + second(startTime);
+	header.dopplerResolution = metrePerSecondF(dopplerResolution);
+	header.oldType = oldType != 0;
+}
+
+//The gate arrays are converted into buffers of plain values and written in one go, which is
+//much quicker than writing each value separately
+template<class T>
+void writeBinaryArray(std::ostream &stream, const sci::GridData<T, 1> &array, std::vector<float> &buffer)
+{
+	buffer.resize(array.size());
+	for (size_t i = 0; i < array.size(); ++i)
+		buffer[i] = float(array[i].template value<T>());
+	stream.write((const char*)buffer.data(), buffer.size() * sizeof(float));
+}
+
+template<class T>
+void readBinaryArray(std::istream &stream, sci::GridData<T, 1> &array, std::vector<float> &buffer)
+{
+	buffer.resize(array.size());
+	stream.read((char*)buffer.data(), buffer.size() * sizeof(float));
+	for (size_t i = 0; i < array.size(); ++i)
+		array[i] = T(buffer[i]);
+}
+
+void HplFileCache::writeProfile(std::ostream &stream, const HplProfile &profile, std::vector<float> &buffer, std::vector<uint32_t> &gateBuffer)
+{
+	writeBinary(stream, double(second(profile.m_time - sci::UtcTime(1970, 1, 1, 0, 0, 0)).value<second>()));
+	writeBinary(stream, profile.m_azimuth.value<degreeF>());
+	writeBinary(stream, profile.m_elevation.value<degreeF>());
+	writeBinary(stream, profile.m_pitch.value<degreeF>());
+	writeBinary(stream, profile.m_roll.value<degreeF>());
+	writeBinary(stream, uint64_t(profile.nGates()));
+	gateBuffer.resize(profile.nGates());
+	for (size_t i = 0; i < gateBuffer.size(); ++i)
+		gateBuffer[i] = uint32_t(profile.m_gates[i]);
+	stream.write((const char*)gateBuffer.data(), gateBuffer.size() * sizeof(uint32_t));
+	writeBinaryArray(stream, profile.m_dopplerVelocities, buffer);
+	writeBinaryArray(stream, profile.m_intensities, buffer);
+	writeBinaryArray(stream, profile.m_betas, buffer);
+}
+
+void HplFileCache::readProfile(std::istream &stream, HplProfile &profile, std::vector<float> &buffer, std::vector<uint32_t> &gateBuffer)
+{
+	double time = 0;
+	degreeF::valueType azimuth = 0;
+	degreeF::valueType elevation = 0;
+	degreeF::valueType pitch = 0;
+	degreeF::valueType roll = 0;
+	uint64_t nGates = 0;
+	readBinary(stream, time);
+	readBinary(stream, azimuth);
+	readBinary(stream, elevation);
+	readBinary(stream, pitch);
+	readBinary(stream, roll);
+	readBinary(stream, nGates);
+	//hpl files never have anywhere near this many gates, so this catches corrupt counts
+	if (!stream || nGates > 100000)
+	{
+		stream.setstate(std::ios::failbit);
+		return;
+	}
+
+	profile.m_time = sci::UtcTime(1970, 1, 1, 0, 0, 0) + second(time);
+	profile.m_azimuth = degreeF(azimuth);
+	profile.m_elevation = degreeF(elevation);
+	profile.m_pitch = degreeF(pitch);
+	profile.m_roll = degreeF(roll);
+	profile.m_gates.resize(size_t(nGates));
+	profile.m_dopplerVelocities.resize(size_t(nGates));
+	profile.m_intensities.resize(size_t(nGates));
+	profile.m_betas.resize(size_t(nGates));
+
+	gateBuffer.resize(size_t(nGates));
+	stream.read((char*)gateBuffer.data(), gateBuffer.size() * sizeof(uint32_t));
+	for (size_t i = 0; i < gateBuffer.size(); ++i)
+		profile.m_gates[i] = gateBuffer[i];
+	readBinaryArray(stream, profile.m_dopplerVelocities, buffer);
+	readBinaryArray(stream, profile.m_intensities, buffer);
+	readBinaryArray(stream, profile.m_betas, buffer);
+}
+
+SharedHplMemoryCache &SharedHplMemoryCache::getInstance()
+{
+	static SharedHplMemoryCache cache;
+	return cache;
+}
+
+SharedHplMemoryCache::SharedHplMemoryCache()
+	:m_bytes(0), m_maxBytes(0)
+{
+}
+
+void SharedHplMemoryCache::setMaxBytes(size_t maxBytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxBytes = maxBytes;
+	evict();
+}
+
+std::shared_ptr<const ParsedHplFile> SharedHplMemoryCache::find(const sci::string &hplFilename)
+{
+	if (!isEnabled())
+		return nullptr;
+	uint64_t size;
+	int64_t modificationTime;
+	if (!getFileStamp(hplFilename, size, modificationTime))
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto entry = m_entries.find(hplFilename);
+	if (entry == m_entries.end())
+		return nullptr;
+	if (entry->second.size != size || entry->second.modificationTime != modificationTime)
+	{
+		erase(entry);
+		return nullptr;
+	}
+	m_recentlyUsed.splice(m_recentlyUsed.begin(), m_recentlyUsed, entry->second.recentlyUsedPosition);
+	return entry->second.parsedFile;
+}
+
+void SharedHplMemoryCache::store(const sci::string &hplFilename, std::shared_ptr<const ParsedHplFile> parsedFile)
+{
+	if (!isEnabled())
+		return;
+	uint64_t size;
+	int64_t modificationTime;
+	if (!getFileStamp(hplFilename, size, modificationTime))
+		return;
+
+	//roughly the memory used by the profiles, the header is negligible
+	size_t bytes = sizeof(ParsedHplFile) + parsedFile->profiles.size() * sizeof(HplProfile);
+	for (size_t i = 0; i < parsedFile->profiles.size(); ++i)
+		bytes += parsedFile->profiles[i].nGates() * (sizeof(size_t) + sizeof(metrePerSecondF) + sizeof(unitlessF) + sizeof(perSteradianPerMetreF));
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto existing = m_entries.find(hplFilename);
+	if (existing != m_entries.end())
+		erase(existing);
+	m_recentlyUsed.push_front(hplFilename);
+	m_entries[hplFilename] = { parsedFile, size, modificationTime, bytes, m_recentlyUsed.begin() };
+	m_bytes += bytes;
+	evict();
+}
+
+//must be called with m_mutex locked
+void SharedHplMemoryCache::erase(std::map<sci::string, Entry>::iterator entry)
+{
+	m_bytes -= entry->second.bytes;
+	m_recentlyUsed.erase(entry->second.recentlyUsedPosition);
+	m_entries.erase(entry);
+}
+
+//must be called with m_mutex locked
+void SharedHplMemoryCache::evict()
+{
+	while (m_bytes > m_maxBytes && m_recentlyUsed.size() > 0)
+		erase(m_entries.find(m_recentlyUsed.back()));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include<svector/sstring.h>
+#include<vector>
+#include<filesystem>
+#include<iostream>
+#include<memory>
+#include<map>
+#include<list>
+#include<mutex>
+#include<atomic>
+#include<cstdint>
+#include"HplHeader.h"
+#include"HplProfile.h"
+
+//the contents of one hpl file before being merged into a processor's arrays
+struct ParsedHplFile
+{
+	HplHeader header;
+	std::vector<HplProfile> profiles;
+};
+
+//A directory of binary files holding the already parsed contents of hpl files. Loading a
+//parsed file from here is much quicker than parsing the text again, which matters because
+//the whole day's files get reread each time new data arrives.
+//Each hpl file gets its own cache file, which records the path, size and modification
+//time of the hpl file. If any of these don't match then the cache file is ignored. When
+//the cache grows beyond maxBytes the least recently used cache files are deleted.
+//Failing to read or write the cache is never an error, we just fall back to parsing the
+//text. It is safe to load and store from several threads at once.
+class HplFileCache
+{
+public:
+	HplFileCache(const sci::string &directory, size_t maxBytes);
+	bool load(const sci::string &hplFilename, HplHeader &header, std::vector<HplProfile> &profiles) const;
+	void store(const sci::string &hplFilename, const HplHeader &header, const std::vector<HplProfile> &profiles) const;
+private:
+	std::filesystem::path getCachePath(const sci::string &hplFilename) const;
+	void trim() const;
+	static void writeHeader(std::ostream &stream, const HplHeader &header);
+	static void readHeader(std::istream &stream, HplHeader &header);
+	static void writeProfile(std::ostream &stream, const HplProfile &profile, std::vector<float> &buffer, std::vector<uint32_t> &gateBuffer);
+	static void readProfile(std::istream &stream, HplProfile &profile, std::vector<float> &buffer, std::vector<uint32_t> &gateBuffer);
+	std::filesystem::path m_directory;
+	size_t m_maxBytes;
+};
+
+//A process wide cache of parsed hpl files held in memory, so that processors reading the
+//same files, e.g. the co and cross polarised stare processors and the pair inside the depol
+//processor, share one parse. The parsed files are shared and never modified, so an entry can
+//be evicted while a processor is still using it, it is just freed once the last user lets go.
+//Like HplFileCache, entries are checked against the size and modification time of the hpl
+//file. When the entries take more than maxBytes the least recently used are evicted. A
+//maxBytes of 0 disables the cache. It is safe to use from several threads at once.
+class SharedHplMemoryCache
+{
+public:
+	static SharedHplMemoryCache &getInstance();
+	void setMaxBytes(size_t maxBytes);
+	bool isEnabled() const { return m_maxBytes > 0; }
+	std::shared_ptr<const ParsedHplFile> find(const sci::string &hplFilename);
+	void store(const sci::string &hplFilename, std::shared_ptr<const ParsedHplFile> parsedFile);
+private:
+	SharedHplMemoryCache();
+	struct Entry
+	{
+		std::shared_ptr<const ParsedHplFile> parsedFile;
+		uint64_t size;
+		int64_t modificationTime;
+		size_t bytes;
+		std::list<sci::string>::iterator recentlyUsedPosition;
+	};
+	void erase(std::map<sci::string, Entry>::iterator entry);
+	void evict();
+	std::map<sci::string, Entry> m_entries;
+	std::list<sci::string> m_recentlyUsed; //most recently used first
+	size_t m_bytes;
+	std::atomic<size_t> m_maxBytes;
+	std::mutex m_mutex;
+};
@@ -3,7 +3,10 @@
 #endif
 #include "HplHeader.h"
 #include<sstream>
+#include<array>
+#include<algorithm>
 #include<svector/serr.h>
+#include"CharBufferParsing.h"
 
 //Used for setting colon to be treated like a space 
 struct ColonIsSpace : std::ctype<char>
@@ -20,27 +23,31 @@ struct ColonIsSpace : std::ctype<char>
 	}
 };
 
-std::istream & operator>> (std::istream & stream, ScanType &scanType)
+void scanTypeFromText(std::string_view text, ScanType &scanType)
 {
-	std::string tempString;
-	std::getline(stream, tempString);
-	if (tempString == "Stare")
+	if (text == "Stare")
 		scanType = ScanType::stare;
-	else if (tempString == "RHI")
+	else if (text == "RHI")
 		scanType = ScanType::rhi;
-	else if (tempString == "VAD")
+	else if (text == "VAD")
 		scanType = ScanType::vad;
-	else if (tempString == "Wind profile")
+	else if (text == "Wind profile")
 		scanType = ScanType::wind;
-	else if (tempString == "User file 1")
+	else if (text == "User file 1")
 		scanType = ScanType::user1;
-	else if (tempString == "User file 2")
+	else if (text == "User file 2")
 		scanType = ScanType::user2;
-	else if (tempString == "User file 3")
+	else if (text == "User file 3")
 		scanType = ScanType::user3;
-	else if (tempString == "User file 4")
+	else if (text == "User file 4")
 		scanType = ScanType::user4;
+}
 
+std::istream & operator>> (std::istream & stream, ScanType &scanType)
+{
+	std::string tempString;
+	std::getline(stream, tempString);
+	scanTypeFromText(tempString, scanType);
 	return stream;
 }
 
@@ -137,6 +144,55 @@ void readHeaderLine(std::istream &stream, T &variable, const std::string &name)
 	readHeaderVariable(varStream, variable);
 }
 
+//Check the fixed text lines which end the header. These are the same whichever way the
+//header was read.
+void checkHeaderFooter(const std::array<std::string, 6> &lines, bool oldType)
+{
+	sci::assertThrow(lines[0] == "Altitude of measurement (center of gate) = (range gate + 0.5) * Gate length",
+		sci::err(sci::SERR_USER, 0, sU("Did not find the expected altitude of measurement equation. Incorrect file format.")));
+
+	if (!oldType)
+	{
+		sci::assertThrow(lines[1] == "Data line 1: Decimal time (hours)  Azimuth (degrees)  Elevation (degrees) Pitch (degrees) Roll (degrees)",
+			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 descriptor. Incorrect file format.")));
+
+		sci::assertThrow(lines[2] == "f9.6,1x,f6.2,1x,f6.2",
+			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 format. Incorrect file format.")));
+	}
+	else
+	{
+		sci::assertThrow(lines[1] == "Data line 1: Decimal time (hours)  Azimuth (degrees)  Elevation (degrees)",
+			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 descriptor. Incorrect file format.")));
+
+		sci::assertThrow(lines[2] == "f7.4,1x,f6.2,1x,f6.2",
+			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 format. Incorrect file format.")));
+	}
+
+	sci::assertThrow(lines[3] == "Data line 2: Range Gate  Doppler (m/s)  Intensity (SNR + 1)  Beta (m-1 sr-1)",
+		sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 2 descriptor. Incorrect file format.")));
+
+	sci::assertThrow(lines[4] == "i3,1x,f6.4,1x,f8.6,1x,e12.6 - repeat for no. gates",
+		sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 2 format. Incorrect file format.")));
+
+	sci::assertThrow(lines[5] == "****",
+		sci::err(sci::SERR_USER, 0, sU("Did not find the expected **** header ending. Incorrect file format.")));
+}
+
+//In the old style files we don't have the date stored in the start time. Parse it from the file name instead
+void setOldTypeStartDateFromFilename(HplHeader &hplHeader)
+{
+	sci::string dateString = hplHeader.filename;
+	dateString = dateString.substr(0, dateString.find_last_of(sU("\\/")));
+	dateString = dateString.substr(dateString.find_last_of(sU("\\/"))+1);
+	sci::stringstream dateStream(dateString);
+	int dateNumber;
+	dateStream >> dateNumber;
+	int year = dateNumber / 10000;
+	unsigned int month = std::abs(dateNumber % 10000) / 100;
+	unsigned int day = std::abs(dateNumber) % 100;
+	hplHeader.startTime.setDate(year, month, day);
+}
+
 std::istream & operator>> (std::istream & stream, HplHeader &hplHeader)
 {
 	try
@@ -176,32 +232,6 @@ std::istream & operator>> (std::istream & stream, HplHeader &hplHeader)
 		hplHeader.focusRange = focusRangeGate >= unitlessF(65535) ? std::numeric_limits<metreF>::infinity() : (metreF)(focusRangeGate * hplHeader.rangeGateLength);
 		readHeaderLine(stream, hplHeader.startTime, "Start time");
 		readHeaderLine(stream, hplHeader.dopplerResolution, "Resolution (m/s)");
-
-		std::string tempString;
-
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "Altitude of measurement (center of gate) = (range gate + 0.5) * Gate length",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected altitude of measurement equation. Incorrect file format.")));
-
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "Data line 1: Decimal time (hours)  Azimuth (degrees)  Elevation (degrees) Pitch (degrees) Roll (degrees)",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 descriptor. Incorrect file format.")));
-
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "f9.6,1x,f6.2,1x,f6.2",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 format. Incorrect file format.")));
-
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "Data line 2: Range Gate  Doppler (m/s)  Intensity (SNR + 1)  Beta (m-1 sr-1)",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 2 descriptor. Incorrect file format.")));
-
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "i3,1x,f6.4,1x,f8.6,1x,e12.6 - repeat for no. gates",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 2 format. Incorrect file format.")));
-
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "****",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected **** header ending. Incorrect file format.")));
 	}
 	else
 	{
@@ -215,43 +245,168 @@ std::istream & operator>> (std::istream & stream, HplHeader &hplHeader)
 		readHeaderLine(stream, hplHeader.scanType, "Scan type");
 		readHeaderLine(stream, hplHeader.focusRange, "Focus range");
 		readHeaderLine(stream, hplHeader.startTime, "Start time");
-		//In the old style files we don't have the date stored in the start time. Parse it from the file name instead
-		sci::string dateString = hplHeader.filename;
-		dateString = dateString.substr(0, dateString.find_last_of(sU("\\/")));
-		dateString = dateString.substr(dateString.find_last_of(sU("\\/"))+1);
-		sci::stringstream dateStream(dateString);
-		int dateNumber;
-		dateStream >> dateNumber;
-		int year = dateNumber / 10000;
-		unsigned int month = std::abs(dateNumber % 10000) / 100;
-		unsigned int day = std::abs(dateNumber) % 100;
-		hplHeader.startTime.setDate(year, month, day);
+		setOldTypeStartDateFromFilename(hplHeader);
 		readHeaderLine(stream, hplHeader.dopplerResolution, "Resolution (m/s)");
+	}
 
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "Altitude of measurement (center of gate) = (range gate + 0.5) * Gate length",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected altitude of measurement equation. Incorrect file format.")));
+	std::array<std::string, 6> footerLines;
+	for (size_t i = 0; i < footerLines.size(); ++i)
+		std::getline(stream, footerLines[i]);
+	checkHeaderFooter(footerLines, hplHeader.oldType);
 
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "Data line 1: Decimal time (hours)  Azimuth (degrees)  Elevation (degrees)",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 descriptor. Incorrect file format.")));
+	return stream;
+}
 
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "f7.4,1x,f6.2,1x,f6.2",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 1 format. Incorrect file format.")));
+//The functions below read the header directly from a character buffer (usually a memory mapped
+//file) using std::from_chars. They mirror the stream based versions above, value for value, but
+//avoid the locale aware stream extraction and the ColonIsSpace facet.
+
+template <class T, class VALUE_TYPE>
+void parseHeaderVariable(std::string_view text, sci::Physical<T, VALUE_TYPE> &variable)
+{
+	VALUE_TYPE dVar;
+	const char *position = text.data();
+	parseBufferNumber(position, text.data() + text.size(), dVar);
+	variable = sci::Physical <T, VALUE_TYPE>(dVar);
+}
 
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "Data line 2: Range Gate  Doppler (m/s)  Intensity (SNR + 1)  Beta (m-1 sr-1)",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 2 descriptor. Incorrect file format.")));
+template <class T>
+void parseHeaderVariable(std::string_view text, T &variable)
+{
+	const char *position = text.data();
+	parseBufferNumber(position, text.data() + text.size(), variable);
+}
 
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "i3,1x,f6.4,1x,f8.6,1x,e12.6 - repeat for no. gates",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected data line 2 format. Incorrect file format.")));
+template <>
+void parseHeaderVariable<sci::string>(std::string_view text, sci::string &variable)
+{
+	//I know this file uses only ascii, so just grab the first whitespace delimited
+	//token, like stream extraction would, then convert to unicode
+	const char *position = text.data();
+	const char *end = text.data() + text.size();
+	skipBufferWhitespace(position, end);
+	const char *tokenStart = position;
+	while (position != end && !isBufferWhitespace(*position))
+		++position;
+	variable = sci::utf8ToUtf16(std::string(tokenStart, position));
+}
 
-		std::getline(stream, tempString);
-		sci::assertThrow(tempString == "****",
-			sci::err(sci::SERR_USER, 0, sU("Did not find the expected **** header ending. Incorrect file format.")));
+template <>
+void parseHeaderVariable(std::string_view text, ScanType &variable)
+{
+	scanTypeFromText(text, variable);
+}
+
+template <>
+void parseHeaderVariable(std::string_view text, sci::UtcTime &variable)
+{
+	const char *position = text.data();
+	const char *end = text.data() + text.size();
+	int date;
+	int year;
+	unsigned int month;
+	unsigned int dayOfMonth;
+	unsigned int hour;
+	unsigned int minute;
+	double second;
+
+	//colons separate the time elements, treat them like spaces
+	auto skipSeparators = [&position, end]()
+	{
+		while (position != end && (isBufferWhitespace(*position) || *position == ':'))
+			++position;
+	};
+	skipSeparators();
+	bool readOkay = parseBufferNumber(position, end, date);
+	skipSeparators();
+	readOkay = readOkay && parseBufferNumber(position, end, hour);
+	skipSeparators();
+	readOkay = readOkay && parseBufferNumber(position, end, minute);
+	skipSeparators();
+	readOkay = readOkay && parseBufferNumber(position, end, second);
+	if (!readOkay)
+	{
+		//this is probably due to an old style file, where the date is not provided. Set date to 1 Jan 1970
+		//and shuffle the read variables along
+		second = minute;
+		minute = hour;
+		hour = date;
+		date = 19700101;
 	}
+	year = date / 10000;
+	month = (date % 10000) / 100;
+	dayOfMonth = date % 100;
 
-	return stream;
+	variable = sci::UtcTime(year, month, dayOfMonth, hour, minute, second);
+}
+
+template <class T>
+void readHeaderLine(const char *&position, const char *end, T &variable, const std::string &name)
+{
+	sci::assertThrow(position != end, sci::err(sci::SERR_USER, 0, sU("Read of file failed - it may be locked or inaccessible.")));
+	std::string_view line = getBufferLine(position, end);
+	size_t colonPosition = line.find(':');
+	sci::assertThrow(colonPosition != std::string_view::npos && line.substr(0, colonPosition) == name, sci::err(sci::SERR_USER, 1, "Could not find the variable " + name + " in the file header at the expected location"));
+	parseHeaderVariable(line.substr(std::min(colonPosition + 2, line.size())), variable);
+}
+
+void readHplHeader(const char *&position, const char *end, HplHeader &hplHeader)
+{
+	try
+	{
+		readHeaderLine(position, end, hplHeader.filename, "Filename");
+	}
+	catch (sci::err err)
+	{
+		//throw a sightly different error if we did't find the first variable
+		if (err.getErrorCode() == 1) //missing variable uses error code 1
+			sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("The file is not a lidar profile. Lidar profile files should start with a \"Filename:\" parameter.")));
+		else
+			throw;
+	}
+
+	try
+	{
+		//newer files have System ID on second line, older files have operating mode instead
+		readHeaderLine(position, end, hplHeader.systemId, "System ID");
+		hplHeader.oldType = false;
+	}
+	catch (...)
+	{
+		hplHeader.systemId = -1;
+		hplHeader.oldType = true;
+	}
+	if (!hplHeader.oldType)
+	{
+		readHeaderLine(position, end, hplHeader.nGates, "Number of gates");
+		readHeaderLine(position, end, hplHeader.rangeGateLength, "Range gate length (m)");
+		readHeaderLine(position, end, hplHeader.pointsPerGate, "Gate length (pts)");
+		readHeaderLine(position, end, hplHeader.pulsesPerRay, "Pulses/ray");
+		readHeaderLine(position, end, hplHeader.nRays, "No. of rays in file");
+		readHeaderLine(position, end, hplHeader.scanType, "Scan type");
+		unitlessF focusRangeGate;
+		readHeaderLine(position, end, focusRangeGate, "Focus range");
+		hplHeader.focusRange = focusRangeGate >= unitlessF(65535) ? std::numeric_limits<metreF>::infinity() : (metreF)(focusRangeGate * hplHeader.rangeGateLength);
+		readHeaderLine(position, end, hplHeader.startTime, "Start time");
+		readHeaderLine(position, end, hplHeader.dopplerResolution, "Resolution (m/s)");
+	}
+	else
+	{
+		readHeaderLine(position, end, hplHeader.nGates, "Number of gates");
+		readHeaderLine(position, end, hplHeader.rangeGateLength, "Range gate length (m)");
+		readHeaderLine(position, end, hplHeader.pointsPerGate, "Gate length (pts)");
+		getBufferLine(position, end); //Software version
+		readHeaderLine(position, end, hplHeader.pulsesPerRay, "Pulses/ray");
+		readHeaderLine(position, end, hplHeader.nRays, "No. of rays in file");
+		readHeaderLine(position, end, hplHeader.scanType, "Scan type");
+		readHeaderLine(position, end, hplHeader.focusRange, "Focus range");
+		readHeaderLine(position, end, hplHeader.startTime, "Start time");
+		setOldTypeStartDateFromFilename(hplHeader);
+		readHeaderLine(position, end, hplHeader.dopplerResolution, "Resolution (m/s)");
+	}
+
+	std::array<std::string, 6> footerLines;
+	for (size_t i = 0; i < footerLines.size(); ++i)
+		footerLines[i] = getBufferLine(position, end);
+	checkHeaderFooter(footerLines, hplHeader.oldType);
 }
\ No newline at end of file
@@ -37,3 +37,6 @@ struct HplHeader
 #pragma warning(pop)
 
 std::istream & operator>> (std::istream & stream, HplHeader &);
+//Read the header from a character buffer, e.g. a memory mapped file. position is moved to the
+//start of the first profile.
+void readHplHeader(const char *&position, const char *end, HplHeader &hplHeader);
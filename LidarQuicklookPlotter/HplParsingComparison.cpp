@@ -0,0 +1,201 @@
+//Checks that parsing hpl lidar files from a memory map with std::from_chars gives bit for bit
+//the same headers and profiles as the original stream based parsing.
+//Usage: HplParsingComparison [file.hpl ...]
+//Each file given is read both ways and every header value and profile value is compared. With
+//no files, synthetic numbers formatted like those in hpl files are compared instead. Returns non
+//zero if anything differs.
+#include"HplHeader.h"
+#include"HplProfile.h"
+#include"MemoryMappedFile.h"
+#include"CharBufferParsing.h"
+#include<svector/serr.h>
+#include<svector/sstring.h>
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<vector>
+#include<string>
+#include<random>
+#include<cstring>
+#include<cstdio>
+#include<cmath>
+
+template<class T>
+bool sameBits(const T &a, const T &b)
+{
+	return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+bool sameTime(const sci::UtcTime &a, const sci::UtcTime &b)
+{
+	return !(a < b) && !(b < a);
+}
+
+bool sameHeader(const HplHeader &a, const HplHeader &b)
+{
+	return a.filename == b.filename
+		&& a.systemId == b.systemId
+		&& a.nGates == b.nGates
+		&& sameBits(a.rangeGateLength, b.rangeGateLength)
+		&& a.pointsPerGate == b.pointsPerGate
+		&& a.pulsesPerRay == b.pulsesPerRay
+		&& a.nRays == b.nRays
+		&& a.scanType == b.scanType
+		&& sameBits(a.focusRange, b.focusRange)
+		&& sameTime(a.startTime, b.startTime)
+		&& sameBits(a.dopplerResolution, b.dopplerResolution)
+		&& a.oldType == b.oldType;
+}
+
+bool sameProfile(const HplProfile &a, const HplProfile &b)
+{
+	if (!sameTime(a.getTime<sci::UtcTime>(), b.getTime<sci::UtcTime>())
+		|| !sameBits(a.getAzimuth(), b.getAzimuth())
+		|| !sameBits(a.getElevation(), b.getElevation())
+		|| !sameBits(a.getPitch(), b.getPitch())
+		|| !sameBits(a.getRoll(), b.getRoll())
+		|| a.nGates() != b.nGates())
+		return false;
+	for (size_t i = 0; i < a.nGates(); ++i)
+	{
+		if (a.getGates()[i] != b.getGates()[i]
+			|| !sameBits(a.getDopplerVelocities()[i], b.getDopplerVelocities()[i])
+			|| !sameBits(a.getIntensities()[i], b.getIntensities()[i])
+			|| !sameBits(a.getBetas()[i], b.getBetas()[i]))
+			return false;
+	}
+	return true;
+}
+
+//Reads a file both ways and reports the first difference. Returns true if they match.
+bool compareFile(const sci::string &filename)
+{
+	HplHeader streamHeader;
+	std::vector<HplProfile> streamProfiles;
+	std::fstream fin(sci::nativeUnicode(filename), std::ios::in);
+	sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not open lidar file ") + filename + sU(".")));
+	fin >> streamHeader;
+	streamProfiles.resize(1);
+	while (streamProfiles.back().readFromStream(fin, streamHeader))
+		streamProfiles.resize(streamProfiles.size() + 1);
+	streamProfiles.pop_back();
+
+	HplHeader bufferHeader;
+	std::vector<HplProfile> bufferProfiles;
+	MemoryMappedFile mappedFile(filename);
+	const char *position = mappedFile.begin();
+	readHplHeader(position, mappedFile.end(), bufferHeader);
+	bufferProfiles.resize(1);
+	while (bufferProfiles.back().readFromBuffer(position, mappedFile.end(), bufferHeader))
+		bufferProfiles.resize(bufferProfiles.size() + 1);
+	bufferProfiles.pop_back();
+
+	std::cout << sci::nativeUnicode(filename) << ": ";
+	if (!sameHeader(streamHeader, bufferHeader))
+	{
+		std::cout << "the headers differ\n";
+		return false;
+	}
+	if (streamProfiles.size() != bufferProfiles.size())
+	{
+		std::cout << "read " << streamProfiles.size() << " profiles from the stream, but " << bufferProfiles.size() << " from the buffer\n";
+		return false;
+	}
+	for (size_t i = 0; i < streamProfiles.size(); ++i)
+	{
+		if (!sameProfile(streamProfiles[i], bufferProfiles[i]))
+		{
+			std::cout << "profile " << i << " differs\n";
+			return false;
+		}
+	}
+	std::cout << streamProfiles.size() << " profiles identical\n";
+	return true;
+}
+
+//Parses each number with stream extraction and with parseBufferNumber and counts how many give
+//different floats, printing the first few
+size_t countDifferences(const std::vector<std::string> &numbers)
+{
+	size_t nDifferent = 0;
+	for (const std::string &number : numbers)
+	{
+		std::istringstream stream(number);
+		float streamValue = 0.0f;
+		stream >> streamValue;
+		float bufferValue = 0.0f;
+		const char *position = number.data();
+		parseBufferNumber(position, number.data() + number.size(), bufferValue);
+		if (!sameBits(streamValue, bufferValue))
+		{
+			if (nDifferent < 5)
+				std::cout << "  " << number << " gives " << streamValue << " from the stream but " << bufferValue << " from the buffer\n";
+			++nDifferent;
+		}
+	}
+	return nDifferent;
+}
+
+std::string format(const char *formatString, double value)
+{
+	char text[128];
+	std::snprintf(text, sizeof(text), formatString, value);
+	return text;
+}
+
+//Compares synthetic numbers, returning true if all numbers formatted like those in hpl files match
+bool compareSyntheticNumbers()
+{
+	std::mt19937 generator(20201017);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	//The precisions used in hpl files: decimal hours and angles in the ray lines, then doppler,
+	//intensity and beta for each gate
+	std::vector<std::string> hplNumbers;
+	for (size_t i = 0; i < 1000000; ++i)
+	{
+		hplNumbers.push_back(format("%.6f", unit(generator) * 24.0));
+		hplNumbers.push_back(format("%.2f", unit(generator) * 360.0 - 180.0));
+		hplNumbers.push_back(format("%.4f", unit(generator) * 40.0 - 20.0));
+		hplNumbers.push_back(format("%.6f", 0.9 + unit(generator) * 0.3));
+		hplNumbers.push_back(format("%.6E", std::pow(10.0, -9.0 + 6.0 * unit(generator)) * (unit(generator) < 0.1 ? -1.0 : 1.0)));
+	}
+	size_t nHplDifferent = countDifferences(hplNumbers);
+	std::cout << hplNumbers.size() << " numbers formatted as in hpl files, " << nHplDifferent << " parsed differently\n";
+
+	//Decimals just above the midpoint between two floats. Rounding these to double first lands
+	//exactly on the midpoint, which then rounds to even rather than up. These have far more
+	//digits than hpl files contain, so are reported, but don't count as a failure.
+	std::vector<std::string> midpointNumbers;
+	for (size_t i = 0; i < 100000; ++i)
+	{
+		float lower = float(std::pow(10.0, -9.0 + 12.0 * unit(generator)));
+		double midpoint = (double(lower) + double(std::nextafter(lower, 2.0f * lower))) / 2.0;
+		std::string text = format("%.70e", midpoint);
+		size_t exponent = text.find('e');
+		midpointNumbers.push_back(text.substr(0, exponent) + "1" + text.substr(exponent));
+	}
+	size_t nMidpointDifferent = countDifferences(midpointNumbers);
+	std::cout << midpointNumbers.size() << " long decimals just above a float midpoint, " << nMidpointDifferent << " parsed differently\n";
+
+	return nHplDifferent == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	bool passed = true;
+	try
+	{
+		if (argc < 2)
+			passed = compareSyntheticNumbers();
+		for (int i = 1; i < argc; ++i)
+			passed = compareFile(sci::fromCodepage(std::string(argv[i]))) && passed;
+	}
+	catch (sci::err err)
+	{
+		std::cout << "Error: " << sci::nativeUnicode(err.getErrorMessage()) << "\n";
+		return 1;
+	}
+	std::cout << (passed ? "The stream and buffer parsing are identical\n" : "FAILED: the stream and buffer parsing differ\n");
+	return passed ? 0 : 1;
+}
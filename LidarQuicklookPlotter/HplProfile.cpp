@@ -3,6 +3,7 @@
 #include"HplHeader.h"
 #include<cmath>
 #include<svector/serr.h>
+#include"CharBufferParsing.h"
 
 bool HplProfile::readFromStream(std::istream &stream, const HplHeader &header)
 {
@@ -15,16 +16,80 @@ bool HplProfile::readFromStream(std::istream &stream, const HplHeader &header)
 		stream >> decimalHour >> azimuthDeg >> elevationDeg >> pitchDeg >> rollDeg;
 	else
 		stream >> decimalHour >> azimuthDeg >> elevationDeg;
-	m_azimuth = degreeF(azimuthDeg);
-	m_elevation = degreeF(elevationDeg);
-	m_pitch = degreeF(pitchDeg);
-	m_roll = degreeF(rollDeg);
 	sci::assertThrow(stream.eof() || stream.good(), sci::err(sci::SERR_USER, 0, sU("Read of file failed - it may be locked or inaccessible.")));
 	if (stream.eof())
 	{
 		return false;
 	}
 
+	setRayValues(decimalHour, azimuthDeg, elevationDeg, pitchDeg, rollDeg, header);
+
+	size_t nGates = header.nGates;
+	for (size_t i = 0; i < nGates; ++i)
+	{
+		stream >> m_gates[i] >> m_dopplerVelocities[i] >> m_intensities[i] >> m_betas[i];
+		if (i != nGates - 1 && stream.eof())
+			return false;
+	}
+	sci::assertThrow(stream.good(), sci::err(sci::SERR_USER, 0, sU("Read of file failed - it may be locked or inaccessible.")));
+
+	return true;
+}
+
+bool HplProfile::readFromBuffer(const char *&position, const char *end, const HplHeader &header)
+{
+	float decimalHour;
+	float azimuthDeg;
+	float elevationDeg;
+	float pitchDeg = std::numeric_limits<float>::quiet_NaN();
+	float rollDeg = std::numeric_limits<float>::quiet_NaN();
+	bool readOkay = parseBufferNumber(position, end, decimalHour)
+		&& parseBufferNumber(position, end, azimuthDeg)
+		&& parseBufferNumber(position, end, elevationDeg);
+	if (readOkay && !header.oldType)
+		readOkay = parseBufferNumber(position, end, pitchDeg)
+		&& parseBufferNumber(position, end, rollDeg);
+	if (!readOkay)
+	{
+		//running out of data here is just the end of the file, anything else means the file is bad
+		sci::assertThrow(position == end, sci::err(sci::SERR_USER, 0, sU("Found a value that is not a number, the file may be corrupt or be incorrectly formatted.")));
+		return false;
+	}
+
+	setRayValues(decimalHour, azimuthDeg, elevationDeg, pitchDeg, rollDeg, header);
+
+	size_t nGates = header.nGates;
+	for (size_t i = 0; i < nGates; ++i)
+	{
+		size_t gate;
+		float dopplerVelocity;
+		float intensity;
+		float beta;
+		readOkay = parseBufferNumber(position, end, gate)
+			&& parseBufferNumber(position, end, dopplerVelocity)
+			&& parseBufferNumber(position, end, intensity)
+			&& parseBufferNumber(position, end, beta);
+		if (!readOkay)
+		{
+			sci::assertThrow(position == end, sci::err(sci::SERR_USER, 0, sU("Found a value that is not a number, the file may be corrupt or be incorrectly formatted.")));
+			return false;
+		}
+		m_gates[i] = gate;
+		m_dopplerVelocities[i] = metrePerSecondF(dopplerVelocity);
+		m_intensities[i] = unitlessF(intensity);
+		m_betas[i] = perSteradianPerMetreF(beta);
+	}
+
+	return true;
+}
+
+void HplProfile::setRayValues(float decimalHour, float azimuthDeg, float elevationDeg, float pitchDeg, float rollDeg, const HplHeader &header)
+{
+	m_azimuth = degreeF(azimuthDeg);
+	m_elevation = degreeF(elevationDeg);
+	m_pitch = degreeF(pitchDeg);
+	m_roll = degreeF(rollDeg);
+
 	unsigned int hour = (unsigned int)std::floor(decimalHour);
 	unsigned int minute = (int)std::floor((decimalHour - hour)*60.0);
 	double second = ((decimalHour - hour)*60.0 - minute) * 60;
@@ -39,13 +104,4 @@ bool HplProfile::readFromStream(std::istream &stream, const HplHeader &header)
 	m_dopplerVelocities.resize(nGates);
 	m_intensities.resize(nGates);
 	m_betas.resize(nGates);
-	for (size_t i = 0; i < nGates; ++i)
-	{
-		stream >> m_gates[i] >> m_dopplerVelocities[i] >> m_intensities[i] >> m_betas[i];
-		if (i != nGates - 1 && stream.eof())
-			return false;
-	}
-	sci::assertThrow(stream.good(), sci::err(sci::SERR_USER, 0, sU("Read of file failed - it may be locked or inaccessible.")));
-
-	return true;
 }
\ No newline at end of file
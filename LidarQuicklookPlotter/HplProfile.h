@@ -1,7 +1,8 @@
 #pragma once
-#include<svector\time.h>
+#include<svector/time.h>
 #include<vector>
 #include<iostream>
+#include<type_traits>
 #include"Units.h"
 #include<svector/gridview.h>
 
@@ -23,21 +24,32 @@ class HplProfile
 {
 public:
 	bool readFromStream(std::istream &stream, const HplHeader &header);
+	//equivalent to readFromStream, but parses directly from a character buffer, e.g. a memory
+	//mapped file. position is moved to the start of the next profile.
+	bool readFromBuffer(const char *&position, const char *end, const HplHeader &header);
 	template<class T>
-	T getTime() const { static_assert(makeFalse<T>(), "HplProfile::getTime<T> can only be called with T=sci::UtcTime or T=second."); }
-	template<>
-	sci::UtcTime getTime<sci::UtcTime>() const { return m_time; }
-	template<>
-	second getTime<second>() const { return second(m_time - sci::UtcTime(1970, 1, 1, 0, 0, 0)); }
+	T getTime() const
+	{
+		if constexpr (std::is_same_v<T, sci::UtcTime>)
+			return m_time;
+		else if constexpr (std::is_same_v<T, second>)
+			return second(m_time - sci::UtcTime(1970, 1, 1, 0, 0, 0));
+		else
+			static_assert(makeFalse<T>(), "HplProfile::getTime<T> can only be called with T=sci::UtcTime or T=second.");
+	}
 	void setTime(const sci::UtcTime &time) { m_time = time; }
 	degreeF getAzimuth() const { return m_azimuth; }
 	degreeF getElevation() const { return m_elevation; }
+	degreeF getPitch() const { return m_pitch; }
+	degreeF getRoll() const { return m_roll; }
 	const sci::GridData<size_t, 1>& getGates() const { return m_gates; }
 	const sci::GridData<metrePerSecondF, 1>& getDopplerVelocities() const { return m_dopplerVelocities; }
 	const sci::GridData<unitlessF, 1>& getIntensities() const { return m_intensities; }
 	const sci::GridData<perSteradianPerMetreF, 1>& getBetas() const { return m_betas; }
 	size_t nGates() const { return m_gates.size(); }
 private:
+	friend class HplFileCache;
+	void setRayValues(float decimalHour, float azimuthDeg, float elevationDeg, float pitchDeg, float rollDeg, const HplHeader &header);
 	sci::UtcTime m_time;
 	degreeF m_azimuth;
 	degreeF m_elevation;
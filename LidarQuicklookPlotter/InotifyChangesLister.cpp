@@ -0,0 +1,293 @@
+#ifdef __linux__
+#include"InotifyChangesLister.h"
+#include"InstrumentProcessor.h"
+#include<functional>
+#include<wx/filefn.h>
+#include<sys/inotify.h>
+#include<sys/vfs.h>
+#include<unistd.h>
+#include<errno.h>
+
+const uint32_t g_inotifyWatchMask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO
+	| IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+//Lists all the files below a directory, in the same way as wxDir::GetAllFiles, but lets us
+//know about each subdirectory before its contents are listed so we can start watching it
+class WatchingDirTraverser : public wxDirTraverser
+{
+public:
+	WatchingDirTraverser(std::function<void(const sci::string &)> onDirectory, std::vector<sci::string> &files)
+		:m_onDirectory(onDirectory), m_files(files)
+	{}
+	wxDirTraverseResult OnFile(const wxString &filename) override
+	{
+		m_files.push_back(sci::fromWxString(filename));
+		return wxDIR_CONTINUE;
+	}
+	wxDirTraverseResult OnDir(const wxString &dirname) override
+	{
+		m_onDirectory(sci::fromWxString(dirname));
+		return wxDIR_CONTINUE;
+	}
+private:
+	std::function<void(const sci::string &)> m_onDirectory;
+	std::vector<sci::string> &m_files;
+};
+
+//wxDir puts a separator between a directory and its contents unless there is one already
+sci::string withTrailingSeparator(const sci::string &directory)
+{
+	if (directory.length() > 0 && directory.back() == sU('/'))
+		return directory;
+	return directory + sU("/");
+}
+
+//The filesystem types, from statfs, where files can be written by other machines without
+//this machine's kernel seeing it: NFS, SMB, CIFS, SMB2, AFS, Coda, Ceph and 9P
+const long g_networkFilesystemTypes[] = { 0x6969, 0x517B, (long)0xFF534D42, (long)0xFE534D42, 0x5346414F, 0x73757245, 0x00C36400, 0x01021997 };
+
+bool isOnNetworkFilesystem(const sci::string &directory)
+{
+	struct statfs filesystem;
+	if (statfs(wxString(sci::nativeUnicode(directory)).fn_str(), &filesystem) != 0)
+		return false;
+	for (size_t i = 0; i < sizeof(g_networkFilesystemTypes) / sizeof(g_networkFilesystemTypes[0]); ++i)
+		if (long(filesystem.f_type) == g_networkFilesystemTypes[i])
+			return true;
+	return false;
+}
+
+InotifyFolderWatcher::InotifyFolderWatcher(const sci::string &directory, second rescanInterval)
+	:m_directory(directory), m_fileDescriptor(-1), m_needsRescan(true), m_canWatch(false), m_rescanInterval(rescanInterval)
+{
+	m_isOnLocalFilesystem = !isOnNetworkFilesystem(directory);
+}
+
+InotifyFolderWatcher::~InotifyFolderWatcher()
+{
+	if (m_fileDescriptor >= 0)
+		close(m_fileDescriptor);
+}
+
+void InotifyFolderWatcher::setRescanInterval(second rescanInterval)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_rescanInterval = rescanInterval;
+}
+
+std::vector<std::pair<sci::string, sci::UtcTime>> InotifyFolderWatcher::listFiles(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_needsRescan)
+		readEvents();
+	if (!m_needsRescan && m_rescanInterval > second(0.0) && !(second(sci::UtcTime::now() - m_lastScanTime) < m_rescanInterval))
+		m_needsRescan = true;
+	if (m_needsRescan)
+		rescan();
+
+	//filter just the ones relevant to the processor. After the first time this is just the
+	//files that are new or changed since the processor last looked.
+	auto relevantFiles = m_relevantFiles.find(&processor);
+	if (relevantFiles == m_relevantFiles.end() || relevantFiles->second.startTime != startTime || relevantFiles->second.endTime != endTime)
+	{
+		std::vector<sci::string> allFiles;
+		allFiles.reserve(m_files.size());
+		for (auto iter = m_files.begin(); iter != m_files.end(); ++iter)
+			allFiles.push_back(iter->first);
+		std::vector<sci::string> relevant = processor.selectRelevantFiles(allFiles, startTime, endTime);
+		relevantFiles = m_relevantFiles.insert_or_assign(&processor, RelevantFiles{ startTime, endTime, std::set<sci::string>(relevant.begin(), relevant.end()), std::vector<sci::string>() }).first;
+	}
+	else if (relevantFiles->second.newFiles.size() > 0)
+	{
+		std::vector<sci::string> relevant = processor.selectRelevantFiles(relevantFiles->second.newFiles, startTime, endTime);
+		relevantFiles->second.files.insert(relevant.begin(), relevant.end());
+		relevantFiles->second.newFiles.clear();
+	}
+
+	//get the modified date of the relevant files, we only need to stat the ones that have
+	//changed since we last looked
+	std::set<sci::string> &files = relevantFiles->second.files;
+	std::vector<std::pair<sci::string, sci::UtcTime>> result;
+	result.reserve(files.size());
+	for (auto iter = files.begin(); iter != files.end(); )
+	{
+		auto file = m_files.find(*iter);
+		if (file != m_files.end() && !file->second)
+		{
+			sci::UtcTime time;
+			if (getModifiedTime(*iter, time))
+				file->second = time;
+			else
+			{
+				m_files.erase(file);
+				file = m_files.end();
+			}
+		}
+		if (file == m_files.end())
+		{
+			//deleted since we last looked
+			iter = files.erase(iter);
+			continue;
+		}
+		result.push_back({ *iter, *file->second });
+		++iter;
+	}
+	return result;
+}
+
+//Starts again from scratch with a new inotify instance, so we don't have to worry about any
+//events still queued for the old watches
+void InotifyFolderWatcher::rescan()
+{
+	m_files.clear();
+	m_relevantFiles.clear();
+	m_watchedDirectories.clear();
+	m_lastScanTime = sci::UtcTime::now();
+	if (m_fileDescriptor >= 0)
+		close(m_fileDescriptor);
+	m_fileDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	m_canWatch = m_fileDescriptor >= 0;
+
+	addWatch(m_directory);
+	scanDirectory(m_directory);
+
+	//if we couldn't watch everything, e.g. we hit the user's inotify watch limit, then we
+	//cannot trust the events and must do a full rescan every time
+	m_needsRescan = !m_canWatch;
+}
+
+void InotifyFolderWatcher::scanDirectory(const sci::string &directory)
+{
+	wxDir dir(sci::nativeUnicode(directory));
+	if (!dir.IsOpened())
+		return;
+	std::vector<sci::string> files;
+	WatchingDirTraverser traverser([this](const sci::string &subdirectory) { addWatch(subdirectory); }, files);
+	dir.Traverse(traverser);
+	//we don't stat the files here, most will never be relevant to any processor
+	for (size_t i = 0; i < files.size(); ++i)
+		if (m_files.emplace(files[i], std::nullopt).second)
+			addNewFile(files[i]);
+}
+
+bool InotifyFolderWatcher::addWatch(const sci::string &directory)
+{
+	int watchDescriptor = -1;
+	if (m_fileDescriptor >= 0)
+		watchDescriptor = inotify_add_watch(m_fileDescriptor, wxString(sci::nativeUnicode(directory)).fn_str(), g_inotifyWatchMask);
+	if (watchDescriptor < 0)
+	{
+		m_canWatch = false;
+		return false;
+	}
+	m_watchedDirectories[watchDescriptor] = withTrailingSeparator(directory);
+	return true;
+}
+
+void InotifyFolderWatcher::readEvents()
+{
+	const sci::string root = withTrailingSeparator(m_directory);
+	//a file often generates lots of events while it is written, we only need to check it once
+	std::set<sci::string> changedFiles;
+	alignas(inotify_event) char buffer[65536];
+	while (!m_needsRescan)
+	{
+		ssize_t length = read(m_fileDescriptor, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length < 0 && errno != EAGAIN)
+			m_needsRescan = true;
+		if (length <= 0)
+			break;
+
+		for (const char *position = buffer; position < buffer + length && !m_needsRescan; )
+		{
+			const inotify_event *event = (const inotify_event*)position;
+			position += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				//the kernel dropped events, so we no longer know what changed
+				m_needsRescan = true;
+				continue;
+			}
+			auto directory = m_watchedDirectories.find(event->wd);
+			if (directory == m_watchedDirectories.end())
+				continue;
+			if (event->mask & IN_IGNORED)
+			{
+				if (directory->second == root)
+					m_needsRescan = true;
+				m_watchedDirectories.erase(directory);
+				continue;
+			}
+			//a subdirectory being deleted or moved is dealt with via the event on its parent
+			if (event->mask & (IN_UNMOUNT | IN_DELETE_SELF | IN_MOVE_SELF))
+			{
+				if (directory->second == root)
+					m_needsRescan = true;
+				continue;
+			}
+			if (event->len == 0)
+				continue;
+
+			sci::string path = directory->second + sci::fromWxString(wxString(event->name, *wxConvFileName));
+			if (event->mask & IN_ISDIR)
+			{
+				//new directories are common (e.g. one per day) so we deal with them here, but
+				//moving or deleting directories is rare and the paths of everything below
+				//them change, so just start again
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+				{
+					addWatch(path);
+					scanDirectory(path);
+				}
+				else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+					m_needsRescan = true;
+			}
+			else
+				changedFiles.insert(path);
+		}
+	}
+
+	if (m_needsRescan)
+		return;
+	for (auto iter = changedFiles.begin(); iter != changedFiles.end(); ++iter)
+		updateFile(*iter);
+}
+
+//Records the file's current modified time, or forgets it if it no longer exists
+void InotifyFolderWatcher::updateFile(const sci::string &filename)
+{
+	sci::UtcTime modifiedTime;
+	if (getModifiedTime(filename, modifiedTime))
+	{
+		m_files[filename] = modifiedTime;
+		addNewFile(filename);
+	}
+	else
+		m_files.erase(filename);
+}
+
+//Queues a new or changed file to be checked against each processor's filename pattern next
+//time that processor looks. Deleted files are dropped from the relevant files when listed.
+void InotifyFolderWatcher::addNewFile(const sci::string &filename)
+{
+	for (auto iter = m_relevantFiles.begin(); iter != m_relevantFiles.end(); ++iter)
+		iter->second.newFiles.push_back(filename);
+}
+
+bool InotifyFolderWatcher::getModifiedTime(const sci::string &filename, sci::UtcTime &modifiedTime) const
+{
+	wxStructStat strucStat;
+	if (wxStat(sci::nativeUnicode(filename), &strucStat) != 0)
+		return false;
+	modifiedTime = sci::UtcTime::getPosixEpoch() + sci::TimeInterval(strucStat.st_mtime);
+	return true;
+}
+
+std::vector<std::pair<sci::string, sci::UtcTime>> InotifyChangesLister::listFolderContents(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime) const
+{
+	return m_watcher->listFiles(processor, startTime, endTime);
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+#ifdef __linux__
+#include"FolderChangesLister.h"
+#include<map>
+#include<set>
+#include<memory>
+#include<mutex>
+#include<optional>
+#include"Units.h"
+
+//Keeps an up to date list of every file in a directory tree, with modified times, using
+//inotify. A full recursive scan is done the first time the list is requested, if the kernel
+//event queue overflows or a watch is lost, and every rescan interval in case any events were
+//missed. Otherwise only the files that inotify reports as created, modified, moved or deleted
+//are checked.
+//Each processor's relevant files are remembered, so only new or changed files need checking
+//against the processor's filename pattern. These are keyed by the processor's address, so
+//the watcher must be replaced whenever the processors are.
+//Note inotify only sees changes made through this machine's kernel. On a network share it
+//will miss files written by other machines, so check isOnLocalFilesystem() before using it.
+//It is safe to use from several threads at once.
+class InotifyFolderWatcher
+{
+public:
+	InotifyFolderWatcher(const sci::string &directory, second rescanInterval);
+	~InotifyFolderWatcher();
+	InotifyFolderWatcher(const InotifyFolderWatcher &) = delete;
+	InotifyFolderWatcher &operator=(const InotifyFolderWatcher &) = delete;
+	const sci::string &getDirectory() const { return m_directory; }
+	//false if the directory is on a network filesystem, where other machines' writes generate no events
+	bool isOnLocalFilesystem() const { return m_isOnLocalFilesystem; }
+	//a zero or negative interval means we only rescan when inotify tells us we need to
+	void setRescanInterval(second rescanInterval);
+	std::vector<std::pair<sci::string, sci::UtcTime>> listFiles(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime);
+private:
+	struct RelevantFiles
+	{
+		sci::UtcTime startTime;
+		sci::UtcTime endTime;
+		std::set<sci::string> files; //may include files that have since been deleted
+		std::vector<sci::string> newFiles; //files created or changed since the processor last looked
+	};
+	void rescan();
+	void scanDirectory(const sci::string &directory);
+	bool addWatch(const sci::string &directory);
+	void readEvents();
+	void updateFile(const sci::string &filename);
+	void addNewFile(const sci::string &filename);
+	bool getModifiedTime(const sci::string &filename, sci::UtcTime &modifiedTime) const;
+	sci::string m_directory;
+	int m_fileDescriptor;
+	std::map<int, sci::string> m_watchedDirectories; //watch descriptor to directory, with a trailing separator
+	std::map<sci::string, std::optional<sci::UtcTime>> m_files; //the modified time is only found once the file is needed
+	std::map<const InstrumentProcessor*, RelevantFiles> m_relevantFiles;
+	bool m_needsRescan;
+	bool m_canWatch; //false if we couldn't watch the whole tree, in which case we rescan every time
+	bool m_isOnLocalFilesystem;
+	second m_rescanInterval;
+	sci::UtcTime m_lastScanTime;
+	std::mutex m_mutex;
+};
+
+//Lists changes in the same way as FolderChangesLister, but gets the folder contents from an
+//InotifyFolderWatcher rather than listing and stating every file each time. The watcher needs
+//to outlive individual listers so it can build up events between checks.
+class InotifyChangesLister : public FolderChangesLister
+{
+public:
+	InotifyChangesLister(std::shared_ptr<InotifyFolderWatcher> watcher, const sci::string snapshotFile)
+		:FolderChangesLister(watcher->getDirectory(), snapshotFile), m_watcher(watcher)
+	{}
+	std::vector<std::pair<sci::string, sci::UtcTime>> listFolderContents(const InstrumentProcessor &processor, sci::UtcTime startTime, sci::UtcTime endTime) const override;
+private:
+	std::shared_ptr<InotifyFolderWatcher> m_watcher;
+};
+#endif
@@ -3,8 +3,17 @@
 #include<wx/filename.h>
 //#include<wx/dir.h>
 #include<wx/regex.h>
+#include<unordered_map>
 
 bool InstrumentProcessor::fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime, size_t dateStartCharacter, size_t hourStartCharacter, size_t minuteStartCharacter, size_t secondStartCharacter, second fileDuration)
+{
+	sci::UtcTime fileStartTime;
+	sci::UtcTime fileEndTime;
+	getFileTimePeriod(fileName, dateStartCharacter, hourStartCharacter, minuteStartCharacter, secondStartCharacter, fileDuration, fileStartTime, fileEndTime);
+	return fileStartTime < endTime && fileEndTime >= startTime;
+}
+
+void InstrumentProcessor::getFileTimePeriod(const sci::string &fileName, size_t dateStartCharacter, size_t hourStartCharacter, size_t minuteStartCharacter, size_t secondStartCharacter, second fileDuration, sci::UtcTime &fileStart, sci::UtcTime &fileEnd)
 {
 	sci::string fileNameToSplit = sci::fromWxString(wxFileName(sci::nativeUnicode(fileName)).GetFullName());
 	int year;
@@ -40,82 +49,79 @@ bool InstrumentProcessor::fileCoversTimePeriod(sci::string fileName, sci::UtcTim
 		stream.str(fileNameToSplit.substr(secondStartCharacter, 2));
 		stream >> second;
 	}
-	sci::UtcTime fileStartTime(year, month, day, hour, minute, second);
-	return fileStartTime < endTime && (fileStartTime + fileDuration) >= startTime;
+	fileStart = sci::UtcTime(year, month, day, hour, minute, second);
+	fileEnd = fileStart + fileDuration;
 }
 
-std::vector<std::vector<sci::string>> InstrumentProcessor::groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles, size_t dateStartCharacter, size_t dateLength)
+std::vector<sci::string> InstrumentProcessor::selectRelevantFiles(const std::vector<sci::string> &allFiles, sci::UtcTime startTime, sci::UtcTime endTime) const
 {
-	//Here we grab the date from each file based on it starting at the given character in the filename (path removed)
-	//it doesn't matter what format the date is in, providing it is consistent as we just check for equality
-
-	std::vector<std::vector<sci::string>> result;
-	std::vector<sci::string> unassignedNewFiles = newFiles;
-
-	//extract the dates from all the existing files
-	std::vector<sci::string> datesAllFiles(allFiles.size());
-	for (size_t i = 0; i < datesAllFiles.size(); ++i)
-	{
-		wxFileName fileNameToSplit(sci::nativeUnicode(allFiles[i]));
-		datesAllFiles[i] = sci::fromWxString(fileNameToSplit.GetFullName()).substr(dateStartCharacter, dateLength);
-	}
-	std::vector<sci::string> datesNewFiles(newFiles.size());
-	for (size_t i = 0; i < datesNewFiles.size(); ++i)
-	{
-		wxFileName fileNameToSplit(sci::nativeUnicode(newFiles[i]));
-		datesNewFiles[i] = sci::fromWxString(fileNameToSplit.GetFullName()).substr(dateStartCharacter, dateLength);
-	}
-
-
-	for (size_t i = 0; i < datesNewFiles.size(); ++i)
+	std::lock_guard<std::mutex> lock(m_fileIndex->mutex);
+	std::vector<sci::string> finalFiles;
+	//the regex only gets compiled if there are files we haven't seen before
+	std::unique_ptr<wxRegEx> regularExpression;
+	for (size_t i = 0; i < allFiles.size(); ++i)
 	{
-		//check we have a valid date - we blank out duplicate dates.
-		if (datesNewFiles[i] != sU(""))
+		auto indexed = m_fileIndex->files.find(allFiles[i]);
+		if (indexed == m_fileIndex->files.end())
 		{
-			//expand our result
-			result.resize(result.size() + 1);
-
-			//go through all the files and grab those that have a date the same as the current
-			//unassigned new file
-			for (size_t j = 0; j < allFiles.size(); ++j)
-			{
-				if (datesAllFiles[j] == datesNewFiles[i])
-				{
-					result.back().push_back(allFiles[j]);
-				}
-			}
-
-			//now go through all the remaining unassigned new files and blank out the date if it matches
-			//Note we strt at i+1 otherwise we overwrite the date we just used and then no other dates
-			//will match it
-			for (size_t j = i + 1; j < datesNewFiles.size(); ++j)
+			if (!regularExpression)
 			{
-				if (datesNewFiles[j] == datesNewFiles[i])
-					datesNewFiles[j] = sU("");
+				regularExpression.reset(new wxRegEx(wxString(sci::nativeUnicode(m_fileSearchRegEx))));
+				sci::assertThrow(regularExpression->IsValid(), sci::err(sci::SERR_USER, 0, sci::nativeCodepage(m_fileSearchRegEx)));
 			}
+			IndexedFile file{ false, false, sci::UtcTime(), sci::UtcTime() };
+			file.matchesRegex = regularExpression->Matches(sci::nativeUnicode(allFiles[i]));
+			if (file.matchesRegex)
+				file.hasTimePeriod = getFileTimePeriod(allFiles[i], file.start, file.end);
+			indexed = m_fileIndex->files.emplace(allFiles[i], file).first;
 		}
+
+		const IndexedFile &file = indexed->second;
+		if (!file.matchesRegex)
+			continue;
+		if (file.hasTimePeriod ? (file.start < endTime && file.end >= startTime) : fileCoversTimePeriod(allFiles[i], startTime, endTime))
+			finalFiles.push_back(allFiles[i]);
 	}
+	return finalFiles;
+}
 
-	return result;
+std::vector<std::vector<sci::string>> InstrumentProcessor::groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles, size_t dateStartCharacter, size_t dateLength)
+{
+	//Here we grab the date from each file based on it starting at the given character in the filename (path removed)
+	//it doesn't matter what format the date is in, providing it is consistent as we just check for equality
+	return groupInputFilesbyOutputFiles(newFiles, allFiles, [dateStartCharacter, dateLength](const sci::string &filename)
+		{
+			size_t nameStart = filename.find_last_of(sU("/\\"));
+			nameStart = nameStart == sci::string::npos ? 0 : nameStart + 1;
+			if (filename.length() < nameStart + dateStartCharacter + dateLength)
+				return sci::string();
+			return filename.substr(nameStart + dateStartCharacter, dateLength);
+		});
 }
 
-std::vector<sci::string> InstrumentProcessor::selectRelevantFilesUsingRegEx(const std::vector<sci::string> &allFiles, sci::string regEx)
+std::vector<std::vector<sci::string>> InstrumentProcessor::groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles, const std::function<sci::string(const sci::string &)> &getOutputKey)
 {
-	std::vector<sci::string> result;
-	result.reserve(allFiles.size());
-	wxRegEx regularExpression = wxString(sci::nativeUnicode(regEx));
-	sci::assertThrow(regularExpression.IsValid(), sci::err(sci::SERR_USER, 0, sci::nativeCodepage(regEx)));
-	for (size_t i = 0; i < allFiles.size(); ++i)
+	//give each output with a new file a group, in the order the new files are found
+	std::vector<std::vector<sci::string>> result;
+	std::unordered_map<sci::string, size_t> groupIndices;
+	groupIndices.reserve(newFiles.size());
+	for (size_t i = 0; i < newFiles.size(); ++i)
 	{
-		if (regularExpression.Matches(sci::nativeUnicode(allFiles[i])))
-		{
-			result.push_back(allFiles[i]);
-		}
+		sci::string key = getOutputKey(newFiles[i]);
+		if (key.length() > 0 && groupIndices.emplace(key, result.size()).second)
+			result.resize(result.size() + 1);
 	}
-	return result;
-}
 
+	//then put every file in the group for its output, if there is one
+	for (size_t i = 0; i < allFiles.size() && result.size() > 0; ++i)
+	{
+		auto group = groupIndices.find(getOutputKey(allFiles[i]));
+		if (group != groupIndices.end())
+			result[group->second].push_back(allFiles[i]);
+	}
 
+	return result;
+}
 
 #include"Lidar.h"
 #include"Ceilometer.h"
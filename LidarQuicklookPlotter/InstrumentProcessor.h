@@ -7,6 +7,9 @@
 #include<svector/sstring.h>
 #include<svector/time.h>
 #include<memory>
+#include<functional>
+#include<mutex>
+#include<unordered_map>
 
 class ProgressReporter;
 class Platform;
@@ -37,7 +40,7 @@ public:
 	//_myInstrument
 	//a . (escaped)
 	//ext
-	InstrumentProcessor(sci::string fileSearchRegEx) : m_fileSearchRegEx(fileSearchRegEx) {}
+	InstrumentProcessor(sci::string fileSearchRegEx) : m_fileSearchRegEx(fileSearchRegEx), m_fileIndex(new FileIndex) {}
 	virtual ~InstrumentProcessor() {}
 	sci::string getFileSearchRegex() const { return m_fileSearchRegEx; }
 	//virtual void readDataAndPlot(const std::string &inputFilename, const std::string &outputFilename, const std::vector<double> maxRanges, ProgressReporter &progressReporter, wxWindow *parent);
@@ -47,29 +50,52 @@ public:
 		const ProcessingSoftwareInfo &processingSoftwareInfo, const ProjectInfo &projectInfo,
 		const Platform &platform, const ProcessingOptions &processingOptions, ProgressReporter &progressReporter) = 0;
 	virtual bool hasData() const = 0;
+	//Processors that can add files to the data they already hold, without reading it all again,
+	//override these. The new files always come after all the files already read. If
+	//replaceLastFile is true the data from the last file already read are dropped first, because
+	//it has grown since, and inputFilenames starts with that file again.
+	virtual bool canAppendData() const { return false; }
+	virtual void appendData(const std::vector<sci::string> &inputFilenames, bool replaceLastFile, const Platform &platform, ProgressReporter &progressReporter)
+	{
+		readData(inputFilenames, platform, progressReporter);
+	}
+	//called once the processing options have been read, before any data are read. Override this
+	//if the processor has options that affect how it reads data.
+	virtual void setProcessingOptions(const ProcessingOptions &processingOptions) {}
 	virtual bool fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime) const = 0;
 	static bool fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime, size_t dateStartCharacter, size_t hourStartCharacter, size_t minuteStartCharacter, size_t secondStartCharacter, second fileDuration);
+	//Override this if the time period of a file can be found from its name. The period is then
+	//worked out once per file and remembered, rather than calling fileCoversTimePeriod every time
+	//we select files. A file covers a period if it starts before the period ends and ends at or
+	//after the period starts, so fileCoversTimePeriod must give the same answer.
+	virtual bool getFileTimePeriod(const sci::string &fileName, sci::UtcTime &fileStart, sci::UtcTime &fileEnd) const { return false; }
+	static void getFileTimePeriod(const sci::string &fileName, size_t dateStartCharacter, size_t hourStartCharacter, size_t minuteStartCharacter, size_t secondStartCharacter, second fileDuration, sci::UtcTime &fileStart, sci::UtcTime &fileEnd);
 	virtual std::vector<std::vector<sci::string>> groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles) const = 0;
 	static std::vector<std::vector<sci::string>> groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles, size_t dateStartCharacter, size_t dateLength);
-	virtual std::vector<sci::string> selectRelevantFiles(const std::vector<sci::string> &allFiles, sci::UtcTime startTime, sci::UtcTime endTime) const
-	{
-		std::vector<sci::string> regexMatchingFiles = selectRelevantFilesUsingRegEx(allFiles, m_fileSearchRegEx);
-		std::vector<sci::string> finalFiles;
-		if (regexMatchingFiles.size() > 0)
-		{
-			finalFiles.reserve(regexMatchingFiles.size());
-			for (auto iter = regexMatchingFiles.begin(); iter != regexMatchingFiles.end(); ++iter)
-			{
-				if (fileCoversTimePeriod(*iter, startTime, endTime))
-					finalFiles.push_back(*iter);
-			}
-		}
-		return finalFiles;
-	}
+	//Groups all the files that go in the same output as any of the new files. getOutputKey gives
+	//the part of a filename that identifies its output, usually the date, or an empty string if
+	//it can't tell. Each group keeps the order of allFiles.
+	static std::vector<std::vector<sci::string>> groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles, const std::function<sci::string(const sci::string &)> &getOutputKey);
+	virtual std::vector<sci::string> selectRelevantFiles(const std::vector<sci::string> &allFiles, sci::UtcTime startTime, sci::UtcTime endTime) const;
 	virtual sci::string getName() const = 0;
 private:
 	sci::string m_fileSearchRegEx;
-	static std::vector<sci::string> selectRelevantFilesUsingRegEx(const std::vector<sci::string> &allFiles, sci::string regEx);
+	//What we have found out about each file we have been asked to select from, so that each file
+	//only gets checked against the regex and has its time period parsed once. It is kept for the
+	//life of the processor, so each check for new files only does this work for the new files.
+	struct IndexedFile
+	{
+		bool matchesRegex;
+		bool hasTimePeriod;
+		sci::UtcTime start;
+		sci::UtcTime end;
+	};
+	struct FileIndex
+	{
+		std::mutex mutex;
+		std::unordered_map<sci::string, IndexedFile> files;
+	};
+	std::shared_ptr<FileIndex> m_fileIndex;
 };
 
 std::shared_ptr<InstrumentProcessor> getProcessorByName(sci::string name, InstrumentInfo &instrumentInfo, CalibrationInfo &calibrationInfo);
\ No newline at end of file
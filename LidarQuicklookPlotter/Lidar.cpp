@@ -9,104 +9,443 @@
 #include<svector/sstring.h>
 #include"ProgressReporter.h"
 #include<svector/gridtupleview.h>
+#include"MemoryMappedFile.h"
+#include"HplFileCache.h"
+#include"ThreadJoiner.h"
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+
+//Appends row as the last row of a profile x gate block. If the number of gates differs from
+//the rows already in the block then whichever is shorter is padded with padValue.
+template<class T>
+void appendPaddedRow(sci::GridData<T, 2> &grid, const sci::GridData<T, 1> &row, const T &padValue)
+{
+	size_t nRows = grid.shape()[0];
+	size_t nColumns = nRows == 0 ? row.size() : grid.shape()[1];
+	if (row.size() > nColumns)
+	{
+		//the user increased the number of gates during the day, so widen the block. This
+		//is rare so we don't worry about the cost of the copy
+		sci::GridData<T, 2> widened({ nRows, row.size() }, padValue);
+		for (size_t i = 0; i < nRows; ++i)
+			for (size_t j = 0; j < nColumns; ++j)
+				widened[i][j] = grid[i][j];
+		grid = std::move(widened);
+		nColumns = row.size();
+	}
+	if (row.size() == nColumns)
+		grid.push_back(row);
+	else
+	{
+		sci::GridData<T, 1> paddedRow(nColumns, padValue);
+		for (size_t i = 0; i < row.size(); ++i)
+			paddedRow[i] = row[i];
+		grid.push_back(paddedRow);
+	}
+}
+
+//Keeps the first nRows rows and nColumns columns of a profile x gate block, the opposite of
+//appendPaddedRow. This copies the block, but that is still much quicker than reading the
+//files again.
+template<class T>
+void removeLastRows(sci::GridData<T, 2> &grid, size_t nRows, size_t nColumns)
+{
+	sci::GridData<T, 2> kept({ nRows, nColumns }, T());
+	kept.reserve(grid.shape()[0]);
+	for (size_t i = 0; i < nRows; ++i)
+		for (size_t j = 0; j < nColumns; ++j)
+			kept[i][j] = grid[i][j];
+	grid = std::move(kept);
+}
+
+std::vector<std::pair<uint8_t, sci::string>> getLidarDopplerFlags(const ProcessingOptions &processingOptions)
+{
+	sci::ostringstream snrBelow3;
+	snrBelow3 << sU("SNR less than ") << processingOptions.lidarSnrFlagThreshold3;
+	sci::ostringstream snrBelow2;
+	snrBelow2 << sU("SNR less_than ") << processingOptions.lidarSnrFlagThreshold2;
+	sci::ostringstream snrBelow1;
+	snrBelow1 << sU("SNR less_than ") << processingOptions.lidarSnrFlagThreshold1;
+	sci::ostringstream dopplerOutOfRange;
+	dopplerOutOfRange << sU("doppler velocity out of +- ") << processingOptions.lidarDopplerFlagLimit << sU(" m s-1 range");
+	return std::vector<std::pair<uint8_t, sci::string>>
+	{
+		{ lidarUnusedFlag, sU("not_used") },
+		{ lidarGoodDataFlag, sU("good_data") },
+		{ lidarSnrBelow3Flag, snrBelow3.str() },
+		{ lidarSnrBelow2Flag, snrBelow2.str() },
+		{ lidarSnrBelow1Flag, snrBelow1.str() },
+		{ lidarDopplerOutOfRangeFlag, dopplerOutOfRange.str() },
+		{ lidarUserChangedGatesFlag, sU("user changed number of gates during the day so padding with fill value") },
+		{ lidarClippedWindProfileFlag, sU("wind profiles are clipped by manufacturer software so padding wih fill value") },
+		{ lidarPaddedBackscatter, sU("padded crosspolarised or copolarised data to match the other in dimension size") },
+		{ lidarNonMatchingRanges, sU("crosspolarised and copolarised data do not have matching ranges or directions") },
+		{ lidarCoAndCrossMisaligned, sU("copolarised and crosspolarised beams are misaligned") },
+		{ lidarMissingDataFlag, sU("lidar data missing, probably due to the number of gates being changed durang the day.") }
+	};
+}
+
+//Flags every gate of a profile in one pass over its data. The checks are in order of
+//precedence, so a gate gets the first flag that applies: missing data, doppler out of range
+//(doppler only), then SNR below threshold 1, 2 and 3. They are written as selects rather than
+//branches so the compiler can use conditional moves. Note the instrument reports SNR+1.
+void flagProfile(const HplProfile &profile, const ProcessingOptions &processingOptions, sci::GridData<uint8_t, 1> &dopplerVelocityFlags, sci::GridData<uint8_t, 1> &betaFlags)
+{
+	const float intensityThreshold1 = float(processingOptions.lidarSnrFlagThreshold1 + 1.0);
+	const float intensityThreshold2 = float(processingOptions.lidarSnrFlagThreshold2 + 1.0);
+	const float intensityThreshold3 = float(processingOptions.lidarSnrFlagThreshold3 + 1.0);
+	const float dopplerLimit = float(processingOptions.lidarDopplerFlagLimit);
+	const sci::GridData<unitlessF, 1> &intensities = profile.getIntensities();
+	const sci::GridData<metrePerSecondF, 1> &dopplerVelocities = profile.getDopplerVelocities();
+	const sci::GridData<perSteradianPerMetreF, 1> &betas = profile.getBetas();
+	const size_t nGates = profile.nGates();
+	dopplerVelocityFlags.resize(nGates);
+	betaFlags.resize(nGates);
+	for (size_t i = 0; i < nGates; ++i)
+	{
+		const float intensity = intensities[i].value<unitlessF::unit>();
+		const float dopplerVelocity = dopplerVelocities[i].value<metrePerSecondF::unit>();
+		const float beta = betas[i].value<perSteradianPerMetreF::unit>();
+		uint8_t snrFlag = intensity < intensityThreshold3 ? lidarSnrBelow3Flag : lidarGoodDataFlag;
+		snrFlag = intensity < intensityThreshold2 ? lidarSnrBelow2Flag : snrFlag;
+		snrFlag = intensity < intensityThreshold1 ? lidarSnrBelow1Flag : snrFlag;
+		const bool intensityMissing = std::isnan(intensity);
+		uint8_t dopplerFlag = std::abs(dopplerVelocity) > dopplerLimit ? lidarDopplerOutOfRangeFlag : snrFlag;
+		dopplerFlag = (std::isnan(dopplerVelocity) || intensityMissing) ? lidarMissingDataFlag : dopplerFlag;
+		dopplerVelocityFlags[i] = dopplerFlag;
+		betaFlags[i] = (std::isnan(beta) || intensityMissing) ? lidarMissingDataFlag : snrFlag;
+	}
+}
+
+void LidarBackscatterDopplerProcessor::clearProfiles()
+{
+	m_times.clear();
+	m_azimuths.clear();
+	m_elevations.clear();
+	m_pitches.clear();
+	m_rolls.clear();
+	m_nGates.clear();
+	m_gates.clear();
+	m_dopplerVelocities.clear();
+	m_intensities.clear();
+	m_betas.clear();
+	m_headerIndex.clear();
+	m_betaFlags.clear();
+	m_dopplerFlags.clear();
+	m_correctedAzimuths.clear();
+	m_correctedElevations.clear();
+	m_correctedDopplerVelocities.clear();
+}
+
+//Removes the profiles from the last file read, leaving everything exactly as if that file had
+//never been read, including the number of gates if that file was the only one with more.
+void LidarBackscatterDopplerProcessor::removeLastFile()
+{
+	if (m_hplHeaders.size() == 0)
+		return;
+	size_t nProfiles = m_headerIndex.size();
+	while (nProfiles > 0 && m_headerIndex[nProfiles - 1] == m_hplHeaders.size() - 1)
+		--nProfiles;
+	m_hplHeaders.pop_back();
+	if (nProfiles == 0)
+	{
+		clearProfiles();
+		m_hasData = m_hplHeaders.size() > 0;
+		return;
+	}
+	size_t nColumns = 0;
+	for (size_t i = 0; i < nProfiles; ++i)
+		nColumns = std::max(nColumns, m_nGates[i]);
+
+	m_times.resize(nProfiles);
+	m_azimuths.resize(nProfiles);
+	m_elevations.resize(nProfiles);
+	m_pitches.resize(nProfiles);
+	m_rolls.resize(nProfiles);
+	m_nGates.resize(nProfiles);
+	removeLastRows(m_gates, nProfiles, nColumns);
+	removeLastRows(m_dopplerVelocities, nProfiles, nColumns);
+	removeLastRows(m_intensities, nProfiles, nColumns);
+	removeLastRows(m_betas, nProfiles, nColumns);
+	m_headerIndex.resize(nProfiles);
+	removeLastRows(m_betaFlags, nProfiles, nColumns);
+	removeLastRows(m_dopplerFlags, nProfiles, nColumns);
+	m_correctedAzimuths.resize(nProfiles);
+	m_correctedElevations.resize(nProfiles);
+	removeLastRows(m_correctedDopplerVelocities, nProfiles, nColumns);
+}
+
+void LidarBackscatterDopplerProcessor::reserveProfiles(size_t nProfiles)
+{
+	m_times.reserve(nProfiles);
+	m_azimuths.reserve(nProfiles);
+	m_elevations.reserve(nProfiles);
+	m_pitches.reserve(nProfiles);
+	m_rolls.reserve(nProfiles);
+	m_nGates.reserve(nProfiles);
+	m_gates.reserve(nProfiles);
+	m_dopplerVelocities.reserve(nProfiles);
+	m_intensities.reserve(nProfiles);
+	m_betas.reserve(nProfiles);
+	m_headerIndex.reserve(nProfiles);
+	m_betaFlags.reserve(nProfiles);
+	m_dopplerFlags.reserve(nProfiles);
+	m_correctedAzimuths.reserve(nProfiles);
+	m_correctedElevations.reserve(nProfiles);
+	m_correctedDopplerVelocities.reserve(nProfiles);
+}
+
+void LidarBackscatterDopplerProcessor::appendProfile(const HplProfile &profile, const sci::UtcTime &time)
+{
+	m_times.push_back(time);
+	m_azimuths.push_back(profile.getAzimuth());
+	m_elevations.push_back(profile.getElevation());
+	m_pitches.push_back(profile.getPitch());
+	m_rolls.push_back(profile.getRoll());
+	m_nGates.push_back(profile.nGates());
+	appendPaddedRow(m_gates, profile.getGates(), std::numeric_limits<size_t>::max());
+	appendPaddedRow(m_dopplerVelocities, profile.getDopplerVelocities(), std::numeric_limits<metrePerSecondF>::quiet_NaN());
+	appendPaddedRow(m_intensities, profile.getIntensities(), std::numeric_limits<unitlessF>::quiet_NaN());
+	appendPaddedRow(m_betas, profile.getBetas(), std::numeric_limits<perSteradianPerMetreF>::quiet_NaN());
+}
+
+void LidarBackscatterDopplerProcessor::setProcessingOptions(const ProcessingOptions &processingOptions)
+{
+	m_processingOptions = processingOptions;
+	if (processingOptions.hplCacheDirectory.length() > 0)
+		m_hplCache.reset(new HplFileCache(processingOptions.hplCacheDirectory, processingOptions.hplCacheMaxMegabytes * 1024 * 1024));
+	else
+		m_hplCache.reset();
+	SharedHplMemoryCache::getInstance().setMaxBytes(processingOptions.sharedHplCacheMegabytes * 1024 * 1024);
+}
 
 void LidarBackscatterDopplerProcessor::readData(const std::vector<sci::string> &inputFilenames, const Platform &platform, ProgressReporter &progressReporter)
 {
+	size_t nThreads = std::min(m_processingOptions.fileReadingThreads, inputFilenames.size());
+	if (nThreads < 2)
+	{
+		for (size_t i = 0; i < inputFilenames.size(); ++i)
+		{
+			//after reading the first file reserve space for the remaining files. This
+			//can speed things up a lot
+			if (i == 1)
+			{
+				size_t reserveSize = m_times.size()*(inputFilenames.size() + 1); // the +1 gives a bit of slack
+				reserveProfiles(reserveSize);
+				m_hplHeaders.reserve(reserveSize);
+			}
+
+			readData(inputFilenames[i], platform, progressReporter, i == 0);
+			if (progressReporter.shouldStop())
+				break;
+		}
+		return;
+	}
+
+	//Parse the files on a pool of worker threads, each of which takes the next unparsed file
+	//until there are none left. The parsed files are merged on this thread in the original
+	//order, so the profiles stay in time order and the platform is only used from one thread.
+	//Workers only start a file once it is within nThreads of the next file to merge, so if one
+	//file is slow the others wait rather than filling memory with parsed files.
+	//Each worker's progress is buffered and only reported when its file is merged, so the
+	//output reads the same as when the files are read one at a time.
+	m_hasData = false;
+	m_hplHeaders.clear();
+	clearProfiles();
+
+	std::vector<std::shared_ptr<const ParsedHplFile>> parsedFiles(inputFilenames.size());
+	std::vector<std::vector<BufferedProgressReporter::Progress>> fileProgress(inputFilenames.size());
+	std::vector<std::exception_ptr> fileErrors(inputFilenames.size());
+	std::vector<bool> fileParsed(inputFilenames.size(), false);
+	std::mutex mutex;
+	std::condition_variable fileParsedCondition;
+	std::atomic<bool> stop(false);
+	std::atomic<size_t> nextFile(0);
+	size_t nMerged = 0;
+
+	auto worker = [&]()
+	{
+		for (size_t i = nextFile++; i < inputFilenames.size() && !stop; i = nextFile++)
+		{
+			{
+				//stop is set without notifying, so check it regularly
+				std::unique_lock<std::mutex> lock(mutex);
+				while (i >= nMerged + nThreads && !stop)
+					fileParsedCondition.wait_for(lock, std::chrono::milliseconds(100));
+			}
+			if (stop)
+				break;
+			BufferedProgressReporter bufferedProgressReporter(stop);
+			try
+			{
+				parseFile(inputFilenames[i], parsedFiles[i], bufferedProgressReporter);
+			}
+			catch (...)
+			{
+				fileErrors[i] = std::current_exception();
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				fileProgress[i] = bufferedProgressReporter.getBufferedProgress();
+				fileParsed[i] = true;
+			}
+			fileParsedCondition.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	ThreadJoiner threadJoiner(threads, stop);
+	for (size_t i = 0; i < nThreads; ++i)
+		threads.push_back(std::thread(worker));
+
 	for (size_t i = 0; i < inputFilenames.size(); ++i)
 	{
-		//after reading the first file reserve space for the remaining files. This
-		//can speed things up a lot
-		if (i == 1)
+		//wait for this file, checking regularly whether the user wants us to stop
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!fileParsedCondition.wait_for(lock, std::chrono::milliseconds(100), [&]() { return fileParsed[i]; }))
+		{
+			lock.unlock();
+			bool userStopped = progressReporter.shouldStop();
+			lock.lock();
+			if (userStopped)
+			{
+				stop = true;
+				lock.unlock();
+				progressReporter << sU("Reading stopped at user request.\n");
+				return;
+			}
+		}
+		lock.unlock();
+
+		BufferedProgressReporter::replay(fileProgress[i], progressReporter);
+		if (fileErrors[i])
+			std::rethrow_exception(fileErrors[i]);
+		mergeFile(*parsedFiles[i], inputFilenames[i], platform);
+		parsedFiles[i].reset();
 		{
-			size_t reserveSize = m_profiles.size()*(inputFilenames.size() + 1); // the +1 gives a bit of slack
-			m_profiles.reserve(reserveSize);
+			std::lock_guard<std::mutex> mergedLock(mutex);
+			nMerged = i + 1;
+		}
+		fileParsedCondition.notify_all();
+
+		if (i == 0)
+		{
+			size_t reserveSize = m_times.size()*(inputFilenames.size() + 1); // the +1 gives a bit of slack
+			reserveProfiles(reserveSize);
 			m_hplHeaders.reserve(reserveSize);
-			m_headerIndex.reserve(reserveSize);
-			m_betaFlags.reserve(reserveSize);
-			m_dopplerFlags.reserve(reserveSize);
-			m_correctedAzimuths.reserve(reserveSize);
-			m_correctedElevations.reserve(reserveSize);
-			m_correctedDopplerVelocities.reserve(reserveSize);
 		}
+		if (progressReporter.shouldStop())
+			break;
+	}
+}
 
-		readData(inputFilenames[i], platform, progressReporter, i == 0);
+//Merges the files onto the end of the profiles we already have, exactly as if they had been
+//read along with the earlier files
+void LidarBackscatterDopplerProcessor::appendData(const std::vector<sci::string> &inputFilenames, bool replaceLastFile, const Platform &platform, ProgressReporter &progressReporter)
+{
+	if (replaceLastFile)
+		removeLastFile();
+	reserveProfiles(m_times.size() + (m_times.size() / std::max(size_t(1), m_hplHeaders.size()) + 1) * inputFilenames.size());
+	for (size_t i = 0; i < inputFilenames.size(); ++i)
+	{
+		readData(inputFilenames[i], platform, progressReporter, false);
 		if (progressReporter.shouldStop())
 			break;
 	}
 }
+
 void LidarBackscatterDopplerProcessor::readData(const sci::string &inputFilename, const Platform &platform, ProgressReporter &progressReporter, bool clear)
 {
 	if (clear)
 	{
 		m_hasData = false;
-		m_profiles.clear();
 		m_hplHeaders.clear();
-		m_headerIndex.clear();
-		m_betaFlags.clear();
-		m_dopplerFlags.clear();
-		m_correctedAzimuths.clear();
-		m_correctedElevations.clear();
-		m_correctedDopplerVelocities.clear();
+		clearProfiles();
 	}
 
+	std::shared_ptr<const ParsedHplFile> parsedFile;
+	if (parseFile(inputFilename, parsedFile, progressReporter))
+		mergeFile(*parsedFile, inputFilename, platform);
+}
+
+//Reads the header and all the profiles from a file. This doesn't modify the processor, so
+//it is safe to parse several files at once on different threads. Returns false if the user
+//asked us to stop before the whole file was read.
+//The parsed file may be shared with other processors via the SharedHplMemoryCache, so it
+//must not be modified.
+bool LidarBackscatterDopplerProcessor::parseFile(const sci::string &inputFilename, std::shared_ptr<const ParsedHplFile> &result, ProgressReporter &progressReporter) const
+{
+	//If another processor has already parsed this file we can just share its copy
+	SharedHplMemoryCache &sharedCache = SharedHplMemoryCache::getInstance();
+	result = sharedCache.find(inputFilename);
+	if (result)
+	{
+		progressReporter << sU("Read file ") << inputFilename << sU(" from memory, ") << result->profiles.size() << sU(" profiles.\n");
+		return true;
+	}
+
+	std::shared_ptr<ParsedHplFile> parsedFilePointer(new ParsedHplFile);
+	ParsedHplFile &parsedFile = *parsedFilePointer;
+	//If this file hasn't changed since we last parsed it we can just grab it from the cache
+	if (m_hplCache)
+	{
+		if (m_hplCache->load(inputFilename, parsedFile.header, parsedFile.profiles))
+		{
+			progressReporter << sU("Read file ") << inputFilename << sU(" from the cache, ") << parsedFile.profiles.size() << sU(" profiles.\n");
+			sharedCache.store(inputFilename, parsedFilePointer);
+			result = parsedFilePointer;
+			return true;
+		}
+		parsedFile = ParsedHplFile();
+	}
+
+	//The file is either read via a stream or parsed directly from a memory map
+	//depending on the processing options. Both should give identical results, HplParsingComparison
+	//checks this.
+	const bool memoryMapped = m_processingOptions.memoryMappedHplParsing;
 	std::fstream fin;
-	fin.open(sci::nativeUnicode(inputFilename), std::ios::in);
-	if (!fin.is_open())
-		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not open lidar file ") + inputFilename + sU(".")));
+	std::unique_ptr<MemoryMappedFile> mappedFile;
+	const char *position = nullptr;
+	const char *end = nullptr;
+	if (memoryMapped)
+	{
+		mappedFile.reset(new MemoryMappedFile(inputFilename));
+		position = mappedFile->begin();
+		end = mappedFile->end();
+	}
+	else
+	{
+		fin.open(sci::nativeUnicode(inputFilename), std::ios::in);
+		if (!fin.is_open())
+			sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not open lidar file ") + inputFilename + sU(".")));
+	}
 
 	progressReporter << sU("Reading file ") << inputFilename << sU(".\n");
 
 	//Read the HPL header from the top of the file
-	m_hplHeaders.resize(m_hplHeaders.size() + 1);
-	fin >> m_hplHeaders.back();
+	if (memoryMapped)
+		readHplHeader(position, end, parsedFile.header);
+	else
+		fin >> parsedFile.header;
 
 	bool readingOkay = true;
 	size_t nRead = 0;
 	//Read each profile in turn
 	while (readingOkay)
 	{
-		m_profiles.resize(m_profiles.size() + 1);
+		parsedFile.profiles.resize(parsedFile.profiles.size() + 1);
 		//Read the profile itself - it takes the header as an input to give details of what needs reading
-		readingOkay = m_profiles.back().readFromStream(fin, m_hplHeaders.back());
+		if (memoryMapped)
+			readingOkay = parsedFile.profiles.back().readFromBuffer(position, end, parsedFile.header);
+		else
+			readingOkay = parsedFile.profiles.back().readFromStream(fin, parsedFile.header);
 		if (!readingOkay) //we hit the end of the file while reading this profile
-			m_profiles.resize(m_profiles.size() - 1);
+			parsedFile.profiles.pop_back();
 		++nRead;
 		if (readingOkay)
 		{
-			//check the time is ascending, we can sometimes cross into the next day, in which case the time recorded for the profile
-			//resets to close to 0. Increment the time by a day as needed;
-			if (m_profiles.size() > 1)
-				while (m_profiles[m_profiles.size() - 1].getTime<sci::UtcTime>() < m_profiles[m_profiles.size() - 2].getTime<sci::UtcTime>())
-					m_profiles[m_profiles.size() - 1].setTime(m_profiles[m_profiles.size() - 1].getTime<sci::UtcTime>() + second(24.0*60.0*60.0));
-			//correct azimuths and elevations for platform orientation
-			m_correctedAzimuths.resize(m_profiles.size(), degreeF(0.0));
-			m_correctedElevations.resize(m_profiles.size(), degreeF(0.0));
-			second profileDuration = (unitlessF((unitlessF::valueType)m_hplHeaders.back().pulsesPerRay) / sci::Physical<sci::Hertz<1, 3>, typename unitlessF::valueType>(15.0));
-			platform.correctDirection(m_profiles.back().getTime<sci::UtcTime>(), m_profiles.back().getTime<sci::UtcTime>() + profileDuration, m_profiles.back().getAzimuth(), m_profiles.back().getElevation(), m_correctedAzimuths.back(), m_correctedElevations.back());
-			metrePerSecondF u;
-			metrePerSecondF v;
-			metrePerSecondF w;
-			platform.getInstrumentVelocity(m_profiles.back().getTime<sci::UtcTime>(), m_profiles.back().getTime<sci::UtcTime>() + profileDuration, u, v, w);
-			metrePerSecondF offset = u * sci::sin(m_correctedAzimuths.back())*sci::cos(m_correctedElevations.back())
-				+ v * sci::cos(m_correctedAzimuths.back())*sci::cos(m_correctedElevations.back())
-				+ w * sci::sin(m_correctedElevations.back());
-			m_correctedDopplerVelocities.push_back(m_profiles.back().getDopplerVelocities() + offset);
-
-			m_headerIndex.push_back(m_hplHeaders.size() - 1);//record which header this profile is linked to
-			sci::GridData<uint8_t, 1> dopplerVelocityFlags(m_profiles.back().nGates(), lidarGoodDataFlag);
-			sci::GridData<uint8_t, 1> betaFlags(m_profiles.back().nGates(), lidarGoodDataFlag);
-			//flag for out of range doppler
-			sci::assign(dopplerVelocityFlags, (dopplerVelocityFlags == lidarGoodDataFlag) && (m_profiles.back().getDopplerVelocities() > metrePerSecondF(19.0) || m_profiles.back().getDopplerVelocities() < metrePerSecondF(-19.0)), lidarDopplerOutOfRangeFlag);
-			//flag for bad snr - not intensity reported by instrument is snr+1
-			sci::assign(dopplerVelocityFlags,(dopplerVelocityFlags == lidarGoodDataFlag) && (m_profiles.back().getIntensities() < unitlessF(2.0)), lidarSnrBelow1Flag);
-			sci::assign(dopplerVelocityFlags, (dopplerVelocityFlags == lidarGoodDataFlag) && (m_profiles.back().getIntensities() < unitlessF(3.0)), lidarSnrBelow2Flag);
-			sci::assign(dopplerVelocityFlags, (dopplerVelocityFlags == lidarGoodDataFlag) && (m_profiles.back().getIntensities() < unitlessF(4.0)), lidarSnrBelow3Flag);
-			sci::assign(betaFlags, (betaFlags == lidarGoodDataFlag) && (m_profiles.back().getIntensities() < unitlessF(2.0)), lidarSnrBelow1Flag);
-			sci::assign(betaFlags, (betaFlags == lidarGoodDataFlag) && (m_profiles.back().getIntensities() < unitlessF(3.0)), lidarSnrBelow2Flag);
-			sci::assign(betaFlags, (betaFlags == lidarGoodDataFlag) && (m_profiles.back().getIntensities() < unitlessF(4.0)), lidarSnrBelow3Flag);
-			m_betaFlags.push_back(betaFlags);
-			m_dopplerFlags.push_back(dopplerVelocityFlags);
-
 			if (nRead == 1)
 				progressReporter << sU("Read profile 1");
 			else if (nRead <= 50)
@@ -115,24 +454,80 @@ void LidarBackscatterDopplerProcessor::readData(const sci::string &inputFilename
 				progressReporter << sU(", ") << nRead - 9 << sU("-") << nRead;
 		}
 		if (progressReporter.shouldStop())
-			break;
+		{
+			progressReporter << sU(", stopped at user request.\n");
+			return false;
+		}
+	}
+	progressReporter << sU(", Reading done.\n");
+	if (m_hplCache)
+		m_hplCache->store(inputFilename, parsedFile.header, parsedFile.profiles);
+	sharedCache.store(inputFilename, parsedFilePointer);
+	result = parsedFilePointer;
+	return true;
+}
 
+//Appends a parsed file to the profile arrays, correcting for the platform motion and
+//flagging the data as we go. Files must be merged in time order.
+void LidarBackscatterDopplerProcessor::mergeFile(const ParsedHplFile &parsedFile, const sci::string &inputFilename, const Platform &platform)
+{
+	m_hplHeaders.push_back(parsedFile.header);
+	size_t firstProfileIndex = m_times.size();
+
+	//check the time is ascending, we can sometimes cross into the next day, in which case the time recorded for the profile
+	//resets to close to 0. Increment the time by a day as needed. The parsed file may be shared, so the corrected times
+	//are kept here rather than put back in the profiles.
+	second profileDuration = (unitlessF((unitlessF::valueType)m_hplHeaders.back().pulsesPerRay) / sci::Physical<sci::Hertz<1, 3>, typename unitlessF::valueType>(15.0));
+	sci::GridData<sci::UtcTime, 1> startTimes(parsedFile.profiles.size());
+	sci::GridData<sci::UtcTime, 1> endTimes(parsedFile.profiles.size());
+	sci::GridData<degreeF, 1> azimuths(parsedFile.profiles.size());
+	sci::GridData<degreeF, 1> elevations(parsedFile.profiles.size());
+	for (size_t i = 0; i < parsedFile.profiles.size(); ++i)
+	{
+		startTimes[i] = parsedFile.profiles[i].getTime<sci::UtcTime>();
+		if (i > 0 || m_times.size() > 0)
+		{
+			sci::UtcTime previousTime = i > 0 ? startTimes[i - 1] : m_times.back();
+			while (startTimes[i] < previousTime)
+				startTimes[i] = startTimes[i] + second(24.0 * 60.0 * 60.0);
+		}
+		endTimes[i] = startTimes[i] + profileDuration;
+		azimuths[i] = parsedFile.profiles[i].getAzimuth();
+		elevations[i] = parsedFile.profiles[i].getElevation();
 	}
-	if (progressReporter.shouldStop())
+	//correct azimuths and elevations for platform orientation and get the platform velocity
+	//for all the profiles in one go
+	sci::GridData<degreeF, 1> correctedAzimuths;
+	sci::GridData<degreeF, 1> correctedElevations;
+	platform.correctDirection(startTimes, endTimes, azimuths, elevations, correctedAzimuths, correctedElevations);
+	sci::GridData<metrePerSecondF, 1> u;
+	sci::GridData<metrePerSecondF, 1> v;
+	sci::GridData<metrePerSecondF, 1> w;
+	platform.getInstrumentVelocity(startTimes, endTimes, u, v, w);
+
+	for (size_t i = 0; i < parsedFile.profiles.size(); ++i)
 	{
-		progressReporter << sU(", stopped at user request.\n");
-		fin.close();
-		return;
-
+		const HplProfile &profile = parsedFile.profiles[i];
+		appendProfile(profile, startTimes[i]);
+		m_correctedAzimuths.push_back(correctedAzimuths[i]);
+		m_correctedElevations.push_back(correctedElevations[i]);
+		metrePerSecondF offset = u[i] * sci::sin(correctedAzimuths[i])*sci::cos(correctedElevations[i])
+			+ v[i] * sci::cos(correctedAzimuths[i])*sci::cos(correctedElevations[i])
+			+ w[i] * sci::sin(correctedElevations[i]);
+		appendPaddedRow(m_correctedDopplerVelocities, profile.getDopplerVelocities() + offset, std::numeric_limits<metrePerSecondF>::quiet_NaN());
+
+		m_headerIndex.push_back(m_hplHeaders.size() - 1);//record which header this profile is linked to
+		sci::GridData<uint8_t, 1> dopplerVelocityFlags;
+		sci::GridData<uint8_t, 1> betaFlags;
+		flagProfile(profile, m_processingOptions, dopplerVelocityFlags, betaFlags);
+		appendPaddedRow(m_betaFlags, betaFlags, lidarUserChangedGatesFlag);
+		appendPaddedRow(m_dopplerFlags, dopplerVelocityFlags, lidarUserChangedGatesFlag);
 	}
-	progressReporter << sU(", Reading done.\n");
 
-	bool gatesGood = true;
-	for (size_t i = m_profiles.size() - nRead; i < m_profiles.size(); ++i)
+	for (size_t i = firstProfileIndex; i < m_times.size(); ++i)
 	{
-		sci::GridData<size_t, 1> gates = m_profiles[i].getGates();
-		for (size_t j = 0; j < gates.size(); ++j)
-			if (gates[j] != j)
+		for (size_t j = 0; j < m_nGates[i]; ++j)
+			if (m_gates[i][j] != j)
 			{
 				sci::ostringstream error;
 				error << sU("The plotting code currently assumes gates go 0, 1, 2, 3, ... but profile ") << i << sU(" (0 indexed) in file ") << inputFilename << sU(" did not have this layout.");
@@ -146,85 +541,18 @@ void LidarBackscatterDopplerProcessor::readData(const sci::string &inputFilename
 
 sci::GridData<second, 1> LidarBackscatterDopplerProcessor::getTimesSeconds() const
 {
-	sci::GridData<second, 1> result(m_profiles.size());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
+	sci::GridData<second, 1> result(m_times.size());
+	for (size_t i = 0; i < m_times.size(); ++i)
 	{
-		result[i] = m_profiles[i].getTime<second>();
-	}
-	return result;
-}
-
-sci::GridData<sci::UtcTime, 1> LidarBackscatterDopplerProcessor::getTimesUtcTime() const
-{
-	sci::GridData<sci::UtcTime, 1> result(m_profiles.size());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		result[i] = m_profiles[i].getTime<sci::UtcTime>();
-	}
-	return result;
-}
-
-sci::GridData<perSteradianPerMetreF, 2> LidarBackscatterDopplerProcessor::getBetas() const
-{
-	sci::GridData<perSteradianPerMetreF, 2> result({ m_profiles.size(), getMaxGates() }, std::numeric_limits< perSteradianPerMetreF>::quiet_NaN());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		for (size_t j = 0; j < getNGates(i); ++j)
-			result[i][j] = m_profiles[i].getBetas()[j];
+		result[i] = second(m_times[i] - sci::UtcTime(1970, 1, 1, 0, 0, 0));
 	}
 	return result;
 }
 
 sci::GridData<unitlessF, 2> LidarBackscatterDopplerProcessor::getSignalToNoiseRatios() const
 {
-	sci::GridData<unitlessF, 2> result({ m_profiles.size(), getMaxGates() }, std::numeric_limits< unitlessF>::quiet_NaN());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		for (size_t j = 0; j < getNGates(i); ++j)
-			result[i][j] = m_profiles[i].getIntensities()[j] - unitlessF(1.0);
-	}
-	return result;
-}
-
-sci::GridData<unitlessF, 2> LidarBackscatterDopplerProcessor::getSignalToNoiseRatiosPlusOne() const
-{
-	sci::GridData<unitlessF, 2> result({ m_profiles.size(), getMaxGates() }, std::numeric_limits< unitlessF>::quiet_NaN());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		for (size_t j = 0; j < getNGates(i); ++j)
-			result[i][j] = m_profiles[i].getIntensities()[j];
-	}
-	return result;
-}
-
-sci::GridData<metrePerSecondF, 2> LidarBackscatterDopplerProcessor::getInstrumentRelativeDopplerVelocities() const
-{
-	sci::GridData<metrePerSecondF, 2> result({ m_profiles.size(), getMaxGates() }, std::numeric_limits< metrePerSecondF>::quiet_NaN());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		for (size_t j = 0; j < getNGates(i); ++j)
-			result[i][j] = m_profiles[i].getDopplerVelocities()[j];
-	}
-	return result;
-}
-
-sci::GridData<degreeF, 1> LidarBackscatterDopplerProcessor::getInstrumentRelativeElevations() const
-{
-	sci::GridData<degreeF, 1> result(m_profiles.size());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		result[i] = m_profiles[i].getElevation();
-	}
-	return result;
-}
-sci::GridData<degreeF, 1> LidarBackscatterDopplerProcessor::getInstrumentRelativeAzimuths() const
-{
-	sci::GridData<degreeF, 1> result(m_profiles.size());
-	for (size_t i = 0; i < m_profiles.size(); ++i)
-	{
-		result[i] = m_profiles[i].getAzimuth();
-	}
-	return result;
+	//the intensity reported by the instrument is snr+1
+	return m_intensities - unitlessF(1.0);
 }
 
 sci::GridData<metreF, 1> LidarBackscatterDopplerProcessor::getGateBoundariesForPlotting(size_t profileIndex) const
@@ -233,7 +561,7 @@ sci::GridData<metreF, 1> LidarBackscatterDopplerProcessor::getGateBoundariesForP
 	//aren't quite what we want.
 	metreF interval = m_hplHeaders[profileIndex].rangeGateLength;
 	//if we have more than 533 gates then we must be using gate overlapping - annoyingly this isn't recorded in the header
-	if (m_profiles[profileIndex].nGates() > 533)
+	if (m_nGates[profileIndex] > 533)
 		interval /= unitlessF((unitlessF::valueType)m_hplHeaders[m_headerIndex[profileIndex]].pointsPerGate);
 
 	sci::GridData<metreF, 1> result = getGateCentres(profileIndex) - unitlessF(0.5) * interval;
@@ -244,14 +572,14 @@ sci::GridData<metreF, 1> LidarBackscatterDopplerProcessor::getGateBoundariesForP
 
 sci::GridData<metreF, 1> LidarBackscatterDopplerProcessor::getGateLowerBoundaries(size_t profileIndex) const
 {
-	if (m_profiles.size() == 0)
+	if (m_times.size() == 0)
 		return sci::GridData<metreF, 1>(0);
 
-	sci::GridData<metreF, 1> result(m_profiles[profileIndex].nGates());
+	sci::GridData<metreF, 1> result(m_nGates[profileIndex]);
 	for (size_t i = 0; i < result.size(); ++i)
 		result[i] = unitlessF((unitlessF::valueType)i) * m_hplHeaders[m_headerIndex[profileIndex]].rangeGateLength;
 	//if we have more than 533 gates then we must be using gate overlapping - annoyingly this isn't recorded in the header
-	if (m_profiles[profileIndex].nGates() > 533)
+	if (m_nGates[profileIndex] > 533)
 		result /= unitlessF((unitlessF::valueType)m_hplHeaders[m_headerIndex[profileIndex]].pointsPerGate);
 	return result;
 }
@@ -323,6 +651,104 @@ void restructureLidarData(sci::GridData<degreeF, 2>& dest, const sci::GridData<d
 	}
 }
 
+//Writes a profile x gate block as a (scan, range, angle) variable one scan at a time, so we
+//only hold one scan's padded copy rather than the whole day's.
+template<class VARIABLE, class T>
+void writeRestructuredLidarData(OutputAmfNcFile &file, const VARIABLE &variable, const sci::GridData<T, 2>& source, const sci::GridData<size_t, 1>& profilesPerScan, size_t nScans, size_t maxNRanges, size_t maxProfilesPerScan, bool isStare)
+{
+	sci::GridData<T, 2> scan({ maxNRanges, maxProfilesPerScan }, std::numeric_limits<T>::quiet_NaN());
+	size_t profileIndex = 0;
+	size_t nRanges = source.shape()[1];
+	for (size_t i = 0; i < nScans; ++i)
+	{
+		size_t nProfiles = isStare ? 1 : profilesPerScan[i];
+		for (size_t j = 0; j < maxProfilesPerScan; ++j)
+		{
+			for (size_t k = 0; k < nRanges; ++k)
+			{
+				//note k and j reversed below as we need altitude before angle
+				scan[k][j] = j < nProfiles ? source[profileIndex + j][k] : std::numeric_limits<T>::quiet_NaN();
+			}
+		}
+		profileIndex += nProfiles;
+		file.writeTimeSlice(variable, i, scan);
+	}
+}
+
+void LidarScanningProcessor::getOutputStructure(sci::GridData<size_t, 1> &profilesPerScan,
+	size_t &nScans,
+	sci::GridData<sci::UtcTime, 1>& scanStartTimes,
+	sci::GridData<sci::UtcTime, 1>& scanEndTimes,
+	size_t &maxProfilesPerScan,
+	size_t &maxNGates,
+	size_t &pulsesPerRay,
+	size_t &raysPerPoint,
+	metreF &focus,
+	metrePerSecondF &dopplerResolution,
+	metreF &gateLength,
+	size_t &pointsPerGate) const
+{
+	//check that the data structure hasn't changed in a way that makes it unprocessable
+	pulsesPerRay = getPulsesPerRay(0);
+	raysPerPoint = getNRays(0);
+	focus = getFocus(0);
+	dopplerResolution = getDopplerResolution(0);
+	gateLength = getGateLength(0);
+	pointsPerGate = getNPointsPerGate(0);
+	for (size_t i = 0; i < getNProfiles(); ++i)
+	{
+		sci::assertThrow(
+			pulsesPerRay == getPulsesPerRay(i) && raysPerPoint == getNRays(i) && focus == getFocus(i) && dopplerResolution == getDopplerResolution(i) && gateLength == getGateLength(i),
+			sci::err(sci::SERR_USER, 0, sU("Pulses per ray, rays per point, focus, doppler resolution or gate length have been changed during the day - cannot process.")));
+	}
+
+	profilesPerScan = getProfilesPerFile();
+	nScans = isStare() ? getNProfiles() : profilesPerScan.size();
+	maxNGates = getMaxGates();
+	maxProfilesPerScan = 1;
+	if (!isStare())
+		maxProfilesPerScan = sci::max(profilesPerScan);
+
+	scanStartTimes = getTimesUtcTime();
+	scanEndTimes.resize(scanStartTimes.size());
+	for(size_t i=0; i<scanEndTimes.size(); ++i)
+		scanEndTimes[i] = scanStartTimes[i] + (unitlessF((unitlessF::valueType)(getHeaderForProfile(i).pulsesPerRay * getHeaderForProfile(i).nRays)) / sci::Physical<sci::Hertz<1, 3>, typename unitlessF::valueType>(15.0)); //this is the time of the last profile in the scan plus the duration of this profile
+}
+
+//The range of each profile and gate, in the same profile x gate layout as the data
+sci::GridData<metreF, 2> LidarScanningProcessor::getOutputRanges(const sci::GridData<size_t, 1>& profilesPerScan, size_t nScans, size_t maxNGates) const
+{
+	sci::GridData<metreF, 2> ranges({ getNProfiles(), maxNGates }, std::numeric_limits<metreF>::quiet_NaN());
+	size_t profileIndex = 0;
+	for (size_t i = 0; i < nScans; ++i)
+	{
+		sci::GridData<metreF, 1> gateCentres = getGateCentres(i);
+		size_t nProfiles = isStare() ? 1 : profilesPerScan[i];
+		for (size_t j = 0; j < nProfiles; ++j)
+		{
+			for (size_t k = 0; k < std::min(maxNGates, gateCentres.size()); ++k)
+				ranges[profileIndex][k] = gateCentres[k];
+			++profileIndex;
+		}
+	}
+	return ranges;
+}
+
+//Writes the range variable one scan at a time. Every angle of a scan gets the gate centres,
+//including the padding after the scan's last profile, as range doesn't depend on angle.
+void LidarScanningProcessor::writeOutputRanges(OutputAmfNcFile &file, const AmfNcVariable<metreF> &variable, size_t nScans, size_t maxNGates, size_t maxProfilesPerScan) const
+{
+	sci::GridData<metreF, 2> scan({ maxNGates, maxProfilesPerScan }, std::numeric_limits<metreF>::quiet_NaN());
+	for (size_t i = 0; i < nScans; ++i)
+	{
+		sci::GridData<metreF, 1> gateCentres = getGateCentres(i);
+		for (size_t j = 0; j < maxNGates; ++j)
+			for (size_t k = 0; k < maxProfilesPerScan; ++k)
+				scan[j][k] = j < gateCentres.size() ? gateCentres[j] : std::numeric_limits<metreF>::quiet_NaN();
+		file.writeTimeSlice(variable, i, scan);
+	}
+}
+
 void LidarScanningProcessor::formatDataForOutput(ProgressReporter& progressReporter,
 	sci::GridData<metreF, 3>& ranges,
 	sci::GridData<degreeF, 2>& instrumentRelativeAzimuthAngles,
@@ -364,26 +790,9 @@ void LidarScanningProcessor::formatDataForOutput(ProgressReporter& progressRepor
 		scanEndTimes.reshape({ 0 });
 	}
 
-	//check that the data structure hasn't changed in a way that makes it unprocessable
-	pulsesPerRay = getPulsesPerRay(0);
-	raysPerPoint = getNRays(0);
-	focus = getFocus(0);
-	dopplerResolution = getDopplerResolution(0);
-	gateLength = getGateLength(0);
-	pointsPerGate = getNPointsPerGate(0);
-	for (size_t i = 0; i < getNProfiles(); ++i)
-	{
-		sci::assertThrow(
-			pulsesPerRay == getPulsesPerRay(i) && raysPerPoint == getNRays(i) && focus == getFocus(i) && dopplerResolution == getDopplerResolution(i) && gateLength == getGateLength(i),
-			sci::err(sci::SERR_USER, 0, sU("Pulses per ray, rays per point, focus, doppler resolution or gate length have been changed during the day - cannot process.")));
-	}
-
-	sci::GridData<size_t, 1> profilesPerFile = getProfilesPerFile();
-	size_t nScans = isStare() ? getNProfiles() : profilesPerFile.size();
-	maxNGates = getMaxGates();
-	maxProfilesPerScan = 1;
-	if (!isStare())
-		maxProfilesPerScan = sci::max(profilesPerFile);
+	sci::GridData<size_t, 1> profilesPerFile;
+	size_t nScans;
+	getOutputStructure(profilesPerFile, nScans, scanStartTimes, scanEndTimes, maxProfilesPerScan, maxNGates, pulsesPerRay, raysPerPoint, focus, dopplerResolution, gateLength, pointsPerGate);
 
 	restructureLidarData(instrumentRelativeDopplerVelocities, getInstrumentRelativeDopplerVelocities(), profilesPerFile, nScans, maxNGates, maxProfilesPerScan, isStare());
 	restructureLidarData(motionCorrectedDopplerVelocities, getMotionCorrectedDopplerVelocities(), profilesPerFile, nScans, maxNGates, maxProfilesPerScan, isStare());
@@ -405,11 +814,6 @@ void LidarScanningProcessor::formatDataForOutput(ProgressReporter& progressRepor
 			for (size_t k = 0; k < maxProfilesPerScan; ++k)
 				ranges[{i, j, k}] = gateCentres[j];
 	}
-
-	scanStartTimes = getTimesUtcTime();
-	scanEndTimes.resize(scanStartTimes.size());
-	for(size_t i=0; i<scanEndTimes.size(); ++i)
-		scanEndTimes[i] = scanStartTimes[i] + (unitlessF((unitlessF::valueType)(getHeaderForProfile(i).pulsesPerRay * getHeaderForProfile(i).nRays)) / sci::Physical<sci::Hertz<1, 3>, typename unitlessF::valueType>(15.0)); //this is the time of the last profile in the scan plus the duration of this profile
 	/*
 	//build up our data arrays. We must account for the fact that the user could change
 	//the number of profiles in a scan pattern or the range of the instruemnt during a day
@@ -673,20 +1077,15 @@ void LidarScanningProcessor::writeToNc(const sci::string &directory, const Perso
 	dataInfo.productName = sU("aerosol backscatter radial winds");
 	dataInfo.processingOptions = processingOptions;
 
-	sci::GridData<metreF, 3> ranges;
 	sci::GridData<degreeF, 2> instrumentRelativeAzimuthAngles;
 	sci::GridData<degreeF, 2> attitudeCorrectedAzimuthAngles;
 	sci::GridData<degreeF, 2> instrumentRelativeElevationAngles;
 	sci::GridData<degreeF, 2> attitudeCorrectedElevationAngles;
-	sci::GridData<metrePerSecondF, 3> instrumentRelativeDopplerVelocities;
-	sci::GridData<metrePerSecondF, 3> motionCorrectedDopplerVelocities;
-	sci::GridData<perSteradianPerMetreF, 3> backscatters;
-	sci::GridData<unitlessF, 3> snrsPlusOne;
-	sci::GridData<uint8_t, 3> dopplerVelocityFlags;
-	sci::GridData<uint8_t, 3> backscatterFlags;
 	sci::GridData<sci::UtcTime, 1> scanStartTimes;
 	sci::GridData<sci::UtcTime, 1> scanEndTimes;
 
+	sci::GridData<size_t, 1> profilesPerScan;
+	size_t nScans;
 	size_t maxProfilesPerScan;
 	size_t maxNGates;
 	size_t pulsesPerRay;
@@ -696,28 +1095,16 @@ void LidarScanningProcessor::writeToNc(const sci::string &directory, const Perso
 	metreF gateLength;
 	size_t pointsPerGate;
 
-	LidarScanningProcessor::formatDataForOutput(progressReporter,
-		ranges,
-		instrumentRelativeAzimuthAngles,
-		attitudeCorrectedAzimuthAngles,
-		instrumentRelativeElevationAngles,
-		attitudeCorrectedElevationAngles,
-		instrumentRelativeDopplerVelocities,
-		motionCorrectedDopplerVelocities,
-		backscatters,
-		snrsPlusOne,
-		dopplerVelocityFlags,
-		backscatterFlags,
-		scanStartTimes,
-		scanEndTimes,
-		maxProfilesPerScan,
-		maxNGates,
-		pulsesPerRay,
-		raysPerPoint,
-		focus,
-		dopplerResolution,
-		gateLength,
-		pointsPerGate);
+	//We don't use formatDataForOutput here. The (scan, range, angle) data is only restructured one
+	//variable at a time as it is written, so we never hold a copy of every variable at once. The
+	//variables' valid min and max are found from the profile x gate data, which holds the same
+	//values without the padding.
+	getOutputStructure(profilesPerScan, nScans, scanStartTimes, scanEndTimes, maxProfilesPerScan, maxNGates, pulsesPerRay, raysPerPoint, focus, dopplerResolution, gateLength, pointsPerGate);
+	restructureLidarData(instrumentRelativeAzimuthAngles, getInstrumentRelativeAzimuths(), profilesPerScan, nScans, maxProfilesPerScan, isStare());
+	restructureLidarData(attitudeCorrectedAzimuthAngles, getAttitudeCorrectedAzimuths(), profilesPerScan, nScans, maxProfilesPerScan, isStare());
+	restructureLidarData(instrumentRelativeElevationAngles, getInstrumentRelativeElevations(), profilesPerScan, nScans, maxProfilesPerScan, isStare());
+	restructureLidarData(attitudeCorrectedElevationAngles, getAttitudeCorrectedElevations(), profilesPerScan, nScans, maxProfilesPerScan, isStare());
+	sci::GridData<metreF, 2> ranges = getOutputRanges(profilesPerScan, nScans, maxNGates);
 
 
 
@@ -801,31 +1188,31 @@ void LidarScanningProcessor::writeToNc(const sci::string &directory, const Perso
 
 	sci::GridData<uint8_t, 0> includeAllFlag(1);
 	//create the variables - note we set swap to true for these variables which swaps the data into the varaibles rather than copying it. This saved memory
-	AmfNcVariable<metreF> rangeVariable(sU("range"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, & angleIndexDimension }, sU("Distance of Measurement Volume Centre Point from Instrument"), sU("range"), ranges, true, coordinates, cellMethodsRange, backscatterFlags);
+	AmfNcVariable<metreF> rangeVariable(sU("range"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, & angleIndexDimension }, sU("Distance of Measurement Volume Centre Point from Instrument"), sU("range"), ranges, true, coordinates, cellMethodsRange, getBetaFlags());
 	AmfNcVariable<degreeF> azimuthVariable(sU("sensor_azimuth_angle_instrument_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &angleIndexDimension }, sU("Scanning head azimuth angle in the instrument frame of reference"),sU(""), instrumentRelativeAzimuthAngles, true, coordinates, cellMethodsAngles, sci::GridData<uint8_t, 0>(1));
 	AmfNcVariable<degreeF> elevationVariable(sU("sensor_view_angle_instrument_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &angleIndexDimension }, sU("Scanning head elevation angle in the instrument frame of reference"), sU(""), instrumentRelativeElevationAngles, true, coordinates, cellMethodsAngles, sci::GridData<uint8_t, 0>(1));
 	AmfNcVariable<degreeF> azimuthVariableEarthFrame(sU("sensor_azimuth_angle_earth_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &angleIndexDimension }, sU("Scanning head azimuth angle in the Earth frame of reference"), sU(""), attitudeCorrectedAzimuthAngles, true, coordinates, cellMethodsAnglesEarthFrame, sci::GridData<uint8_t, 0>(1));
 	AmfNcVariable<degreeF> elevationVariableEarthFrame(sU("sensor_view_angle_earth_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &angleIndexDimension }, sU("Scanning head elevation angle in the Earth frame of reference"), sU(""), attitudeCorrectedElevationAngles, true, coordinates, cellMethodsAnglesEarthFrame, sci::GridData<uint8_t, 0>(1));
-	AmfNcVariable<metrePerSecondF> dopplerVariable(sU("radial_velocity_of_scatterers_away_from_instrument"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Radial Velocity of Scatterers Away From Instrument"), sU("radial_velocity_of_scatterers_away_from_instrument"), instrumentRelativeDopplerVelocities, true, coordinates, cellMethodsData, dopplerVelocityFlags);
+	AmfNcVariable<metrePerSecondF> dopplerVariable(sU("radial_velocity_of_scatterers_away_from_instrument"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Radial Velocity of Scatterers Away From Instrument"), sU("radial_velocity_of_scatterers_away_from_instrument"), getInstrumentRelativeDopplerVelocities(), true, coordinates, cellMethodsData, getDopplerFlags());
 	//AmfNcVariable<metrePerSecondF, decltype(motionCorrectedDopplerVelocities), true> dopplerVariableEarthFrame(sU("radial_velocity_of_scatterers_away_from_instrument_earth_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Radial Velocity of Scatterers Away From Instrument Earth Frame"), sU(""), motionCorrectedDopplerVelocities, true, coordinates, cellMethodsData);
-	AmfNcVariable<perSteradianPerMetreF> backscatterVariable(sU("attenuated_aerosol_backscatter_coefficient"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Attenuated Aerosol Backscatter Coefficient"), sU(""), backscatters, true, coordinates, cellMethodsData, backscatterFlags);
-	AmfNcVariable<unitlessF> snrsPlusOneVariable(sU("signal_to_noise_ratio_plus_1"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Signal to Noise Ratio: SNR+1"), sU(""), snrsPlusOne, true, coordinates, cellMethodsData, backscatterFlags);
-	AmfNcFlagVariable dopplerFlagVariable(sU("qc_flag_radial_velocity_of_scatterers_away_from_instrument"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension });
-	AmfNcFlagVariable backscatterFlagVariable(sU("qc_flag_backscatter"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension });
+	AmfNcVariable<perSteradianPerMetreF> backscatterVariable(sU("attenuated_aerosol_backscatter_coefficient"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Attenuated Aerosol Backscatter Coefficient"), sU(""), getBetas(), true, coordinates, cellMethodsData, getBetaFlags());
+	AmfNcVariable<unitlessF> snrsPlusOneVariable(sU("signal_to_noise_ratio_plus_1"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension }, sU("Signal to Noise Ratio: SNR+1"), sU(""), getSignalToNoiseRatiosPlusOne(), true, coordinates, cellMethodsData, getBetaFlags());
+	AmfNcFlagVariable dopplerFlagVariable(sU("qc_flag_radial_velocity_of_scatterers_away_from_instrument"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension });
+	AmfNcFlagVariable backscatterFlagVariable(sU("qc_flag_backscatter"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension, &angleIndexDimension });
 
 	file.writeTimeAndLocationData(platform);
 
-	file.write(rangeVariable, ranges);
+	writeOutputRanges(file, rangeVariable, nScans, maxNGates, maxProfilesPerScan);
 	file.write(azimuthVariable, instrumentRelativeAzimuthAngles);
 	file.write(azimuthVariableEarthFrame, attitudeCorrectedAzimuthAngles);
 	file.write(elevationVariable, instrumentRelativeElevationAngles);
 	file.write(elevationVariableEarthFrame, attitudeCorrectedElevationAngles);
-	file.write(dopplerVariable, instrumentRelativeDopplerVelocities);
+	writeRestructuredLidarData(file, dopplerVariable, getInstrumentRelativeDopplerVelocities(), profilesPerScan, nScans, maxNGates, maxProfilesPerScan, isStare());
 	//file.write(dopplerVariableEarthFrame);
-	file.write(backscatterVariable, backscatters);
-	file.write(snrsPlusOneVariable, snrsPlusOne);
-	file.write(dopplerFlagVariable, dopplerVelocityFlags);
-	file.write(backscatterFlagVariable, backscatterFlags);
+	writeRestructuredLidarData(file, backscatterVariable, getBetas(), profilesPerScan, nScans, maxNGates, maxProfilesPerScan, isStare());
+	writeRestructuredLidarData(file, snrsPlusOneVariable, getSignalToNoiseRatiosPlusOne(), profilesPerScan, nScans, maxNGates, maxProfilesPerScan, isStare());
+	writeRestructuredLidarData(file, dopplerFlagVariable, getDopplerFlags(), profilesPerScan, nScans, maxNGates, maxProfilesPerScan, isStare());
+	writeRestructuredLidarData(file, backscatterFlagVariable, getBetaFlags(), profilesPerScan, nScans, maxNGates, maxProfilesPerScan, isStare());
 }
 
 std::vector<std::vector<sci::string>> HplFileLidar::groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles) const
@@ -10,9 +10,12 @@
 #include"Plotting.h"
 #include"HplProfile.h"
 #include"HplHeader.h"
+#include<memory>
 
 class ProgressReporter;
 class wxWindow;
+class HplFileCache;
+struct ParsedHplFile;
 
 const InstrumentInfo g_dopplerLidar1Info
 {
@@ -57,6 +60,12 @@ public:
 		sci::UtcTime fileTime = extractDateFromLidarFilename(fileName);
 		return fileTime < endTime && fileTime >= startTime;
 	}
+	virtual bool getFileTimePeriod(const sci::string &fileName, sci::UtcTime &fileStart, sci::UtcTime &fileEnd) const override
+	{
+		fileStart = extractDateFromLidarFilename(fileName);
+		fileEnd = fileStart;
+		return true;
+	}
 	std::vector<std::vector<sci::string>> groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles) const override;
 	sci::string getName() const override
 	{
@@ -74,25 +83,32 @@ public:
 	virtual ~LidarBackscatterDopplerProcessor() {}
 	virtual void readData(const std::vector<sci::string> &inputFilenames, const Platform &platform, ProgressReporter &progressReporter) override;
 	void readData(const sci::string &inputFilename, const Platform &platform, ProgressReporter &progressReporter, bool clear);
+	virtual bool canAppendData() const override { return true; }
+	virtual void appendData(const std::vector<sci::string> &inputFilenames, bool replaceLastFile, const Platform &platform, ProgressReporter &progressReporter) override;
 	virtual bool hasData() const override { return m_hasData; }
+	virtual void setProcessingOptions(const ProcessingOptions &processingOptions) override;
 	virtual std::vector<sci::string> getProcessingOptions() const = 0;
+	//The 2D getters below return the profile x gate blocks directly. If the number of gates
+	//changed during the day then the shorter profiles are padded with NaNs.
 	sci::GridData<second, 1> getTimesSeconds() const;
-	sci::GridData<sci::UtcTime, 1> getTimesUtcTime() const;
-	sci::GridData<perSteradianPerMetreF, 2> getBetas() const;
-	sci::GridData<metrePerSecondF, 2> getInstrumentRelativeDopplerVelocities() const;
-	sci::GridData<metrePerSecondF, 2> getMotionCorrectedDopplerVelocities() const { return m_correctedDopplerVelocities; }
+	const sci::GridData<sci::UtcTime, 1> &getTimesUtcTime() const { return m_times; }
+	const sci::GridData<perSteradianPerMetreF, 2> &getBetas() const { return m_betas; }
+	const sci::GridData<metrePerSecondF, 2> &getInstrumentRelativeDopplerVelocities() const { return m_dopplerVelocities; }
+	const sci::GridData<metrePerSecondF, 2> &getMotionCorrectedDopplerVelocities() const { return m_correctedDopplerVelocities; }
 	sci::GridData<unitlessF, 2> getSignalToNoiseRatios() const;
-	sci::GridData<unitlessF, 2> getSignalToNoiseRatiosPlusOne() const;
-	sci::GridData<uint8_t, 2> getDopplerFlags() const { return m_dopplerFlags; }
-	sci::GridData<uint8_t, 2> getBetaFlags() const { return m_betaFlags; }
+	const sci::GridData<unitlessF, 2> &getSignalToNoiseRatiosPlusOne() const { return m_intensities; }
+	const sci::GridData<uint8_t, 2> &getDopplerFlags() const { return m_dopplerFlags; }
+	const sci::GridData<uint8_t, 2> &getBetaFlags() const { return m_betaFlags; }
 	sci::GridData<metreF, 1> getGateBoundariesForPlotting(size_t profileIndex) const;
 	sci::GridData<metreF, 1> getGateLowerBoundaries(size_t profileIndex) const;
 	sci::GridData<metreF, 1> getGateUpperBoundaries(size_t profileIndex) const;
 	sci::GridData<metreF, 1> getGateCentres(size_t profileIndex) const;
-	sci::GridData<degreeF, 1> getAttitudeCorrectedAzimuths() const { return m_correctedAzimuths; }
-	sci::GridData<degreeF, 1> getInstrumentRelativeElevations() const;
-	sci::GridData<degreeF, 1> getInstrumentRelativeAzimuths() const;
-	sci::GridData<degreeF, 1> getAttitudeCorrectedElevations() const { return m_correctedElevations; }
+	const sci::GridData<degreeF, 1> &getAttitudeCorrectedAzimuths() const { return m_correctedAzimuths; }
+	const sci::GridData<degreeF, 1> &getInstrumentRelativeElevations() const { return m_elevations; }
+	const sci::GridData<degreeF, 1> &getInstrumentRelativeAzimuths() const { return m_azimuths; }
+	const sci::GridData<degreeF, 1> &getAttitudeCorrectedElevations() const { return m_correctedElevations; }
+	const sci::GridData<degreeF, 1> &getInstrumentPitches() const { return m_pitches; }
+	const sci::GridData<degreeF, 1> &getInstrumentRolls() const { return m_rolls; }
 	CalibrationInfo getCalibrationInfo() const { return m_calibrationInfo; }
 	InstrumentInfo getInstrumentInfo() const { return m_instrumentInfo; }
 	void setupCanvas(splotframe **window, splot2d **plot, const sci::string &extraDescriptor, wxWindow *parent)
@@ -101,23 +117,17 @@ public:
 		PlotableLidar::setupCanvas(window, plot, extraDescriptor, parent, m_hplHeaders[0]);
 	}
 	const HplHeader &getHeaderForProfile(size_t profileIndex) const { return m_hplHeaders[m_headerIndex[profileIndex]]; }
-	size_t getNGates(size_t profile) const { return m_profiles[profile].nGates(); }
-	size_t getMaxGates() const
-	{
-		size_t nGates = 0;
-		for (size_t i = 0; i < m_profiles.size(); ++i)
-			nGates = std::max(nGates, getNGates(i));
-		return nGates;
-	}
+	size_t getNGates(size_t profile) const { return m_nGates[profile]; }
+	size_t getMaxGates() const { return m_times.size() == 0 ? 0 : m_betas.shape()[1]; }
 	sci::GridData<size_t, 1> getProfilesPerFile() const
 	{
-		if (m_profiles.size() == 0)
+		if (m_times.size() == 0)
 			return sci::GridData<size_t, 1>();
 		sci::GridData<size_t, 1> result;
-		result.reserve(m_profiles.size() / 6);
+		result.reserve(m_times.size() / 6);
 		size_t currentProfilesPerFile = 1;
 		size_t currentHeaderIndex = m_headerIndex[0];
-		for (size_t i = 1; i < m_profiles.size(); ++i)
+		for (size_t i = 1; i < m_times.size(); ++i)
 		{
 			if (m_headerIndex[i] == currentHeaderIndex)
 				++currentProfilesPerFile;
@@ -132,7 +142,7 @@ public:
 	}
 	
 	size_t getNFilesRead() const { return m_hplHeaders.size(); }
-	size_t getNProfiles() const { return m_profiles.size(); }
+	size_t getNProfiles() const { return m_times.size(); }
 	size_t getPulsesPerRay(size_t profile) const { return m_hplHeaders[m_headerIndex[profile]].pulsesPerRay; }
 	size_t getNRays(size_t profile) const { return m_hplHeaders[m_headerIndex[profile]].nRays; }
 	metreF getFocus(size_t profile) const { return m_hplHeaders[m_headerIndex[profile]].focusRange; }
@@ -141,17 +151,37 @@ public:
 	size_t getNPointsPerGate(size_t profile) const { return m_hplHeaders[m_headerIndex[profile]].pointsPerGate; }
 	virtual bool isStare() const { return false; }
 private:
+	bool parseFile(const sci::string &inputFilename, std::shared_ptr<const ParsedHplFile> &result, ProgressReporter &progressReporter) const;
+	void mergeFile(const ParsedHplFile &parsedFile, const sci::string &inputFilename, const Platform &platform);
+	void clearProfiles();
+	void removeLastFile();
+	void reserveProfiles(size_t nProfiles);
+	void appendProfile(const HplProfile &profile, const sci::UtcTime &time);
 	bool m_hasData;
 	std::vector<HplHeader> m_hplHeaders; //one per file
-	std::vector<HplProfile> m_profiles; //multiple per file
-	sci::GridData<uint8_t, 2> m_dopplerFlags; //same number as m_profiles
-	sci::GridData<uint8_t, 2> m_betaFlags; //same number as m_profiles
+	//The profiles are stored as a structure of arrays, multiple profiles per file. The 1d arrays
+	//have one element per profile and the 2d arrays are profile x gate, so all the data for a day
+	//lives in a few contiguous blocks rather than a few small allocations per profile.
+	sci::GridData<sci::UtcTime, 1> m_times;
+	sci::GridData<degreeF, 1> m_azimuths;
+	sci::GridData<degreeF, 1> m_elevations;
+	sci::GridData<degreeF, 1> m_pitches;
+	sci::GridData<degreeF, 1> m_rolls;
+	sci::GridData<size_t, 1> m_nGates; //the gates actually recorded for each profile, the rest of the row is padding
+	sci::GridData<size_t, 2> m_gates;
+	sci::GridData<metrePerSecondF, 2> m_dopplerVelocities;
+	sci::GridData<unitlessF, 2> m_intensities;
+	sci::GridData<perSteradianPerMetreF, 2> m_betas;
+	sci::GridData<uint8_t, 2> m_dopplerFlags; //same number as m_times
+	sci::GridData<uint8_t, 2> m_betaFlags; //same number as m_times
 	std::vector<size_t> m_headerIndex; //this links headers to profiles m_hplHeaders[m_headerIndex[i]] is the header for the ith profile
 	const InstrumentInfo m_instrumentInfo;
 	const CalibrationInfo m_calibrationInfo;
-	sci::GridData<degreeF, 1> m_correctedAzimuths; //same number as m_profiles
-	sci::GridData<degreeF, 1> m_correctedElevations; //same number as m_profiles
+	sci::GridData<degreeF, 1> m_correctedAzimuths; //same number as m_times
+	sci::GridData<degreeF, 1> m_correctedElevations; //same number as m_times
 	sci::GridData<metrePerSecondF, 2> m_correctedDopplerVelocities;
+	ProcessingOptions m_processingOptions;
+	std::shared_ptr<HplFileCache> m_hplCache;
 };
 
 class LidarScanningProcessor : public LidarBackscatterDopplerProcessor
@@ -182,6 +212,21 @@ public:
 		metrePerSecondF& dopplerResolution,
 		metreF& gateLength,
 		size_t& pointsPerGate);
+	//The structure formatDataForOutput uses, without restructuring the data itself
+	void getOutputStructure(sci::GridData<size_t, 1>& profilesPerScan,
+		size_t& nScans,
+		sci::GridData<sci::UtcTime, 1>& scanStartTimes,
+		sci::GridData<sci::UtcTime, 1>& scanEndTimes,
+		size_t& maxProfilesPerScan,
+		size_t& maxNGates,
+		size_t& pulsesPerRay,
+		size_t& raysPerPoint,
+		metreF& focus,
+		metrePerSecondF& dopplerResolution,
+		metreF& gateLength,
+		size_t& pointsPerGate) const;
+	sci::GridData<metreF, 2> getOutputRanges(const sci::GridData<size_t, 1>& profilesPerScan, size_t nScans, size_t maxNGates) const;
+	void writeOutputRanges(OutputAmfNcFile& file, const AmfNcVariable<metreF>& variable, size_t nScans, size_t maxNGates, size_t maxProfilesPerScan) const;
 	virtual void writeToNc(const sci::string &directory, const PersonInfo &author,
 		const ProcessingSoftwareInfo &processingSoftwareInfo, const ProjectInfo &projectInfo,
 		const Platform &platform, const ProcessingOptions &processingOptions, ProgressReporter &progressReporter) override;
@@ -346,6 +391,7 @@ public:
 		const ProcessingSoftwareInfo &processingSoftwareInfo, const ProjectInfo &projectInfo,
 		const Platform &platform, const ProcessingOptions &processingOptions, ProgressReporter &progressReporter) override;
 	virtual bool hasData() const override { return m_hasData; }
+	virtual void setProcessingOptions(const ProcessingOptions &processingOptions) override { m_processingOptions = processingOptions; }
 	InstrumentInfo getInstrumentInfo() const { return m_instrumentInfo; }
 	CalibrationInfo getCalibrationInfo() const { return m_calibrationInfo; }
 private:
@@ -353,6 +399,7 @@ private:
 	std::vector<Profile> m_profiles;
 	const InstrumentInfo m_instrumentInfo;
 	const CalibrationInfo m_calibrationInfo;
+	ProcessingOptions m_processingOptions;
 };
 
 class LidarDepolProcessor : public PlotableLidar
@@ -365,13 +412,25 @@ public:
 		const ProcessingSoftwareInfo &processingSoftwareInfo, const ProjectInfo &projectInfo,
 		const Platform &platform, const ProcessingOptions &processingOptions, ProgressReporter &progressReporter) override;
 	virtual bool hasData() const override { return m_copolarisedProcessor.hasData() &&m_crosspolarisedProcessor.hasData(); }
-	virtual bool InstrumentProcessor::fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime) const override
+	virtual void setProcessingOptions(const ProcessingOptions &processingOptions) override
+	{
+		m_copolarisedProcessor.setProcessingOptions(processingOptions);
+		m_crosspolarisedProcessor.setProcessingOptions(processingOptions);
+	}
+	virtual bool fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime) const override
 	{
 		if(isCrossFile(fileName))
 			return m_crosspolarisedProcessor.fileCoversTimePeriod(fileName, startTime, endTime);
 		else
 			return m_copolarisedProcessor.fileCoversTimePeriod(fileName, startTime, endTime);
 	}
+	virtual bool getFileTimePeriod(const sci::string &fileName, sci::UtcTime &fileStart, sci::UtcTime &fileEnd) const override
+	{
+		if (isCrossFile(fileName))
+			return m_crosspolarisedProcessor.getFileTimePeriod(fileName, fileStart, fileEnd);
+		else
+			return m_copolarisedProcessor.getFileTimePeriod(fileName, fileStart, fileEnd);
+	}
 	virtual std::vector<std::vector<sci::string>> groupInputFilesbyOutputFiles(const std::vector<sci::string> &newFiles, const std::vector<sci::string> &allFiles) const override;
 	sci::string getName() const override
 	{
@@ -397,18 +456,7 @@ const uint8_t lidarNonMatchingRanges = 9;
 const uint8_t lidarCoAndCrossMisaligned = 10;
 const uint8_t lidarMissingDataFlag = 11;
 
-const std::vector<std::pair<uint8_t, sci::string>> lidarDopplerFlags
-{
-{ lidarUnusedFlag, sU("not_used") },
-{lidarGoodDataFlag, sU("good_data")},
-{lidarSnrBelow3Flag, sU("SNR less than 3") },
-{lidarSnrBelow2Flag, sU("SNR less_than 2") },
-{lidarSnrBelow1Flag, sU("SNR less_than 1") },
-{lidarDopplerOutOfRangeFlag, sU("doppler velocity out of +- 19 m s-1 range") },
-{lidarUserChangedGatesFlag, sU("user changed number of gates during the day so padding with fill value")},
-{lidarClippedWindProfileFlag, sU("wind profiles are clipped by manufacturer software so padding wih fill value")},
-{lidarPaddedBackscatter, sU("padded crosspolarised or copolarised data to match the other in dimension size")},
-{lidarNonMatchingRanges, sU("crosspolarised and copolarised data do not have matching ranges or directions")},
-{lidarCoAndCrossMisaligned, sU("copolarised and crosspolarised beams are misaligned")},
-{lidarMissingDataFlag, sU("lidar data missing, probably due to the number of gates being changed durang the day.")}
-};
\ No newline at end of file
+//The flag values and meanings for the lidar doppler and backscatter flag variables. The SNR and
+//doppler range meanings give the thresholds in the processing options, so they describe the
+//flags that were actually applied.
+std::vector<std::pair<uint8_t, sci::string>> getLidarDopplerFlags(const ProcessingOptions &processingOptions);
\ No newline at end of file
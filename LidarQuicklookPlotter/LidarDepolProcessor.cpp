@@ -520,28 +520,32 @@ void LidarDepolProcessor::writeToNc(const sci::string& directory, const PersonIn
 		return;
 	}
 
+	//flag the averages with the same SNR thresholds as the profiles, remembering the instrument reports SNR+1
+	const unitlessF snrPlusOneThreshold1(float(processingOptions.lidarSnrFlagThreshold1 + 1.0));
+	const unitlessF snrPlusOneThreshold2(float(processingOptions.lidarSnrFlagThreshold2 + 1.0));
+	const unitlessF snrPlusOneThreshold3(float(processingOptions.lidarSnrFlagThreshold3 + 1.0));
 	auto averagedFlagsCoIter = averagedFlagsCo.begin();
 	auto averagedSnrPlusOneCoIter = averagedSnrPlusOneCo.begin();
 	for (; averagedFlagsCoIter != averagedFlagsCo.end(); ++averagedFlagsCoIter, ++averagedSnrPlusOneCoIter)
 	{
-		if (*averagedSnrPlusOneCoIter < unitlessF(2.0) && *averagedFlagsCoIter == lidarGoodDataFlag)
+		if (*averagedSnrPlusOneCoIter < snrPlusOneThreshold1 && *averagedFlagsCoIter == lidarGoodDataFlag)
 			*averagedFlagsCoIter = lidarSnrBelow1Flag;
-		if (*averagedSnrPlusOneCoIter < unitlessF(3.0) && *averagedFlagsCoIter == lidarGoodDataFlag)
+		if (*averagedSnrPlusOneCoIter < snrPlusOneThreshold2 && *averagedFlagsCoIter == lidarGoodDataFlag)
+			*averagedFlagsCoIter = lidarSnrBelow2Flag;
+		if (*averagedSnrPlusOneCoIter < snrPlusOneThreshold3 && *averagedFlagsCoIter == lidarGoodDataFlag)
 			*averagedFlagsCoIter = lidarSnrBelow3Flag;
-		if (*averagedSnrPlusOneCoIter < unitlessF(4.0) && *averagedFlagsCoIter == lidarGoodDataFlag)
-			*averagedFlagsCoIter = lidarSnrBelow1Flag;
 	}
 
 	auto averagedFlagsCrossIter = averagedFlagsCross.begin();
 	auto averagedSnrPlusOneCrossIter = averagedSnrPlusOneCross.begin();
 	for (; averagedFlagsCrossIter != averagedFlagsCross.end(); ++averagedFlagsCrossIter, ++averagedSnrPlusOneCrossIter)
 	{
-		if (*averagedSnrPlusOneCrossIter < unitlessF(2.0) && *averagedFlagsCrossIter == lidarGoodDataFlag)
+		if (*averagedSnrPlusOneCrossIter < snrPlusOneThreshold1 && *averagedFlagsCrossIter == lidarGoodDataFlag)
 			*averagedFlagsCrossIter = lidarSnrBelow1Flag;
-		if (*averagedSnrPlusOneCrossIter < unitlessF(3.0) && *averagedFlagsCrossIter == lidarGoodDataFlag)
+		if (*averagedSnrPlusOneCrossIter < snrPlusOneThreshold2 && *averagedFlagsCrossIter == lidarGoodDataFlag)
+			*averagedFlagsCrossIter = lidarSnrBelow2Flag;
+		if (*averagedSnrPlusOneCrossIter < snrPlusOneThreshold3 && *averagedFlagsCrossIter == lidarGoodDataFlag)
 			*averagedFlagsCrossIter = lidarSnrBelow3Flag;
-		if (*averagedSnrPlusOneCrossIter < unitlessF(4.0) && *averagedFlagsCrossIter == lidarGoodDataFlag)
-			*averagedFlagsCrossIter = lidarSnrBelow1Flag;
 	}
 
 
@@ -641,9 +645,9 @@ void LidarDepolProcessor::writeToNc(const sci::string& directory, const PersonIn
 	AmfNcVariable<perSteradianPerMetreF> backscatterCrossVariable(sU("attenuated_aerosol_backscatter_coefficient_cr"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension}, sU("Attenuated Aerosol Backscatter Coefficient (Cross Polarised)"), sU(""), averagedBackscatterCross, true, coordinatesData, cellMethodsData, averagedFlagsCross);
 	AmfNcVariable<unitlessF> snrPlusOneCrossVariable(sU("signal_to_noise_ratio_plus_1_cr"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension}, sU("Signal to Noise Ratio: SNR+1 (Cross Polarised)"), sU(""), averagedSnrPlusOneCross, true, coordinatesData, cellMethodsData, averagedFlagsCross);
 	AmfNcVariable<unitlessF> depolarisationVariable(sU("depolarisation_ratio"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension}, sU("Volume Linear Depolarization Ratio"), sU(""), depolarisation, true, coordinatesData, cellMethodsData, depolarisationFlags);
-	AmfNcFlagVariable backscatterFlagCoVariable(sU("qc_flag_attenuated_aerosol_backscatter_coefficient_co"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
-	AmfNcFlagVariable backscatterFlagCrossVariable(sU("qc_flag_attenuated_aerosol_backscatter_coefficient_cr"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
-	AmfNcFlagVariable depolarisationFlagVariable(sU("qc_flag_depolarisation_ratio"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
+	AmfNcFlagVariable backscatterFlagCoVariable(sU("qc_flag_attenuated_aerosol_backscatter_coefficient_co"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
+	AmfNcFlagVariable backscatterFlagCrossVariable(sU("qc_flag_attenuated_aerosol_backscatter_coefficient_cr"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
+	AmfNcFlagVariable depolarisationFlagVariable(sU("qc_flag_depolarisation_ratio"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
 
 	file.writeTimeAndLocationData(platform);
 
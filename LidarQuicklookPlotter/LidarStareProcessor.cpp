@@ -4,7 +4,7 @@
 #include"Units.h"
 #include<cmath>
 #include"Plotting.h"
-#include<svector\splot.h>
+#include<svector/splot.h>
 #include"ProgressReporter.h"
 #include<wx/filename.h>
 
@@ -106,8 +106,8 @@ void LidarStareProcessor::plotData(const sci::string &outputFilename, const std:
 	AmfNcVariable<metrePerSecondF, decltype(motionCorrectedDopplerVelocities)> dopplerVariableEarthFrame(sU("radial_velocity_of_scatterers_away_from_instrument_earth_frame"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension}, sU("Radial Velocity of Scatterers Away From Instrument - Earth Frame"), sU(""), motionCorrectedDopplerVelocities, true, coordinatesData, cellMethodsData, sU("Instrument relative. Positive is away, negative is towards."));
 	AmfNcVariable<perSteradianPerMetreF, decltype(backscatters)> backscatterVariable(sU("attenuated_aerosol_backscatter_coefficient"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension}, sU("Attenuated Aerosol Backscatter Coefficient"), sU(""), backscatters, true, coordinatesData, cellMethodsData);
 	AmfNcVariable<unitlessF, decltype(snrPlusOne)> snrPlusOneVariable(sU("signal_to_noise_ratio_plus_1"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension}, sU("Signal to Noise Ratio: SNR+1"), sU(""), snrPlusOne, true, coordinatesData, cellMethodsData);
-	AmfNcFlagVariable dopplerFlagVariable(sU("qc_flag_radial_velocity_of_scatterers_away_from_instrument"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
-	AmfNcFlagVariable backscatterFlagVariable(sU("qc_flag_attenuated_aerosol_backscatter_coefficient"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
+	AmfNcFlagVariable dopplerFlagVariable(sU("qc_flag_radial_velocity_of_scatterers_away_from_instrument"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
+	AmfNcFlagVariable backscatterFlagVariable(sU("qc_flag_attenuated_aerosol_backscatter_coefficient"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), &rangeIndexDimension});
 
 	file.writeTimeAndLocationData(platform);
 
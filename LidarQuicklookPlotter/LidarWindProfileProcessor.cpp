@@ -5,7 +5,7 @@
 #include"Units.h"
 #include<cmath>
 #include"Plotting.h"
-#include<svector\splot.h>
+#include<svector/splot.h>
 #include"ProgressReporter.h"
 #include"AmfNc.h"
 
@@ -103,6 +103,7 @@ void LidarWindProfileProcessor::readData(const std::vector<sci::string> &inputFi
 
 			//now read the hpl file
 			progressReporter << sU("Reading matching ray data file\n");
+			thisProfile.m_VadProcessor.setProcessingOptions(m_processingOptions);
 			thisProfile.m_VadProcessor.readData({ hplFilenames[i] }, platform, progressReporter);
 
 			//check that we actually found some VAD data
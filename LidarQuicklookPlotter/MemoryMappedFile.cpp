@@ -0,0 +1,102 @@
+#include"MemoryMappedFile.h"
+#include<svector/serr.h>
+#ifdef _WIN32
+#include<windows.h>
+#else
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#endif
+
+#ifdef _WIN32
+MemoryMappedFile::MemoryMappedFile(const sci::string &filename)
+	:m_data(nullptr), m_size(0), m_fileHandle(INVALID_HANDLE_VALUE), m_mappingHandle(nullptr)
+{
+	m_fileHandle = CreateFileW(sci::nativeUnicode(filename).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	sci::assertThrow(m_fileHandle != INVALID_HANDLE_VALUE, sci::err(sci::SERR_USER, 0, sU("Could not open file ") + filename + sU(" for memory mapping.")));
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_fileHandle, &fileSize))
+	{
+		close();
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not get the size of file ") + filename + sU(".")));
+	}
+	m_size = size_t(fileSize.QuadPart);
+
+	//a zero length file cannot be mapped, but it is valid to have an empty view
+	if (m_size == 0)
+		return;
+
+	m_mappingHandle = CreateFileMappingW(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mappingHandle)
+	{
+		close();
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not memory map file ") + filename + sU(" - it may be locked or inaccessible.")));
+	}
+	m_data = (const char*)MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data)
+	{
+		close();
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not memory map file ") + filename + sU(" - it may be locked or inaccessible.")));
+	}
+}
+
+void MemoryMappedFile::close()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mappingHandle)
+		CloseHandle(m_mappingHandle);
+	if (m_fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_fileHandle);
+	m_data = nullptr;
+	m_size = 0;
+	m_mappingHandle = nullptr;
+	m_fileHandle = INVALID_HANDLE_VALUE;
+}
+#else
+MemoryMappedFile::MemoryMappedFile(const sci::string &filename)
+	:m_data(nullptr), m_size(0), m_fileDescriptor(-1)
+{
+	m_fileDescriptor = open(sci::toUtf8(filename).c_str(), O_RDONLY);
+	sci::assertThrow(m_fileDescriptor != -1, sci::err(sci::SERR_USER, 0, sU("Could not open file ") + filename + sU(" for memory mapping.")));
+
+	struct stat fileStat;
+	if (fstat(m_fileDescriptor, &fileStat) != 0)
+	{
+		close();
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not get the size of file ") + filename + sU(".")));
+	}
+	m_size = size_t(fileStat.st_size);
+
+	//a zero length file cannot be mapped, but it is valid to have an empty view
+	if (m_size == 0)
+		return;
+
+	void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fileDescriptor, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Could not memory map file ") + filename + sU(" - it may be locked or inaccessible.")));
+	}
+	m_data = (const char*)data;
+	madvise(data, m_size, MADV_SEQUENTIAL);
+}
+
+void MemoryMappedFile::close()
+{
+	if (m_data)
+		munmap((void*)m_data, m_size);
+	if (m_fileDescriptor != -1)
+		::close(m_fileDescriptor);
+	m_data = nullptr;
+	m_size = 0;
+	m_fileDescriptor = -1;
+}
+#endif
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	close();
+}
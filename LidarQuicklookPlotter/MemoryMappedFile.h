@@ -0,0 +1,29 @@
+#pragma once
+#include<svector/sstring.h>
+#include<cstddef>
+
+//A read only view of the whole of a file which the operating system maps into memory.
+//The bytes can be parsed directly from begin() to end() without being copied through
+//stream buffers. The file is unmapped and closed when the object is destroyed, so
+//any pointers into the data must not outlive the object.
+class MemoryMappedFile
+{
+public:
+	MemoryMappedFile(const sci::string &filename);
+	~MemoryMappedFile();
+	MemoryMappedFile(const MemoryMappedFile &) = delete;
+	MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+	const char *begin() const { return m_data; }
+	const char *end() const { return m_data + m_size; }
+	size_t size() const { return m_size; }
+private:
+	void close();
+	const char *m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void *m_fileHandle;
+	void *m_mappingHandle;
+#else
+	int m_fileDescriptor;
+#endif
+};
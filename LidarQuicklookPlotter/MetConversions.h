@@ -1,6 +1,6 @@
 #pragma once
 
-#include"units.h"
+#include"Units.h"
 
 //////////////////////////////////////////////////////////////////////
 //All the parameters here have the following units                  //
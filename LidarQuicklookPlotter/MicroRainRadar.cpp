@@ -1,6 +1,10 @@
 #include"MicroRainRadar.h"
 #include<svector/sreadwrite.h>
 #include"ProgressReporter.h"
+#include"CharBufferParsing.h"
+#include<string_view>
+#include<cstring>
+#include<cmath>
 
 const uint8_t microRainRadarUnusedFlag = 0;
 const uint8_t microRainRadarGoodDataFlag = 1;
@@ -37,6 +41,149 @@ MicroRainRadarProcessor::MicroRainRadarProcessor(const InstrumentInfo &instrumen
 	m_calibrationInfo = calibrationInfo;
 }
 
+const size_t g_microRainRadarNHeights = 31;
+const size_t g_microRainRadarPrefixLength = 3;
+const size_t g_microRainRadarFieldWidth = 7;
+const size_t g_microRainRadarLineLength = g_microRainRadarPrefixLength + g_microRainRadarNHeights * g_microRainRadarFieldWidth;
+
+//Parses a number in the same way as atof/atoi, which give 0 if there is no number
+template<class T>
+T parseMicroRainRadarNumber(const char *start, const char *end)
+{
+	T value = 0;
+	parseBufferNumber(start, end, value);
+	return value;
+}
+
+template<class T>
+T parseMicroRainRadarNumber(std::string_view text)
+{
+	return parseMicroRainRadarNumber<T>(text.data(), text.data() + text.length());
+}
+
+//a field of only spaces means there is no value
+bool isEmptyMicroRainRadarField(const char *field)
+{
+	for (size_t i = 0; i < g_microRainRadarFieldWidth; ++i)
+		if (field[i] != ' ')
+			return false;
+	return true;
+}
+
+//Gets the value in hundredths of a field with exactly two decimal places, e.g. " -12.34".
+//Returns false for a field in any other format.
+bool parseMicroRainRadarHundredths(const char *field, int &hundredths)
+{
+	const char *position = field;
+	const char *end = field + g_microRainRadarFieldWidth;
+	while (position != end && *position == ' ')
+		++position;
+	bool negative = position != end && *position == '-';
+	if (negative)
+		++position;
+	const char *digitsStart = position;
+	int value = 0;
+	while (position != end && *position >= '0' && *position <= '9')
+	{
+		value = value * 10 + (*position - '0');
+		++position;
+	}
+	if (position == digitsStart || end - position != 3 || position[0] != '.'
+		|| position[1] < '0' || position[1] > '9' || position[2] < '0' || position[2] > '9')
+		return false;
+	value = value * 100 + (position[1] - '0') * 10 + (position[2] - '0');
+	hundredths = negative ? -value : value;
+	return true;
+}
+
+//The dB values are written with two decimal places, so for the usual range of values
+//10^(x/10) is looked up by the value in hundredths rather than calculated with pow.
+const int g_microRainRadarUndbTableMin = -10000; //-100.00 dB
+const int g_microRainRadarUndbTableMax = 10000; //100.00 dB
+
+const std::vector<double> &getMicroRainRadarUndbTable()
+{
+	static const std::vector<double> table = []()
+	{
+		std::vector<double> result(g_microRainRadarUndbTableMax - g_microRainRadarUndbTableMin + 1);
+		//dividing the hundredths by 100 gives exactly the same double as parsing the text,
+		//so these are identical to the values calculated from the text
+		for (int i = g_microRainRadarUndbTableMin; i <= g_microRainRadarUndbTableMax; ++i)
+			result[i - g_microRainRadarUndbTableMin] = std::pow(10, (double(i) / 100.0) / 10.0);
+		return result;
+	}();
+	return table;
+}
+
+double undbMicroRainRadarField(const char *field)
+{
+	int hundredths;
+	if (parseMicroRainRadarHundredths(field, hundredths) && hundredths >= g_microRainRadarUndbTableMin && hundredths <= g_microRainRadarUndbTableMax)
+		return getMicroRainRadarUndbTable()[hundredths - g_microRainRadarUndbTableMin];
+	return std::pow(10, parseMicroRainRadarNumber<double>(field, field + g_microRainRadarFieldWidth) / 10.0);
+}
+
+template<class T, class DESTINATION>
+void MicroRainRadarProfile::readDataLine(std::istream &stream, std::string &line, const char *expectedPrefix, DESTINATION &&destination)
+{
+	std::getline(stream, line);
+	bool transferFunction = std::strcmp(expectedPrefix, "TF ") == 0;
+	//all lines should have 220 characters, but i have occasionally found crazy TF lines that don't follow the correct pattern
+	sci::assertThrow(line.length() == g_microRainRadarLineLength || transferFunction, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with the wrong length.")));
+	sci::assertThrow(line.compare(0, g_microRainRadarPrefixLength, expectedPrefix) == 0, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with an unexpected prefix.")));
+
+	if (transferFunction)
+	{
+		//all lines should have fixed width of 7 characters per value.
+		//TF values should all be between 1 and zero. They are actually output
+		//with a delimiting space then 4 digits after the point. This should be
+		//the same as 7 characters fixed width. However, occasionally something
+		//goes a bit haywire and we get values outside the range 0-1 breaking
+		//the fixed width. Hence for TF lines we split on whitespace instead.
+		const char *position = line.data() + g_microRainRadarPrefixLength;
+		const char *end = line.data() + line.length();
+		bool parsed = true;
+		for (size_t i = 0; i < g_microRainRadarNHeights; ++i)
+		{
+			double value = 0.0;
+			parsed = parsed && parseBufferNumber(position, end, value);
+			destination[i] = parsed ? T((typename T::valueType)value) : std::numeric_limits<T>::quiet_NaN();
+		}
+	}
+	else
+	{
+		//the lines should all be fixed width with 7 characters
+		//per value and a 3 character identifier to start the line
+		const char *field = line.data() + g_microRainRadarPrefixLength;
+		for (size_t i = 0; i < g_microRainRadarNHeights; ++i)
+		{
+			if (isEmptyMicroRainRadarField(field))
+				destination[i] = std::numeric_limits<T>::quiet_NaN();
+			else
+				destination[i] = T((typename T::valueType)parseMicroRainRadarNumber<double>(field, field + g_microRainRadarFieldWidth));
+			field += g_microRainRadarFieldWidth;
+		}
+	}
+}
+
+template<class T, class DESTINATION>
+void MicroRainRadarProfile::readAndUndbDataLine(std::istream &stream, std::string &line, const char *expectedPrefix, DESTINATION &&destination)
+{
+	std::getline(stream, line);
+	sci::assertThrow(line.length() == g_microRainRadarLineLength, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with the wrong length.")));
+	sci::assertThrow(line.compare(0, g_microRainRadarPrefixLength, expectedPrefix) == 0, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with an unexpected prefix.")));
+
+	const char *field = line.data() + g_microRainRadarPrefixLength;
+	for (size_t i = 0; i < g_microRainRadarNHeights; ++i)
+	{
+		if (isEmptyMicroRainRadarField(field))
+			destination[i] = std::numeric_limits<T>::quiet_NaN();
+		else
+			destination[i] = T((typename T::valueType)undbMicroRainRadarField(field));
+		field += g_microRainRadarFieldWidth;
+	}
+}
+
 bool MicroRainRadarProfile::readProfile(std::istream &stream)
 {
 	std::string line;
@@ -48,9 +195,27 @@ bool MicroRainRadarProfile::readProfile(std::istream &stream)
 	sci::assertThrow(!stream.eof(), sci::err(sci::SERR_USER, 0, sU("Found an unexpected end of data.")));
 	sci::assertThrow(!stream.bad(), sci::err(sci::SERR_USER, 0, sU("Bad read.")));
 
+	//split the header line on spaces, as views of the line rather than new strings
+	std::string_view headerChunks[23];
+	size_t nHeaderChunks = 0;
+	const char *position = line.data();
+	const char *end = line.data() + line.length();
+	while (position != end)
+	{
+		while (position != end && *position == ' ')
+			++position;
+		if (position == end)
+			break;
+		const char *chunkStart = position;
+		while (position != end && *position != ' ')
+			++position;
+		if (nHeaderChunks < 23)
+			headerChunks[nHeaderChunks] = std::string_view(chunkStart, position - chunkStart);
+		++nHeaderChunks;
+	}
+
 	//parse the header line
-	std::vector<std::string> headerChunks = sci::splitstring(line, " ", true);
-	sci::assertThrow(headerChunks.size() == 23 &&
+	sci::assertThrow(nHeaderChunks == 23 &&
 		headerChunks[0] == "MRR" &&
 		headerChunks[2] == "UTC" &&
 		headerChunks[3] == "AVE" &&
@@ -65,21 +230,21 @@ bool MicroRainRadarProfile::readProfile(std::istream &stream)
 		headerChunks[21] == "TYP",
 		sci::err(sci::SERR_USER, 0, sU("Incorrectly formatted header line.")));
 	sci::assertThrow(headerChunks[1].length() == 12, sci::err(sci::SERR_USER, 0, sU("Incorrectly formatted time in the header")));
-	m_time = sci::UtcTime(std::atoi(headerChunks[1].substr(0, 2).c_str()) + 2000,
-		std::atoi(headerChunks[1].substr(2, 2).c_str()),
-		std::atoi(headerChunks[1].substr(4, 2).c_str()),
-		std::atoi(headerChunks[1].substr(6, 2).c_str()),
-		std::atoi(headerChunks[1].substr(8, 2).c_str()),
-		std::atoi(headerChunks[1].substr(10, 2).c_str()));
-	m_averagingTime = second(std::atof(headerChunks[4].c_str()));
-	m_heightResolution = metreF((metreF::valueType)std::atof(headerChunks[6].c_str()));
-	m_instrumentHeight = metreF((metreF::valueType)std::atof(headerChunks[8].c_str()));
-	m_samplingRate = hertzF((hertzF::valueType)std::atof(headerChunks[10].c_str()));
-	m_serviceVersionNumber = sci::fromCodepage(headerChunks[12]);
-	m_firmwareVersionNumber = sci::fromCodepage(headerChunks[14]);
-	m_serialNumber = sci::fromCodepage(headerChunks[16]);
-	m_calibrationConstant = unitlessF((unitlessF::valueType)std::atof(headerChunks[18].c_str()));
-	m_validFraction = percentF((percentF::valueType)std::atof(headerChunks[20].c_str()));
+	m_time = sci::UtcTime(parseMicroRainRadarNumber<int>(headerChunks[1].substr(0, 2)) + 2000,
+		parseMicroRainRadarNumber<int>(headerChunks[1].substr(2, 2)),
+		parseMicroRainRadarNumber<int>(headerChunks[1].substr(4, 2)),
+		parseMicroRainRadarNumber<int>(headerChunks[1].substr(6, 2)),
+		parseMicroRainRadarNumber<int>(headerChunks[1].substr(8, 2)),
+		parseMicroRainRadarNumber<int>(headerChunks[1].substr(10, 2)));
+	m_averagingTime = second(parseMicroRainRadarNumber<double>(headerChunks[4]));
+	m_heightResolution = metreF((metreF::valueType)parseMicroRainRadarNumber<double>(headerChunks[6]));
+	m_instrumentHeight = metreF((metreF::valueType)parseMicroRainRadarNumber<double>(headerChunks[8]));
+	m_samplingRate = hertzF((hertzF::valueType)parseMicroRainRadarNumber<double>(headerChunks[10]));
+	m_serviceVersionNumber = sci::fromCodepage(std::string(headerChunks[12]));
+	m_firmwareVersionNumber = sci::fromCodepage(std::string(headerChunks[14]));
+	m_serialNumber = sci::fromCodepage(std::string(headerChunks[16]));
+	m_calibrationConstant = unitlessF((unitlessF::valueType)parseMicroRainRadarNumber<double>(headerChunks[18]));
+	m_validFraction = percentF((percentF::valueType)parseMicroRainRadarNumber<double>(headerChunks[20]));
 	if (headerChunks[22] == "AVE")
 		m_profileType = MRRPT_averaged;
 	else if (headerChunks[22] == "PRO")
@@ -89,42 +254,50 @@ bool MicroRainRadarProfile::readProfile(std::istream &stream)
 	else
 		throw(sci::err(sci::SERR_USER, 0, "Found and invalid micro rain radar profile type."));
 
-	//Read each chiunk of data in turn
-	m_ranges = readDataLine<metreF>(stream, "H  ");
-	m_transferFunction = readDataLine<unitlessF>(stream, "TF ");
-	m_spectralReflectivities.reshape({ 64, 31 });
+	//Size all the storage, then read each chunk of data in turn straight into it
+	m_ranges = sci::GridData<metreF, 1>(g_microRainRadarNHeights);
+	m_transferFunction = sci::GridData<unitlessF, 1>(g_microRainRadarNHeights);
+	m_spectralReflectivities.reshape({ 64, g_microRainRadarNHeights });
+	m_dropDiameters.reshape({ 64, g_microRainRadarNHeights });
+	m_numberDistribution.reshape({ 64, g_microRainRadarNHeights });
+	m_pathIntegratedAttenuation = sci::GridData<unitlessF, 1>(g_microRainRadarNHeights);
+	m_reflectivity = sci::GridData<reflectivityF, 1>(g_microRainRadarNHeights);
+	m_reflectivityAttenuationCorrected = sci::GridData<reflectivityF, 1>(g_microRainRadarNHeights);
+	m_rainRate = sci::GridData<millimetrePerHourF, 1>(g_microRainRadarNHeights);
+	m_liquidWaterContent = sci::GridData<gramPerMetreCubedF, 1>(g_microRainRadarNHeights);
+	m_fallVelocity = sci::GridData<metrePerSecondF, 1>(g_microRainRadarNHeights);
+
+	readDataLine<metreF>(stream, line, "H  ", m_ranges);
+	readDataLine<unitlessF>(stream, line, "TF ", m_transferFunction);
+	//the spectral lines have prefixes F00-F63, D00-D63 and N00-N63
+	char prefix[4] = { ' ', ' ', ' ', '\0' };
+	auto setPrefix = [&prefix](char letter, size_t index)
+	{
+		prefix[0] = letter;
+		prefix[1] = char('0' + index / 10);
+		prefix[2] = char('0' + index % 10);
+	};
 	for (size_t i = 0; i < m_spectralReflectivities.shape()[0]; ++i)
 	{
-		std::ostringstream prefix;
-		prefix << "F" << (i < 10 ? "0" : "") << i;
-		auto line = readAndUndbDataLine<perMetreF>(stream, prefix.str());
-		for (size_t j = 0; j < 31; ++j)
-			m_spectralReflectivities[i][j] = line[j];
+		setPrefix('F', i);
+		readAndUndbDataLine<perMetreF>(stream, line, prefix, m_spectralReflectivities[i]);
 	}
-	m_dropDiameters.reshape({ 64, 31 });
 	for (size_t i = 0; i < m_dropDiameters.shape()[0]; ++i)
 	{
-		std::ostringstream prefix;
-		prefix << "D" << (i < 10 ? "0" : "") << i;
-		auto line = readDataLine<millimetreF>(stream, prefix.str());
-		for (size_t j = 0; j < 31; ++j)
-			m_dropDiameters[i][j] = line[j];
+		setPrefix('D', i);
+		readDataLine<millimetreF>(stream, line, prefix, m_dropDiameters[i]);
 	}
-	m_numberDistribution.reshape({ 64, 31 });
 	for (size_t i = 0; i < m_numberDistribution.shape()[0]; ++i)
 	{
-		std::ostringstream prefix;
-		prefix << "N" << (i < 10 ? "0" : "") << i;
-		auto line = readDataLine<perMetreCubedPerMillimetreF>(stream, prefix.str());
-		for (size_t j = 0; j < 31; ++j)
-			m_numberDistribution[i][j] = line[j];
+		setPrefix('N', i);
+		readDataLine<perMetreCubedPerMillimetreF>(stream, line, prefix, m_numberDistribution[i]);
 	}
-	m_pathIntegratedAttenuation = readAndUndbDataLine<unitlessF>(stream, "PIA");
-	m_reflectivity = readAndUndbDataLine<reflectivityF>(stream, "z  ");
-	m_reflectivityAttenuationCorrected = readAndUndbDataLine<reflectivityF>(stream, "Z  ");
-	m_rainRate = readDataLine<millimetrePerHourF>(stream, "RR ");
-	m_liquidWaterContent = readDataLine<gramPerMetreCubedF>(stream, "LWC");
-	m_fallVelocity = readDataLine<metrePerSecondF>(stream, "W  ");
+	readAndUndbDataLine<unitlessF>(stream, line, "PIA", m_pathIntegratedAttenuation);
+	readAndUndbDataLine<reflectivityF>(stream, line, "z  ", m_reflectivity);
+	readAndUndbDataLine<reflectivityF>(stream, line, "Z  ", m_reflectivityAttenuationCorrected);
+	readDataLine<millimetrePerHourF>(stream, line, "RR ", m_rainRate);
+	readDataLine<gramPerMetreCubedF>(stream, line, "LWC", m_liquidWaterContent);
+	readDataLine<metrePerSecondF>(stream, line, "W  ", m_fallVelocity);
 
 	return true;
 }
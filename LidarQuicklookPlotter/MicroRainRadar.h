@@ -30,67 +30,13 @@ public:
 	const sci::GridData<perMetreCubedPerMillimetreF, 2> &getNumberDistribution() { return m_numberDistribution; }
 private:
 
-	template<class T>
-	sci::GridData<T, 1> readDataLine(std::istream &stream, std::string expectedPrefix)
-	{
-		std::string line;
-		std::getline(stream, line);
-		//all lines should have 220 characters, but i have occasionally found crazy TF lines that don't follow the correct pattern
-		sci::assertThrow(line.length() == 220 || expectedPrefix =="TF ", sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with the wrong length.")));
-		sci::assertThrow(line.substr(0, 3) == expectedPrefix, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with an unexpected prefix.")));
-
-		sci::GridData<T, 1> result(31);
-		if (expectedPrefix == "TF ")
-		{
-			//all lines should have fixed width of 7 characters per value.
-			//TF values should all be between 1 and zero. They are actually output
-			//with a delimiting space then 4 digits after the point. This should be
-			//the same as 7 characters fixed width. However, occasionally something
-			//goes a bit haywire and we get values outside the range 0-1 breaking
-			//the fixed width. Hence for TF lines we use the delimiter the read in
-			//using the << operator instead.
-			std::istringstream tfLineStream(line.substr(3));
-			for (size_t i = 0; i < result.size(); ++i)
-				tfLineStream >> result[i];
-		}
-		else
-		{
-			//the lines should all be fixed width with 7 characters
-			//per value and a 3 character identifier to start the line
-			for (size_t i = 0; i < result.size(); ++i)
-			{
-				bool empty = true;
-				for (size_t j = 0; j < 7; ++j)
-					empty = empty && line[3 + i * 7 + j] == ' ';
-				if (empty)
-					result[i] = std::numeric_limits<T>::quiet_NaN();
-				else
-					result[i] = T((typename T::valueType)atof(line.substr(3 + i * 7, 7).c_str()));
-			}
-		}
-		return result;
-	}
-	template<class T>
-	sci::GridData<T, 1> readAndUndbDataLine(std::istream &stream, std::string expectedPrefix)
-	{
-		std::string line;
-		std::getline(stream, line);
-		sci::assertThrow(line.length() == 220, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with the wrong length.")));
-		sci::assertThrow(line.substr(0, 3) == expectedPrefix, sci::err(sci::SERR_USER, 0, sU("Micro rain radar data line found with an unexpected prefix.")));
-
-		sci::GridData<T, 1> result(31);
-		for (size_t i = 0; i < result.size(); ++i)
-		{
-			bool empty = true;
-			for (size_t j = 0; j < 7; ++j)
-				empty = empty && line[3 + i * 7 + j] == ' ';
-			if (empty)
-				result[i] = std::numeric_limits<T>::quiet_NaN();
-			else
-				result[i] = T((typename T::valueType)std::pow(10, atof(line.substr(3 + i * 7, 7).c_str()) / 10.0));
-		}
-		return result;
-	}
+	//Each data line is a 3 character prefix followed by 31 values, each 7 characters wide.
+	//The values are parsed straight from the line into destination, which can be a 1d
+	//GridData or a row of a 2d one. line is reused between calls so it isn't reallocated.
+	template<class T, class DESTINATION>
+	static void readDataLine(std::istream &stream, std::string &line, const char *expectedPrefix, DESTINATION &&destination);
+	template<class T, class DESTINATION>
+	static void readAndUndbDataLine(std::istream &stream, std::string &line, const char *expectedPrefix, DESTINATION &&destination);
 
 	//header parameters
 	sci::UtcTime m_time;
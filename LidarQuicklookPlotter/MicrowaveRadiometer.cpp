@@ -1,5 +1,6 @@
 #include"MicrowaveRadiometer.h"
 #include"ProgressReporter.h"
+#include"ProcessingScheduler.h"
 
 MicrowaveRadiometerProcessor::MicrowaveRadiometerProcessor(const InstrumentInfo& instrumentInfo, const CalibrationInfo& calibrationInfo)
 	//: InstrumentProcessor(sU("[/\\\\]Y....[/\\\\]M..[/\\\\]D..[/\\\\]........\\.(LWP|IWV|HKD|STA|BRT|MET|ATN|TPC|TPB|HPC)$"))
@@ -7,170 +8,345 @@ MicrowaveRadiometerProcessor::MicrowaveRadiometerProcessor(const InstrumentInfo&
 	//: InstrumentProcessor(sU("[/\\\\]Y....[/\\\\]M..[/\\\\]D..[/\\\\]........\\.LWP$"))
 {
 	m_hasData = false;
+	m_reallocations = 0;
 	m_instrumentInfo = instrumentInfo;
 	m_calibrationInfo = calibrationInfo;
 }
 
-void MicrowaveRadiometerProcessor::readData(const std::vector<sci::string>& inputFilenames, const Platform& platform, ProgressReporter& progressReporter)
+sci::string getHatproProduct(const sci::string& filename)
 {
+	return filename.length() < 3 ? filename : filename.substr(filename.length() - 3);
+}
 
-	size_t elementsInFirstFile;
-	size_t elementsInSecondFile;
-	for (size_t i = 0; i < inputFilenames.size(); ++i)
-	{
-		//after reading the first two files reserve space for the remaining files. This
-		//can speed things up a lot
-		//We use the second file to work out the space needed as the first one might be a partial hour.
-		bool reservedSpace = false;
-		if (i == 1)
-			elementsInFirstFile = std::max(m_lwp.size(), m_iwv.size());
-		if (!reservedSpace && i > 1 && (m_lwp.size() > elementsInFirstFile || m_iwv.size() > elementsInFirstFile))
-		{
-			elementsInSecondFile = std::max(m_lwp.size(), m_iwv.size()) - elementsInFirstFile;
-			size_t reserveSize = inputFilenames.size() * std::max(elementsInFirstFile, elementsInSecondFile);
-
-			m_lwpTime.reserve(reserveSize);
-			m_lwp.reserve(reserveSize);
-			m_lwpElevation.reserve(reserveSize);
-			m_lwpAzimuth.reserve(reserveSize);
-			m_lwpRainFlag.reserve(reserveSize);
-			m_lwpQuality.reserve(reserveSize);
-			m_lwpQualityExplanation.reserve(reserveSize);
-
-			m_iwvTime.reserve(reserveSize);
-			m_iwv.reserve(reserveSize);
-			m_iwvElevation.reserve(reserveSize);
-			m_iwvAzimuth.reserve(reserveSize);
-			m_iwvRainFlag.reserve(reserveSize);
-			m_iwvQuality.reserve(reserveSize);
-			m_iwvQualityExplanation.reserve(reserveSize);
-
-			reservedSpace = true;
-		}
+template<class T>
+void allocateHatproSamples(sci::GridData<T, 1>& data, size_t nSamples)
+{
+	data.resize(nSamples);
+}
 
-		try
-		{
-			readData(inputFilenames[i], platform, progressReporter, i == 0);
-		}
-		catch (sci::err err)
-		{
-			//catch any sci::errors - these probably mean a corrupt or incomplete file, but we can continue with other files.
-			progressReporter << err.getErrorMessage() << "\n";
-		}
-		if (progressReporter.shouldStop())
-			break;
-	}
+//the second dimension isn't known until the first file is read
+template<class T>
+void allocateHatproSamples(sci::GridData<T, 2>& data, size_t nSamples)
+{
+	data.reshape({ nSamples, 0 });
 }
 
+//Copies source into destination starting at element offset, growing destination only if it
+//wasn't sized for it in advance
 template<class T>
-void appendData2dInFirstDimension(sci::GridData<T, 2>& destination, const sci::GridData<T, 2>& source)
+void copyHatproSamples(sci::GridData<T, 1>& destination, size_t offset, const sci::GridData<T, 1>& source, size_t& reallocations)
 {
-	if (destination.shape()[0] == 0 || destination.shape()[1] == 0)
+	if (offset + source.size() > destination.size())
 	{
-		destination = source;
+		destination.resize(offset + source.size());
+		++reallocations;
+	}
+	for (size_t i = 0; i < source.size(); ++i)
+		destination[offset + i] = source[i];
+}
+
+//As above but copying rows starting at row offset
+template<class T>
+void copyHatproSamples(sci::GridData<T, 2>& destination, size_t offset, const sci::GridData<T, 2>& source, size_t& reallocations)
+{
+	auto sourceShape = source.shape();
+	if (sourceShape[0] == 0)
 		return;
+	auto destShape = destination.shape();
+	if (destShape[1] == 0 && offset == 0)
+	{
+		destShape[1] = sourceShape[1];
+		destination.reshape(destShape);
 	}
+	sci::assertThrow(destShape[1] == sourceShape[1], sci::err(sci::SERR_USER, 0, sU("Trying to append 2d data where the size in the second dimension does not match.")));
 
-	sci::assertThrow(destination.shape()[1] == source.shape()[1], sci::err(sci::SERR_USER, 0, sU("Trying to append 2d data where the size in the second dimension does not match.")));
+	if (offset + sourceShape[0] > destShape[0])
+	{
+		destShape[0] = offset + sourceShape[0];
+		destination.reshape(destShape);
+		++reallocations;
+	}
+	for (size_t i = 0; i < sourceShape[0]; ++i)
+		for (size_t j = 0; j < sourceShape[1]; ++j)
+			destination[i + offset][j] = source[i][j];
+}
 
-	auto destShape = destination.shape();
-	auto sourceShape = source.shape();
-	std::array<size_t, 2> resultShape{ destShape[0] + sourceShape[0], destShape[1] };
+template<class T>
+void trimHatproSamples(sci::GridData<T, 1>& data, size_t nSamples)
+{
+	data.resize(nSamples);
+}
 
-	destination.reshape(resultShape);
+template<class T>
+void trimHatproSamples(sci::GridData<T, 2>& data, size_t nSamples)
+{
+	if (data.shape()[1] == 0)
+		nSamples = 0;
+	data.reshape({ nSamples, data.shape()[1] });
+}
 
-	for (size_t i = 0; i < sourceShape[0]; ++i)
+template<class FUNCTION>
+void MicrowaveRadiometerProcessor::forEachSampleArray(const sci::string& product, FUNCTION function)
+{
+	if (product == sU("LWP"))
 	{
-		for (size_t j = 0; j < sourceShape[1]; ++j)
+		function(m_lwpTime);
+		function(m_lwp);
+		function(m_lwpElevation);
+		function(m_lwpAzimuth);
+		function(m_lwpRainFlag);
+		function(m_lwpQuality);
+		function(m_lwpQualityExplanation);
+	}
+	else if (product == sU("IWV"))
+	{
+		function(m_iwvTime);
+		function(m_iwv);
+		function(m_iwvElevation);
+		function(m_iwvAzimuth);
+		function(m_iwvRainFlag);
+		function(m_iwvQuality);
+		function(m_iwvQualityExplanation);
+	}
+	else if (product == sU("HKD"))
+	{
+		function(m_hkdTime);
+		function(m_latitude);
+		function(m_longitude);
+		function(m_ambientTarget1Temperature);
+		function(m_ambientTarget2Temperature);
+		function(m_humidityProfilerTemperature);
+		function(m_temperatureProfilerTemperature);
+		function(m_temperatureStabilityReceiver1);
+		function(m_temperatureStabilityReceiver2);
+		function(m_status);
+		function(m_remainingMemory);
+	}
+	else if (product == sU("MET"))
+	{
+		function(m_metTime);
+		function(m_enviromentTemperature);
+		function(m_enviromentPressure);
+		function(m_enviromentRelativeHumidity);
+	}
+	else if (product == sU("STA"))
+	{
+		//the indices are only in the file if they are switched on, so they are appended separately
+		function(m_staTime);
+		function(m_staRainFlag);
+	}
+	else if (product == sU("BRT"))
+	{
+		function(m_brtTime);
+		function(m_brightnessTemperature);
+		function(m_brtElevation);
+		function(m_brtAzimuth);
+		function(m_brtRainFlag);
+	}
+	else if (product == sU("ATN"))
+	{
+		function(m_atnTime);
+		function(m_attenuation);
+		function(m_atnElevation);
+		function(m_atnAzimuth);
+		function(m_atnRainFlag);
+	}
+	else if (product == sU("TPB"))
+	{
+		function(m_tpbTime);
+		function(m_tpbTemperatures);
+		function(m_tpbRainFlag);
+	}
+	else if (product == sU("TPC"))
+	{
+		function(m_tpcTime);
+		function(m_tpcTemperatures);
+		function(m_tpcRainFlag);
+	}
+	else if (product == sU("HPC"))
+	{
+		function(m_hpcTime);
+		function(m_hpcAbsoluteHumidity);
+		function(m_hpcRelativeHumidity);
+		function(m_hpcRainFlag);
+	}
+}
+
+void MicrowaveRadiometerProcessor::readData(const std::vector<sci::string>& inputFilenames, const Platform& platform, ProgressReporter& progressReporter)
+{
+	clearData();
+
+	//size the arrays for each product from the sample counts in the file headers, so reading
+	//each file just fills in its part rather than growing every array file by file
+	std::map<sci::string, size_t> headerSamples;
+	std::map<sci::string, std::vector<sci::string>> productFiles;
+	size_t totalHeaderSamples = 0;
+	for (size_t i = 0; i < inputFilenames.size(); ++i)
+	{
+		sci::string product = getHatproProduct(inputFilenames[i]);
+		productFiles[product].push_back(inputFilenames[i]);
+		uint32_t fileTypeId;
+		uint32_t nSamples;
+		if (readHatproSampleCount(inputFilenames[i], fileTypeId, nSamples))
 		{
-			destination[i+destShape[0]][j] = source[i][j];
+			headerSamples[product] += nSamples;
+			totalHeaderSamples += nSamples;
 		}
 	}
+	for (auto& product : headerSamples)
+		forEachSampleArray(product.first, [&](auto& data) { allocateHatproSamples(data, product.second); });
+	const size_t staSamples = headerSamples.count(sU("STA")) > 0 ? headerSamples[sU("STA")] : 0;
+	m_liftedIndex.reserve(staSamples);
+	m_kModifiedIndex.reserve(staSamples);
+	m_totalTotalsIndex.reserve(staSamples);
+	m_kIndex.reserve(staSamples);
+	m_showalterIndex.reserve(staSamples);
+	m_cape.reserve(staSamples);
+
+	//The products share nothing until they are aligned when writing, so each product is read
+	//as a separate task, reading its files in order. The counters are per task so the tasks
+	//never write to the same memory.
+	ProcessingScheduler scheduler(m_processingOptions.fileReadingThreads);
+	std::vector<size_t> productReallocations(productFiles.size(), 0);
+	std::vector<uint8_t> productHasData(productFiles.size(), 0);
+	size_t productIndex = 0;
+	for (auto& product : productFiles)
+	{
+		size_t* filled = &m_filledSamples[product.first];
+		size_t* reallocations = &productReallocations[productIndex];
+		uint8_t* hasData = &productHasData[productIndex];
+		const std::vector<sci::string>* files = &product.second;
+		scheduler.addTask(sU("Reading ") + product.first + sU(" files"), 0, [this, filled, reallocations, hasData, files](ProgressReporter& taskProgressReporter)
+			{
+				for (size_t i = 0; i < files->size(); ++i)
+				{
+					try
+					{
+						if (appendFile((*files)[i], taskProgressReporter, *filled, *reallocations))
+							*hasData = 1;
+					}
+					catch (sci::err err)
+					{
+						//catch any sci::errors - these probably mean a corrupt or incomplete file, but we can continue with other files.
+						taskProgressReporter << err.getErrorMessage() << "\n";
+					}
+					if (taskProgressReporter.shouldStop())
+						break;
+				}
+			});
+		++productIndex;
+	}
+	scheduler.run(progressReporter, []() {});
+	for (size_t i = 0; i < productFiles.size(); ++i)
+	{
+		m_reallocations += productReallocations[i];
+		if (productHasData[i])
+			m_hasData = true;
+	}
+
+	//remove any space that wasn't filled, e.g. due to a corrupt file
+	for (auto& product : headerSamples)
+	{
+		size_t filled = m_filledSamples[product.first];
+		forEachSampleArray(product.first, [&](auto& data) { trimHatproSamples(data, filled); });
+	}
+	progressReporter << "Allocated space for " << totalHeaderSamples << " samples from the file headers, arrays were reallocated "
+		<< m_reallocations << " times while reading.\n";
 }
 
-void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, const Platform& platform, ProgressReporter& progressReporter, bool clear)
+void MicrowaveRadiometerProcessor::clearData()
 {
-	progressReporter << "Reading file " << inputFilename << "\n";
+	m_hasData = false;
+	m_filledSamples.clear();
+	m_reallocations = 0;
+
+	m_lwpTime.resize(0);
+	m_lwp.resize(0);
+	m_lwpElevation.resize(0);
+	m_lwpAzimuth.resize(0);
+	m_lwpRainFlag.resize(0);
+	m_lwpQuality.resize(0);
+	m_lwpQualityExplanation.resize(0);
+
+	m_iwvTime.resize(0);
+	m_iwv.resize(0);
+	m_iwvElevation.resize(0);
+	m_iwvAzimuth.resize(0);
+	m_iwvRainFlag.resize(0);
+	m_iwvQuality.resize(0);
+	m_iwvQualityExplanation.resize(0);
+	
+	m_hkdTime.resize(0);
+	m_latitude.resize(0);
+	m_longitude.resize(0);
+	m_ambientTarget1Temperature.resize(0);
+	m_ambientTarget2Temperature.resize(0);
+	m_humidityProfilerTemperature.resize(0);
+	m_temperatureProfilerTemperature.resize(0);
+	m_temperatureStabilityReceiver1.resize(0);
+	m_temperatureStabilityReceiver2.resize(0);
+	m_status.resize(0);
+	m_remainingMemory.resize(0);
+
+	m_metTime.resize(0);
+	m_enviromentTemperature.resize(0);
+	m_enviromentPressure.resize(0);
+	m_enviromentRelativeHumidity.resize(0);
+
+	m_staTime.resize(0);
+	m_staRainFlag.resize(0);
+	m_liftedIndex.resize(0);
+	m_kModifiedIndex.resize(0);
+	m_totalTotalsIndex.resize(0);
+	m_kIndex.resize(0);
+	m_showalterIndex.resize(0);
+	m_cape.resize(0);
+
+	sci::GridData<sci::UtcTime, 1> m_bldTime;
+	sci::GridData<metreF, 1> m_boundaryLayerDepth;
+
+	m_brtTime.resize(0);
+	m_brtFrequencies.resize(0);
+	m_brightnessTemperature.reshape({ 0,0 });
+	m_brtElevation.resize(0);
+	m_brtAzimuth.resize(0);
+	m_brtRainFlag.resize(0);
+
+	m_atnTime.resize(0);
+	m_atnFrequencies.resize(0);
+	m_attenuation.reshape({ 0,0 });
+	m_atnElevation.resize(0);
+	m_atnAzimuth.resize(0);
+	m_atnRainFlag.resize(0);
+
+	m_tpbTime.resize(0);
+	m_tpbAltitudes.resize(0);
+	m_tpbTemperatures.reshape({ 0,0 });
+	m_tpbRainFlag.resize(0);
+
+	m_tpcTime.resize(0);
+	m_tpcAltitudes.resize(0);
+	m_tpcTemperatures.reshape({ 0,0 });
+	m_tpcRainFlag.resize(0);
+
+	m_hpcTime.resize(0);
+	m_hpcAltitudes.resize(0);
+	m_hpcAbsoluteHumidity.reshape({ 0,0 });
+	m_hpcRelativeHumidity.reshape({ 0,0 });
+	m_hpcRainFlag.resize(0);
+}
 
+void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, const Platform& platform, ProgressReporter& progressReporter, bool clear)
+{
 	if (clear)
-	{
-		m_hasData = false;
-
-		m_lwpTime.resize(0);
-		m_lwp.resize(0);
-		m_lwpElevation.resize(0);
-		m_lwpAzimuth.resize(0);
-		m_lwpRainFlag.resize(0);
-		m_lwpQuality.resize(0);
-		m_lwpQualityExplanation.resize(0);
-
-		m_iwvTime.resize(0);
-		m_iwv.resize(0);
-		m_iwvElevation.resize(0);
-		m_iwvAzimuth.resize(0);
-		m_iwvRainFlag.resize(0);
-		m_iwvQuality.resize(0);
-		m_iwvQualityExplanation.resize(0);
-		
-		m_hkdTime.resize(0);
-		m_latitude.resize(0);
-		m_longitude.resize(0);
-		m_ambientTarget1Temperature.resize(0);
-		m_ambientTarget2Temperature.resize(0);
-		m_humidityProfilerTemperature.resize(0);
-		m_temperatureProfilerTemperature.resize(0);
-		m_temperatureStabilityReceiver1.resize(0);
-		m_temperatureStabilityReceiver2.resize(0);
-		m_status.resize(0);
-		m_remainingMemory.resize(0);
-
-		m_metTime.resize(0);
-		m_enviromentTemperature.resize(0);
-		m_enviromentPressure.resize(0);
-		m_enviromentRelativeHumidity.resize(0);
-
-		m_staTime.resize(0);
-		m_staRainFlag.resize(0);
-		m_liftedIndex.resize(0);
-		m_kModifiedIndex.resize(0);
-		m_totalTotalsIndex.resize(0);
-		m_kIndex.resize(0);
-		m_showalterIndex.resize(0);
-		m_cape.resize(0);
-
-		sci::GridData<sci::UtcTime, 1> m_bldTime;
-		sci::GridData<metreF, 1> m_boundaryLayerDepth;
-
-		m_brtTime.resize(0);
-		m_brtFrequencies.resize(0);
-		m_brightnessTemperature.reshape({ 0,0 });
-		m_brtElevation.resize(0);
-		m_brtAzimuth.resize(0);
-		m_brtRainFlag.resize(0);
-
-		m_atnTime.resize(0);
-		m_atnFrequencies.resize(0);
-		m_attenuation.reshape({ 0,0 });
-		m_atnElevation.resize(0);
-		m_atnAzimuth.resize(0);
-		m_atnRainFlag.resize(0);
-
-		m_tpbTime.resize(0);
-		m_tpbAltitudes.resize(0);
-		m_tpbTemperatures.reshape({ 0,0 });
-		m_tpbRainFlag.resize(0);
-
-		m_tpcTime.resize(0);
-		m_tpcAltitudes.resize(0);
-		m_tpcTemperatures.reshape({ 0,0 });
-		m_tpcRainFlag.resize(0);
-
-		m_hpcTime.resize(0);
-		m_hpcAltitudes.resize(0);
-		m_hpcAbsoluteHumidity.reshape({ 0,0 });
-		m_hpcRelativeHumidity.reshape({ 0,0 });
-		m_hpcRainFlag.resize(0);
-	}
+		clearData();
+	if (appendFile(inputFilename, progressReporter, m_filledSamples[getHatproProduct(inputFilename)], m_reallocations))
+		m_hasData = true;
+}
+
+bool MicrowaveRadiometerProcessor::appendFile(const sci::string& inputFilename, ProgressReporter& progressReporter, size_t& filled, size_t& reallocations)
+{
+	progressReporter << "Reading file " << inputFilename << "\n";
 
 	uint32_t fileTypeId;
 	sci::GridData<sci::UtcTime, 1> time;
@@ -210,7 +386,7 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 	sci::GridData<percentF, 2> relativeHumidity;
 	sci::GridData<metreF, 1> altitudes;
 
-	sci::string extension = inputFilename.length() < 3 ? inputFilename : inputFilename.substr(inputFilename.length() - 3);
+	sci::string extension = getHatproProduct(inputFilename);
 	
 
 	if (extension == sU("HKD"))
@@ -238,68 +414,67 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 	else
 		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Unexpected extension. Read aborted.")));
 
+	bool hasData = false;
 	if (fileTypeId == hatproLwpV1Id || fileTypeId == hatproLwpV2Id)
 	{
-		m_lwpTime.insert(m_lwpTime.size(), time);
-		m_lwp.insert(m_lwp.size(), water);
-		m_lwpElevation.insert(m_lwpElevation.size(), elevation);
-		m_lwpAzimuth.insert(m_lwpAzimuth.size(), azimuth);
-		m_lwpRainFlag.insert(m_lwpRainFlag.size(), rainFlag);
-		m_lwpQuality.insert(m_lwpQuality.size(), quality);
-		m_lwpQualityExplanation.insert(m_lwpQualityExplanation.size(), qualityExplanation);
-		m_hasData = true;
+		copyHatproSamples(m_lwpTime, filled, time, reallocations);
+		copyHatproSamples(m_lwp, filled, water, reallocations);
+		copyHatproSamples(m_lwpElevation, filled, elevation, reallocations);
+		copyHatproSamples(m_lwpAzimuth, filled, azimuth, reallocations);
+		copyHatproSamples(m_lwpRainFlag, filled, rainFlag, reallocations);
+		copyHatproSamples(m_lwpQuality, filled, quality, reallocations);
+		copyHatproSamples(m_lwpQualityExplanation, filled, qualityExplanation, reallocations);
+		hasData = true;
 	}
 	else if (fileTypeId == hatproIwvV1Id || fileTypeId == hatproIwvV2Id)
 	{
-		m_iwvTime.insert(m_iwvTime.size(), time);
-		m_iwv.insert(m_iwv.size(), water);
-		m_iwvElevation.insert(m_iwvElevation.size(), elevation);
-		m_iwvAzimuth.insert(m_iwvAzimuth.size(), azimuth);
-		m_iwvRainFlag.insert(m_iwvRainFlag.size(), rainFlag);
-		m_iwvQuality.insert(m_iwvQuality.size(), quality);
-		m_iwvQualityExplanation.insert(m_iwvQualityExplanation.size(), qualityExplanation);
-		m_hasData = true;
+		copyHatproSamples(m_iwvTime, filled, time, reallocations);
+		copyHatproSamples(m_iwv, filled, water, reallocations);
+		copyHatproSamples(m_iwvElevation, filled, elevation, reallocations);
+		copyHatproSamples(m_iwvAzimuth, filled, azimuth, reallocations);
+		copyHatproSamples(m_iwvRainFlag, filled, rainFlag, reallocations);
+		copyHatproSamples(m_iwvQuality, filled, quality, reallocations);
+		copyHatproSamples(m_iwvQualityExplanation, filled, qualityExplanation, reallocations);
+		hasData = true;
 	}
 	else if (fileTypeId == hatproHkdId)
 	{
-		m_hkdTime.insert(m_hkdTime.size(), time);
-		m_latitude.insert(m_latitude.size(), latitude);
-		m_longitude.insert(m_longitude.size(), longitude);
-		m_ambientTarget1Temperature.insert(m_ambientTarget1Temperature.size(), ambientTarget1Temperature);
-		m_ambientTarget2Temperature.insert(m_ambientTarget2Temperature.size(), ambientTarget2Temperature);
-		m_humidityProfilerTemperature.insert(m_humidityProfilerTemperature.size(), humidityProfilerTemperature);
-		m_temperatureProfilerTemperature.insert(m_temperatureProfilerTemperature.size(), temperatureProfilerTemperature);
-		m_temperatureStabilityReceiver1.insert(m_temperatureStabilityReceiver1.size(), temperatureStabilityReceiver1);
-		m_temperatureStabilityReceiver2.insert(m_temperatureStabilityReceiver2.size(), temperatureStabilityReceiver2);
-		m_status.insert(m_status.size(), status);
-		m_remainingMemory.insert(m_remainingMemory.size(), remainingMemory);
-		m_hasData = true;
+		copyHatproSamples(m_hkdTime, filled, time, reallocations);
+		copyHatproSamples(m_latitude, filled, latitude, reallocations);
+		copyHatproSamples(m_longitude, filled, longitude, reallocations);
+		copyHatproSamples(m_ambientTarget1Temperature, filled, ambientTarget1Temperature, reallocations);
+		copyHatproSamples(m_ambientTarget2Temperature, filled, ambientTarget2Temperature, reallocations);
+		copyHatproSamples(m_humidityProfilerTemperature, filled, humidityProfilerTemperature, reallocations);
+		copyHatproSamples(m_temperatureProfilerTemperature, filled, temperatureProfilerTemperature, reallocations);
+		copyHatproSamples(m_temperatureStabilityReceiver1, filled, temperatureStabilityReceiver1, reallocations);
+		copyHatproSamples(m_temperatureStabilityReceiver2, filled, temperatureStabilityReceiver2, reallocations);
+		copyHatproSamples(m_status, filled, status, reallocations);
+		copyHatproSamples(m_remainingMemory, filled, remainingMemory, reallocations);
+		hasData = true;
 	}
 	else if (fileTypeId == hatproMetId || fileTypeId == hatproMetNewId)
 	{
 		//note, we don't currently do anything with the "additional sensor" data
-		m_metTime.insert(m_metTime.size(), time);
-		m_enviromentTemperature.insert(m_enviromentTemperature.size(), enviromentTemperature);
-		m_enviromentPressure.insert(m_enviromentPressure.size(), enviromentPressure);
-		m_enviromentRelativeHumidity.insert(m_enviromentRelativeHumidity.size(), enviromentRelativeHumidity);
-		m_hasData = true;
+		copyHatproSamples(m_metTime, filled, time, reallocations);
+		copyHatproSamples(m_enviromentTemperature, filled, enviromentTemperature, reallocations);
+		copyHatproSamples(m_enviromentPressure, filled, enviromentPressure, reallocations);
+		copyHatproSamples(m_enviromentRelativeHumidity, filled, enviromentRelativeHumidity, reallocations);
+		hasData = true;
 	}
 	else if (fileTypeId == hatproStaId)
 	{
-		m_staTime.insert(m_staTime.size(), time);
-		m_staRainFlag.insert(m_staRainFlag.size(), rainFlag);
+		copyHatproSamples(m_staTime, filled, time, reallocations);
+		copyHatproSamples(m_staRainFlag, filled, rainFlag, reallocations);
 		m_liftedIndex.insert(m_liftedIndex.size(), liftedIndex);
 		m_kModifiedIndex.insert(m_kModifiedIndex.size(), kModifiedIndex);
 		m_totalTotalsIndex.insert(m_totalTotalsIndex.size(), totalTotalsIndex);
 		m_kIndex.insert(m_kIndex.size(), kIndex);
 		m_showalterIndex.insert(m_showalterIndex.size(), showalterIndex);
 		m_cape.insert(m_cape.size(), cape);
-		m_hasData = true;
+		hasData = true;
 	}
 	else if (fileTypeId == hatproBrtV1Id || fileTypeId == hatproBrtV2Id)
 	{
-		m_brtTime.insert(m_brtTime.size(), time);
-		appendData2dInFirstDimension(m_brightnessTemperature, brightnessTemperature);
 		if(m_brtFrequencies.size()==0)
 			m_brtFrequencies = frequencies;
 		else
@@ -308,15 +483,15 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 			for (size_t i = 0; i < m_brtFrequencies.size(); ++i)
 				sci::assertThrow(frequencies[i] == m_brtFrequencies[i], sci::err(sci::SERR_USER, 0, sU("Found a file with different frequencies.")));
 		}
-		m_brtElevation.insert(m_brtElevation.size(), elevation);
-		m_brtAzimuth.insert(m_brtAzimuth.size(), azimuth);
-		m_brtRainFlag.insert(m_brtRainFlag.size(), rainFlag);
-		m_hasData = true;
+		copyHatproSamples(m_brtTime, filled, time, reallocations);
+		copyHatproSamples(m_brightnessTemperature, filled, brightnessTemperature, reallocations);
+		copyHatproSamples(m_brtElevation, filled, elevation, reallocations);
+		copyHatproSamples(m_brtAzimuth, filled, azimuth, reallocations);
+		copyHatproSamples(m_brtRainFlag, filled, rainFlag, reallocations);
+		hasData = true;
 	}
 	else if (fileTypeId == hatproAtnV1Id || fileTypeId == hatproAtnV2Id)
 	{
-		m_atnTime.insert(m_atnTime.size(), time);
-		appendData2dInFirstDimension(m_attenuation, attenuation);
 		if (m_atnFrequencies.size() == 0)
 			m_atnFrequencies = frequencies;
 		else
@@ -325,15 +500,15 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 			for (size_t i = 0; i < m_atnFrequencies.size(); ++i)
 				sci::assertThrow(frequencies[i] == m_atnFrequencies[i], sci::err(sci::SERR_USER, 0, sU("Found a file with different frequencies.")));
 		}
-		m_atnElevation.insert(m_atnElevation.size(), elevation);
-		m_atnAzimuth.insert(m_atnAzimuth.size(), azimuth);
-		m_atnRainFlag.insert(m_atnRainFlag.size(), rainFlag);
-		m_hasData = true;
+		copyHatproSamples(m_atnTime, filled, time, reallocations);
+		copyHatproSamples(m_attenuation, filled, attenuation, reallocations);
+		copyHatproSamples(m_atnElevation, filled, elevation, reallocations);
+		copyHatproSamples(m_atnAzimuth, filled, azimuth, reallocations);
+		copyHatproSamples(m_atnRainFlag, filled, rainFlag, reallocations);
+		hasData = true;
 	}
 	else if (fileTypeId == hatproTpbId)
 	{
-		m_tpbTime.insert(m_tpbTime.size(), time);
-		appendData2dInFirstDimension(m_tpbTemperatures, temperatures);
 		if (m_tpbAltitudes.size() == 0)
 			m_tpbAltitudes = altitudes;
 		else
@@ -342,12 +517,12 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 			for (size_t i = 0; i < m_tpbAltitudes.size(); ++i)
 				sci::assertThrow(altitudes[i] == m_tpbAltitudes[i], sci::err(sci::SERR_USER, 0, sU("Found a file with different altitudes.")));
 		}
-		m_tpbRainFlag.insert(m_tpbRainFlag.size(), rainFlag);
+		copyHatproSamples(m_tpbTime, filled, time, reallocations);
+		copyHatproSamples(m_tpbTemperatures, filled, temperatures, reallocations);
+		copyHatproSamples(m_tpbRainFlag, filled, rainFlag, reallocations);
 	}
 	else if (fileTypeId == hatproTpcId)
 	{
-		m_tpcTime.insert(m_tpcTime.size(), time);
-		appendData2dInFirstDimension(m_tpcTemperatures, temperatures);
 		if (m_tpcAltitudes.size() == 0)
 			m_tpcAltitudes = altitudes;
 		else
@@ -356,18 +531,12 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 			for (size_t i = 0; i < m_tpcAltitudes.size(); ++i)
 				sci::assertThrow(altitudes[i] == m_tpcAltitudes[i], sci::err(sci::SERR_USER, 0, sU("Found a file with different altitudes.")));
 		}
-		m_tpcRainFlag.insert(m_tpcRainFlag.size(), rainFlag);
+		copyHatproSamples(m_tpcTime, filled, time, reallocations);
+		copyHatproSamples(m_tpcTemperatures, filled, temperatures, reallocations);
+		copyHatproSamples(m_tpcRainFlag, filled, rainFlag, reallocations);
 	}
 	else if (fileTypeId == hatproHpcWithRhId || fileTypeId == hatproHpcNoRhId)
 	{
-		m_hpcTime.insert(m_hpcTime.size(), time);
-		appendData2dInFirstDimension(m_hpcAbsoluteHumidity, absoluteHumidity);
-		if (relativeHumidity.size() > 0)
-		{
-			appendData2dInFirstDimension(m_hpcRelativeHumidity, relativeHumidity);
-			sci::assertThrow(m_hpcRelativeHumidity.shape() == m_hpcAbsoluteHumidity.shape(), sci::err(sci::SERR_USER, 0, sU("Some files contain RH and some do not.")));
-		}
-
 		if (m_hpcAltitudes.size() == 0)
 			m_hpcAltitudes = altitudes;
 		else
@@ -376,8 +545,14 @@ void MicrowaveRadiometerProcessor::readData(const sci::string& inputFilename, co
 			for (size_t i = 0; i < m_hpcAltitudes.size(); ++i)
 				sci::assertThrow(altitudes[i] == m_hpcAltitudes[i], sci::err(sci::SERR_USER, 0, sU("Found a file with different altitudes.")));
 		}
-		m_hpcRainFlag.insert(m_hpcRainFlag.size(), rainFlag);
+		sci::assertThrow(filled == 0 || (relativeHumidity.size() > 0) == (m_hpcRelativeHumidity.shape()[1] > 0), sci::err(sci::SERR_USER, 0, sU("Some files contain RH and some do not.")));
+		copyHatproSamples(m_hpcTime, filled, time, reallocations);
+		copyHatproSamples(m_hpcAbsoluteHumidity, filled, absoluteHumidity, reallocations);
+		copyHatproSamples(m_hpcRelativeHumidity, filled, relativeHumidity, reallocations);
+		copyHatproSamples(m_hpcRainFlag, filled, rainFlag, reallocations);
 	}
+	filled += time.size();
+	return hasData;
 }
 
 void MicrowaveRadiometerProcessor::writeToNc(const sci::string& directory, const PersonInfo& author,
@@ -446,10 +621,15 @@ void MicrowaveRadiometerProcessor::writeIwvLwpNc(const sci::string& directory, c
 	sci::GridData<uint8_t, 1> iwvFlag = buildAmfFlagFromHatproQualityAndNanBadData(m_iwvQuality, m_iwvQualityExplanation, m_iwv);
 
 	//pad the data so it matches the housekeeping data
+	TimeJoin hkdJoin(m_hkdTime);
 	if(m_iwvTime.size() > 0)
-		padDataToMatchHkp(m_hkdTime, m_iwvTime, m_iwv, m_iwvElevation, m_iwvAzimuth, m_iwvRainFlag, m_iwvQuality, m_iwvQualityExplanation, iwvFlag);
+		hkdJoin.join(m_iwvTime, timeJoinVariable(m_iwv), timeJoinVariable(m_iwvElevation), timeJoinVariable(m_iwvAzimuth),
+			timeJoinVariable(m_iwvRainFlag, mwrRainMissingDataFlag), timeJoinVariable(m_iwvQuality, mwrMissingDataFlag),
+			timeJoinVariable(m_iwvQualityExplanation, 0), timeJoinVariable(iwvFlag, mwrMissingDataFlag));
 	if(m_lwpTime.size() > 0)
-		padDataToMatchHkp(m_hkdTime, m_lwpTime, m_lwp, m_lwpElevation, m_lwpAzimuth, m_lwpRainFlag, m_lwpQuality, m_lwpQualityExplanation, lwpFlag);
+		hkdJoin.join(m_lwpTime, timeJoinVariable(m_lwp), timeJoinVariable(m_lwpElevation), timeJoinVariable(m_lwpAzimuth),
+			timeJoinVariable(m_lwpRainFlag, mwrRainMissingDataFlag), timeJoinVariable(m_lwpQuality, mwrMissingDataFlag),
+			timeJoinVariable(m_lwpQualityExplanation, 0), timeJoinVariable(lwpFlag, mwrMissingDataFlag));
 
 	if(m_iwvTime.size() > 0 && m_lwpTime.size() > 0)
 		for(size_t i=0; i< m_iwv.size(); ++i)
@@ -879,33 +1059,11 @@ void MicrowaveRadiometerProcessor::writeMoistureProfileNc(const sci::string& dir
 
 std::vector<std::vector<sci::string>> MicrowaveRadiometerProcessor::groupInputFilesbyOutputFiles(const std::vector<sci::string>& newFiles, const std::vector<sci::string>& allFiles) const
 {
-	std::vector<std::vector<sci::string>> result;
-	for (auto& a : allFiles)
-	{
-		bool include = false;
-		//check if a new file exists on the for the day of the file, if so we want this file
-		for (auto& n : newFiles)
-			if (n.substr(n.length() - 12, 6) == a.substr(a.length() - 12, 6))
-				include = true;
-
-		//if include is false, go back up to the begining of the for loop and move to the next file
-		if (!include)
-			continue;
-
-		bool added = false;
-		//check if there is already a group for the day of this file and add the new files there if there is
-		for (auto& r : result)
+	//the date is the 6 characters YYMMDD, 12 characters from the end of the filename
+	std::vector<std::vector<sci::string>> result = InstrumentProcessor::groupInputFilesbyOutputFiles(newFiles, allFiles, [](const sci::string& filename)
 		{
-			if (a.substr(a.length() - 12, 6) == r[0].substr(r[0].length() - 12, 6))
-			{
-				r.push_back(a);
-				added = true;
-			}
-		}
-		//if there wasn't then add the new file as the first of new group
-		if (!added)
-			result.push_back(std::vector<sci::string>(1, a));
-	}
+			return filename.length() < 12 ? sci::string() : filename.substr(filename.length() - 12, 6);
+		});
 
 	//sort each group in alphabetical (chronological) order
 	for (auto& r : result)
@@ -9,6 +9,8 @@
 #include<svector/array.h>
 #include<map>
 #include<memory>
+#include"MemoryMappedFile.h"
+#include"BinaryBufferParsing.h"
 
 //The purpose of this function is to always return false at compile time
 //It can be used in combination with static_assert to throw a compile time error
@@ -178,197 +180,217 @@ const std::map<uint32_t, sci::string> hatproFileTypes
 
 
 
+//A memory mapped view of a HATPRO binary file. The header fields are read with checked reads,
+//then the fixed size records are checked once with requireRecords and read with the unchecked
+//reads. All values in the files are little endian.
+class HatproBinaryView
+{
+public:
+	HatproBinaryView(const sci::string &filename)
+		:m_filename(filename), m_file(filename), m_position(m_file.begin())
+	{
+	}
+	template<class T>
+	T read()
+	{
+		require(sizeof(T));
+		return readLittleEndian<T>(m_position);
+	}
+	template<class T>
+	void read(T *destination, size_t n)
+	{
+		require(uint64_t(n) * sizeof(T));
+		readLittleEndian(m_position, destination, n);
+	}
+	void require(uint64_t nBytes) const
+	{
+		sci::assertThrow(bufferHasBytes(m_position, m_file.end(), nBytes), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + m_filename));
+	}
+	void requireRecords(uint32_t nRecords, size_t recordSize) const
+	{
+		sci::assertThrow(bufferHasRecords(m_position, m_file.end(), nRecords, recordSize), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + m_filename));
+	}
+	template<class T>
+	T readUnchecked()
+	{
+		return readLittleEndian<T>(m_position);
+	}
+	template<class T>
+	void readUnchecked(T *destination, size_t n)
+	{
+		readLittleEndian(m_position, destination, n);
+	}
+private:
+	sci::string m_filename;
+	MemoryMappedFile m_file;
+	const char *m_position;
+};
+
+//HATPRO times are seconds since the start of 2001
+const sci::UtcTime hatproEpoch(2001, 1, 1, 0, 0, 0);
+
+//Reads just the file type and sample count, which every HATPRO binary file starts with. Returns
+//false if the file can't be read or is too short to hold that many samples.
+inline bool readHatproSampleCount(const sci::string &filename, uint32_t &fileTypeId, uint32_t &nSamples)
+{
+	try
+	{
+		MemoryMappedFile file(filename);
+		const char *position = file.begin();
+		if (!bufferHasBytes(position, file.end(), 8))
+			return false;
+		fileTypeId = readLittleEndian<uint32_t>(position);
+		nSamples = readLittleEndian<uint32_t>(position);
+		if (hatproFileTypes.count(fileTypeId) == 0 && fileTypeId != hatproMetNewId)
+			return false;
+		//every sample has at least a 4 byte time and a 1 byte flag
+		return bufferHasRecords(position, file.end(), nSamples, 5);
+	}
+	catch (sci::err)
+	{
+		return false;
+	}
+}
+
 inline void readHatproHkdFile(sci::string filename, sci::GridData<sci::UtcTime, 1>& time, sci::GridData<degreeF, 1>& latitude, sci::GridData<degreeF, 1>& longitude,
 	sci::GridData<kelvinF, 1>& ambientTarget1Temperature, sci::GridData<kelvinF, 1>& ambientTarget2Temperature, sci::GridData<kelvinF, 1>& humidityProfilerTemperature,
 	sci::GridData<kelvinF, 1>& temperatureProfilerTemperature, sci::GridData<kelvinF, 1>& temperatureStabilityReceiver1, sci::GridData<kelvinF, 1>& temperatureStabilityReceiver2,
 	sci::GridData<uint32_t, 1> &status, sci::GridData<uint32_t, 1>& remainingMemory, uint32_t& fileTypeId)
 {
-	try
+	HatproBinaryView file(filename);
+
+	fileTypeId = file.read<uint32_t>();
+	sci::assertThrow(fileTypeId == hatproHkdId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the HKD code.")));
+
+	uint32_t nSamples = file.read<uint32_t>();
+
+	uint32_t timeType = file.read<uint32_t>();
+	sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
+
+	uint32_t hkdSelect = file.read<uint32_t>();
+
+	//each record is the time and alarm, followed by the groups of values selected by hkdSelect
+	size_t recordSize = 5;
+	if (hkdSelect & 0x01)
+		recordSize += 8;
+	if (hkdSelect & 0x02)
+		recordSize += 16;
+	if (hkdSelect & 0x04)
+		recordSize += 8;
+	if (hkdSelect & 0x08)
+		recordSize += 4;
+	if (hkdSelect & 0x10)
+		recordSize += 8;
+	file.requireRecords(nSamples, recordSize);
+
+	//read the data
+
+	time.resize(nSamples);
+	latitude.resize(nSamples, std::numeric_limits<degreeF>::quiet_NaN());
+	longitude.resize(nSamples, std::numeric_limits<degreeF>::quiet_NaN());
+	ambientTarget1Temperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	ambientTarget2Temperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	humidityProfilerTemperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	temperatureProfilerTemperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	temperatureStabilityReceiver1.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	temperatureStabilityReceiver2.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	status.resize(nSamples, -1);
+	remainingMemory.resize(nSamples, -1);
+	float angleRaw;
+	float angleDegrees;
+	float angleArcMinutes;
+	for (size_t i = 0; i < nSamples; ++i)
 	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(filename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Failed to open HATPRO LWP file ") + filename));
-
-		uint32_t nSamples;
-		uint32_t timeType;
-
-		fin.read((char*)&fileTypeId, 4);
-		sci::assertThrow(fileTypeId == hatproHkdId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the HKD code.")));
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-		fin.read((char*)&nSamples, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-		fin.read((char*)&timeType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
-
-		uint32_t hkdSelect;
-		fin.read((char*)&hkdSelect, 4);
-
+		time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+		file.readUnchecked<uint8_t>(); //alarm, unused
 
-		//read the data
-
-		time.resize(nSamples);
-		latitude.resize(nSamples, std::numeric_limits<degreeF>::quiet_NaN());
-		longitude.resize(nSamples, std::numeric_limits<degreeF>::quiet_NaN());
-		ambientTarget1Temperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		ambientTarget2Temperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		humidityProfilerTemperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		temperatureProfilerTemperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		temperatureStabilityReceiver1.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		temperatureStabilityReceiver2.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		status.resize(nSamples, -1);
-		remainingMemory.resize(nSamples, -1);
-		sci::GridData<uint8_t, 1> alarm(nSamples, -1);
-		sci::GridData<uint32_t, 1> quality(nSamples, -1);
-		uint32_t timeTemp;
-		float angleRaw;
-		float angleDegrees;
-		float angleArcMinutes;
-		for (size_t i = 0; i < nSamples; ++i)
+		if (hkdSelect & 0x01)
 		{
-			fin.read((char*)&timeTemp, 4);
-			fin.read((char*)&alarm[i], 1);
-
-			time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
-
-			if (hkdSelect & 0x01)
-			{
-				fin.read((char*)&angleRaw, 4);
-				angleDegrees = std::floor(angleRaw / 100.0f);
-				angleArcMinutes = angleRaw - angleDegrees * 100.0f;
-				longitude[i] = degreeF(angleDegrees) + arcMinuteF(angleArcMinutes);
-				fin.read((char*)&angleRaw, 4);
-				angleDegrees = std::floor(angleRaw / 100.0f);
-				angleArcMinutes = angleRaw - angleDegrees * 100.0f;
-				latitude[i] = degreeF(angleDegrees) + arcMinuteF(angleArcMinutes);
-			}
-			if (hkdSelect & 0x02)
-			{
-				fin.read((char*)&ambientTarget1Temperature[i], 4);
-				fin.read((char*)&ambientTarget2Temperature[i], 4);
-				fin.read((char*)&humidityProfilerTemperature[i], 4);
-				fin.read((char*)&temperatureProfilerTemperature[i], 4);
-			}
-			if (hkdSelect & 0x04)
-			{
-				fin.read((char*)&temperatureStabilityReceiver1[i], 4);
-				fin.read((char*)&temperatureStabilityReceiver2[i], 4);
-			}
-			if (hkdSelect & 0x08)
-			{
-				fin.read((char*)&remainingMemory[i], 4);
-			}
-			if (hkdSelect & 0x10)
-			{
-				fin.read((char*)&quality[i], 4);
-				fin.read((char*)&status[i], 4);
-			}
+			angleRaw = file.readUnchecked<float>();
+			angleDegrees = std::floor(angleRaw / 100.0f);
+			angleArcMinutes = angleRaw - angleDegrees * 100.0f;
+			longitude[i] = degreeF(angleDegrees) + arcMinuteF(angleArcMinutes);
+			angleRaw = file.readUnchecked<float>();
+			angleDegrees = std::floor(angleRaw / 100.0f);
+			angleArcMinutes = angleRaw - angleDegrees * 100.0f;
+			latitude[i] = degreeF(angleDegrees) + arcMinuteF(angleArcMinutes);
+		}
+		if (hkdSelect & 0x02)
+		{
+			ambientTarget1Temperature[i] = kelvinF(file.readUnchecked<float>());
+			ambientTarget2Temperature[i] = kelvinF(file.readUnchecked<float>());
+			humidityProfilerTemperature[i] = kelvinF(file.readUnchecked<float>());
+			temperatureProfilerTemperature[i] = kelvinF(file.readUnchecked<float>());
+		}
+		if (hkdSelect & 0x04)
+		{
+			temperatureStabilityReceiver1[i] = kelvinF(file.readUnchecked<float>());
+			temperatureStabilityReceiver2[i] = kelvinF(file.readUnchecked<float>());
+		}
+		if (hkdSelect & 0x08)
+		{
+			remainingMemory[i] = file.readUnchecked<uint32_t>();
+		}
+		if (hkdSelect & 0x10)
+		{
+			file.readUnchecked<uint32_t>(); //quality, unused
+			status[i] = file.readUnchecked<uint32_t>();
 		}
-	}
-	catch (...)
-	{
-		throw;
 	}
 }
 
 inline void readHatproMetData(const sci::string & filename, sci::GridData<sci::UtcTime, 1>& time, sci::GridData<kelvinF, 1> &temperature, sci::GridData<unitlessF, 1> &relativeHumidity,
 	sci::GridData<hectoPascalF, 1> &pressure, sci::GridData<float,2> &additionalSensorData,  sci::GridData<bool,1> rainFlag, uint32_t& fileTypeId)
 {
+	HatproBinaryView file(filename);
 
-	try
-	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(filename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Failed to open HATPRO MET file ") + filename));
-
-		uint32_t nSamples;
-		uint32_t timeType;
-
-		fin.read((char*)&fileTypeId, 4);
-		sci::assertThrow(fileTypeId == hatproMetId || fileTypeId== hatproMetNewId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the MET code.")));
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-		fin.read((char*)&nSamples, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-		uint8_t additionalSensorCode = 0;
-		float minPressure;
-		float maxPressure;
-		float minTemperature;
-		float maxTemperature;
-		float minRelativeHumidity;
-		float maxRelativeHumidity;
-
-		if (fileTypeId == hatproMetNewId)
-			fin.read((char*)&additionalSensorCode, 1);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&minPressure, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&maxPressure, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&minTemperature, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&maxTemperature, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&minRelativeHumidity, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&maxRelativeHumidity, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-		size_t nAdditionalSensors = 0;
-		if (additionalSensorCode & 0x1)
-			++nAdditionalSensors;
-		if (additionalSensorCode & 0x2)
-			++nAdditionalSensors;
-		if (additionalSensorCode & 0x4)
-			++nAdditionalSensors;
-
-		std::vector<float> minAdditionalSensorValues(nAdditionalSensors);
-		std::vector<float> maxAdditionalSensorValues(nAdditionalSensors);
-
-		for (size_t i = 0; i < nAdditionalSensors; ++i)
-		{
-			fin.read((char*)&(minAdditionalSensorValues[i]), 4);
-			sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-			fin.read((char*)&(maxAdditionalSensorValues[i]), 4);
-			sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		}
+	fileTypeId = file.read<uint32_t>();
+	sci::assertThrow(fileTypeId == hatproMetId || fileTypeId== hatproMetNewId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the MET code.")));
 
-		fin.read((char*)&timeType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
+	uint32_t nSamples = file.read<uint32_t>();
 
-		//read the data
+	uint8_t additionalSensorCode = 0;
+	if (fileTypeId == hatproMetNewId)
+		additionalSensorCode = file.read<uint8_t>();
+	//min and max of pressure, temperature and relative humidity, which we don't use
+	float ranges[6];
+	file.read(ranges, 6);
 
-		time.resize(nSamples);
-		rainFlag.resize(nSamples);
-		temperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
-		relativeHumidity.resize(nSamples, std::numeric_limits<unitlessF>::quiet_NaN());
-		pressure.resize(nSamples, std::numeric_limits<hectoPascalF>::quiet_NaN());
-		additionalSensorData.reshape({ nAdditionalSensors, nSamples });
-		
-		uint32_t timeTemp;
-		percentF relativeHumidityTemp;
-		uint8_t rainFlagTemp;
-		for (size_t i = 0; i < nSamples; ++i)
-		{
-			fin.read((char*)&timeTemp, 4);
-			time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
-			fin.read((char*)&rainFlagTemp, 1);
-			rainFlag[i] = rainFlagTemp == 0 ? false : true;
-			fin.read((char*)&pressure[i], 4);
-			fin.read((char*)&temperature[i], 4);
-			fin.read((char*)&relativeHumidityTemp, 4);
-			relativeHumidity[i] = relativeHumidityTemp;
-			for(size_t j=0; j<nAdditionalSensors; ++j)
-				fin.read((char*)&(additionalSensorData[j][i]), 4);
-		}
-	}
-	catch (...)
+	size_t nAdditionalSensors = 0;
+	if (additionalSensorCode & 0x1)
+		++nAdditionalSensors;
+	if (additionalSensorCode & 0x2)
+		++nAdditionalSensors;
+	if (additionalSensorCode & 0x4)
+		++nAdditionalSensors;
+
+	//min and max of each additional sensor
+	std::vector<float> additionalSensorRanges(nAdditionalSensors * 2);
+	file.read(additionalSensorRanges.data(), additionalSensorRanges.size());
+
+	uint32_t timeType = file.read<uint32_t>();
+	sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
+
+	file.requireRecords(nSamples, 17 + 4 * nAdditionalSensors);
+
+	//read the data
+
+	time.resize(nSamples);
+	rainFlag.resize(nSamples);
+	temperature.resize(nSamples, std::numeric_limits<kelvinF>::quiet_NaN());
+	relativeHumidity.resize(nSamples, std::numeric_limits<unitlessF>::quiet_NaN());
+	pressure.resize(nSamples, std::numeric_limits<hectoPascalF>::quiet_NaN());
+	additionalSensorData.reshape({ nAdditionalSensors, nSamples });
+
+	for (size_t i = 0; i < nSamples; ++i)
 	{
-		throw;
+		time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+		rainFlag[i] = file.readUnchecked<uint8_t>() == 0 ? false : true;
+		pressure[i] = hectoPascalF(file.readUnchecked<float>());
+		temperature[i] = kelvinF(file.readUnchecked<float>());
+		relativeHumidity[i] = percentF(file.readUnchecked<float>());
+		for(size_t j=0; j<nAdditionalSensors; ++j)
+			additionalSensorData[j][i] = file.readUnchecked<float>();
 	}
 }
 
@@ -378,39 +400,23 @@ void readHatproOneDimensionalData(sci::string filename, sci::GridData<sci::UtcTi
 {
 	try
 	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(filename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Failed to open HATPRO ") + hatproFileTypes.at(expectedFileTypeId) + sU(" file ") + filename));
-
-		uint32_t nSamples;
-		float minData;
-		float maxData;
-		uint32_t timeType;
-		uint32_t retrievalType;
-		uint32_t timeTemp;
-		float dataTemp;
-		float angleTemp;
-		uint8_t rainFlagTemp;
+		HatproBinaryView file(filename);
 
-		fin.read((char*)&fileTypeId, 4);
+		fileTypeId = file.read<uint32_t>();
 		sci::assertThrow(fileTypeId == expectedFileTypeId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the ") + hatproFileTypes.at(expectedFileTypeId) + sU(" code.")));
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 
-		fin.read((char*)&nSamples, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t nSamples = file.read<uint32_t>();
 
-		fin.read((char*)&minData, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&maxData, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		float minData = file.read<float>();
+		float maxData = file.read<float>();
 
-		fin.read((char*)&timeType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t timeType = file.read<uint32_t>();
 		sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
 
-		fin.read((char*)&retrievalType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t retrievalType = file.read<uint32_t>();
 
+		//time, rain flag, data, angle
+		file.requireRecords(nSamples, 13);
 
 		time.resize(nSamples);
 		data.resize(nSamples);
@@ -420,14 +426,16 @@ void readHatproOneDimensionalData(sci::string filename, sci::GridData<sci::UtcTi
 		quality.resize(nSamples);
 		qualityExplanation.resize(nSamples);
 
+		uint8_t rainFlagTemp;
+		float dataTemp;
+		float angleTemp;
 		for (size_t i = 0; i < nSamples; ++i)
 		{
-			fin.read((char*)&timeTemp, 4);
-			fin.read((char*)&rainFlagTemp, 1);
-			fin.read((char*)&dataTemp, 4);
-			fin.read((char*)&angleTemp, 4);
+			time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+			rainFlagTemp = file.readUnchecked<uint8_t>();
+			dataTemp = file.readUnchecked<float>();
+			angleTemp = file.readUnchecked<float>();
 
-			time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
 			rainFlag[i] = (rainFlagTemp & 0x01) > 0;
 			quality[i] = (rainFlagTemp & 0x06) >> 1;
 			qualityExplanation[i] = (rainFlagTemp & 0x18) >> 3;
@@ -441,7 +449,6 @@ void readHatproOneDimensionalData(sci::string filename, sci::GridData<sci::UtcTi
 			azimuth[i] = hatproDecodeAzimuth(angleTemp);
 			elevation[i] = hatproDecodeElevation(angleTemp);
 		}
-		sci::assertThrow(fin.good(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 	}
 	catch (...)
 	{
@@ -466,40 +473,29 @@ void readHatproStaData(sci::string filename, sci::GridData<sci::UtcTime, 1>& tim
 	const uint32_t expectedFileTypeId = hatproStaId;
 	try
 	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(filename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Failed to open HATPRO ") + hatproFileTypes.at(expectedFileTypeId) + sU(" file ") + filename));
-
-		uint32_t nSamples;
-		float minData;
-		float maxData;
-		uint32_t indexList[6];
-		uint32_t timeType;
-		uint32_t timeTemp;
-		float indexTemp[6];
-		uint8_t rainFlagTemp;
+		HatproBinaryView file(filename);
 
-		fin.read((char*)&fileTypeId, 4);
+		fileTypeId = file.read<uint32_t>();
 		sci::assertThrow(fileTypeId == expectedFileTypeId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the ") + hatproFileTypes.at(expectedFileTypeId) + sU(" code.")));
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 
-		fin.read((char*)&nSamples, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t nSamples = file.read<uint32_t>();
 
-		fin.read((char*)&minData, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&maxData, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		float minData = file.read<float>();
+		float maxData = file.read<float>();
 
-		fin.read((char*)&indexList[0], 24);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t indexList[6];
+		file.read(indexList, 6);
+		size_t nIndices = 0;
 		for (size_t i = 0; i < 6; ++i)
+		{
 			sci::assertThrow(indexList[i] == 0 || indexList[i] == 1, sci::err(sci::SERR_USER, 0, sU("Found corrupt STAIndexList (value neither 0 nor 1) in file ") + filename));
+			nIndices += indexList[i];
+		}
 
-		fin.read((char*)&timeType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t timeType = file.read<uint32_t>();
 		sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
 
+		file.requireRecords(nSamples, 5 + 4 * nIndices);
 
 		time.resize(nSamples);
 		if(indexList[0] == 1)
@@ -518,29 +514,22 @@ void readHatproStaData(sci::string filename, sci::GridData<sci::UtcTime, 1>& tim
 
 		for (size_t i = 0; i < nSamples; ++i)
 		{
-			fin.read((char*)&timeTemp, 4);
-			fin.read((char*)&rainFlagTemp, 1);
-			for (size_t j = 0; j < 6; ++j)
-				if (indexList[j])
-					fin.read((char*)&indexTemp[j], 4);
-
-			time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
-			rainFlag[i] = (rainFlagTemp & 0x01) > 0;
+			time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+			rainFlag[i] = (file.readUnchecked<uint8_t>() & 0x01) > 0;
 
 			if (indexList[0])
-				liftedIndex[i] = kelvinF(indexTemp[0]);
+				liftedIndex[i] = kelvinF(file.readUnchecked<float>());
 			if (indexList[1])
-				kModifiedIndex[i] = kelvinF(indexTemp[1]);
+				kModifiedIndex[i] = kelvinF(file.readUnchecked<float>());
 			if (indexList[2])
-				totalTotalsIndex[i] = kelvinF(indexTemp[2]);
+				totalTotalsIndex[i] = kelvinF(file.readUnchecked<float>());
 			if (indexList[3])
-				kIndex[i] = kelvinF(indexTemp[3]);
+				kIndex[i] = kelvinF(file.readUnchecked<float>());
 			if (indexList[4])
-				showalterIndex[i] = kelvinF(indexTemp[4]);
+				showalterIndex[i] = kelvinF(file.readUnchecked<float>());
 			if (indexList[5])
-				cape[i] = joulePerKilogramF(indexTemp[5]);
+				cape[i] = joulePerKilogramF(file.readUnchecked<float>());
 		}
-		sci::assertThrow(fin.good(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 	}
 	catch (...)
 	{
@@ -564,74 +553,48 @@ void readHatproOneDimensionPerFrequencyData(sci::string filename, bool hasRetrie
 {
 	try
 	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(filename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Failed to open HATPRO ") + hatproFileTypes.at(expectedFileTypeId) + sU(" file ") + filename));
-
-		uint32_t nSamples;
-		uint32_t nFrequencies;
-		sci::GridData<gigaHertzF, 1> frequenciesTemp;
-		sci::GridData<float, 1> minData;
-		sci::GridData<float, 1> maxData;
-		uint32_t timeType;
-		uint32_t retrievalType;
-
-		uint32_t timeTemp;
-		sci::GridData<float, 1> dataTemp;
-		float angleTemp;
-		uint8_t rainFlagTemp;
+		HatproBinaryView file(filename);
 
-		fin.read((char*)&fileTypeId, 4);
+		fileTypeId = file.read<uint32_t>();
 		sci::assertThrow(fileTypeId == expectedFileTypeId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the ") + hatproFileTypes.at(expectedFileTypeId) + sU(" code.")));
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 
-		fin.read((char*)&nSamples, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t nSamples = file.read<uint32_t>();
 
-		fin.read((char*)&timeType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t timeType = file.read<uint32_t>();
 		sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
 
 		if (hasRetrievalVariable)
-		{
-			fin.read((char*)&retrievalType, 4);
-			sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		}
+			file.read<uint32_t>(); //retrieval type, unused
 
-		fin.read((char*)&nFrequencies, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t nFrequencies = file.read<uint32_t>();
 
+		//the frequencies are followed by the min and max of the data at each frequency, which we don't use
+		file.require(uint64_t(nFrequencies) * 12);
+		std::vector<float> frequenciesTemp(nFrequencies);
+		file.read(frequenciesTemp.data(), nFrequencies);
+		std::vector<float> dataRanges(size_t(nFrequencies) * 2);
+		file.read(dataRanges.data(), dataRanges.size());
 		frequencies.resize(nFrequencies);
-		frequenciesTemp.resize(nFrequencies);
-		minData.resize(nFrequencies);
-		maxData.resize(nFrequencies);
-
-		fin.read((char*)&frequenciesTemp[0], nFrequencies * 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&minData[0], nFrequencies * 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-		fin.read((char*)&maxData[0], nFrequencies * 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 		for (size_t i = 0; i < frequencies.size(); ++i)
-			frequencies[i] = frequenciesTemp[i];
+			frequencies[i] = gigaHertzF(frequenciesTemp[i]);
+
+		//time, rain flag, one value per frequency, angle
+		file.requireRecords(nSamples, 9 + 4 * size_t(nFrequencies));
 
 		time.resize(nSamples);
 		data.reshape({ nSamples, nFrequencies });
 		elevation.resize(nSamples);
 		azimuth.resize(nSamples);
 		rainFlag.resize(nSamples);
-		dataTemp.resize(nFrequencies);
 
+		std::vector<float> dataTemp(nFrequencies);
+		float angleTemp;
 		for (size_t i = 0; i < nSamples; ++i)
 		{
-			fin.read((char*)&timeTemp, 4);
-			fin.read((char*)&rainFlagTemp, 1);
-			for (size_t j = 0; j < nFrequencies; ++j)
-				fin.read((char*)&dataTemp[j], 4);
-			fin.read((char*)&angleTemp, 4);
-
-			time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
-			rainFlag[i] = (rainFlagTemp & 0x01) > 0;
+			time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+			rainFlag[i] = (file.readUnchecked<uint8_t>() & 0x01) > 0;
+			file.readUnchecked(dataTemp.data(), nFrequencies);
+			angleTemp = file.readUnchecked<float>();
 
 			if constexpr (expectedFileTypeId == hatproBrtV1Id || expectedFileTypeId == hatproBrtV2Id || expectedFileTypeId == hatproOlcId)
 				for(size_t j=0; j<nFrequencies; ++j)
@@ -647,7 +610,6 @@ void readHatproOneDimensionPerFrequencyData(sci::string filename, bool hasRetrie
 			azimuth[i] = hatproDecodeAzimuth(angleTemp);
 			elevation[i] = hatproDecodeElevation(angleTemp);
 		}
-		sci::assertThrow(fin.good(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 	}
 	catch (...)
 	{
@@ -668,67 +630,48 @@ void readHatproProfile(sci::string filename, uint32_t &retrievalType, sci::GridD
 {
 	try
 	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(filename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Failed to open HATPRO ") + hatproFileTypes.at(expectedFileTypeId) + sU(" file ") + filename));
-
-		uint32_t nSamples;
-		uint32_t nAltitudes;
-		sci::GridData<uint32_t, 1> altitudesTemp;
-		float minData;
-		float maxData;
-		uint32_t timeType;
-
-		uint32_t timeTemp;
-		sci::GridData<float, 1> dataTemp;
-		uint8_t rainFlagTemp;
+		HatproBinaryView file(filename);
 
-		fin.read((char*)&fileTypeId, 4);
+		fileTypeId = file.read<uint32_t>();
 		sci::assertThrow(fileTypeId == expectedFileTypeId, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" does not start with the ") + hatproFileTypes.at(expectedFileTypeId) + sU(" code.")));
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 
-		fin.read((char*)&nSamples, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t nSamples = file.read<uint32_t>();
 
-		fin.read((char*)&minData, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		float minData = file.read<float>();
+		float maxData = file.read<float>();
 
-		fin.read((char*)&maxData, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-		fin.read((char*)&timeType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t timeType = file.read<uint32_t>();
 		sci::assertThrow(timeType == 1, sci::err(sci::SERR_USER, 0, sU("File ") + filename + sU(" is in local time, not UTC time. This software can only process UTC time data.")));
 
-		fin.read((char*)&retrievalType, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		retrievalType = file.read<uint32_t>();
 
-		fin.read((char*)&nAltitudes, 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+		uint32_t nAltitudes = file.read<uint32_t>();
 
+		file.require(uint64_t(nAltitudes) * 4);
+		std::vector<uint32_t> altitudesTemp(nAltitudes);
+		file.read(altitudesTemp.data(), nAltitudes);
 		altitudes.resize(nAltitudes);
-		altitudesTemp.resize(nAltitudes);
-
-		fin.read((char*)&altitudesTemp[0], nAltitudes * 4);
-		sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 		for (size_t i = 0; i < altitudes.size(); ++i)
 			altitudes[i] = metreF(altitudesTemp[i]);
 
+		//time, rain flag, one value per altitude
+		const size_t recordSize = 5 + 4 * size_t(nAltitudes);
+		file.requireRecords(nSamples, recordSize);
+
 		time.resize(nSamples);
 		data1.reshape({ nSamples, nAltitudes });
 		rainFlag.resize(nSamples);
 		quality.resize(nSamples);
 		qualityExplanation.resize(nSamples);
-		dataTemp.resize(nAltitudes);
 
+		std::vector<float> dataTemp(nAltitudes);
+		uint8_t rainFlagTemp;
 		for (size_t i = 0; i < nSamples; ++i)
 		{
-			fin.read((char*)&timeTemp, 4);
-			fin.read((char*)&rainFlagTemp, 1);
-			for (size_t j = 0; j < nAltitudes; ++j)
-				fin.read((char*)&dataTemp[j], 4);
+			time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+			rainFlagTemp = file.readUnchecked<uint8_t>();
+			file.readUnchecked(dataTemp.data(), nAltitudes);
 
-			time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
 			rainFlag[i] = (rainFlagTemp & 0x01) > 0;
 			quality[i] = (rainFlagTemp & 0x06) >> 1;
 			qualityExplanation[i] = (rainFlagTemp & 0x18) >> 3;
@@ -744,21 +687,17 @@ void readHatproProfile(sci::string filename, uint32_t &retrievalType, sci::GridD
 		}
 		if constexpr (expectedFileTypeId == hatproHpcWithRhId)
 		{
-			fin.read((char*)&minData, 4);
-			sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
-
-			fin.read((char*)&maxData, 4);
-			sci::assertThrow(fin.good() && !fin.eof(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
+			minData = file.read<float>();
+			maxData = file.read<float>();
+			file.requireRecords(nSamples, recordSize);
 
 			data2.reshape({ nSamples, nAltitudes });
 			for (size_t i = 0; i < nSamples; ++i)
 			{
-				fin.read((char*)&timeTemp, 4);
-				fin.read((char*)&rainFlagTemp, 1);
-				for (size_t j = 0; j < nAltitudes; ++j)
-					fin.read((char*)&dataTemp[j], 4);
+				time[i] = hatproEpoch + second(double(file.readUnchecked<uint32_t>()));
+				rainFlagTemp = file.readUnchecked<uint8_t>();
+				file.readUnchecked(dataTemp.data(), nAltitudes);
 
-				time[i] = sci::UtcTime(2001, 1, 1, 0, 0, 0) + second(double(timeTemp));
 				for (size_t j = 0; j < nAltitudes; ++j)
 					data2[i][j] = percentF(dataTemp[j]);
 				rainFlag[i] = (rainFlagTemp & 0x01) > 0;
@@ -766,7 +705,6 @@ void readHatproProfile(sci::string filename, uint32_t &retrievalType, sci::GridD
 				qualityExplanation[i] = (rainFlagTemp & 0x18) >> 3;
 			}
 		}
-		sci::assertThrow(fin.good(), sci::err(sci::SERR_USER, 0, sU("Found unexpected end of file or bad read in file ") + filename));
 	}
 	catch (...)
 	{
@@ -959,12 +897,14 @@ void readHatproCbhData(sci::string filename, sci::GridData<sci::UtcTime, 1>& tim
 
 #include "InstrumentProcessor.h"
 #include"AmfNc.h"
+#include"TimeJoin.h"
 class MicrowaveRadiometerProcessor : public InstrumentProcessor
 {
 public:
 	MicrowaveRadiometerProcessor(const InstrumentInfo& instrumentInfo, const CalibrationInfo& calibrationInfo);
 	virtual void readData(const std::vector<sci::string>& inputFilenames, const Platform& platform, ProgressReporter& progressReporter) override;
 	void readData(const sci::string& inputFilename, const Platform& platform, ProgressReporter& progressReporter, bool clear);
+	virtual void setProcessingOptions(const ProcessingOptions& processingOptions) override { m_processingOptions = processingOptions; }
 	virtual void plotData(const sci::string& baseOutputFilename, const std::vector<metreF> maxRanges, ProgressReporter& progressReporter, wxWindow* parent) override
 	{
 		throw(sci::err(sci::SERR_USER, 0, "Microwave Radiometer plotting is not yet supported."));
@@ -982,13 +922,6 @@ public:
 	{
 		return sU("Microwave Radiometer Processor");
 	}
-	template<class DATA_UNIT, size_t NDIMS>
-	static void padDataToMatchHkp(const sci::GridData<sci::UtcTime, 1>& hkdTime, sci::GridData<sci::UtcTime, 1>& dataTime, sci::GridData<DATA_UNIT, NDIMS>& data,
-		sci::GridData<degreeF, 1> &elevation, sci::GridData<degreeF, 1> &azimuth, sci::GridData<bool, 1> &rainFlag, sci::GridData<unsigned char, 1> &quality,
-		sci::GridData<unsigned char, 1> &qualityExplanation, sci::GridData<uint8_t, 1> &flag);
-	template<class DATA_UNIT, size_t NDIMS>
-	static void padDataToMatchHkp(const sci::GridData<sci::UtcTime, 1>& hkdTime, sci::GridData<sci::UtcTime, 1> dataTime, sci::GridData<DATA_UNIT, NDIMS>& data, DATA_UNIT padValue = std::numeric_limits<DATA_UNIT>::quiet_NaN());
-
 	template<class DATA_UNIT, size_t NDIMS>
 	static sci::GridData<uint8_t, 1> buildAmfFlagFromHatproQualityAndNanBadData(const sci::GridData<unsigned char, 1>& quality, const sci::GridData<unsigned char, 1>& qualityExplanation, sci::GridData<DATA_UNIT, NDIMS>& data)
 	{
@@ -1083,24 +1016,16 @@ public:
 			const sci::GridData<kelvinF, 1>& temperatureStabilityReceiver2)
 			: metFlags(neededTimes.size())
 		{
-			//filter the housekeepingdata for the required times
-			//These are the status and stability data - the rain flag comes from the
-			//data file, so does not need filtering
-			sci::GridData<uint32_t, 1> filteredStatus(neededTimes.size(), mwrMissingDataFlag);
-			sci::GridData<kelvinF, 1> filteredTemperatureStabilityReceiver1(neededTimes.size());
-			sci::GridData<kelvinF, 1> filteredTemperatureStabilityReceiver2(neededTimes.size());
-			size_t hkdIndex = 0;
-			for (size_t i = 0; i < neededTimes.size(); ++i)
-			{
-				while (hkdIndex < hkdTime.size() && hkdTime[hkdIndex] < neededTimes[i])
-					++hkdIndex;
-				if (hkdIndex < hkdTime.size())
-				{
-					filteredStatus[i] = status[hkdIndex];
-					filteredTemperatureStabilityReceiver1[i] = temperatureStabilityReceiver1[hkdIndex];
-					filteredTemperatureStabilityReceiver2[i] = temperatureStabilityReceiver2[hkdIndex];
-				}
-			}
+			//filter the housekeepingdata for the required times, using the first housekeeping
+			//record at or after each time. These are the status and stability data - the rain
+			//flag comes from the data file, so does not need filtering
+			TimeJoinIndex index = TimeJoin(neededTimes, second(0.0), TimeJoinFill::next).match(hkdTime);
+			sci::GridData<uint32_t, 1> filteredStatus = status;
+			sci::GridData<kelvinF, 1> filteredTemperatureStabilityReceiver1 = temperatureStabilityReceiver1;
+			sci::GridData<kelvinF, 1> filteredTemperatureStabilityReceiver2 = temperatureStabilityReceiver2;
+			TimeJoin::align(index, filteredStatus, uint32_t(mwrMissingDataFlag));
+			TimeJoin::align(index, filteredTemperatureStabilityReceiver1, std::numeric_limits<kelvinF>::quiet_NaN());
+			TimeJoin::align(index, filteredTemperatureStabilityReceiver2, std::numeric_limits<kelvinF>::quiet_NaN());
 			init(rawRainFlag, filteredStatus, filteredTemperatureStabilityReceiver1, filteredTemperatureStabilityReceiver2);
 		}
 
@@ -1382,9 +1307,23 @@ public:
 		const ProcessingSoftwareInfo& processingSoftwareInfo, const ProjectInfo& projectInfo,
 		const Platform& platform, const ProcessingOptions& processingOptions, ProgressReporter& progressReporter);
 private:
+	void clearData();
+	//Reads one file and copies it into its product's arrays after the filled samples already
+	//there. Only that product's members are touched, so different products can be read on
+	//different threads. Returns true if the file counts towards hasData().
+	bool appendFile(const sci::string& inputFilename, ProgressReporter& progressReporter, size_t& filled, size_t& reallocations);
+	//Calls function on every array that holds one element, or row, per sample of a product.
+	//The product is the file extension, e.g. LWP.
+	template<class FUNCTION>
+	void forEachSampleArray(const sci::string &product, FUNCTION function);
 	InstrumentInfo m_instrumentInfo;
 	CalibrationInfo m_calibrationInfo;
+	ProcessingOptions m_processingOptions;
 	bool m_hasData;
+	//The arrays are sized from the file headers before reading, then each file is copied in
+	//after the samples already read for its product
+	std::map<sci::string, size_t> m_filledSamples;
+	size_t m_reallocations; //times an array had to grow because it wasn't sized in advance
 
 	//liquid water path data
 	sci::GridData<sci::UtcTime, 1> m_lwpTime;
@@ -1473,149 +1412,3 @@ private:
 	sci::GridData<bool, 1> m_hpcRainFlag;
 
 };
-
-template<class DATA_UNIT, size_t NDIMS>
-static void MicrowaveRadiometerProcessor::padDataToMatchHkp(const sci::GridData<sci::UtcTime, 1>& hkdTime, sci::GridData<sci::UtcTime, 1>& dataTime, sci::GridData<DATA_UNIT, NDIMS>& data,
-	sci::GridData<degreeF, 1>& elevation, sci::GridData<degreeF, 1>& azimuth, sci::GridData<bool, 1>& rainFlag, sci::GridData<unsigned char, 1>& quality,
-	sci::GridData<unsigned char, 1>& qualityExplanation, sci::GridData<uint8_t, 1> &flag)
-{
-	size_t hkdIndex = 0;
-	size_t dataIndex = 0;
-
-	sci::GridData<DATA_UNIT, NDIMS> resultData;
-	sci::GridData<degreeF, 1> resultElevation;
-	sci::GridData<degreeF, 1> resultAzimuth;
-	sci::GridData<bool, 1> resultRainFlag;
-	sci::GridData<unsigned char, 1> resultQuality;
-	sci::GridData<unsigned char, 1> resultQualityExplanation;
-	sci::GridData<uint8_t, 1> resultFlag;
-	resultData.reserve(hkdTime.size()*(data.size()/dataTime.size()));
-	resultElevation.reserve(hkdTime.size());
-	resultAzimuth.reserve(hkdTime.size());
-	resultRainFlag.reserve(hkdTime.size());
-	resultQuality.reserve(hkdTime.size());
-	resultQualityExplanation.reserve(hkdTime.size());
-	resultFlag.reserve(hkdTime.size());
-
-	std::array<size_t, NDIMS> dataShape = data.shape();
-	std::array<size_t, NDIMS-1> elementShape;
-	for (size_t i = 0; i < NDIMS - 1; ++i)
-		elementShape[i] = dataShape[i + 1];
-
-	std::array<size_t, NDIMS> finalShape = dataShape;
-	finalShape[0] = hkdTime.size();
-
-	while (hkdIndex < hkdTime.size() && dataIndex < dataTime.size())
-	{
-		//skip any data which is before the current hkdTime
-		while (dataIndex < dataTime.size() && dataTime[dataIndex] < hkdTime[hkdIndex])
-			++dataIndex;
-		//if we got to the end of the data, break now rather than adding data
-		if (dataIndex == dataTime.size())
-			break;
-
-		//if we have identical times, copy the data
-		if (dataTime[dataIndex] == hkdTime[hkdIndex])
-		{
-			if constexpr(NDIMS==1)
-				resultData.push_back(data[dataIndex]);
-			else
-				resultData.push_back(sci::GridData<DATA_UNIT, NDIMS - 1>(data[dataIndex]));
-			resultElevation.push_back(elevation[dataIndex]);
-			resultAzimuth.push_back(azimuth[dataIndex]);
-			resultRainFlag.push_back(rainFlag[dataIndex]);
-			resultQuality.push_back(quality[dataIndex]);
-			resultQualityExplanation.push_back(qualityExplanation[dataIndex]);
-			resultFlag.push_back(flag[dataIndex]);
-			++dataIndex;
-			++hkdIndex;
-		}
-		//if we don't have identical times then it means we have a hkd time that does not match any data time
-		else
-		{
-			if constexpr (NDIMS == 1)
-				resultData.push_back(std::numeric_limits<DATA_UNIT>::quiet_NaN());
-			else
-				resultData.push_back(sci::GridData<DATA_UNIT, NDIMS - 1>(elementShape, std::numeric_limits<DATA_UNIT>::quiet_NaN()));
-			resultElevation.push_back(std::numeric_limits<degreeF>::quiet_NaN());
-			resultAzimuth.push_back(std::numeric_limits<degreeF>::quiet_NaN());
-			resultRainFlag.push_back(mwrRainMissingDataFlag);
-			resultQuality.push_back(mwrMissingDataFlag);
-			resultQualityExplanation.push_back(0);
-			resultFlag.push_back(mwrMissingDataFlag);
-			++hkdIndex;//only increment hkdIndex, not data index as we haven't used the data element yet
-		}
-	}
-	
-	//pad any extra elements at the end of the data
-	resultData.reshape(finalShape, std::numeric_limits<DATA_UNIT>::quiet_NaN());
-	resultElevation.resize(hkdTime.size(), std::numeric_limits<degreeF>::quiet_NaN());
-	resultAzimuth.resize(hkdTime.size(), std::numeric_limits<degreeF>::quiet_NaN());
-	resultRainFlag.resize(hkdTime.size(), mwrRainMissingDataFlag);
-	resultQuality.resize(hkdTime.size(), mwrMissingDataFlag);
-	resultQualityExplanation.resize(hkdTime.size(), 0);
-	resultFlag.resize(hkdTime.size(), mwrMissingDataFlag);
-
-	dataTime = hkdTime;
-	data = std::move(resultData);
-	elevation = std::move(resultElevation);
-	azimuth = std::move(resultAzimuth);
-	rainFlag = std::move(resultRainFlag);
-	quality = std::move(resultQuality);
-	qualityExplanation = std::move(resultQualityExplanation);
-	flag = std::move(resultFlag);
-}
-
-template<class DATA_UNIT, size_t NDIMS>
-static void MicrowaveRadiometerProcessor::padDataToMatchHkp(const sci::GridData<sci::UtcTime, 1>& hkdTime, sci::GridData<sci::UtcTime, 1> dataTime, sci::GridData<DATA_UNIT, NDIMS>& data, DATA_UNIT padValue)
-{
-	size_t hkdIndex = 0;
-	size_t dataIndex = 0;
-
-	sci::GridData<DATA_UNIT, NDIMS> resultData;
-	resultData.reserve(hkdTime.size()*(data.size()/dataTime.size()));
-
-	std::array<size_t, NDIMS> dataShape = data.shape();
-	std::array<size_t, NDIMS-1> elementShape;
-	for (size_t i = 0; i < NDIMS - 1; ++i)
-		elementShape[i] = dataShape[i + 1];
-
-	std::array<size_t, NDIMS> finalShape = dataShape;
-	finalShape[0] = hkdTime.size();
-
-	while (hkdIndex < hkdTime.size() && dataIndex < dataTime.size())
-	{
-		//skip any data which is before the current hkdTime
-		while (dataIndex < dataTime.size() && dataTime[dataIndex] < hkdTime[hkdIndex])
-			++dataIndex;
-		//if we got to the end of the data, break now rather than adding data
-		if (dataIndex == dataTime.size())
-			break;
-
-		//if we have identical times, copy the data
-		if (dataTime[dataIndex] == hkdTime[hkdIndex])
-		{
-			if constexpr (NDIMS == 1)
-				resultData.push_back(data[dataIndex]);
-			else
-				resultData.push_back(sci::GridData<DATA_UNIT, NDIMS - 1>(data[dataIndex]));
-			++dataIndex;
-			++hkdIndex;
-		}
-		//if we don't have identical times then it means we have a hkd time that does not match any data time
-		else
-		{
-			if constexpr (NDIMS == 1)
-				resultData.push_back(padValue);
-			else
-				resultData.push_back(sci::GridData<DATA_UNIT, NDIMS - 1>(elementShape, padValue));
-			++hkdIndex;//only increment hkdIndex, not data index as we haven't used the data element yet
-		}
-	}
-	
-	//pad any extra elements at the end of the data
-	resultData.reshape(finalShape, std::numeric_limits<DATA_UNIT>::quiet_NaN());
-
-	dataTime = hkdTime;
-	data = std::move(resultData);
-}
\ No newline at end of file
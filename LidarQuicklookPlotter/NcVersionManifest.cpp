@@ -0,0 +1,174 @@
+#include"NcVersionManifest.h"
+#include<svector/serr.h>
+#include<filesystem>
+#include<fstream>
+#include<sstream>
+#include<mutex>
+#include<cstdint>
+
+const char g_ncVersionManifestHeader[] = "AMF netCDF version manifest 1";
+
+//The manifests that have been read, by manifest filename, along with the modification time
+//of the manifest file when it was read. All the manifests share one lock.
+struct LoadedNcVersionManifest
+{
+	int64_t modificationTime = 0;
+	std::map<std::string, NcVersionRecord> records;
+};
+std::map<std::string, LoadedNcVersionManifest> g_loadedNcVersionManifests;
+std::mutex g_ncVersionManifestMutex;
+
+//the history is multi line, so newlines and tabs get escaped to keep one record per line
+std::string escapeManifestField(const std::string &field)
+{
+	std::string result;
+	result.reserve(field.length());
+	for (size_t i = 0; i < field.length(); ++i)
+	{
+		if (field[i] == '\\')
+			result.append("\\\\");
+		else if (field[i] == '\n')
+			result.append("\\n");
+		else if (field[i] == '\t')
+			result.append("\\t");
+		else if (field[i] != '\r')
+			result.push_back(field[i]);
+	}
+	return result;
+}
+
+std::string unescapeManifestField(const std::string &field)
+{
+	std::string result;
+	result.reserve(field.length());
+	for (size_t i = 0; i < field.length(); ++i)
+	{
+		if (field[i] == '\\' && i + 1 < field.length())
+		{
+			++i;
+			result.push_back(field[i] == 'n' ? '\n' : field[i] == 't' ? '\t' : field[i]);
+		}
+		else
+			result.push_back(field[i]);
+	}
+	return result;
+}
+
+bool getManifestModificationTime(const sci::string &filename, int64_t &modificationTime)
+{
+	std::error_code error;
+	modificationTime = std::filesystem::last_write_time(std::filesystem::path(sci::nativeUnicode(filename)), error).time_since_epoch().count();
+	return !error;
+}
+
+//Gets the records for a manifest, reading the file if we haven't already or if it has been
+//modified since we did. A missing or unreadable manifest just gives no records.
+//Must be called with g_ncVersionManifestMutex locked.
+LoadedNcVersionManifest &getLoadedManifest(const sci::string &manifestFilename)
+{
+	LoadedNcVersionManifest &loaded = g_loadedNcVersionManifests[sci::toUtf8(manifestFilename)];
+	int64_t modificationTime;
+	if (!getManifestModificationTime(manifestFilename, modificationTime))
+	{
+		loaded = LoadedNcVersionManifest();
+		return loaded;
+	}
+	if (modificationTime == loaded.modificationTime)
+		return loaded;
+
+	loaded = LoadedNcVersionManifest();
+	loaded.modificationTime = modificationTime;
+	std::ifstream fin(std::filesystem::path(sci::nativeUnicode(manifestFilename)), std::ios::in | std::ios::binary);
+	std::string line;
+	if (!fin.is_open() || !std::getline(fin, line) || line != g_ncVersionManifestHeader)
+		return loaded;
+	while (std::getline(fin, line))
+	{
+		std::istringstream lineStream(line);
+		std::string baseFilename;
+		std::string majorVersion;
+		std::string minorVersion;
+		std::string filename;
+		std::string history;
+		//a malformed line is ignored, that output just gets scanned for again
+		if (!std::getline(lineStream, baseFilename, '\t') || !std::getline(lineStream, majorVersion, '\t')
+			|| !std::getline(lineStream, minorVersion, '\t') || !std::getline(lineStream, filename, '\t'))
+			continue;
+		std::getline(lineStream, history);
+		NcVersionRecord record;
+		try
+		{
+			record.majorVersion = std::stoull(majorVersion);
+			record.minorVersion = std::stoull(minorVersion);
+		}
+		catch (...)
+		{
+			continue;
+		}
+		record.filename = sci::fromUtf8(unescapeManifestField(filename));
+		record.history = sci::fromUtf8(unescapeManifestField(history));
+		loaded.records[unescapeManifestField(baseFilename)] = record;
+	}
+	return loaded;
+}
+
+NcVersionManifest::NcVersionManifest(const sci::string &directory)
+{
+	m_directory = directory;
+	if (m_directory.length() > 0 && m_directory.back() != sU('\\') && m_directory.back() != sU('/'))
+		m_directory = m_directory + sU('/');
+	m_manifestFilename = m_directory + sU("ncVersionManifest.txt");
+}
+
+bool NcVersionManifest::find(const sci::string &baseFilename, NcVersionRecord &record) const
+{
+	std::lock_guard<std::mutex> lock(g_ncVersionManifestMutex);
+	const LoadedNcVersionManifest &loaded = getLoadedManifest(m_manifestFilename);
+	auto found = loaded.records.find(sci::toUtf8(baseFilename));
+	if (found == loaded.records.end())
+		return false;
+
+	//if the latest version has been deleted or renamed the record is out of date
+	std::error_code error;
+	if (!std::filesystem::exists(std::filesystem::path(sci::nativeUnicode(m_directory + found->second.filename)), error))
+		return false;
+	record = found->second;
+	return true;
+}
+
+//The whole manifest is written to a temporary file which then replaces the old one, so the
+//manifest is never left half written
+void NcVersionManifest::update(const sci::string &baseFilename, const NcVersionRecord &record)
+{
+	std::lock_guard<std::mutex> lock(g_ncVersionManifestMutex);
+	LoadedNcVersionManifest &loaded = getLoadedManifest(m_manifestFilename);
+	loaded.records[sci::toUtf8(baseFilename)] = record;
+
+	std::filesystem::path manifestPath(sci::nativeUnicode(m_manifestFilename));
+	std::filesystem::path temporaryPath(sci::nativeUnicode(m_manifestFilename + sU(".tmp")));
+	{
+		std::ofstream fout(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!fout.is_open())
+			return;
+		fout << g_ncVersionManifestHeader << "\n";
+		for (auto iter = loaded.records.begin(); iter != loaded.records.end(); ++iter)
+		{
+			fout << escapeManifestField(iter->first) << "\t" << iter->second.majorVersion << "\t" << iter->second.minorVersion << "\t"
+				<< escapeManifestField(sci::toUtf8(iter->second.filename)) << "\t" << escapeManifestField(sci::toUtf8(iter->second.history)) << "\n";
+		}
+		if (!fout)
+			return;
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, manifestPath, error);
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		//we don't know what state the file is in now, so read it again next time
+		loaded.modificationTime = 0;
+		return;
+	}
+	//we already have the records in memory, so don't read back the file we just wrote
+	if (!getManifestModificationTime(m_manifestFilename, loaded.modificationTime))
+		loaded.modificationTime = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include<svector/sstring.h>
+#include<map>
+#include<string>
+
+//The latest version of one netCDF output, identified by its filename without the version
+//and .nc suffix
+struct NcVersionRecord
+{
+	size_t majorVersion = 0;
+	size_t minorVersion = 0;
+	sci::string filename; //the name of the latest version, without the directory
+	sci::string history; //the history attribute of the latest version
+};
+
+//A record of the latest version and history of each netCDF file in an output directory, so
+//a new version can be created without opening every previous version of the file to find
+//these. The records are kept in a text file in the directory and in memory, so after the
+//first lookup in a directory a lookup doesn't touch the disk unless the manifest file has
+//been modified by someone else.
+//A record is only trusted if the file it names still exists. Otherwise, or if the manifest
+//can't be read, find returns false and the caller scans the directory and updates the
+//record, so the manifest can always be rebuilt from the files. Failing to write the manifest
+//is never an error. It is safe to use from several threads at once.
+class NcVersionManifest
+{
+public:
+	NcVersionManifest(const sci::string &directory);
+	bool find(const sci::string &baseFilename, NcVersionRecord &record) const;
+	void update(const sci::string &baseFilename, const NcVersionRecord &record);
+private:
+	sci::string m_directory; //with a trailing separator
+	sci::string m_manifestFilename;
+};
@@ -0,0 +1,154 @@
+//Checks that the Platform functions that work on many averaging windows at once give exactly the
+//same directions and velocities as calling the single window versions for each window. A ship is
+//simulated pitching, rolling and turning through north while the instrument points at a range of
+//directions, including straight up, and the windows include ones that run off either end of the
+//ship's data. Returns non zero if anything differs.
+//Usage: PlatformCorrectionComparison [nWindows]
+#include"AmfNc.h"
+#include<iostream>
+#include<random>
+#include<cstring>
+#include<cstdlib>
+#include<cmath>
+
+//true if both are nan, or both have exactly the same value
+template<class T>
+bool identical(const T &a, const T &b)
+{
+	if (a != a && b != b)
+		return true;
+	return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+//Compares the single and multiple window functions of a platform over the given windows and
+//directions. Returns true if they all match.
+bool comparePlatform(const std::string &name, const Platform &platform, const sci::GridData<sci::UtcTime, 1> &startTimes, const sci::GridData<sci::UtcTime, 1> &endTimes, const sci::GridData<degreeF, 1> &azimuths, const sci::GridData<degreeF, 1> &elevations)
+{
+	sci::GridData<degreeF, 1> correctedAzimuths;
+	sci::GridData<degreeF, 1> correctedElevations;
+	platform.correctDirection(startTimes, endTimes, azimuths, elevations, correctedAzimuths, correctedElevations);
+	sci::GridData<metrePerSecondF, 1> eastwardVelocities;
+	sci::GridData<metrePerSecondF, 1> northwardVelocities;
+	sci::GridData<metrePerSecondF, 1> upwardVelocities;
+	platform.getInstrumentVelocity(startTimes, endTimes, eastwardVelocities, northwardVelocities, upwardVelocities);
+
+	size_t nDirectionsDifferent = 0;
+	size_t nVelocitiesDifferent = 0;
+	size_t nNan = 0;
+	for (size_t i = 0; i < startTimes.size(); ++i)
+	{
+		degreeF correctedAzimuth;
+		degreeF correctedElevation;
+		platform.correctDirection(startTimes[i], endTimes[i], azimuths[i], elevations[i], correctedAzimuth, correctedElevation);
+		metrePerSecondF eastwardVelocity;
+		metrePerSecondF northwardVelocity;
+		metrePerSecondF upwardVelocity;
+		platform.getInstrumentVelocity(startTimes[i], endTimes[i], eastwardVelocity, northwardVelocity, upwardVelocity);
+
+		if (correctedElevation != correctedElevation)
+			++nNan;
+		if (!identical(correctedAzimuth, correctedAzimuths[i]) || !identical(correctedElevation, correctedElevations[i]))
+		{
+			if (nDirectionsDifferent == 0)
+				std::cout << "  window " << i << ": single window direction " << correctedElevation.value<degreeF>() << ", " << correctedAzimuth.value<degreeF>()
+				<< " but multiple window direction " << correctedElevations[i].value<degreeF>() << ", " << correctedAzimuths[i].value<degreeF>() << " degrees\n";
+			++nDirectionsDifferent;
+		}
+		if (!identical(eastwardVelocity, eastwardVelocities[i]) || !identical(northwardVelocity, northwardVelocities[i]) || !identical(upwardVelocity, upwardVelocities[i]))
+		{
+			if (nVelocitiesDifferent == 0)
+				std::cout << "  window " << i << ": single window velocity " << eastwardVelocity.value<metrePerSecondF>() << ", " << northwardVelocity.value<metrePerSecondF>() << ", " << upwardVelocity.value<metrePerSecondF>()
+				<< " but multiple window velocity " << eastwardVelocities[i].value<metrePerSecondF>() << ", " << northwardVelocities[i].value<metrePerSecondF>() << ", " << upwardVelocities[i].value<metrePerSecondF>() << " m/s\n";
+			++nVelocitiesDifferent;
+		}
+	}
+	std::cout << name << ": " << startTimes.size() << " windows (" << nNan << " outside the data), " << nDirectionsDifferent << " directions and " << nVelocitiesDifferent << " velocities differ\n";
+	return nDirectionsDifferent == 0 && nVelocitiesDifferent == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nWindows = 20000;
+	if (argc > 1)
+		nWindows = std::strtoul(argv[1], nullptr, 10);
+	if (nWindows == 0)
+	{
+		std::cout << "Usage: PlatformCorrectionComparison [nWindows]\n";
+		return 1;
+	}
+
+	try
+	{
+		//two hours of ship data at 1 Hz
+		const size_t nShipTimes = 7200;
+		const double pi = std::acos(-1.0);
+		sci::UtcTime shipStart(2020, 10, 17, 12, 0, 0.0);
+		sci::GridData<sci::UtcTime, 1> shipTimes(nShipTimes);
+		sci::GridData<degreeF, 1> latitudes(nShipTimes);
+		sci::GridData<degreeF, 1> longitudes(nShipTimes);
+		sci::GridData<degreeF, 1> courses(nShipTimes);
+		sci::GridData<metrePerSecondF, 1> speeds(nShipTimes);
+		sci::GridData<degreeF, 1> shipElevations(nShipTimes);
+		sci::GridData<degreeF, 1> shipAzimuths(nShipTimes);
+		sci::GridData<degreeF, 1> shipRolls(nShipTimes);
+		sci::GridData<degreeF, 1> instrumentElevations(nShipTimes);
+		sci::GridData<degreeF, 1> instrumentAzimuths(nShipTimes);
+		sci::GridData<degreeF, 1> instrumentRolls(nShipTimes);
+		for (size_t i = 0; i < nShipTimes; ++i)
+		{
+			double t = double(i);
+			shipTimes[i] = shipStart + second(t);
+			latitudes[i] = degreeF(float(50.0 + t * 1e-4));
+			longitudes[i] = degreeF(float(179.9 + t * 5e-5)); //crosses the dateline
+			//the ship turns steadily through north and back
+			shipAzimuths[i] = degreeF(float(std::fmod(330.0 + 60.0 * std::sin(2.0 * pi * t / 3600.0) + 360.0, 360.0)));
+			courses[i] = shipAzimuths[i];
+			speeds[i] = metrePerSecondF(float(5.0 + 2.0 * std::sin(2.0 * pi * t / 900.0)));
+			shipElevations[i] = degreeF(float(3.0 * std::sin(2.0 * pi * t / 7.0)));
+			shipRolls[i] = degreeF(float(8.0 * std::sin(2.0 * pi * t / 11.0)));
+			instrumentElevations[i] = degreeF(float(0.5 * std::sin(2.0 * pi * t / 600.0)));
+			instrumentAzimuths[i] = degreeF(float(1.0 + 0.5 * std::cos(2.0 * pi * t / 600.0)));
+			instrumentRolls[i] = degreeF(float(-0.3));
+		}
+		sci::GridData<sci::string, 1> locationKeywords(1, sU("ocean"));
+
+		//windows of up to 30 s, some of zero length, some running off the ends of the ship data
+		std::mt19937 generator(20201017);
+		std::uniform_real_distribution<double> startDistribution(-60.0, double(nShipTimes) + 60.0);
+		std::uniform_real_distribution<double> durationDistribution(0.0, 30.0);
+		std::uniform_real_distribution<double> azimuthDistribution(0.0, 360.0);
+		std::uniform_real_distribution<double> elevationDistribution(-10.0, 90.0);
+		sci::GridData<sci::UtcTime, 1> startTimes(nWindows);
+		sci::GridData<sci::UtcTime, 1> endTimes(nWindows);
+		sci::GridData<degreeF, 1> azimuths(nWindows);
+		sci::GridData<degreeF, 1> elevations(nWindows);
+		for (size_t i = 0; i < nWindows; ++i)
+		{
+			double start = startDistribution(generator);
+			double duration = i % 10 == 0 ? 0.0 : durationDistribution(generator);
+			startTimes[i] = shipStart + second(start);
+			endTimes[i] = shipStart + second(start + duration);
+			azimuths[i] = degreeF(float(azimuthDistribution(generator)));
+			//a third of the profiles point straight up, as for a stare
+			elevations[i] = i % 3 == 0 ? degreeF(90.0f) : degreeF(float(elevationDistribution(generator)));
+		}
+
+		bool passed = true;
+		ShipPlatform shipPlatform(sU("ship"), metreF(10.0f), shipTimes, latitudes, longitudes, locationKeywords, instrumentElevations, instrumentAzimuths, instrumentRolls, courses, speeds, shipElevations, shipAzimuths, shipRolls, sU(""));
+		passed = comparePlatform("ShipPlatform", shipPlatform, startTimes, endTimes, azimuths, elevations) && passed;
+		ShipPlatform fixedMountShipPlatform(sU("ship"), metreF(10.0f), shipTimes, latitudes, longitudes, locationKeywords, degreeF(0.5f), degreeF(1.0f), degreeF(-0.3f), courses, speeds, shipElevations, shipAzimuths, shipRolls, sU(""));
+		passed = comparePlatform("ShipPlatform with a fixed mount", fixedMountShipPlatform, startTimes, endTimes, azimuths, elevations) && passed;
+		ShipPlatformShipRelativeCorrected shipRelativeCorrectedPlatform(sU("ship"), metreF(10.0f), shipTimes, latitudes, longitudes, locationKeywords, degreeF(0.5f), degreeF(1.0f), degreeF(-0.3f), courses, speeds, shipElevations, shipAzimuths, shipRolls, sU(""));
+		passed = comparePlatform("ShipPlatformShipRelativeCorrected", shipRelativeCorrectedPlatform, startTimes, endTimes, azimuths, elevations) && passed;
+		StationaryPlatform stationaryPlatform(sU("land"), metreF(10.0f), degreeF(50.0f), degreeF(-1.0f), locationKeywords, degreeF(0.5f), degreeF(1.0f), degreeF(-0.3f), sU(""));
+		passed = comparePlatform("StationaryPlatform", stationaryPlatform, startTimes, endTimes, azimuths, elevations) && passed;
+
+		std::cout << (passed ? "The single and multiple window results are identical\n" : "FAILED: the single and multiple window results differ\n");
+		return passed ? 0 : 1;
+	}
+	catch (sci::err err)
+	{
+		std::cout << "Error: " << sci::nativeUnicode(err.getErrorMessage()) << "\n";
+		return 1;
+	}
+}
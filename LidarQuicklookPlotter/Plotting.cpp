@@ -1,5 +1,5 @@
-#include"plotting.h"
-#include<svector\splot.h>
+#include"Plotting.h"
+#include<svector/splot.h>
 #include"HplHeader.h"
 #include"HplProfile.h"
 #include<fstream>
@@ -0,0 +1,423 @@
+#include"ProcessingRunner.h"
+#include"FolderChangesLister.h"
+#include"InotifyChangesLister.h"
+#include"InstrumentProcessor.h"
+#include"ProcessingScheduler.h"
+#include<wx/filename.h>
+#include<svector/serr.h>
+#include<svector/time.h>
+#include<mutex>
+#include<algorithm>
+
+//The netCDF library is not thread safe, so only one day's netCDF is written at a time
+std::mutex g_netCdfMutex;
+
+ProcessingRunner::ProcessingRunner(ProgressReporter *progressReporter, wxWindow *plotParent, const sci::string &setupFileName)
+	:m_progressReporter(progressReporter), m_plotParent(plotParent)
+{
+	setSetupFile(setupFileName);
+
+	m_processingSoftwareInfo.url = sU("https://github.com/philrosenberg/AmfBlSuite.git");
+	m_processingSoftwareInfo.version = sU("1.1.20");
+}
+
+void ProcessingRunner::setSetupFile(const sci::string &setupFileName)
+{
+	m_setupFileName = setupFileName;
+	m_isSetup = false;
+}
+
+bool ProcessingRunner::readSetupFile()
+{
+	(*m_progressReporter) << "Reading setup information. For a moving platform this can take some time while the position data is read.\n";
+	try
+	{
+		//the retained days and the watcher's relevant files are keyed by processor, which are
+		//about to be replaced
+		m_retainedDays.clear();
+		m_inputDirectoryWatcher.reset();
+		setup(m_setupFileName, sU("info.xml"), *m_progressReporter, m_processingOptions, m_author, m_projectInfo, m_platform, m_instrumentProcessors);
+		if (m_progressReporter->shouldStop())
+			(*m_progressReporter) << sU("Reading setup data halted at the users request. Processing will stop.\n\n");
+		m_isSetup = true;
+	}
+	catch (sci::err err)
+	{
+		ErrorSetter setter(m_progressReporter);
+		(*m_progressReporter) << err.getErrorCategory() << ":" << err.getErrorCode() << " " << err.getErrorMessage() << "\n";
+	}
+	catch (std::exception err)
+	{
+		ErrorSetter setter(m_progressReporter);
+		(*m_progressReporter) << err.what() << "\n";
+	}
+	if (m_isSetup)
+		(*m_progressReporter) << sU("Setup data read successfully\n\n");
+	else
+		(*m_progressReporter) << sU("Reading setup data failed. Correct the setup file or info.xml file, or select a different setup file, then rerun. \n\n");
+	return m_isSetup;
+}
+
+bool ProcessingRunner::openLogFile(std::fstream &logOut)
+{
+	if (m_processingOptions.logFileName.length() == 0)
+		return false;
+
+	logOut.open(sci::nativeUnicode(m_processingOptions.logFileName), std::ios::app);
+	bool open = logOut.is_open();
+	wxString logDirectory = wxPathOnly(sci::nativeUnicode(m_processingOptions.logFileName));
+	if(!wxDirExists(logDirectory))
+		wxMkDir(logDirectory);
+	sci::assertThrow(logOut.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not open log file ")+ m_processingOptions.logFileName));
+	(*m_progressReporter) << sU("Log file set to ") << m_processingOptions.logFileName << sU("\n");
+	(*m_progressReporter) << sU("Search directory set to ") << m_processingOptions.inputDirectory << sU("\n");
+	(*m_progressReporter) << sU("Time range set to ") << sci::fromCodepage(m_processingOptions.startTime.getIso8601String()) << " - "
+		<< sci::fromCodepage(m_processingOptions.endTime.getIso8601String()) << sU("\n");
+	if(m_processingOptions.onlyProcessNewFiles)
+		(*m_progressReporter) << sU("Only previously unprocessed files will be processed\n");
+	else
+		(*m_progressReporter) << sU("Previously processed files will be reprocessed\n");
+
+	(*m_progressReporter) << sU("Beginning processing at") << sci::fromCodepage(sci::UtcTime::now().getIso8601String()) << sU("\n\n");
+	return true;
+}
+
+void ProcessingRunner::process(std::function<void()> whileWaiting)
+{
+	//check if we have the setup data - if not then read it
+	if (!m_isSetup)
+		readSetupFile();
+	//if this did not work for some reason then return
+	if (!m_isSetup)
+		return;
+
+	//Quicklooks are plotted as we go through the processors because they use wxWidgets windows,
+	//which must stay on this thread. Each day's netCDF is independent of the others so they
+	//are given to the scheduler, which can process several at once.
+	std::vector<ConfiguredProcessor> processors = m_instrumentProcessors;
+	std::stable_sort(processors.begin(), processors.end(), [](const ConfiguredProcessor &first, const ConfiguredProcessor &second) { return first.priority > second.priority; });
+	ProcessingScheduler scheduler(m_processingOptions.maxConcurrentTasks);
+	for (size_t i = 0; i < processors.size(); ++i)
+	{
+		if (m_progressReporter->shouldStop())
+			break;
+		process(processors[i], scheduler);
+	}
+	scheduler.run(*m_progressReporter, whileWaiting);
+}
+
+void ProcessingRunner::resetDirectoryWatcher()
+{
+	m_inputDirectoryWatcher.reset();
+}
+
+void ProcessingRunner::process(const ConfiguredProcessor &processor, ProcessingScheduler &scheduler)
+{
+	try
+	{
+		(*m_progressReporter) << sU("Starting ") << processor.processor->getName() <<  sU(".\n\n");
+		//Check that the input/output diectories are actually there
+		checkDirectoryStructue();
+
+		//These list changes that have occured since the last time its method
+		//updateSnapshotFile() was called. 
+		std::unique_ptr<FolderChangesLister> plotChangesLister;
+		std::shared_ptr<FolderChangesLister> ncChangesLister;
+
+#ifdef __linux__
+		bool watchInputDirectory = m_processingOptions.onlyProcessNewFiles && m_processingOptions.watchInputDirectory;
+		if (watchInputDirectory)
+		{
+			second rescanInterval(m_processingOptions.watchRescanMinutes * 60.0);
+			if (!m_inputDirectoryWatcher || m_inputDirectoryWatcher->getDirectory() != m_processingOptions.inputDirectory)
+			{
+				m_inputDirectoryWatcher.reset(new InotifyFolderWatcher(m_processingOptions.inputDirectory, rescanInterval));
+				if (!m_inputDirectoryWatcher->isOnLocalFilesystem())
+				{
+					WarningSetter setter(m_progressReporter);
+					(*m_progressReporter) << sU("The input directory ") << m_processingOptions.inputDirectory << sU(" is on a network filesystem, where inotify does not see files written by other machines. The whole directory will be listed each time instead.\n");
+				}
+			}
+			m_inputDirectoryWatcher->setRescanInterval(rescanInterval);
+			watchInputDirectory = m_inputDirectoryWatcher->isOnLocalFilesystem();
+		}
+		if (watchInputDirectory)
+		{
+			//This class gets the folder contents from inotify events rather than listing the
+			//whole input directory every time. The watcher is shared by all processors.
+			plotChangesLister.reset(new InotifyChangesLister(m_inputDirectoryWatcher, m_processingOptions.outputDirectory + sU("previouslyPlottedFilesByTime.txt")));
+			ncChangesLister.reset(new InotifyChangesLister(m_inputDirectoryWatcher, m_processingOptions.outputDirectory + sU("previouslyProcessedFilesByTime.txt")));
+		}
+		else
+#endif
+		if (m_processingOptions.onlyProcessNewFiles)
+		{
+			//This class in particular assumes that when
+			//it performs a search of previously existing files, the last one alphabetically
+			//will have changed, but the rest will not.
+			plotChangesLister.reset(new FolderChangesLister(m_processingOptions.inputDirectory, m_processingOptions.outputDirectory + sU("previouslyPlottedFilesByTime.txt")));
+			ncChangesLister.reset(new FolderChangesLister(m_processingOptions.inputDirectory, m_processingOptions.outputDirectory + sU("previouslyProcessedFilesByTime.txt")));
+		}
+		else
+		{
+			//This class just assumes all files have changed so we process all files even if they existed previously and are unmodified
+			plotChangesLister.reset(new AssumeAllChangedChangesLister(m_processingOptions.inputDirectory, m_processingOptions.outputDirectory + sU("previouslyPlottedFilesByTime.txt")));
+			ncChangesLister.reset(new AssumeAllChangedChangesLister(m_processingOptions.inputDirectory, m_processingOptions.outputDirectory + sU("previouslyProcessedFilesByTime.txt")));
+		}
+
+		if (!m_progressReporter->shouldStop() && m_processingOptions.generateQuicklooks && !m_plotParent)
+		{
+			WarningSetter setter(m_progressReporter);
+			(*m_progressReporter) << sU("Quicklooks cannot be plotted without a window to plot in, so they will not be generated.\n");
+		}
+		else if (!m_progressReporter->shouldStop() && m_processingOptions.generateQuicklooks)
+		{
+			//if there is nothing new to plot we don't look for netCDFs to make either
+			if (!plotQuicklooks(*(plotChangesLister.get()), *m_platform, *processor.processor))
+				return;
+		}
+		if (!m_progressReporter->shouldStop() && m_processingOptions.generateNetCdf)
+			scheduleNetCdfs(ncChangesLister, processor, scheduler);
+	}
+	catch (sci::err err)
+	{
+		ErrorSetter setter(m_progressReporter);
+		(*m_progressReporter) << err.getErrorCategory() << ":" << err.getErrorCode() << " " << err.getErrorMessage() << "\n";
+	}
+	catch (std::exception err)
+	{
+		ErrorSetter setter(m_progressReporter);
+		(*m_progressReporter) << err.what() << "\n";
+	}
+}
+
+//Check that the directory names are correctly formatted (with trailing slash or blank) and
+//that all input and output directories actually exist
+void ProcessingRunner::checkDirectoryStructue()
+{
+	//ensure that the input and output directories end with a slash or are empty
+	if (m_processingOptions.inputDirectory.length() > 0 && m_processingOptions.inputDirectory.back() != sU('/') && m_processingOptions.inputDirectory.back() != sU('\\'))
+		m_processingOptions.inputDirectory = m_processingOptions.inputDirectory + sU("/");
+	if (m_processingOptions.outputDirectory.length() > 0 && m_processingOptions.outputDirectory.back() != sU('/') && m_processingOptions.outputDirectory.back() != sU('\\'))
+		m_processingOptions.outputDirectory = m_processingOptions.outputDirectory + sU("/");
+
+	//check the output directory exists
+	if (!wxDirExists(sci::nativeUnicode(m_processingOptions.outputDirectory)))
+		wxFileName::Mkdir(sci::nativeUnicode(m_processingOptions.outputDirectory), 770, wxPATH_MKDIR_FULL);
+	if (!wxDirExists(sci::nativeUnicode(m_processingOptions.outputDirectory)))
+	{
+		sci::ostringstream message;
+		message << sU("The output directory ") << m_processingOptions.outputDirectory << sU(" does not exist and could not be created.");
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, message.str()));
+	}
+
+	//check the input directory exists
+	if (!wxDirExists(sci::nativeUnicode(m_processingOptions.inputDirectory)))
+	{
+		sci::ostringstream message;
+		message << sU("The input directory ") << m_processingOptions.inputDirectory << sU(" does not exist.");
+		sci::assertThrow(false, sci::err(sci::SERR_USER, 0, message.str()));
+	}
+}
+
+//Plots quicklooks for any new files. Returns false if there were no new files.
+bool ProcessingRunner::plotQuicklooks(const FolderChangesLister &plotChangesLister, const Platform &platform, InstrumentProcessor &processor)
+{
+	//check for new files
+	(*m_progressReporter) << sU("Looking for data files to plot.\n");
+	sci::UtcTime checkedForChangesTime = sci::UtcTime::now();
+	std::vector<sci::string> newPlotFiles = plotChangesLister.getChanges(processor, m_processingOptions.startTime, m_processingOptions.endTime);
+
+	//Keep the user updated
+	if (newPlotFiles.size() == 0)
+	{
+		(*m_progressReporter) << sU("Found no new files to process for the current processor\n");
+		return false;
+	}
+	else
+	{
+		(*m_progressReporter) << sU("Found the following new files to for the  current processor:\n");
+		for (size_t i = 0; i < newPlotFiles.size(); ++i)
+			(*m_progressReporter) << sU("\t") << newPlotFiles[i] << sU("\n");
+	}
+
+	//plot the quicklooks
+	for (size_t i = 0; i < newPlotFiles.size(); ++i)
+	{
+		(*m_progressReporter) << sU("Plotting ") << newPlotFiles[i] << sU("\n");
+		sci::string outputFile = m_processingOptions.outputDirectory + newPlotFiles[i].substr(m_processingOptions.inputDirectory.length(), sci::string::npos);
+		try
+		{
+			//readData takes an array of files that will all be processed and plotted together
+			//and put in a single netcdf. To process just one file we make an array with just one filename
+			processor.readData({ newPlotFiles[i] }, platform, *m_progressReporter);
+
+			if (m_progressReporter->shouldStop())
+			{
+				(*m_progressReporter) << sU("Operation halted at user request.\n");
+				break;
+			}
+
+			if (processor.hasData())
+			{
+				processor.plotData(outputFile, { std::numeric_limits<metreF>::max(), metreF(2000.0), metreF(1000.0) }, *m_progressReporter, m_plotParent);
+
+				if (m_progressReporter->shouldStop())
+				{
+					(*m_progressReporter) << sU("Operation halted at user request.\n");
+					break;
+				}
+
+				//remember which files have been plotted
+				plotChangesLister.updateSnapshotFile(newPlotFiles[i], checkedForChangesTime);
+			}
+		}
+		catch (sci::err err)
+		{
+			ErrorSetter setter(m_progressReporter);
+			(*m_progressReporter) << err.getErrorCategory() << ":" << err.getErrorCode() << " " << err.getErrorMessage() << "\n";
+		}
+		catch (std::exception err)
+		{
+			ErrorSetter setter(m_progressReporter);
+			(*m_progressReporter) << err.what() << "\n";
+		}
+
+		if (m_progressReporter->shouldStop())
+		{
+			(*m_progressReporter) << sU("Operation halted at user request.\n");
+			break;
+		}
+	}
+	return true;
+}
+
+//Returns the files that need appending to a retained day to give all the files for the day, or
+//false if the day has changed in some other way and must be read again from scratch. This is
+//only the case when the retained files are the start of the day's files and all the others are
+//new, so the appended data are identical to reading the whole day. The last retained file may
+//have changed too, as the current hour's hpl file is still being written. Then replaceLastFile
+//is set and that file is appended again after its old data are dropped. A change to any other
+//retained file means the day is reread.
+bool getFilesToAppend(const std::vector<sci::string> &retainedFiles, const std::vector<sci::string> &dayFiles, const std::vector<sci::string> &changedFiles, std::vector<sci::string> &filesToAppend, bool &replaceLastFile)
+{
+	if (retainedFiles.size() == 0 || retainedFiles.size() > dayFiles.size())
+		return false;
+	if (!std::equal(retainedFiles.begin(), retainedFiles.end(), dayFiles.begin()))
+		return false;
+	for (size_t i = 0; i < retainedFiles.size() - 1; ++i)
+		if (std::find(changedFiles.begin(), changedFiles.end(), retainedFiles[i]) != changedFiles.end())
+			return false;
+	replaceLastFile = std::find(changedFiles.begin(), changedFiles.end(), retainedFiles.back()) != changedFiles.end();
+	if (!replaceLastFile && retainedFiles.size() == dayFiles.size())
+		return false;
+	for (size_t i = retainedFiles.size(); i < dayFiles.size(); ++i)
+		if (std::find(changedFiles.begin(), changedFiles.end(), dayFiles[i]) == changedFiles.end())
+			return false;
+	filesToAppend.assign(dayFiles.begin() + retainedFiles.size() - (replaceLastFile ? 1 : 0), dayFiles.end());
+	return true;
+}
+
+//Finds the new files for each output day and adds a task to the scheduler to make each day's
+//netCDF. The tasks run after all the processors have been through here.
+void ProcessingRunner::scheduleNetCdfs(std::shared_ptr<FolderChangesLister> ncChangesLister, const ConfiguredProcessor &processor, ProcessingScheduler &scheduler)
+{
+	//check for new files
+	(*m_progressReporter) << sU("Looking for data files to process into netcdf format.\n");
+	sci::UtcTime checkedForChangesTime = sci::UtcTime::now();
+	std::shared_ptr<std::vector<sci::string>> changedFiles(new std::vector<sci::string>);
+	std::vector<std::vector<sci::string>> dayFileSets = ncChangesLister->getChangesSeparatedByOutput(*processor.processor, m_processingOptions.startTime, m_processingOptions.endTime, *changedFiles);
+	(*m_progressReporter) << sU("Found ") << dayFileSets.size() << sU(" days to process.\n\n");
+
+	//when days run at the same time each needs its own processor to hold its data
+	bool concurrent = scheduler.getMaxConcurrency() > 1;
+	std::shared_ptr<Platform> platform = m_platform;
+	//In append mode we keep hold of the data for the latest day. Only the last day's task can
+	//take or replace the retained day, so it is never used by two tasks at once.
+	bool appendMode = m_processingOptions.appendToLatestDay && m_processingOptions.onlyProcessNewFiles && processor.processor->canAppendData();
+	if (!appendMode)
+	{
+		std::lock_guard<std::mutex> lock(m_retainedDaysMutex);
+		m_retainedDays.erase(processor.processor.get());
+	}
+	for (size_t i = 0; i < dayFileSets.size(); ++i)
+	{
+		sci::ostringstream description;
+		description << processor.processor->getName() << sU(" day ") << i + 1;
+		std::vector<sci::string> dayFiles = dayFileSets[i];
+		bool retainDay = appendMode && i + 1 == dayFileSets.size();
+		scheduler.addTask(description.str(), processor.priority, [this, ncChangesLister, processor, platform, concurrent, dayFiles, changedFiles, retainDay, checkedForChangesTime, i](ProgressReporter &progressReporter)
+		{
+			//a retained day must not share the processor used for plotting, so it always gets its own
+			std::shared_ptr<InstrumentProcessor> dayProcessor = concurrent || retainDay ? processor.createProcessor() : processor.processor;
+			std::vector<sci::string> filesToAppend;
+			bool replaceLastFile = false;
+			if (retainDay)
+			{
+				//take the retained day out of the map, so if anything goes wrong below we don't
+				//leave behind data that only partly matches the files
+				std::lock_guard<std::mutex> lock(m_retainedDaysMutex);
+				auto retained = m_retainedDays.find(processor.processor.get());
+				if (retained != m_retainedDays.end())
+				{
+					if (getFilesToAppend(retained->second.files, dayFiles, *changedFiles, filesToAppend, replaceLastFile))
+						dayProcessor = retained->second.processor;
+					m_retainedDays.erase(retained);
+				}
+			}
+
+			progressReporter << sU("Day ") << i + 1 << sU(": Found the following files:\n");
+			for (size_t j = 0; j < dayFiles.size(); ++j)
+				progressReporter << dayFiles[j] << sU("\n");
+
+			if (filesToAppend.size() > 0)
+			{
+				if (replaceLastFile)
+					progressReporter << sU("\nThe other files for this day are already in memory, rereading ") << filesToAppend[0] << sU(" and appending the ") << filesToAppend.size() - 1 << sU(" new file(s)...\n\n");
+				else
+					progressReporter << sU("\nThe other files for this day are already in memory, appending the ") << filesToAppend.size() << sU(" new file(s)...\n\n");
+				dayProcessor->appendData(filesToAppend, replaceLastFile, *platform, progressReporter);
+			}
+			else
+			{
+				progressReporter << sU("\nReading...\n\n");
+				dayProcessor->readData(dayFiles, *platform, progressReporter);
+			}
+
+			if (progressReporter.shouldStop())
+			{
+				progressReporter << sU("Operation halted at user request.\n");
+				return;
+			}
+
+			if (dayProcessor->hasData())
+			{
+				progressReporter << sU("read one day of data - writing to netcdf\n\n");
+				{
+					std::lock_guard<std::mutex> lock(g_netCdfMutex);
+					dayProcessor->writeToNc(m_processingOptions.outputDirectory, m_author, m_processingSoftwareInfo, m_projectInfo, *platform, m_processingOptions, progressReporter);
+				}
+
+				if (progressReporter.shouldStop())
+				{
+					progressReporter << sU("Operation halted at user request.\n");
+					return;
+				}
+			}
+			else
+			{
+				WarningSetter setter(&progressReporter);
+				progressReporter << sU("No valid data found for this day, not netcdf will be written\n\n");
+			}
+
+			//whether the data files contained data or not, remember which files have been processed
+			ncChangesLister->updateSnapshotFile(dayFiles, checkedForChangesTime);
+
+			if (retainDay)
+			{
+				std::lock_guard<std::mutex> lock(m_retainedDaysMutex);
+				m_retainedDays[processor.processor.get()] = { dayProcessor, dayFiles };
+			}
+		});
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include<svector/sstring.h>
+#include<functional>
+#include<fstream>
+#include<memory>
+#include<map>
+#include<mutex>
+#include"AmfNc.h"
+#include"Setup.h"
+
+class FolderChangesLister;
+class InstrumentProcessor;
+class InotifyFolderWatcher;
+class ProcessingScheduler;
+class wxWindow;
+
+//Reads the setup file and runs the processors it describes, checking the input directory for
+//new files, plotting quicklooks and writing netCDFs. This holds everything the processing
+//needs between checks, but nothing to do with how or when the checks are triggered, so it can
+//be driven by the GUI's timers or by the headless daemon's loop.
+//Quicklooks need a wxWindow to plot in. With no plot parent they are skipped.
+class ProcessingRunner
+{
+public:
+	ProcessingRunner(ProgressReporter *progressReporter, wxWindow *plotParent, const sci::string &setupFileName);
+	void setSetupFile(const sci::string &setupFileName);
+	const sci::string &getSetupFile() const { return m_setupFileName; }
+	bool isSetup() const { return m_isSetup; }
+	//returns true if the setup was read successfully
+	bool readSetupFile();
+	//Opens the log file from the processing options, if there is one, and writes the details
+	//of this run to the progress reporter. Returns false if no log file is set.
+	bool openLogFile(std::fstream &logOut);
+	//Checks each processor for new files, reading the setup file first if needed. whileWaiting
+	//is called regularly while netCDFs are being written on other threads.
+	void process(std::function<void()> whileWaiting);
+	//Forget the directory watcher, e.g. because we won't see events while stopped
+	void resetDirectoryWatcher();
+	ProcessingOptions &getProcessingOptions() { return m_processingOptions; }
+	const ProcessingOptions &getProcessingOptions() const { return m_processingOptions; }
+	const ProcessingSoftwareInfo &getProcessingSoftwareInfo() const { return m_processingSoftwareInfo; }
+private:
+	void process(const ConfiguredProcessor &processor, ProcessingScheduler &scheduler);
+	bool plotQuicklooks(const FolderChangesLister &plotChangesLister, const Platform &platform, InstrumentProcessor &processor);
+	void scheduleNetCdfs(std::shared_ptr<FolderChangesLister> ncChangesLister, const ConfiguredProcessor &processor, ProcessingScheduler &scheduler);
+	void checkDirectoryStructue();
+
+	ProgressReporter *m_progressReporter;
+	wxWindow *m_plotParent;
+	bool m_isSetup;
+	sci::string m_setupFileName;
+	PersonInfo m_author;
+	ProcessingSoftwareInfo m_processingSoftwareInfo;
+	ProjectInfo m_projectInfo;
+	std::shared_ptr<Platform> m_platform;
+	std::vector<ConfiguredProcessor> m_instrumentProcessors;
+	ProcessingOptions m_processingOptions;
+	std::shared_ptr<InotifyFolderWatcher> m_inputDirectoryWatcher; //kept between checks so it can collect file system events
+	//The data read for the latest day of each processor and the files it was read from, kept
+	//between checks so that if the day only gains new files we can read just those
+	struct RetainedDay
+	{
+		std::shared_ptr<InstrumentProcessor> processor;
+		std::vector<sci::string> files;
+	};
+	std::map<const InstrumentProcessor*, RetainedDay> m_retainedDays;
+	std::mutex m_retainedDaysMutex;
+};
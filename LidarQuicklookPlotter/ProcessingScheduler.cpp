@@ -0,0 +1,102 @@
+#include"ProcessingScheduler.h"
+#include"ThreadJoiner.h"
+#include<svector/serr.h>
+#include<algorithm>
+#include<memory>
+#include<chrono>
+
+ProcessingScheduler::ProcessingScheduler(size_t maxConcurrency)
+	:m_maxConcurrency(std::max(size_t(1), maxConcurrency))
+{
+}
+
+void ProcessingScheduler::addTask(const sci::string &description, int priority, std::function<void(ProgressReporter &)> task)
+{
+	m_tasks.push_back({ description, priority, task });
+}
+
+//an error in one task is reported, but doesn't stop the other tasks
+void ProcessingScheduler::runTask(Task &task, ProgressReporter &progressReporter)
+{
+	try
+	{
+		task.function(progressReporter);
+	}
+	catch (sci::err err)
+	{
+		ErrorSetter setter(&progressReporter);
+		progressReporter << err.getErrorCategory() << ":" << err.getErrorCode() << " " << err.getErrorMessage() << "\n";
+	}
+	catch (std::exception err)
+	{
+		ErrorSetter setter(&progressReporter);
+		progressReporter << err.what() << "\n";
+	}
+}
+
+void ProcessingScheduler::run(ProgressReporter &progressReporter, std::function<void()> whileWaiting)
+{
+	std::stable_sort(m_tasks.begin(), m_tasks.end(), [](const Task &first, const Task &second) { return first.priority > second.priority; });
+
+	if (m_maxConcurrency == 1 || m_tasks.size() < 2)
+	{
+		for (size_t i = 0; i < m_tasks.size(); ++i)
+		{
+			if (progressReporter.shouldStop())
+				break;
+			runTask(m_tasks[i], progressReporter);
+		}
+		m_tasks.clear();
+		return;
+	}
+
+	std::atomic<bool> stop(false);
+	std::atomic<size_t> nextTask(0);
+	std::atomic<size_t> nRunningWorkers(0);
+	std::vector<std::unique_ptr<BufferedProgressReporter>> taskProgressReporters(m_tasks.size());
+	for (size_t i = 0; i < taskProgressReporters.size(); ++i)
+		taskProgressReporters[i].reset(new BufferedProgressReporter(stop));
+
+	auto worker = [&]()
+	{
+		for (size_t i = nextTask++; i < m_tasks.size() && !stop; i = nextTask++)
+			runTask(m_tasks[i], *taskProgressReporters[i]);
+		--nRunningWorkers;
+	};
+
+	//pass on what the tasks have reported, with a heading whenever the output switches task
+	size_t lastReportedTask = m_tasks.size();
+	auto passOnProgress = [&]()
+	{
+		for (size_t i = 0; i < taskProgressReporters.size(); ++i)
+		{
+			std::vector<BufferedProgressReporter::Progress> progress = taskProgressReporters[i]->takeBufferedProgress();
+			if (progress.size() == 0)
+				continue;
+			if (i != lastReportedTask)
+				progressReporter << sU("\n[") << m_tasks[i].description << sU("]\n");
+			BufferedProgressReporter::replay(progress, progressReporter);
+			lastReportedTask = i;
+		}
+	};
+
+	size_t nThreads = std::min(m_maxConcurrency, m_tasks.size());
+	{
+		std::vector<std::thread> threads;
+		ThreadJoiner threadJoiner(threads, stop);
+		nRunningWorkers = nThreads;
+		for (size_t i = 0; i < nThreads; ++i)
+			threads.push_back(std::thread(worker));
+
+		while (nRunningWorkers > 0)
+		{
+			if (progressReporter.shouldStop())
+				stop = true;
+			passOnProgress();
+			whileWaiting();
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	}
+	passOnProgress();
+	m_tasks.clear();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include<svector/sstring.h>
+#include<functional>
+#include<vector>
+#include"ProgressReporter.h"
+
+//Runs independent pieces of processing, e.g. different instruments or different output days
+//of one instrument, on a pool of worker threads. Tasks with a higher priority are started
+//first and tasks with equal priority start in the order they were added.
+//Each task reports to its own BufferedProgressReporter and the thread calling run() passes
+//this on to the main reporter, so the main reporter is only ever used from its own thread.
+//Cancellation is cooperative. Once the main reporter's shouldStop() returns true, tasks that
+//haven't started are skipped and running tasks see shouldStop() return true.
+//With a maximum concurrency of 1 the tasks are just run in turn on the calling thread,
+//reporting straight to the main reporter.
+class ProcessingScheduler
+{
+public:
+	ProcessingScheduler(size_t maxConcurrency);
+	void addTask(const sci::string &description, int priority, std::function<void(ProgressReporter &)> task);
+	//Runs all the tasks and returns once they have all finished or been skipped. whileWaiting
+	//is called regularly from this thread while the tasks run, the GUI uses it to yield.
+	void run(ProgressReporter &progressReporter, std::function<void()> whileWaiting);
+	size_t getMaxConcurrency() const { return m_maxConcurrency; }
+private:
+	struct Task
+	{
+		sci::string description;
+		int priority;
+		std::function<void(ProgressReporter &)> function;
+	};
+	static void runTask(Task &task, ProgressReporter &progressReporter);
+	size_t m_maxConcurrency;
+	std::vector<Task> m_tasks;
+};
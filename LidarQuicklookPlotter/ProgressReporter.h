@@ -1,6 +1,9 @@
 #pragma once
 #include<string>
 #include<sstream>
+#include<atomic>
+#include<mutex>
+#include<vector>
 
 class ProgressReporter
 {
@@ -74,6 +77,79 @@ public:
 	void setErrorModeFormat() override {}
 };
 
+//Holds on to everything reported so it can be passed on to another reporter later. This
+//lets a worker thread report progress without writing to a reporter that may be in use
+//by other threads. shouldStop returns true once stop has been set by the owning thread.
+//The owning thread can take the progress so far while the worker is still reporting.
+//Each piece of text is kept with the mode it was reported in, so warnings and errors are
+//still warnings and errors when they are replayed.
+class BufferedProgressReporter : public ProgressReporter
+{
+public:
+	enum class Mode
+	{
+		normal,
+		warning,
+		error
+	};
+	struct Progress
+	{
+		Mode mode;
+		sci::string text;
+	};
+	BufferedProgressReporter(const std::atomic<bool> &stop)
+		:m_stop(stop)
+	{
+	}
+	void reportProgress(const sci::string &progress) override
+	{
+		Mode mode = isErrorMode() ? Mode::error : (isWarningMode() ? Mode::warning : Mode::normal);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_buffer.size() > 0 && m_buffer.back().mode == mode)
+			m_buffer.back().text += progress;
+		else
+			m_buffer.push_back({ mode, progress });
+	}
+	bool shouldStop() override { return m_stop; }
+	std::vector<Progress> getBufferedProgress() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_buffer;
+	}
+	//returns everything reported since the last call and clears the buffer
+	std::vector<Progress> takeBufferedProgress()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<Progress> result;
+		result.swap(m_buffer);
+		return result;
+	}
+	//reports the progress to another reporter in the modes it was originally reported in,
+	//leaving that reporter in normal mode
+	static void replay(const std::vector<Progress> &progress, ProgressReporter &progressReporter)
+	{
+		for (size_t i = 0; i < progress.size(); ++i)
+		{
+			if (progress[i].mode == Mode::error)
+				progressReporter.setErrorMode();
+			else if (progress[i].mode == Mode::warning)
+				progressReporter.setWarningMode();
+			else if (!progressReporter.isNormalMode())
+				progressReporter.setNormalMode();
+			progressReporter.reportProgress(progress[i].text);
+		}
+		if (!progressReporter.isNormalMode())
+			progressReporter.setNormalMode();
+	}
+private:
+	void setNormalModeFormat() override {}
+	void setWarningModeFormat() override {}
+	void setErrorModeFormat() override {}
+	const std::atomic<bool> &m_stop;
+	std::vector<Progress> m_buffer;
+	mutable std::mutex m_mutex;
+};
+
 template<class STREAM>
 class StreamProgressReporter : public ProgressReporter
 {
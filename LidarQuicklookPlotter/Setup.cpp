@@ -388,6 +388,7 @@ ProcessingOptions parseProcessingOptions(wxXmlNode *node)
 	//comment logfile, start and end times are optional, so ensure they have sensible defaults
 	result.comment = sU("");
 	result.logFileName = sU("");
+	result.hplCacheDirectory = sU("");
 	result.startTime = sci::UtcTime(1900, 1, 1, 0, 0, 0);
 	result.endTime = sci::UtcTime(2200, 1, 1, 0, 0, 0);
 
@@ -396,7 +397,8 @@ ProcessingOptions parseProcessingOptions(wxXmlNode *node)
 		nameVarPair<sci::string>(sU("outputDirectory"), &(result.outputDirectory)),
 		nameVarPair<sci::string>(sU("comment"), &(result.comment)),
 		nameVarPair<sci::string>(sU("reasonForProcessing"), &(result.reasonForProcessing)),
-		nameVarPair<sci::string>(sU("logFile"), &(result.logFileName))
+		nameVarPair<sci::string>(sU("logFile"), &(result.logFileName)),
+		nameVarPair<sci::string>(sU("hplCacheDirectory"), &(result.hplCacheDirectory))
 	};
 	std::vector<nameVarPair<bool>> boolLinks
 	{ nameVarPair<bool>(sU("startImmediately"), &(result.startImmediately)),
@@ -408,8 +410,27 @@ ProcessingOptions parseProcessingOptions(wxXmlNode *node)
 		nameVarPair<bool>(sU("closeOnCompletion"), &(result.closeOnCompletion))
 	};
 
+	//these are optional, so they are not checked for below
+	std::vector<nameVarPair<bool>> optionalBoolLinks
+	{ nameVarPair<bool>(sU("memoryMappedHplParsing"), &(result.memoryMappedHplParsing)),
+		nameVarPair<bool>(sU("watchInputDirectory"), &(result.watchInputDirectory)),
+		nameVarPair<bool>(sU("appendToLatestDay"), &(result.appendToLatestDay)),
+		nameVarPair<bool>(sU("useNcVersionManifest"), &(result.useNcVersionManifest)),
+		nameVarPair<bool>(sU("verifyNcVersionManifest"), &(result.verifyNcVersionManifest))
+	};
+	std::vector<nameVarPair<size_t>> optionalSizeLinks
+	{ nameVarPair<size_t>(sU("fileReadingThreads"), &(result.fileReadingThreads)),
+		nameVarPair<size_t>(sU("hplCacheMaxMegabytes"), &(result.hplCacheMaxMegabytes)),
+		nameVarPair<size_t>(sU("sharedHplCacheMegabytes"), &(result.sharedHplCacheMegabytes)),
+		nameVarPair<size_t>(sU("maxConcurrentTasks"), &(result.maxConcurrentTasks))
+	};
+
 	parseXmlNode(node, textLinks.begin(), textLinks.end());
 	parseXmlNode(node, boolLinks.begin(), boolLinks.end());
+	parseXmlNode(node, optionalBoolLinks.begin(), optionalBoolLinks.end());
+	parseXmlNode(node, optionalSizeLinks.begin(), optionalSizeLinks.end());
+	sci::assertThrow(result.fileReadingThreads > 0, sci::err(sci::SERR_USER, 0, "fileReadingThreads must be at least 1 when parsing processing options."));
+	sci::assertThrow(result.maxConcurrentTasks > 0, sci::err(sci::SERR_USER, 0, "maxConcurrentTasks must be at least 1 when parsing processing options."));
 
 	bool readStartTime;
 	bool readEndTime;
@@ -419,16 +440,28 @@ ProcessingOptions parseProcessingOptions(wxXmlNode *node)
 	double waitSeconds;
 	std::vector<nameVarPair<double>> numberLinks { nameVarPair<double>(sU("waitSeconds"), &waitSeconds) };
 	parseXmlNode(node, numberLinks.begin(), numberLinks.end());
+	std::vector<nameVarPair<double>> optionalNumberLinks
+	{ nameVarPair<double>(sU("lidarSnrFlagThreshold1"), &(result.lidarSnrFlagThreshold1)),
+		nameVarPair<double>(sU("lidarSnrFlagThreshold2"), &(result.lidarSnrFlagThreshold2)),
+		nameVarPair<double>(sU("lidarSnrFlagThreshold3"), &(result.lidarSnrFlagThreshold3)),
+		nameVarPair<double>(sU("lidarDopplerFlagLimit"), &(result.lidarDopplerFlagLimit)),
+		nameVarPair<double>(sU("watchRescanMinutes"), &(result.watchRescanMinutes))
+	};
+	parseXmlNode(node, optionalNumberLinks.begin(), optionalNumberLinks.end());
+	sci::assertThrow(result.lidarSnrFlagThreshold1 <= result.lidarSnrFlagThreshold2 && result.lidarSnrFlagThreshold2 <= result.lidarSnrFlagThreshold3,
+		sci::err(sci::SERR_USER, 0, "lidarSnrFlagThreshold1, lidarSnrFlagThreshold2 and lidarSnrFlagThreshold3 must be in ascending order when parsing processing options."));
 	result.waitTime = second(waitSeconds);
 
 
 	for (auto iter = textLinks.begin(); iter != textLinks.end(); ++iter)
 	{
-		//coment and logFile are optional
+		//coment, logFile and hplCacheDirectory are optional
 		if (iter->m_name == sU("comment"))
 			continue;
 		if (iter->m_name == sU("logFile"))
 			continue;
+		if (iter->m_name == sU("hplCacheDirectory"))
+			continue;
 		sci::assertThrow(iter->m_read, sci::err(sci::SERR_USER, 0, "missing parameter " + sci::nativeCodepage(iter->m_name) + " when parsing processing options."));
 	}
 	for (auto iter = boolLinks.begin(); iter != boolLinks.end(); ++iter)
@@ -461,12 +494,13 @@ CalibrationInfo parseCalibrationInfo(wxXmlNode *node)
 }
 
 
-std::shared_ptr<InstrumentProcessor> parseInstrumentProcessor(wxXmlNode *node, wxXmlNode *infoNode, ProgressReporter &progressReporter)
+ConfiguredProcessor parseInstrumentProcessor(wxXmlNode *node, wxXmlNode *infoNode, const ProcessingOptions &processingOptions, ProgressReporter &progressReporter)
 {
 	wxXmlNode *child = node->GetChildren();
 	sci::string name;
 	InstrumentInfo instrumentInfo;
 	CalibrationInfo calibrationInfo;
+	int priority = 0;
 	bool gotName = false;
 	bool gotInstrumentInfo = false;
 	bool gotCalibrationInfo = false;
@@ -499,6 +533,12 @@ std::shared_ptr<InstrumentProcessor> parseInstrumentProcessor(wxXmlNode *node, w
 			calibrationInfo = parseCalibrationInfo(node);
 			gotCalibrationInfo = true;
 		}
+		else if (child->GetName() == sci::nativeUnicode(sU("priority")))
+		{
+			wxXmlNode *valueNode = child->GetChildren();
+			if (valueNode)
+				priority = textToValue<int>(sci::fromWxString(valueNode->GetContent()));
+		}
 		child = child->GetNext();
 	}
 
@@ -506,7 +546,16 @@ std::shared_ptr<InstrumentProcessor> parseInstrumentProcessor(wxXmlNode *node, w
 	sci::assertThrow(gotInstrumentInfo, sci::err(sci::SERR_USER, 0, sU("Found a processor with no instrument.")));
 	sci::assertThrow(gotCalibrationInfo, sci::err(sci::SERR_USER, 0, sU("Found a processor with no calibrationInfo.")));
 
-	return getProcessorByName(name, instrumentInfo, calibrationInfo);
+	ConfiguredProcessor result;
+	result.createProcessor = [name, instrumentInfo, calibrationInfo, processingOptions]() mutable
+	{
+		std::shared_ptr<InstrumentProcessor> processor = getProcessorByName(name, instrumentInfo, calibrationInfo);
+		processor->setProcessingOptions(processingOptions);
+		return processor;
+	};
+	result.processor = result.createProcessor();
+	result.priority = priority;
+	return result;
 }
 
 ProjectInfo parseProjectInfo(wxXmlNode *node, wxXmlNode *infoNode)
@@ -674,7 +723,7 @@ std::shared_ptr<Platform> parsePlatformInfo(wxXmlNode *node, ProgressReporter &p
 
 void setup(sci::string setupFilename, sci::string infoFilename, ProgressReporter &progressReporter,
 	ProcessingOptions &processingOptions, PersonInfo &author, ProjectInfo &projectInfo, std::shared_ptr<Platform> &platform,
-	std::vector<std::shared_ptr<InstrumentProcessor>> &instrumentProcessors)
+	std::vector<ConfiguredProcessor> &instrumentProcessors)
 {
 	wxXmlDocument info;
 	info.Load(sci::nativeUnicode(infoFilename));
@@ -735,7 +784,7 @@ void setup(sci::string setupFilename, sci::string infoFilename, ProgressReporter
 		}
 		else if (child->GetName() == sci::nativeUnicode(sU("processor")))
 		{
-			instrumentProcessors.push_back(parseInstrumentProcessor(node, infoNode, progressReporter));
+			instrumentProcessors.push_back(parseInstrumentProcessor(node, infoNode, processingOptions, progressReporter));
 			gotAtLeastOneInstrument = true;
 		}
 		child = child->GetNext();
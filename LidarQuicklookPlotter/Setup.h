@@ -3,9 +3,20 @@
 #include<svector/sstring.h>
 #include"AmfNc.h"
 
+#include<functional>
+
 class InstrumentProcessor;
 
+//A processor from the settings file, along with what we need to schedule it
+struct ConfiguredProcessor
+{
+	std::shared_ptr<InstrumentProcessor> processor;
+	//creates another processor set up the same way, so different output files can be processed at the same time
+	std::function<std::shared_ptr<InstrumentProcessor>()> createProcessor;
+	int priority = 0; //processors with a higher priority are processed first
+};
+
 void setup(sci::string setupFilename, sci::string infoFilename, ProgressReporter &progressReporter,
 	ProcessingOptions &processingOptions, PersonInfo &author, ProjectInfo &projectInfo, std::shared_ptr<Platform> &platform,
-	std::vector<std::shared_ptr<InstrumentProcessor>> &instrumentProcessors);
+	std::vector<ConfiguredProcessor> &instrumentProcessors);
 void setupProcessingOptionsOnly(sci::string setupFilename, ProcessingOptions &processingOptions);
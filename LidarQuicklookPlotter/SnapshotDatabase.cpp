@@ -0,0 +1,434 @@
+#include"SnapshotDatabase.h"
+#include"MemoryMappedFile.h"
+#include<svector/serr.h>
+#include<fstream>
+#include<sstream>
+#include<filesystem>
+#include<mutex>
+#include<cstring>
+#include"Units.h"
+
+//Increase this whenever the layout of the base file changes
+const uint32_t g_snapshotDatabaseVersion = 1;
+const char g_snapshotDatabaseMagic[8] = { 'S', 'N', 'A', 'P', 'S', 'H', 'O', 'T' };
+const uint32_t g_snapshotJournalBatchMarker = 0x48435442; //"BTCH"
+const size_t g_snapshotBaseHeaderBytes = 24; //magic, version, reserved, number of records
+//the journal is merged into the base file once it is bigger than both of these
+const uint64_t g_minJournalBytesBeforeCompaction = 64 * 1024;
+const uint64_t g_journalToBaseRatioBeforeCompaction = 4;
+
+//All the snapshot databases in this process share one lock, so two threads can never write
+//to the same journal or base file at once
+std::mutex g_snapshotDatabaseMutex;
+//The databases already opened, by text snapshot filename
+std::map<sci::string, std::shared_ptr<SnapshotDatabase>> g_snapshotDatabases;
+
+template<class T>
+void appendBinary(std::string &buffer, const T &value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "appendBinary can only be used with trivially copyable types.");
+	buffer.append((const char*)&value, sizeof(T));
+}
+
+//reads a value from an unaligned position in a buffer
+template<class T>
+T extractBinary(const char *position)
+{
+	T result;
+	std::memcpy(&result, position, sizeof(T));
+	return result;
+}
+
+uint64_t snapshotChecksum(const char *begin, const char *end)
+{
+	//64 bit FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (const char *position = begin; position != end; ++position)
+	{
+		hash ^= uint64_t((unsigned char)*position);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+double snapshotTimeToSeconds(const sci::UtcTime &time)
+{
+	return second(time - sci::UtcTime::getPosixEpoch()).value<second>();
+}
+
+sci::UtcTime snapshotSecondsToTime(double seconds)
+{
+	return sci::UtcTime::getPosixEpoch() + second(seconds);
+}
+
+bool snapshotFileExists(const sci::string &filename)
+{
+	std::error_code error;
+	return std::filesystem::exists(std::filesystem::path(sci::nativeUnicode(filename)), error);
+}
+
+//Gives the database for this snapshot file, opening it the first time or catching up with
+//anything written to its files by other processes since
+std::shared_ptr<SnapshotDatabase> SnapshotDatabase::get(const sci::string &textSnapshotFilename)
+{
+	std::lock_guard<std::mutex> lock(g_snapshotDatabaseMutex);
+	std::shared_ptr<SnapshotDatabase> &database = g_snapshotDatabases[textSnapshotFilename];
+	if (database)
+		database->refreshUnlocked();
+	else
+		database.reset(new SnapshotDatabase(textSnapshotFilename));
+	return database;
+}
+
+//only called from get(), which holds the lock
+SnapshotDatabase::SnapshotDatabase(const sci::string &textSnapshotFilename)
+	:m_nBaseRecords(0), m_validJournalBytes(0)
+{
+	sci::string stem = textSnapshotFilename;
+	if (stem.length() > 4 && stem.substr(stem.length() - 4) == sU(".txt"))
+		stem = stem.substr(0, stem.length() - 4);
+	m_baseFilename = stem + sU(".snapshotdb");
+	m_journalFilename = stem + sU(".snapshotjournal");
+
+	if (!snapshotFileExists(m_baseFilename) && !snapshotFileExists(m_journalFilename) && snapshotFileExists(textSnapshotFilename))
+		importTextSnapshot(textSnapshotFilename);
+	reload();
+}
+
+SnapshotDatabase::~SnapshotDatabase()
+{
+}
+
+bool SnapshotDatabase::find(const sci::string &filename, sci::UtcTime &lastProcessedTime) const
+{
+	std::string utf8Filename = sci::toUtf8(filename);
+	std::lock_guard<std::mutex> lock(g_snapshotDatabaseMutex);
+	auto journalEntry = m_journal.find(utf8Filename);
+	if (journalEntry != m_journal.end())
+	{
+		lastProcessedTime = snapshotSecondsToTime(journalEntry->second);
+		return true;
+	}
+	double seconds;
+	if (findInBase(utf8Filename, seconds))
+	{
+		lastProcessedTime = snapshotSecondsToTime(seconds);
+		return true;
+	}
+	return false;
+}
+
+void SnapshotDatabase::update(const std::vector<std::pair<sci::string, sci::UtcTime>> &entries)
+{
+	if (entries.size() == 0)
+		return;
+
+	//build the whole batch in memory so it is written with a single write
+	std::string payload;
+	std::vector<std::pair<std::string, double>> utf8Entries(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		utf8Entries[i].first = sci::toUtf8(entries[i].first);
+		utf8Entries[i].second = snapshotTimeToSeconds(entries[i].second);
+		appendBinary(payload, uint32_t(utf8Entries[i].first.length()));
+		payload.append(utf8Entries[i].first);
+		appendBinary(payload, utf8Entries[i].second);
+	}
+	std::string batch;
+	batch.reserve(payload.length() + 24);
+	appendBinary(batch, g_snapshotJournalBatchMarker);
+	appendBinary(batch, uint32_t(entries.size()));
+	appendBinary(batch, uint64_t(payload.length()));
+	batch.append(payload);
+	appendBinary(batch, snapshotChecksum(payload.data(), payload.data() + payload.length()));
+
+	std::lock_guard<std::mutex> lock(g_snapshotDatabaseMutex);
+	//pick up anything written since we last looked and chop off any partly written batch,
+	//otherwise our batch would follow it and never be read
+	refreshUnlocked();
+	std::error_code error;
+	std::filesystem::path journalPath(sci::nativeUnicode(m_journalFilename));
+	if (std::filesystem::exists(journalPath, error) && std::filesystem::file_size(journalPath, error) != m_validJournalBytes)
+		std::filesystem::resize_file(journalPath, m_validJournalBytes, error);
+
+	std::fstream fout;
+	fout.open(sci::nativeUnicode(m_journalFilename), std::ios::out | std::ios::app | std::ios::binary);
+	sci::assertThrow(fout.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not open the snapshot journal ") + m_journalFilename + sU(" to record processed files.")));
+	fout.write(batch.data(), batch.length());
+	fout.close();
+	sci::assertThrow(!fout.fail(), sci::err(sci::SERR_USER, 0, sU("Could not write to the snapshot journal ") + m_journalFilename + sU(".")));
+
+	for (size_t i = 0; i < utf8Entries.size(); ++i)
+		m_journal[utf8Entries[i].first] = utf8Entries[i].second;
+	m_validJournalBytes += batch.length();
+
+	uint64_t baseBytes = m_base ? m_base->size() : 0;
+	if (m_validJournalBytes > g_minJournalBytesBeforeCompaction && m_validJournalBytes * g_journalToBaseRatioBeforeCompaction > baseBytes)
+	{
+		//compaction is just housekeeping. If it fails, e.g. because the base file is mapped
+		//elsewhere, the journal is still valid so we can try again next time
+		try
+		{
+			compactUnlocked();
+		}
+		catch (...)
+		{
+			//the journal entries are only dropped once compaction succeeds, so just the base
+			//needs reopening
+			openBase();
+		}
+	}
+}
+
+void SnapshotDatabase::refresh()
+{
+	std::lock_guard<std::mutex> lock(g_snapshotDatabaseMutex);
+	refreshUnlocked();
+}
+
+void SnapshotDatabase::compact()
+{
+	std::lock_guard<std::mutex> lock(g_snapshotDatabaseMutex);
+	refreshUnlocked();
+	compactUnlocked();
+}
+
+void SnapshotDatabase::clear()
+{
+	std::lock_guard<std::mutex> lock(g_snapshotDatabaseMutex);
+	writeBase(std::map<std::string, double>());
+	std::error_code error;
+	std::filesystem::remove(std::filesystem::path(sci::nativeUnicode(m_journalFilename)), error);
+	m_journal.clear();
+	m_validJournalBytes = 0;
+}
+
+void SnapshotDatabase::compactUnlocked()
+{
+	//merge the base and journal with the journal taking precedence
+	std::map<std::string, double> records;
+	for (uint64_t i = 0; i < m_nBaseRecords; ++i)
+	{
+		std::string_view filename;
+		double seconds;
+		readBaseRecord(i, filename, seconds);
+		records.emplace_hint(records.end(), std::string(filename), seconds);
+	}
+	for (auto iter = m_journal.begin(); iter != m_journal.end(); ++iter)
+		records[iter->first] = iter->second;
+
+	writeBase(records);
+	//if we stop before removing the journal it just gets replayed over the new base, which is harmless
+	std::error_code error;
+	std::filesystem::remove(std::filesystem::path(sci::nativeUnicode(m_journalFilename)), error);
+	m_journal.clear();
+	m_validJournalBytes = 0;
+}
+
+void SnapshotDatabase::openBase()
+{
+	m_base.reset();
+	m_nBaseRecords = 0;
+	if (!snapshotFileExists(m_baseFilename))
+		return;
+
+	std::error_code error;
+	m_baseWriteTime = std::filesystem::last_write_time(std::filesystem::path(sci::nativeUnicode(m_baseFilename)), error);
+	m_base.reset(new MemoryMappedFile(m_baseFilename));
+	const char *data = m_base->begin();
+	size_t size = m_base->size();
+	sci::string corruptMessage = sU("The snapshot database ") + m_baseFilename + sU(" is corrupt. Delete it (and the .snapshotjournal file) to reprocess all files.");
+	sci::assertThrow(size >= g_snapshotBaseHeaderBytes && std::equal(data, data + 8, g_snapshotDatabaseMagic), sci::err(sci::SERR_USER, 0, corruptMessage));
+	sci::assertThrow(extractBinary<uint32_t>(data + 8) == g_snapshotDatabaseVersion, sci::err(sci::SERR_USER, 0, sU("The snapshot database ") + m_baseFilename + sU(" was written by a different version of this software.")));
+	m_nBaseRecords = extractBinary<uint64_t>(data + 16);
+	sci::assertThrow(m_nBaseRecords <= (size - g_snapshotBaseHeaderBytes) / 8, sci::err(sci::SERR_USER, 0, corruptMessage));
+}
+
+//reads the base and the whole journal again from scratch
+void SnapshotDatabase::reload()
+{
+	openBase();
+	m_journal.clear();
+	m_validJournalBytes = 0;
+	readJournal();
+}
+
+//Catches up with changes made to the files by other processes. Normally this just reads any
+//batches appended to the journal since we last read it. If the base has been rewritten or the
+//journal has shrunk then someone else has compacted or cleared the database and we start again.
+void SnapshotDatabase::refreshUnlocked()
+{
+	std::error_code error;
+	std::filesystem::path basePath(sci::nativeUnicode(m_baseFilename));
+	bool baseExists = std::filesystem::exists(basePath, error);
+	if (baseExists != bool(m_base) || (baseExists && (std::filesystem::last_write_time(basePath, error) != m_baseWriteTime || std::filesystem::file_size(basePath, error) != m_base->size())))
+	{
+		reload();
+		return;
+	}
+	std::filesystem::path journalPath(sci::nativeUnicode(m_journalFilename));
+	uint64_t journalBytes = std::filesystem::exists(journalPath, error) ? std::filesystem::file_size(journalPath, error) : 0;
+	if (journalBytes < m_validJournalBytes)
+		reload();
+	else if (journalBytes > m_validJournalBytes)
+		readJournal();
+}
+
+//reads the journal batches after the ones we have already read
+void SnapshotDatabase::readJournal()
+{
+	std::fstream fin;
+	fin.open(sci::nativeUnicode(m_journalFilename), std::ios::in | std::ios::binary);
+	if (!fin.is_open())
+		return;
+	fin.seekg(m_validJournalBytes);
+	std::ostringstream contentsStream;
+	contentsStream << fin.rdbuf();
+	fin.close();
+	std::string contents = contentsStream.str();
+	const uint64_t alreadyReadBytes = m_validJournalBytes;
+
+	//replay the complete batches in order, stopping at the first incomplete or corrupt one
+	const char *position = contents.data();
+	const char *end = contents.data() + contents.length();
+	while (end - position >= 16)
+	{
+		uint32_t marker = extractBinary<uint32_t>(position);
+		uint32_t nEntries = extractBinary<uint32_t>(position + 4);
+		uint64_t payloadBytes = extractBinary<uint64_t>(position + 8);
+		if (marker != g_snapshotJournalBatchMarker || payloadBytes > uint64_t(end - position) - 16 || uint64_t(end - position) - 16 - payloadBytes < 8)
+			break;
+		const char *payload = position + 16;
+		const char *payloadEnd = payload + payloadBytes;
+		if (extractBinary<uint64_t>(payloadEnd) != snapshotChecksum(payload, payloadEnd))
+			break;
+
+		const char *entry = payload;
+		for (uint32_t i = 0; i < nEntries && payloadEnd - entry >= 4; ++i)
+		{
+			uint32_t length = extractBinary<uint32_t>(entry);
+			entry += 4;
+			if (uint64_t(payloadEnd - entry) < uint64_t(length) + 8)
+				break;
+			m_journal[std::string(entry, length)] = extractBinary<double>(entry + length);
+			entry += length + 8;
+		}
+		position = payloadEnd + 8;
+		m_validJournalBytes = alreadyReadBytes + (position - contents.data());
+	}
+}
+
+void SnapshotDatabase::readBaseRecord(uint64_t index, std::string_view &filename, double &lastProcessedTime) const
+{
+	const char *data = m_base->begin();
+	size_t size = m_base->size();
+	uint64_t offset = extractBinary<uint64_t>(data + g_snapshotBaseHeaderBytes + index * 8);
+	sci::assertThrow(offset <= size && size - offset >= 12, sci::err(sci::SERR_USER, 0, sU("The snapshot database ") + m_baseFilename + sU(" is corrupt.")));
+	uint32_t length = extractBinary<uint32_t>(data + offset);
+	sci::assertThrow(size - offset - 12 >= length, sci::err(sci::SERR_USER, 0, sU("The snapshot database ") + m_baseFilename + sU(" is corrupt.")));
+	filename = std::string_view(data + offset + 4, length);
+	lastProcessedTime = extractBinary<double>(data + offset + 4 + length);
+}
+
+bool SnapshotDatabase::findInBase(std::string_view filename, double &lastProcessedTime) const
+{
+	//binary search of the sorted records
+	uint64_t begin = 0;
+	uint64_t end = m_nBaseRecords;
+	while (begin < end)
+	{
+		uint64_t middle = begin + (end - begin) / 2;
+		std::string_view middleFilename;
+		double middleTime;
+		readBaseRecord(middle, middleFilename, middleTime);
+		int comparison = middleFilename.compare(filename);
+		if (comparison == 0)
+		{
+			lastProcessedTime = middleTime;
+			return true;
+		}
+		if (comparison < 0)
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+	return false;
+}
+
+void SnapshotDatabase::writeBase(const std::map<std::string, double> &records)
+{
+	//the map is already sorted by filename, which is the order the binary search needs
+	std::string buffer;
+	buffer.append(g_snapshotDatabaseMagic, 8);
+	appendBinary(buffer, g_snapshotDatabaseVersion);
+	appendBinary(buffer, uint32_t(0));
+	appendBinary(buffer, uint64_t(records.size()));
+	size_t offsetTableStart = buffer.length();
+	buffer.resize(buffer.length() + records.size() * 8);
+	size_t index = 0;
+	for (auto iter = records.begin(); iter != records.end(); ++iter, ++index)
+	{
+		uint64_t offset = buffer.length();
+		std::memcpy(&buffer[offsetTableStart + index * 8], &offset, 8);
+		appendBinary(buffer, uint32_t(iter->first.length()));
+		buffer.append(iter->first);
+		appendBinary(buffer, iter->second);
+	}
+
+	//write to a temporary file then rename it over the old one, so the base file is never half written
+	sci::string temporaryFilename = m_baseFilename + sU(".tmp");
+	std::fstream fout;
+	fout.open(sci::nativeUnicode(temporaryFilename), std::ios::out | std::ios::trunc | std::ios::binary);
+	sci::assertThrow(fout.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not create the snapshot database file ") + temporaryFilename + sU(".")));
+	fout.write(buffer.data(), buffer.length());
+	fout.close();
+	sci::assertThrow(!fout.fail(), sci::err(sci::SERR_USER, 0, sU("Could not write the snapshot database file ") + temporaryFilename + sU(".")));
+
+	//the old base must be unmapped before it can be replaced
+	m_base.reset();
+	m_nBaseRecords = 0;
+	std::error_code error;
+	std::filesystem::rename(std::filesystem::path(sci::nativeUnicode(temporaryFilename)), std::filesystem::path(sci::nativeUnicode(m_baseFilename)), error);
+	sci::assertThrow(!error, sci::err(sci::SERR_USER, 0, sU("Could not replace the snapshot database file ") + m_baseFilename + sU(".")));
+	openBase();
+}
+
+void SnapshotDatabase::importTextSnapshot(const sci::string &textSnapshotFilename)
+{
+	std::map<std::string, double> records;
+
+	//each line of the text snapshot is filename:yyyy-mm-ddThh:mm:ss, with the latest entry for
+	//a file being the one that counts
+	std::fstream fin;
+	fin.open(sci::nativeUnicode(textSnapshotFilename), std::ios::in);
+	sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not open the snapshot file ") + textSnapshotFilename + sU(" to import it.")));
+	std::string line; //utf8
+	std::getline(fin, line);
+	while (!fin.eof() && !fin.bad() && !fin.fail())
+	{
+		if (line.length() > 19)
+		{
+			//split the line into a filename and a date/time
+			std::string filename = line.substr(0, line.length() - 20);
+			std::string timeString = line.substr(line.length() - 19);
+			//replace the date/time separators with spaces
+			for (size_t i = 0; i < timeString.length(); ++i)
+				if (timeString[i] == '-' || timeString[i] == ':' || timeString[i] == 'T')
+					timeString[i] = ' ';
+			//read in time from the time string
+			int hour;
+			int minute;
+			int second;
+			int year;
+			int month;
+			int dayOfMonth;
+			std::istringstream strm(timeString);
+			strm >> year >> month >> dayOfMonth >> hour >> minute >> second;
+			records[filename] = snapshotTimeToSeconds(sci::UtcTime(year, month, dayOfMonth, hour, minute, second));
+		}
+		std::getline(fin, line);
+	}
+	fin.close();
+
+	writeBase(records);
+}
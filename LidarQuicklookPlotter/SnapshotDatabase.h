@@ -0,0 +1,53 @@
+#pragma once
+#include<svector/sstring.h>
+#include<svector/time.h>
+#include<vector>
+#include<map>
+#include<memory>
+#include<string>
+#include<string_view>
+#include<cstdint>
+#include<filesystem>
+
+class MemoryMappedFile;
+
+//Records the last time each input file was processed. This replaces the old filename:time
+//text snapshot files, which had to be parsed in full every time we checked for changes.
+//The records live in two files. The base file holds them sorted by filename with a table of
+//offsets at the start, so it is memory mapped and a lookup is just a binary search. Updates
+//are appended to a journal file in batches. Each batch is checksummed, so a batch that was
+//only partly written is ignored and a batch is either recorded completely or not at all. Once
+//the journal grows large it is merged into a new base file, dropping superseded entries.
+//If neither file exists but the old text snapshot does, the text snapshot is imported.
+//There is one database per snapshot file for the life of the process, obtained from get().
+//It remembers how much of the journal it has read, so checking for changes each time only
+//reads the batches appended since, rather than the whole journal.
+class SnapshotDatabase
+{
+public:
+	static std::shared_ptr<SnapshotDatabase> get(const sci::string &textSnapshotFilename);
+	~SnapshotDatabase();
+	bool find(const sci::string &filename, sci::UtcTime &lastProcessedTime) const;
+	void update(const std::vector<std::pair<sci::string, sci::UtcTime>> &entries);
+	void refresh();
+	void compact();
+	void clear();
+private:
+	SnapshotDatabase(const sci::string &textSnapshotFilename);
+	void openBase();
+	void reload();
+	void refreshUnlocked();
+	void readJournal();
+	void compactUnlocked();
+	bool findInBase(std::string_view filename, double &lastProcessedTime) const;
+	void readBaseRecord(uint64_t index, std::string_view &filename, double &lastProcessedTime) const;
+	void writeBase(const std::map<std::string, double> &records);
+	void importTextSnapshot(const sci::string &textSnapshotFilename);
+	sci::string m_baseFilename;
+	sci::string m_journalFilename;
+	std::unique_ptr<MemoryMappedFile> m_base;
+	uint64_t m_nBaseRecords;
+	std::filesystem::file_time_type m_baseWriteTime; //used to spot the base being rewritten by another process
+	std::map<std::string, double> m_journal; //the latest journal entries, these override the base file
+	uint64_t m_validJournalBytes;
+};
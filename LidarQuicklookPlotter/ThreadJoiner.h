@@ -0,0 +1,25 @@
+#pragma once
+#include<vector>
+#include<thread>
+#include<atomic>
+
+//Sets stop then joins all the threads when it goes out of scope, so worker threads are
+//never left running if the work finishes early or throws.
+class ThreadJoiner
+{
+public:
+	ThreadJoiner(std::vector<std::thread> &threads, std::atomic<bool> &stop)
+		:m_threads(threads), m_stop(stop)
+	{
+	}
+	~ThreadJoiner()
+	{
+		m_stop = true;
+		for (size_t i = 0; i < m_threads.size(); ++i)
+			if (m_threads[i].joinable())
+				m_threads[i].join();
+	}
+private:
+	std::vector<std::thread> &m_threads;
+	std::atomic<bool> &m_stop;
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include<svector/time.h>
+#include<svector/array.h>
+#include<svector/serr.h>
+#include<vector>
+#include<array>
+#include<limits>
+#include"Units.h"
+
+//How a master time with no matching sample in a series is filled
+enum class TimeJoinFill
+{
+	pad, //use the pad value given for each variable
+	previous, //use the latest sample before the master time, or the pad value if there isn't one
+	next //use the earliest sample after the master time, or the pad value if there isn't one
+};
+
+//The index of the series sample used for each master time, or npos where the pad value is used
+class TimeJoinIndex
+{
+public:
+	static constexpr size_t npos = std::numeric_limits<size_t>::max();
+	size_t size() const { return m_indices.size(); }
+	size_t operator[](size_t masterIndex) const { return m_indices[masterIndex]; }
+	size_t getSeriesSize() const { return m_seriesSize; }
+private:
+	friend class TimeJoin;
+	std::vector<size_t> m_indices;
+	size_t m_seriesSize;
+};
+
+//A variable to be aligned by TimeJoin::join along with the value used where it has no data.
+//The pad value defaults to NaN.
+template<class T, size_t NDIMS>
+struct TimeJoinVariable
+{
+	sci::GridData<T, NDIMS> *data;
+	T padValue;
+};
+
+template<class T, size_t NDIMS, class PAD>
+TimeJoinVariable<T, NDIMS> timeJoinVariable(sci::GridData<T, NDIMS> &data, PAD padValue)
+{
+	return TimeJoinVariable<T, NDIMS>{ &data, T(padValue) };
+}
+
+template<class T, size_t NDIMS>
+TimeJoinVariable<T, NDIMS> timeJoinVariable(sci::GridData<T, NDIMS> &data)
+{
+	return TimeJoinVariable<T, NDIMS>{ &data, std::numeric_limits<T>::quiet_NaN() };
+}
+
+//Aligns time series from different files or instruments onto one master time axis, e.g. each
+//HATPRO product onto the housekeeping times. Each series is matched against the master times
+//in a single merge pass, which gives a TimeJoinIndex, then every variable sharing that series'
+//time is rebuilt at its final size from the index. Nothing is appended element by element.
+//With the pad fill each series sample is used at most once: it can only match the master time it
+//is nearest to, if that is within the tolerance, and where several samples are nearest to the
+//same master time the nearest of them is used. With the previous and next fills a master time
+//uses the nearest sample within the tolerance, otherwise the sample before or after it, and
+//samples may be used for more than one master time. Ties always go to the earlier time. Both the
+//master and series times must be sorted, and the master time must outlive the TimeJoin.
+class TimeJoin
+{
+public:
+	TimeJoin(const sci::GridData<sci::UtcTime, 1> &masterTime, second tolerance = second(0.0), TimeJoinFill fill = TimeJoinFill::pad)
+		:m_masterTime(masterTime), m_tolerance(tolerance), m_fill(fill)
+	{
+	}
+	const sci::GridData<sci::UtcTime, 1> &getMasterTime() const { return m_masterTime; }
+
+	TimeJoinIndex match(const sci::GridData<sci::UtcTime, 1> &seriesTime) const
+	{
+		TimeJoinIndex result;
+		result.m_seriesSize = seriesTime.size();
+		result.m_indices.resize(m_masterTime.size(), TimeJoinIndex::npos);
+		if (m_fill == TimeJoinFill::pad)
+		{
+			//each sample is offered to the master time it is nearest to, and each master time keeps
+			//the nearest sample it is offered. Ties go to the earlier time in both cases
+			std::vector<second> nearestDistances(m_masterTime.size());
+			for (size_t i = 0; i < seriesTime.size(); ++i)
+			{
+				size_t nearest = nearestIndex(m_masterTime, seriesTime[i]);
+				if (nearest == TimeJoinIndex::npos)
+					continue;
+				second distance = absoluteDistance(seriesTime[i], m_masterTime[nearest]);
+				if (distance > m_tolerance)
+					continue;
+				if (result.m_indices[nearest] == TimeJoinIndex::npos || distance < nearestDistances[nearest])
+				{
+					result.m_indices[nearest] = i;
+					nearestDistances[nearest] = distance;
+				}
+			}
+		}
+		else
+		{
+			//samples are not used up, so repeated master times get the same sample
+			for (size_t i = 0; i < m_masterTime.size(); ++i)
+			{
+				size_t nearest = nearestIndex(seriesTime, m_masterTime[i]);
+				if (nearest != TimeJoinIndex::npos && !(absoluteDistance(seriesTime[nearest], m_masterTime[i]) > m_tolerance))
+					result.m_indices[i] = nearest;
+				else if (m_fill == TimeJoinFill::previous)
+				{
+					size_t after = firstAfter(seriesTime, m_masterTime[i]);
+					//with repeated times, use the first of them
+					if (after > 0)
+						result.m_indices[i] = firstNotBefore(seriesTime, seriesTime[after - 1]);
+				}
+				else
+				{
+					size_t notBefore = firstNotBefore(seriesTime, m_masterTime[i]);
+					if (notBefore < seriesTime.size())
+						result.m_indices[i] = notBefore;
+				}
+			}
+		}
+		return result;
+	}
+
+	//Rebuilds data, which has one element or row per series time, with one per master time
+	template<class T, size_t NDIMS>
+	static void align(const TimeJoinIndex &index, sci::GridData<T, NDIMS> &data, T padValue)
+	{
+		sci::assertThrow(data.shape()[0] == index.getSeriesSize(), sci::err(sci::SERR_USER, 0, sU("Tried to time align data whose size does not match its time series.")));
+		if constexpr (NDIMS == 1)
+		{
+			sci::GridData<T, 1> result(index.size(), padValue);
+			for (size_t i = 0; i < index.size(); ++i)
+				if (index[i] != TimeJoinIndex::npos)
+					result[i] = data[index[i]];
+			data = std::move(result);
+		}
+		else if constexpr (NDIMS == 2)
+		{
+			const size_t rowLength = data.shape()[1];
+			sci::GridData<T, 2> result(std::array<size_t, 2>{ index.size(), rowLength }, padValue);
+			for (size_t i = 0; i < index.size(); ++i)
+				if (index[i] != TimeJoinIndex::npos)
+					for (size_t j = 0; j < rowLength; ++j)
+						result[i][j] = data[index[i]][j];
+			data = std::move(result);
+		}
+		else
+			static_assert(NDIMS == 1 || NDIMS == 2, "TimeJoin can only align 1d or 2d data.");
+	}
+
+	//Aligns a series time and all the variables that share it in one go. On return seriesTime
+	//is a copy of the master time. Use timeJoinVariable to pass the variables.
+	template<class... VARIABLES>
+	void join(sci::GridData<sci::UtcTime, 1> &seriesTime, VARIABLES... variables) const
+	{
+		TimeJoinIndex index = match(seriesTime);
+		(align(index, *variables.data, variables.padValue), ...);
+		seriesTime = m_masterTime;
+	}
+private:
+	static second absoluteDistance(const sci::UtcTime &a, const sci::UtcTime &b)
+	{
+		return a < b ? second(b - a) : second(a - b);
+	}
+	//the index of the first of times which is not before time, or times.size() if there isn't one
+	static size_t firstNotBefore(const sci::GridData<sci::UtcTime, 1> &times, const sci::UtcTime &time)
+	{
+		size_t begin = 0;
+		size_t end = times.size();
+		while (begin < end)
+		{
+			size_t middle = begin + (end - begin) / 2;
+			if (times[middle] < time)
+				begin = middle + 1;
+			else
+				end = middle;
+		}
+		return begin;
+	}
+	//the index of the first of times which is after time, or times.size() if there isn't one
+	static size_t firstAfter(const sci::GridData<sci::UtcTime, 1> &times, const sci::UtcTime &time)
+	{
+		size_t begin = 0;
+		size_t end = times.size();
+		while (begin < end)
+		{
+			size_t middle = begin + (end - begin) / 2;
+			if (time < times[middle])
+				end = middle;
+			else
+				begin = middle + 1;
+		}
+		return begin;
+	}
+	//the index of the element of times nearest to time, the earliest if there is a tie, or npos if times is empty
+	static size_t nearestIndex(const sci::GridData<sci::UtcTime, 1> &times, const sci::UtcTime &time)
+	{
+		size_t after = firstNotBefore(times, time);
+		if (after == times.size())
+			return times.size() == 0 ? TimeJoinIndex::npos : times.size() - 1;
+		if (after == 0)
+			return 0;
+		//pick the earlier of the two if they are equally near
+		size_t nearest = absoluteDistance(times[after], time) < absoluteDistance(times[after - 1], time) ? after : after - 1;
+		//with repeated times, use the first of them
+		return firstNotBefore(times, times[nearest]);
+	}
+	const sci::GridData<sci::UtcTime, 1> &m_masterTime;
+	second m_tolerance;
+	TimeJoinFill m_fill;
+};
@@ -0,0 +1,108 @@
+//Checks TimeJoin::match against hand built series with known answers, covering repeated times,
+//samples between master times, tolerances and each fill. Returns non zero if any case fails.
+//Usage: TimeJoinCheck
+#include"TimeJoin.h"
+#include<iostream>
+#include<string>
+
+const size_t npos = TimeJoinIndex::npos;
+
+//builds times at the given number of seconds after an arbitrary start
+sci::GridData<sci::UtcTime, 1> makeTimes(const std::vector<double> &seconds)
+{
+	sci::UtcTime start(2020, 10, 17, 0, 0, 0.0);
+	sci::GridData<sci::UtcTime, 1> result(seconds.size());
+	for (size_t i = 0; i < seconds.size(); ++i)
+		result[i] = start + second(seconds[i]);
+	return result;
+}
+
+std::string indexString(const std::vector<size_t> &indices)
+{
+	std::string result = "[";
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		if (i > 0)
+			result += ", ";
+		result += indices[i] == npos ? std::string("pad") : std::to_string(indices[i]);
+	}
+	return result + "]";
+}
+
+//Matches series against master and compares the indices to expected. Returns true if they match.
+bool check(const std::string &name, const std::vector<double> &master, const std::vector<double> &series, double tolerance, TimeJoinFill fill, const std::vector<size_t> &expected)
+{
+	sci::GridData<sci::UtcTime, 1> masterTime = makeTimes(master);
+	TimeJoinIndex index = TimeJoin(masterTime, second(tolerance), fill).match(makeTimes(series));
+	std::vector<size_t> indices(index.size());
+	for (size_t i = 0; i < index.size(); ++i)
+		indices[i] = index[i];
+	bool passed = indices == expected && index.getSeriesSize() == series.size();
+	std::cout << (passed ? "passed: " : "FAILED: ") << name;
+	if (!passed)
+		std::cout << ", expected " << indexString(expected) << " but got " << indexString(indices);
+	std::cout << "\n";
+	return passed;
+}
+
+int main()
+{
+	try
+	{
+		const TimeJoinFill pad = TimeJoinFill::pad;
+		const TimeJoinFill previous = TimeJoinFill::previous;
+		const TimeJoinFill next = TimeJoinFill::next;
+		bool passed = true;
+
+		//pad fill, each sample used at most once
+		passed = check("pad, exact matches", { 0, 1, 2, 3 }, { 1, 3 }, 0.0, pad, { npos, 0, npos, 1 }) && passed;
+		passed = check("pad, repeated master time only gets one sample", { 1, 1, 2 }, { 1, 2 }, 0.0, pad, { 0, npos, 1 }) && passed;
+		passed = check("pad, repeated sample time uses the first", { 1, 2 }, { 1, 1, 2 }, 0.0, pad, { 0, 2 }) && passed;
+		passed = check("pad, samples outside the tolerance are not used", { 0, 10 }, { 0.6, 9.4 }, 0.5, pad, { npos, npos }) && passed;
+		passed = check("pad, samples within the tolerance", { 0, 10 }, { 0.4, 9.6 }, 0.5, pad, { 0, 1 }) && passed;
+		//a greedy pass would give master time 0 the sample at 0.9, leaving 1 with nothing
+		passed = check("pad, sample goes to its nearest master time", { 0, 1 }, { 0.9 }, 1.0, pad, { npos, 0 }) && passed;
+		passed = check("pad, master time keeps its nearest sample", { 0, 1 }, { 0.3, 0.1, 0.9 }, 1.0, pad, { 1, 2 }) && passed;
+		//0.4 and 0.45 are both nearest to 0, so nothing is left for 1
+		passed = check("pad, samples nearer another master time are not reused", { 0, 1 }, { 0.4, 0.45 }, 1.0, pad, { 0, npos }) && passed;
+		passed = check("pad, equally near sample goes to the earlier master time", { 0, 2 }, { 1 }, 1.0, pad, { 0, npos }) && passed;
+		passed = check("pad, equally near samples, the earlier is used", { 1 }, { 0, 2 }, 1.0, pad, { 0 }) && passed;
+		passed = check("pad, empty series", { 0, 1 }, { }, 1.0, pad, { npos, npos }) && passed;
+		passed = check("pad, empty master", { }, { 0, 1 }, 1.0, pad, { }) && passed;
+
+		//next fill, as used to pick the housekeeping record for each microwave radiometer time
+		passed = check("next, repeated master time reuses the same sample", { 5, 5 }, { 5, 6 }, 0.0, next, { 0, 0 }) && passed;
+		passed = check("next, first sample at or after", { 0, 1.5, 2, 2.5, 4 }, { 1, 2, 3 }, 0.0, next, { 0, 1, 1, 2, npos }) && passed;
+		passed = check("next, several master times between samples", { 1.1, 1.2, 1.3 }, { 1, 2 }, 0.0, next, { 1, 1, 1 }) && passed;
+		passed = check("next, repeated sample time uses the first", { 1 }, { 0, 2, 2 }, 0.0, next, { 1 }) && passed;
+		passed = check("next, nearest within the tolerance before the next one", { 1, 3 }, { 0.9, 2 }, 0.5, next, { 0, npos }) && passed;
+		passed = check("next, empty series", { 0, 1 }, { }, 0.0, next, { npos, npos }) && passed;
+
+		//previous fill
+		passed = check("previous, repeated master time reuses the same sample", { 5, 5 }, { 4, 6 }, 0.0, previous, { 0, 0 }) && passed;
+		passed = check("previous, last sample at or before", { 0, 1, 1.5, 2, 4 }, { 1, 2, 3 }, 0.0, previous, { npos, 0, 0, 1, 2 }) && passed;
+		//a sample used by an earlier master time must not become the previous sample of a later one
+		passed = check("previous, never a sample after the master time", { 1, 1.2 }, { 1.1 }, 0.2, previous, { 0, 0 }) && passed;
+		passed = check("previous, never a sample after the master time outside the tolerance", { 0.9, 1.2 }, { 1.1, 1.3 }, 0.05, previous, { npos, 0 }) && passed;
+		passed = check("previous, repeated sample time uses the first", { 3 }, { 2, 2, 4 }, 0.0, previous, { 0 }) && passed;
+		passed = check("previous, empty series", { 0, 1 }, { }, 0.0, previous, { npos, npos }) && passed;
+
+		//align uses the index and pads the rest
+		sci::GridData<sci::UtcTime, 1> masterTime = makeTimes({ 0, 1, 2 });
+		sci::GridData<double, 1> data(2);
+		data[0] = 10.0;
+		data[1] = 20.0;
+		TimeJoin::align(TimeJoin(masterTime).match(makeTimes({ 1, 2 })), data, -1.0);
+		bool alignPassed = data.size() == 3 && data[0] == -1.0 && data[1] == 10.0 && data[2] == 20.0;
+		std::cout << (alignPassed ? "passed: " : "FAILED: ") << "align\n";
+		passed = alignPassed && passed;
+
+		std::cout << (passed ? "All time joins are as expected\n" : "FAILED: some time joins are wrong\n");
+		return passed ? 0 : 1;
+	}
+	catch (sci::err err)
+	{
+		std::cout << "Error: " << sci::nativeUnicode(err.getErrorMessage()) << "\n";
+		return 1;
+	}
+}
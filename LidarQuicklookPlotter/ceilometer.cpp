@@ -3,7 +3,11 @@
 #include"ProgressReporter.h"
 #include<svector/splot.h>
 #include"Plotting.h"
+#include"MemoryMappedFile.h"
+#include"CharBufferParsing.h"
 #include<svector/svector.h>
+#include<string_view>
+#include<cstring>
 
 
 uint8_t CampbellCeilometerProfile::getProfileFlag() const
@@ -496,15 +500,30 @@ void CeilometerProcessor::writeToNc(const HplHeader& header, const std::vector<C
 
 
 
-sci::UtcTime getCeilometerTime(const sci::string &timeDateString)
+//Parses an integer field of a time stamp in the same way as atoi, i.e. leading whitespace
+//and a sign are allowed, anything after the digits is ignored and no digits gives 0
+int parseCeilometerTimeField(std::string_view field)
 {
+	const char *position = field.data();
+	int value = 0;
+	parseBufferNumber(position, position + field.length(), value);
+	return value;
+}
+
+//The time stamp must already have been checked to be at least 19 characters with the separators
+//in the right places
+sci::UtcTime getCeilometerTime(std::string_view timeDate)
+{
+	const char *secondStart = timeDate.data() + 17;
+	double second = 0.0;
+	parseBufferNumber(secondStart, timeDate.data() + timeDate.length(), second);
 	sci::UtcTime result(
-		std::atoi(sci::utf16ToUtf8(timeDateString.substr(0, 4)).c_str()), //year
-		std::atoi(sci::utf16ToUtf8(timeDateString.substr(5, 2)).c_str()), //month
-		std::atoi(sci::utf16ToUtf8(timeDateString.substr(8, 2)).c_str()), //day
-		std::atoi(sci::utf16ToUtf8(timeDateString.substr(11, 2)).c_str()), //hour
-		std::atoi(sci::utf16ToUtf8(timeDateString.substr(14, 2)).c_str()), //minute
-		std::atof(sci::utf16ToUtf8(timeDateString.substr(17, std::string::npos)).c_str()) //second
+		parseCeilometerTimeField(timeDate.substr(0, 4)), //year
+		parseCeilometerTimeField(timeDate.substr(5, 2)), //month
+		parseCeilometerTimeField(timeDate.substr(8, 2)), //day
+		parseCeilometerTimeField(timeDate.substr(11, 2)), //hour
+		parseCeilometerTimeField(timeDate.substr(14, 2)), //minute
+		second
 	);
 	return result;
 }
@@ -527,30 +546,29 @@ void CeilometerProcessor::readData(const sci::string &inputFilename, ProgressRep
 
 	if (inputFilename.find(sU("_ceilometer.csv")) != std::string::npos)
 	{
-		std::fstream fin;
-		fin.open(sci::nativeUnicode(inputFilename), std::ios::in | std::ios::binary);
-		sci::assertThrow(fin.is_open(), sci::err(sci::SERR_USER, 0, sU("Could not ope file ") + inputFilename + sU(".")));
+		//The whole file is mapped into memory and each record is parsed in place. Each record
+		//is a time stamp, then a comma, then a Campbell message.
+		MemoryMappedFile file(inputFilename);
+		const char *position = file.begin();
+		const char *end = file.end();
 
 		progressReporter << sU("Reading file ") << inputFilename << sU("\n");
 
 
 		const size_t displayInterval = 120;
 		sci::string firstBatchDate;
-		sci::string timeDate;
-		while (!fin.eof())
+		std::string_view timeDate;
+		while (position != end)
 		{
 			bool badTimeDate = false;
-			timeDate = sU("");
-			char character;
-			fin.read(&character, 1);
-			//size_t counter = 1;
-			while (character != ',' && !fin.eof())
+			const char *comma = (const char*)std::memchr(position, ',', end - position);
+			if (!comma)
 			{
-				timeDate = timeDate + sci::utf8ToUtf16(std::string(&character, (&character) + 1));
-				fin.read(&character, 1);
-			}
-			if (fin.eof())
+				timeDate = std::string_view(position, end - position);
 				break;
+			}
+			timeDate = std::string_view(position, comma - position);
+			position = comma + 1;
 			size_t firstDash = timeDate.find_first_of('-');
 			if (firstDash == std::string::npos || firstDash < 4)
 				badTimeDate = true;
@@ -575,22 +593,23 @@ void CeilometerProcessor::readData(const sci::string &inputFilename, ProgressRep
 			//unless we have a bad time/date we can read in the data
 			if (!badTimeDate)
 			{
+				sci::UtcTime time = getCeilometerTime(timeDate);
 				//I have found one instance where time went backwards in the second entry in
 				//a file. I'm not really sure why, but the best thing to do in this case seems
 				//to be to discard the first entry.
 
 				//If we have more than one entry already then I'm not sure what to do. For now abort processing this file..
-				if (m_allData.size() == 1 && m_allData.back().getTime() > getCeilometerTime(timeDate))
+				if (m_allData.size() == 1 && m_allData.back().getTime() > time)
 				{
 					m_allData.pop_back();
 					progressReporter << sU("The second entry in the file has a timestamp earlier than the first. This may be due to a logging glitch. The first entry will be deleted.\n");
 				}
-				else if (m_allData.size() > 1 && m_allData.back().getTime() > getCeilometerTime(timeDate))
+				else if (m_allData.size() > 1 && m_allData.back().getTime() > time)
 				{
 					sci::assertThrow(false, sci::err(sci::SERR_USER, 0, sU("Time jumps backwards in this file, it cannot be processed.")));
 				}
 				CampbellHeader header;
-				header.readHeader(fin);
+				header.readHeader(position, end);
 				if (m_ceilometerOsVersion.length() == 0)
 					m_ceilometerOsVersion = sci::fromCodepage(header.getOs());
 				if (m_allData.size() == 1)
@@ -603,19 +622,19 @@ void CeilometerProcessor::readData(const sci::string &inputFilename, ProgressRep
 					if (m_allData.size() == 0)
 						progressReporter << sU("Found CS 002 messages: ");
 					if (m_allData.size() % displayInterval == 0)
-						firstBatchDate = timeDate;
+						firstBatchDate = sci::fromUtf8(std::string(timeDate));
 					if (m_allData.size() % displayInterval == displayInterval - 1)
-						progressReporter << firstBatchDate << sU("-") << timeDate << sU("(") << displayInterval << sU(" profiles) ");
+						progressReporter << firstBatchDate << sU("-") << sci::fromUtf8(std::string(timeDate)) << sU("(") << displayInterval << sU(" profiles) ");
 					CampbellMessage2 profile;
-					profile.read(fin, header);
+					profile.read(position, end, header);
 					if (profile.getPassedChecksum())
-						m_allData.push_back(CampbellCeilometerProfile(getCeilometerTime(timeDate), profile));
+						m_allData.push_back(CampbellCeilometerProfile(time, profile));
 					else
-						progressReporter << sU("Found a message at time ") << timeDate << sU(" which does not pass the checksum and is hence corrupt. This profile will be ignored.\n");
+						progressReporter << sU("Found a message at time ") << sci::fromUtf8(std::string(timeDate)) << sU(" which does not pass the checksum and is hence corrupt. This profile will be ignored.\n");
 				}
 				else
 				{
-					progressReporter << sU("Found ") << header.getMessageNumber() << sU(" message ") << timeDate << sU(". Halting Read\n");
+					progressReporter << sU("Found ") << header.getMessageNumber() << sU(" message ") << sci::fromUtf8(std::string(timeDate)) << sU(". Halting Read\n");
 					break;
 				}
 			}
@@ -624,9 +643,8 @@ void CeilometerProcessor::readData(const sci::string &inputFilename, ProgressRep
 
 		}
 		if (m_allData.size() % displayInterval != displayInterval - 1)
-			progressReporter << firstBatchDate << sU("-") << timeDate << sU("(") << (m_allData.size() % displayInterval) + 1 << sU(" profiles)\n");
+			progressReporter << firstBatchDate << sU("-") << sci::fromUtf8(std::string(timeDate)) << sU("(") << (m_allData.size() % displayInterval) + 1 << sU(" profiles)\n");
 		progressReporter << sU("Completed reading file. ") << m_allData.size() << sU(" profiles found\n");
-		fin.close();
 
 		if (m_allData.size() > 0)
 		{
@@ -744,4 +762,10 @@ std::vector<std::vector<sci::string>> CeilometerProcessor::groupInputFilesbyOutp
 bool CeilometerProcessor::fileCoversTimePeriod(sci::string fileName, sci::UtcTime startTime, sci::UtcTime endTime) const
 {
 	return InstrumentProcessor::fileCoversTimePeriod(fileName, startTime, endTime, 0, -1, -1, -1, second(86399));
+}
+
+bool CeilometerProcessor::getFileTimePeriod(const sci::string &fileName, sci::UtcTime &fileStart, sci::UtcTime &fileEnd) const
+{
+	InstrumentProcessor::getFileTimePeriod(fileName, 0, -1, -1, -1, second(86399), fileStart, fileEnd);
+	return true;
 }
\ No newline at end of file
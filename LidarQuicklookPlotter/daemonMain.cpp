@@ -0,0 +1,182 @@
+//Entry point for the headless version of the suite, which does the same processing as the GUI
+//but with no windows or event loop, so it can be run on a server, e.g. as a systemd service.
+//Usage: AmfBlSuiteDaemon settingsFile [--once] [--start yyyy-mm-ddThh:mm:ss] [--end yyyy-mm-ddThh:mm:ss]
+#include<wx/init.h>
+#include<svector/sstring.h>
+#include<svector/serr.h>
+#include<svector/time.h>
+#include"ProgressReporter.h"
+#include"ProcessingRunner.h"
+#include<iostream>
+#include<fstream>
+#include<atomic>
+#include<csignal>
+#include<cstdio>
+#include<thread>
+#include<chrono>
+
+//set by SIGINT or SIGTERM, processing stops at the next point it checks the progress reporter
+std::atomic<bool> g_stopRequested(false);
+
+extern "C" void requestStop(int signal)
+{
+	g_stopRequested = true;
+}
+
+//Reports to the console and, while processing, to the log file from the processing options
+class ConsoleProgressReporter : public StreamProgressReporter<sci::Oteestream<std::ostream, std::ostream>>
+{
+public:
+	ConsoleProgressReporter()
+		:StreamProgressReporter<sci::Oteestream<std::ostream, std::ostream>>(&m_stream), m_stream(&std::cout, nullptr)
+	{
+	}
+	void setLogStream(std::ostream *stream)
+	{
+		m_stream.setStream2(stream);
+	}
+	//flush at the end of each line so the output appears promptly when redirected to a file or journal
+	void reportProgress(const sci::string &progress) override
+	{
+		StreamProgressReporter<sci::Oteestream<std::ostream, std::ostream>>::reportProgress(progress);
+		if (progress.length() > 0 && progress.back() == sU('\n'))
+			std::cout.flush();
+	}
+	bool shouldStop() override { return g_stopRequested; }
+private:
+	void setNormalModeFormat() override {}
+	void setWarningModeFormat() override { reportProgress(sU("Warning: ")); }
+	void setErrorModeFormat() override { reportProgress(sU("Error: ")); }
+	sci::Oteestream<std::ostream, std::ostream> m_stream;
+};
+
+bool parseTime(const char *text, sci::UtcTime &time)
+{
+	int year;
+	unsigned int month;
+	unsigned int day;
+	unsigned int hour = 0;
+	unsigned int minute = 0;
+	double second = 0.0;
+	int nRead = std::sscanf(text, "%d-%u-%uT%u:%u:%lf", &year, &month, &day, &hour, &minute, &second);
+	if (nRead != 3 && nRead != 6)
+		return false;
+	time = sci::UtcTime(year, month, day, hour, minute, second);
+	return true;
+}
+
+void printUsage()
+{
+	std::cerr << "Usage: AmfBlSuiteDaemon settingsFile [--once] [--start yyyy-mm-ddThh:mm:ss] [--end yyyy-mm-ddThh:mm:ss]\n"
+		"Processes the data described by the settings file. If the settings file says to check for new files then "
+		"this repeats, waiting between checks, until interrupted. Use --once to process the files found at start up "
+		"and exit. --start and --end override the time range in the settings file. Quicklooks are not plotted.\n";
+}
+
+int main(int argc, char *argv[])
+{
+	wxInitializer initializer(argc, argv);
+	if (!initializer.IsOk())
+	{
+		std::cerr << "Failed to initialise wxWidgets.\n";
+		return 1;
+	}
+
+	if (argc < 2)
+	{
+		printUsage();
+		return 1;
+	}
+	sci::string settingsFile = sci::fromCodepage(std::string(argv[1]));
+	bool once = false;
+	bool overrideStart = false;
+	bool overrideEnd = false;
+	sci::UtcTime startTime;
+	sci::UtcTime endTime;
+	for (int i = 2; i < argc; ++i)
+	{
+		std::string argument(argv[i]);
+		if (argument == "--once")
+			once = true;
+		else if (argument == "--start" && i + 1 < argc && parseTime(argv[i + 1], startTime))
+		{
+			overrideStart = true;
+			++i;
+		}
+		else if (argument == "--end" && i + 1 < argc && parseTime(argv[i + 1], endTime))
+		{
+			overrideEnd = true;
+			++i;
+		}
+		else
+		{
+			std::cerr << "Unrecognised or incomplete argument " << argument << "\n";
+			printUsage();
+			return 1;
+		}
+	}
+
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+
+	ConsoleProgressReporter progressReporter;
+	ProcessingRunner runner(&progressReporter, nullptr, settingsFile);
+	if (!runner.readSetupFile())
+		return 1;
+
+	ProcessingOptions &processingOptions = runner.getProcessingOptions();
+	if (overrideStart)
+		processingOptions.startTime = startTime;
+	if (overrideEnd)
+		processingOptions.endTime = endTime;
+	if (processingOptions.generateQuicklooks)
+	{
+		WarningSetter setter(&progressReporter);
+		progressReporter << sU("Quicklooks cannot be plotted without a window to plot in, only netCDFs will be generated.\n");
+		processingOptions.generateQuicklooks = false;
+	}
+
+	int result = 0;
+	while (!g_stopRequested)
+	{
+		try
+		{
+			std::fstream logOut;
+			if (runner.openLogFile(logOut))
+				progressReporter.setLogStream(&logOut);
+			runner.process([]() {});
+			progressReporter.setLogStream(nullptr);
+		}
+		catch (sci::err err)
+		{
+			progressReporter.setLogStream(nullptr);
+			ErrorSetter setter(&progressReporter);
+			progressReporter << err.getErrorCategory() << ":" << err.getErrorCode() << " " << err.getErrorMessage() << "\n";
+			result = 1;
+		}
+		catch (std::exception err)
+		{
+			progressReporter.setLogStream(nullptr);
+			ErrorSetter setter(&progressReporter);
+			progressReporter << err.what() << "\n";
+			result = 1;
+		}
+
+		if (g_stopRequested)
+			break;
+		if (once || !processingOptions.checkForNewFiles)
+		{
+			progressReporter << sU("Processed all files found. Processing complete.\n\n");
+			break;
+		}
+		progressReporter << sU("Processed all files found. New data will be checked for every ") << processingOptions.waitTime << sU(".\n\n");
+
+		//wait in short steps so a stop request is acted on promptly
+		auto nextCheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(int64_t(processingOptions.waitTime.value<sci::Second<1, -3>>()));
+		while (!g_stopRequested && std::chrono::steady_clock::now() < nextCheck)
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (g_stopRequested)
+		progressReporter << sU("Stopped\n\n");
+	return result;
+}
@@ -8,13 +8,8 @@
 #include<svector/sstring.h>
 #include"TextCtrlProgressReporter.h"
 #include<memory>
-#include"AmfNc.h"
 
-//predeclaration of the class that records status of files when looking for new ones.
-//we need to predeclare it because we have a reference to it in the method declarations
-//below.
-class FolderChangesLister;
-class InstrumentProcessor;
+class ProcessingRunner;
 
 class mainFrame : public wxFrame
 {
@@ -46,26 +41,12 @@ private:
 	//std::unique_ptr<StreamProgressReporter<wxTextCtrl>> m_progressReporter;
 	std::unique_ptr<TextCtrlProgressReporter<std::ostream>> m_progressReporter;
 
-	bool m_isSetup;
-	sci::string m_setupFileName;
-	PersonInfo m_author;
-	ProcessingSoftwareInfo m_processingSoftwareInfo;
-	ProjectInfo m_projectInfo;
-	std::shared_ptr<Platform> m_platform;
-	std::vector<std::shared_ptr<InstrumentProcessor>> m_instrumentProcessors;
-	ProcessingOptions m_processingOptions;
+	std::unique_ptr<ProcessingRunner> m_runner;
 	//int m_processingLevel;
 
-	void setSetupFile(sci::string setupFileName);
-	void readSetupFile();
 	void start();
 	void stop();
 	void process();
-	void process(InstrumentProcessor &processor);
-	void readDataThenPlotThenNc(const FolderChangesLister &plotChangesLister, const FolderChangesLister &ncChangesLister,
-		const PersonInfo &author, const ProcessingSoftwareInfo &processingSoftwareInfo, const ProjectInfo &projectInfo,
-		const Platform &platform, const ProcessingOptions &processingOptions, InstrumentProcessor &processor);
-	void checkDirectoryStructue();
 
 	DECLARE_EVENT_TABLE();
 };
@@ -105,7 +105,7 @@ void WindProfileProcessor::writeToNc(const sci::string& directory, const PersonI
 		AmfNcAltitudeVariable altitudeVariable(file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, altitudes, FeatureType::timeSeriesProfile);
 		AmfNcVariable<metrePerSecondF> windSpeedVariable(sU("wind_speed"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, sU("Mean Wind Speed"), sU("wind_speed"), windSpeeds, true, coordinates, cellMethods, windFlags);
 		AmfNcVariable<degreeF> windDirectionVariable(sU("wind_from_direction"), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension }, sU("Wind From Direction"), sU("wind_from_direction"), windDirections, true, coordinates, cellMethods, windFlags);
-		AmfNcFlagVariable windFlagVariable(sU("qc_flag"), lidarDopplerFlags, file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension });
+		AmfNcFlagVariable windFlagVariable(sU("qc_flag"), getLidarDopplerFlags(processingOptions), file, std::vector<sci::NcDimension*>{ &file.getTimeDimension(), & indexDimension });
 
 		file.writeTimeAndLocationData(platform);
 